@@ -1112,8 +1112,8 @@ SpatialInertia_ shift(const Vec3P& S) const
 /// operation in the manner of assignment operators. Cost is 37 flops.
 /// @see shift() if you want to leave this object unmolested.
 SpatialInertia_& shiftInPlace(const Vec3P& S) {
-    G.shiftToCentroidInPlace(p);    // change to central inertia
-    G.shiftFromCentroidInPlace(S);  // now inertia is about S
+    G.shiftToCentroidInPlace(p);      // change to central inertia
+    G.shiftFromCentroidInPlace(S-p);  // now inertia is about OF+S
     p -= S; // was p=com-OF, now want p'=com-(OF+S)=p-S
     return *this;
 }
@@ -1322,6 +1322,13 @@ SymMat33P J;
 Mat33P    F;
 };
 
+// The double precision shifts are specialized to use SIMD kernels; see
+// SpatialKernels.h.
+template <> SimTK_SimTKCOMMON_EXPORT ArticulatedInertia_<double>
+ArticulatedInertia_<double>::shift(const Vec3P& s) const;
+template <> SimTK_SimTKCOMMON_EXPORT ArticulatedInertia_<double>&
+ArticulatedInertia_<double>::shiftInPlace(const Vec3P& s);
+
 /// Add two compatible articulated inertias. Cost is 21 flops.
 /// @relates ArticulatedInertia_
 template <class P> inline ArticulatedInertia_<P>
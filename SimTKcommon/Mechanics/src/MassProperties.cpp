@@ -27,6 +27,7 @@
 
 #include "SimTKcommon/internal/common.h"
 #include "SimTKcommon/internal/MassProperties.h"
+#include "SpatialKernels.h"
 
 #include <iostream>
 
@@ -135,6 +136,21 @@ ArticulatedInertia_<P>::shiftInPlace(const Vec3P& s) {
     return *this;
 }
 
+// In double precision we use the SIMD kernel, which does the same 
+// calculation as above; see SpatialKernels.h.
+template <> ArticulatedInertia_<double>
+ArticulatedInertia_<double>::shift(const Vec3P& s) const {
+    ArticulatedInertia_ shifted(*this);
+    Impl::shiftArticulatedInertia(s, shifted.M, shifted.F, shifted.J);
+    return shifted;
+}
+
+template <> ArticulatedInertia_<double>&
+ArticulatedInertia_<double>::shiftInPlace(const Vec3P& s) {
+    Impl::shiftArticulatedInertia(s, M, F, J);
+    return *this;
+}
+
 // Instantiate so we catch bugs now.
 template class ArticulatedInertia_<float>;
 template class ArticulatedInertia_<double>;
@@ -0,0 +1,211 @@
+#ifndef SimTK_SIMMATRIX_SPATIAL_KERNELS_H_
+#define SimTK_SIMMATRIX_SPATIAL_KERNELS_H_
+
+/* -------------------------------------------------------------------------- *
+ *                       Simbody(tm): SimTKcommon                             *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+/** @file
+Low-level kernels for the spatial algebra operations that dominate the cost of
+Simbody's O(n) recursive algorithms: the articulated body inertia shift
+P' = Phi P ~Phi and the cross products that produce gyroscopic forces and
+coriolis accelerations. This header is private to SimTKcommon and Simbody and
+is not installed; use the ordinary spatial algebra operators in your own code.
+
+The kernels use SSE2 or AVX instructions if the compiler is permitted to
+generate them (see the BUILD_INST_SET CMake variable). The implementation is
+selected at compile time with the SimTK_SPATIAL_KERNELS macro (CMake variable
+BUILD_SPATIAL_KERNELS):
+ - 0 (SCALAR): plain C++ only.
+ - 1 (STRICT, the default): SIMD instructions are used but every result is
+   computed with the same operations in the same order as the scalar code, so
+   results are bitwise identical to the scalar code. That assumes the compiler
+   does not contract multiplies and adds into fused multiply-adds on its own;
+   the CMake build sees to that for the files that include this header.
+ - 2 (FAST): like STRICT but fused multiply-add instructions are used where
+   available, which can change results in the last bit.
+
+Only double precision is vectorized; float uses the scalar code. **/
+
+#include "SimTKcommon/SmallMatrix.h"
+
+#ifndef SimTK_SPATIAL_KERNELS
+    #define SimTK_SPATIAL_KERNELS 1
+#endif
+
+#if SimTK_SPATIAL_KERNELS != 0 && (defined(__SSE2__) || defined(_M_X64) \
+                                   || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #define SimTK_SPATIAL_KERNELS_SSE2
+    #include <emmintrin.h>
+    #if defined(__AVX__)
+        #define SimTK_SPATIAL_KERNELS_AVX
+        #include <immintrin.h>
+    #endif
+    #if SimTK_SPATIAL_KERNELS == 2 && defined(__FMA__)
+        #define SimTK_SPATIAL_KERNELS_FMA
+        #include <immintrin.h>
+    #endif
+#endif
+
+namespace SimTK {
+namespace Impl {
+
+#ifdef SimTK_SPATIAL_KERNELS_SSE2
+// a*b - c*d in each lane.
+inline __m128d mulSub(__m128d a, __m128d b, __m128d c, __m128d d) {
+    #ifdef SimTK_SPATIAL_KERNELS_FMA
+    return _mm_fmsub_pd(a, b, _mm_mul_pd(c,d));
+    #else
+    return _mm_sub_pd(_mm_mul_pd(a,b), _mm_mul_pd(c,d));
+    #endif
+}
+#endif
+
+#ifdef SimTK_SPATIAL_KERNELS_AVX
+inline __m256d mulSub(__m256d a, __m256d b, __m256d c, __m256d d) {
+    #ifdef SimTK_SPATIAL_KERNELS_FMA
+    return _mm256_fmsub_pd(a, b, _mm256_mul_pd(c,d));
+    #else
+    return _mm256_sub_pd(_mm256_mul_pd(a,b), _mm256_mul_pd(c,d));
+    #endif
+}
+#endif
+
+/** out[i] = e[i] + (a[i]*b[i] - c[i]*d[i]) for i=0..n-1. If e is null it is
+treated as zero (but no addition is done). **/
+inline void addMulSub(int n, const double* e,
+                      const double* a, const double* b,
+                      const double* c, const double* d, double* out)
+{
+    int i = 0;
+#ifdef SimTK_SPATIAL_KERNELS_AVX
+    for (; i+4 <= n; i += 4) {
+        __m256d t = mulSub(_mm256_loadu_pd(a+i), _mm256_loadu_pd(b+i),
+                           _mm256_loadu_pd(c+i), _mm256_loadu_pd(d+i));
+        if (e) t = _mm256_add_pd(_mm256_loadu_pd(e+i), t);
+        _mm256_storeu_pd(out+i, t);
+    }
+#endif
+#ifdef SimTK_SPATIAL_KERNELS_SSE2
+    for (; i+2 <= n; i += 2) {
+        __m128d t = mulSub(_mm_loadu_pd(a+i), _mm_loadu_pd(b+i),
+                           _mm_loadu_pd(c+i), _mm_loadu_pd(d+i));
+        if (e) t = _mm_add_pd(_mm_loadu_pd(e+i), t);
+        _mm_storeu_pd(out+i, t);
+    }
+#endif
+    for (; i < n; ++i)
+        out[i] = e ? e[i] + (a[i]*b[i] - c[i]*d[i]) : a[i]*b[i] - c[i]*d[i];
+}
+
+/** Calculate two independent cross products a%b and c%d at once, with the
+first in the low lane and the second in the high lane. The results are the
+same as cross() produces. 18 flops. **/
+inline void cross2(const Vec<3,double>& a, const Vec<3,double>& b,
+                   const Vec<3,double>& c, const Vec<3,double>& d,
+                   Vec<3,double>& axb, Vec<3,double>& cxd)
+{
+#ifdef SimTK_SPATIAL_KERNELS_SSE2
+    const __m128d p0 = _mm_set_pd(c[0],a[0]), q0 = _mm_set_pd(d[0],b[0]);
+    const __m128d p1 = _mm_set_pd(c[1],a[1]), q1 = _mm_set_pd(d[1],b[1]);
+    const __m128d p2 = _mm_set_pd(c[2],a[2]), q2 = _mm_set_pd(d[2],b[2]);
+    const __m128d x = mulSub(p1,q2, p2,q1);
+    const __m128d y = mulSub(p2,q0, p0,q2);
+    const __m128d z = mulSub(p0,q1, p1,q0);
+    _mm_storel_pd(&axb[0], x); _mm_storeh_pd(&cxd[0], x);
+    _mm_storel_pd(&axb[1], y); _mm_storeh_pd(&cxd[1], y);
+    _mm_storel_pd(&axb[2], z); _mm_storeh_pd(&cxd[2], z);
+#else
+    axb = a % b;
+    cxd = c % d;
+#endif
+}
+
+/** Float version of cross2() is just scalar code. **/
+inline void cross2(const Vec<3,float>& a, const Vec<3,float>& b,
+                   const Vec<3,float>& c, const Vec<3,float>& d,
+                   Vec<3,float>& axb, Vec<3,float>& cxd)
+{   axb = a % b; cxd = c % d; }
+
+/** Rigid-shift an articulated body inertia with blocks M (mass), F (first
+mass moment) and J (inertia) by the vector s, in place. This is the
+congruence P' = Phi P ~Phi with Phi=[1 sx; 0 1], computed as
+<pre>
+    F' = F + sx*M
+    J' = J + (sx*~F - F'*sx)
+</pre>
+The parenthesized quantity is symmetric so we only compute its lower
+triangle. Results are the same as the scalar code in ArticulatedInertia_<P>;
+see MassProperties.cpp. M does not change. 72 flops. **/
+inline void shiftArticulatedInertia(const Vec<3,double>&    s,
+                                    const SymMat<3,double>& M,
+                                    Mat<3,3,double>&        F,
+                                    SymMat<3,double>&       J)
+{
+    const double x=s[0], y=s[1], z=s[2];
+    const double a=M(0,0);
+    const double b=M(1,0), d=M(1,1);
+    const double c=M(2,0), e=M(2,1), f=M(2,2);
+
+    // F' = F + s % M, stored by columns.
+    const double pF[9] = {y,z,x, y,z,x, y,z,x};
+    const double qF[9] = {c,a,b, e,b,d, f,c,e};
+    const double rF[9] = {z,x,y, z,x,y, z,x,y};
+    const double tF[9] = {b,c,a, d,e,b, e,f,c};
+    Mat<3,3,double> Fp;
+    addMulSub(9, &F(0,0), pF,qF, rF,tF, &Fp(0,0));
+
+    // Lower triangle of sx*~F - F'*sx. Using G=~F and F' as in halfCrossDiff()
+    // in MassProperties.cpp, the elements are (in the order we calculate them)
+    //  (0,0) = y*(G20+F'02) - z*(G10+F'01)
+    //  (1,1) = z*(G01+F'10) - x*(G21+F'12)
+    //  (2,2) = x*(G12+F'21) - y*(G02+F'20)
+    //  (1,0) = z*(G00-F'11) - x*G20 + y*F'12
+    //  (2,1) = x*(G11-F'22) - y*G01 + z*F'20
+    //  (2,0) = x*G10 - z*F'21 - y*(G00-F'22)
+    // where Gij=F(j,i). The sums and differences are done first as in the
+    // scalar code, then the first two products in all six lanes, then the
+    // remaining product in the last three.
+    const double p[6] = {y, z, x, z, x, x};
+    const double q[6] = {F(0,2)+Fp(0,2), F(1,0)+Fp(1,0),
+                         F(2,1)+Fp(2,1), F(0,0)-Fp(1,1),
+                         F(1,1)-Fp(2,2), F(0,1)};
+    const double r[6] = {z, x, y, x, y, z};
+    const double t[6] = {F(0,1)+Fp(0,1), F(1,2)+Fp(1,2),
+                         F(2,0)+Fp(2,0), F(0,2),
+                         F(1,0), Fp(2,1)};
+    double h[6];
+    addMulSub(6, 0, p,q, r,t, h);
+    h[3] += y*Fp(1,2);
+    h[4] += z*Fp(2,0);
+    h[5] -= y*(F(0,0)-Fp(2,2));
+
+    J += SymMat<3,double>(h[0],
+                          h[3], h[1],
+                          h[5], h[4], h[2]);
+    F = Fp;
+}
+
+} // namespace Impl
+} // namespace SimTK
+
+#endif // SimTK_SIMMATRIX_SPATIAL_KERNELS_H_
@@ -0,0 +1,176 @@
+#ifndef SimTK_SimTKCOMMON_REALIZE_PROFILER_H_
+#define SimTK_SimTKCOMMON_REALIZE_PROFILER_H_
+
+/* -------------------------------------------------------------------------- *
+ *                       Simbody(tm): SimTKcommon                             *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+#include "SimTKcommon/basics.h"
+#include "SimTKcommon/internal/State.h"
+
+#include <ostream>
+
+namespace SimTK {
+
+/** This class accumulates the time spent realizing a System, broken down by
+Subsystem and Stage, and optionally by the elements (such as force elements
+or constraints) that a Subsystem realizes. Every System has one; get it with
+System::getRealizeProfiler(). It is disabled initially, and then costs only a
+test of a flag per Subsystem realization. Enable it with
+System::setRealizeProfilingEnabled().
+
+For each (Subsystem, Stage) pair, and for the System as a whole at each Stage
+from Model on, the profiler counts the calls made and accumulates elapsed wall clock time and
+the CPU time used by the calling thread. Times are inclusive, so the System
+times include the Subsystem times, and a Subsystem's times include those of
+its elements. Results can be queried here or written out in JSON format
+(writeJSON()). If you set a nonzero trace capacity, the most recent calls are
+also kept individually and can be written in Chrome's trace event format
+(writeChromeTrace()) for viewing with chrome://tracing or similar tools.
+
+Recording is thread safe so States may be realized concurrently. Like the
+System's other statistics, the profiler is mutable and never affects results.
+
+Subsystems record their elements using a RealizeProfiler::Scope object,
+which measures the time between its construction and destruction and does
+nothing if profiling is disabled:
+@code
+    for (int i=0; i < (int)forces.size(); ++i) {
+        RealizeProfiler::Scope scope(profiler, getMySubsystemIndex(),
+                                     Stage::Dynamics, "Force", i);
+        forces[i]->calcForce(...);
+    }
+@endcode **/
+class SimTK_SimTKCOMMON_EXPORT RealizeProfiler {
+public:
+    /** The accumulated results for one (Subsystem, Stage) pair or one
+    element. Times are in seconds. **/
+    struct Timing {
+        Timing() : numCalls(0), wallTime(0), cpuTime(0) {}
+        long long   numCalls;
+        double      wallTime;
+        double      cpuTime;
+    };
+
+    /** Create a disabled profiler with no results. **/
+    RealizeProfiler();
+    ~RealizeProfiler();
+
+    /** Start or stop recording. Results recorded so far are kept. **/
+    void setEnabled(bool enabled);
+    /** Return true if calls are currently being recorded. **/
+    bool isEnabled() const {return m_enabled;}
+
+    /** Discard all results, including the trace, but not the setting of
+    the enabled flag or the trace capacity. **/
+    void clear();
+
+    /** Keep the \a n most recent calls for writeChromeTrace(). The default is
+    zero so that no individual calls are kept. Changing the capacity discards
+    the current trace. **/
+    void setTraceCapacity(int n);
+    /** Return the number of calls that can be kept in the trace. **/
+    int getTraceCapacity() const;
+
+    /** Return the total results for all Subsystems at Stage \a g. **/
+    Timing getSystemTiming(Stage g) const;
+    /** Return the results for Subsystem \a subsys at Stage \a g; these are
+    all zero if nothing has been recorded for it. **/
+    Timing getSubsystemTiming(SubsystemIndex subsys, Stage g) const;
+
+    /** Return the number of distinct (Subsystem, Stage, kind, index) elements
+    for which results have been recorded. **/
+    int getNumElements() const;
+    /** Return the Subsystem of the \a i'th recorded element. **/
+    SubsystemIndex getElementSubsystem(int i) const;
+    /** Return the Stage at which the \a i'th recorded element was realized. **/
+    Stage getElementStage(int i) const;
+    /** Return the kind of the \a i'th recorded element, such as "Force". **/
+    const char* getElementKind(int i) const;
+    /** Return the index of the \a i'th recorded element among those of its
+    kind in its Subsystem. **/
+    int getElementIndex(int i) const;
+    /** Return the results for the \a i'th recorded element. **/
+    Timing getElementTiming(int i) const;
+    /** Return the position of the given element in the recorded elements,
+    or -1 if nothing has been recorded for it. **/
+    int findElement(SubsystemIndex subsys, Stage g, const char* kind,
+                    int index) const;
+
+    /** Write all the results as a JSON object. **/
+    void writeJSON(std::ostream& out) const;
+    /** Write the trace of recent calls as a JSON array in Chrome's trace
+    event format. Timestamps are in microseconds. **/
+    void writeChromeTrace(std::ostream& out) const;
+
+    /** This object times the code executed between its construction and
+    destruction, and records it in a profiler if that profiler is enabled.
+    The Subsystem's name is taken from \a name the first time the Subsystem
+    is seen. **/
+    class SimTK_SimTKCOMMON_EXPORT Scope {
+    public:
+        /** Time the realization of the whole System at Stage \a g. **/
+        Scope(const RealizeProfiler& profiler, Stage g)
+        :   m_profiler(profiler.isEnabled() ? &profiler : 0)
+        {   if (m_profiler) begin(SubsystemIndex(), g, "", -1); }
+        /** Time the realization of a Subsystem at Stage \a g. **/
+        Scope(const RealizeProfiler& profiler, SubsystemIndex subsys, Stage g,
+              const char* name)
+        :   m_profiler(profiler.isEnabled() ? &profiler : 0)
+        {   if (m_profiler) begin(subsys, g, name, -1); }
+        /** Time an element of kind \a kind (a string literal), numbered
+        \a index within its Subsystem, being realized at Stage \a g. **/
+        Scope(const RealizeProfiler& profiler, SubsystemIndex subsys, Stage g,
+              const char* kind, int index)
+        :   m_profiler(profiler.isEnabled() ? &profiler : 0)
+        {   if (m_profiler) begin(subsys, g, kind, index); }
+
+        ~Scope() {if (m_profiler) end();}
+    private:
+        Scope(const Scope&);            // suppress
+        Scope& operator=(const Scope&); //    "
+        void begin(SubsystemIndex subsys, Stage g, const char* nameOrKind,
+                   int index);
+        void end();
+
+        const RealizeProfiler*  m_profiler;
+        SubsystemIndex          m_subsys;
+        Stage                   m_stage;
+        const char*             m_nameOrKind;
+        int                     m_index;
+        long long               m_startWallNs;
+        double                  m_startCpu;
+    };
+
+private:
+    friend class Scope;
+    class Impl;
+    RealizeProfiler(const RealizeProfiler&);            // suppress
+    RealizeProfiler& operator=(const RealizeProfiler&); //    "
+
+    bool    m_enabled;
+    Impl*   m_impl;     // allocated when first needed
+};
+
+} // namespace SimTK
+
+#endif // SimTK_SimTKCOMMON_REALIZE_PROFILER_H_
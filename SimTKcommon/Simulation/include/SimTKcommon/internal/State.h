@@ -37,6 +37,7 @@ done in a separate internal class. **/
 #include <ostream>
 #include <cassert>
 #include <algorithm>
+#include <atomic>
 
 namespace SimTK {
 
@@ -284,6 +285,8 @@ State();
 /// source %State, copying only state variables and not the cache. If the source
 /// state hasn't been realized to at least Stage::Model, then we don't copy its
 /// state variables either, except those associated with the Topology stage.
+/// If the source is in copy-on-write mode, nothing is copied yet; see
+/// setUseCopyOnWrite().
 State(const State&);
 
 /// Copy assignment has deep copy semantics; that is, \c this %State will 
@@ -292,6 +295,8 @@ State(const State&);
 /// copying only state variables and not the cache. If the source state hasn't
 /// been realized to at least Stage::Model, then we don't copy its state
 /// variables either, except those associated with the Topology stage.
+/// If the source is in copy-on-write mode, nothing is copied yet; see
+/// setUseCopyOnWrite().
 State& operator=(const State&);
 
 /// Destruct this %State object and free up the heap space it is using.
@@ -300,6 +305,28 @@ State& operator=(const State&);
 /// Restore State to default-constructed condition.
 void clear();
 
+/// Turn copy-on-write mode on or off for this %State; it is off by default.
+/// When it is on, copying this %State (by copy construction or assignment)
+/// doesn't copy anything. Instead the copy shares this %State's contents,
+/// including the cache, until one of them is written to. The first write
+/// through either one, including realizing it, gives that one a complete
+/// private copy. That makes a snapshot that is used only to roll back to
+/// nearly free, and a rollback is then just an assignment. Copies made from a
+/// %State in this mode are in this mode too.
+///
+/// A copy made this way is realized exactly as far as its source was, unlike
+/// an ordinary copy which keeps only the state variables and Instance-stage
+/// cache. Be careful with references into a %State (for example from updQ()
+/// or updCacheEntry()) that you obtained before copying it: they refer to the
+/// shared contents, so writing through them afterwards changes both copies.
+/// Obtain them again after copying. Turning this mode off gives this %State
+/// a private copy of its contents if it is sharing them.
+void setUseCopyOnWrite(bool useCopyOnWrite);
+
+/// Return true if this %State is in copy-on-write mode; see
+/// setUseCopyOnWrite().
+bool getUseCopyOnWrite() const {return useCopyOnWrite;}
+
 /// Set the number of subsystems in this state. This is done during
 /// initialization of the State by a System; it completely wipes out
 /// anything that used to be in the State so use cautiously!
@@ -537,6 +564,10 @@ inline Stage
 getDiscreteVarInvalidatesStage(SubsystemIndex, DiscreteVariableIndex) const;
 
 
+/** Return the number of discrete variables that have been allocated for
+this subsystem; their indices are 0 through one less than this. **/
+inline int getNumDiscreteVariables(SubsystemIndex) const;
+
 /** Get the current value of the indicated discrete variable. This requires
 only that the variable has already been allocated and will fail otherwise. **/
 inline const AbstractValue& 
@@ -1094,9 +1125,16 @@ inline String cacheToString() const;
 // The implementation class and associated inline methods are defined in a
 // separate header file included below.
                                 private:
-class StateImpl* impl;
+// In copy-on-write mode the StateImpl may be shared with other States.
+mutable class StateImpl* impl;
+bool                     useCopyOnWrite;
 const StateImpl& getImpl() const {assert(impl); return *impl;}
-StateImpl&       updImpl()       {assert(impl); return *impl;}
+
+// These replace a shared StateImpl with a private copy before returning it.
+// The second is for const methods that write to the cache.
+inline StateImpl&       updImpl();
+inline const StateImpl& getImplForWriting() const;
+void makeImplPrivate() const;
 };
 
 // Dump state and cache to a stream for debugging; this is not serialization.
@@ -0,0 +1,210 @@
+#ifndef SimTK_SimTKCOMMON_STATE_CHECKPOINT_H_
+#define SimTK_SimTKCOMMON_STATE_CHECKPOINT_H_
+
+/* -------------------------------------------------------------------------- *
+ *                       Simbody(tm): SimTKcommon                             *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+#include "SimTKcommon/basics.h"
+#include "SimTKcommon/Simmatrix.h"
+#include "SimTKcommon/internal/State.h"
+#include "SimTKcommon/internal/System.h"
+
+#include <typeinfo>
+#include <cstring>
+#include <ostream>
+
+namespace SimTK {
+
+/** This class saves a State to a compact binary file (a "checkpoint") and
+restores States from it. Use it to restart a long simulation, or to start
+many runs from the same initial conditions without recalculating them.
+
+A checkpoint contains time, the continuous state variables q, u, and z, and
+the values of discrete variables whose types have registered serializers (see
+below), all organized by subsystem. It also records the stage to which the
+State had been realized. The cache is not saved; instead, restoring realizes
+the State back to the recorded stage. Discrete variables of types without a
+serializer are skipped if they affect only Position stage or later; when
+restoring they keep whatever values they have in the target State. Skipping
+one that affects Instance stage or earlier would change the model, so
+writing such a State throws an exception instead. Simbody registers the
+types of its own model and instance variables (such as which constraints are
+disabled, which mobilizers are locked, and whether Euler angles are used).
+
+To restore, construct a %StateCheckpoint from the file. The file is mapped
+into memory rather than read, and can then be used to restore any number of
+States cheaply:
+@code
+    StateCheckpoint::writeFile(state, "initial.chk");
+    // ... later, perhaps in another process ...
+    StateCheckpoint checkpoint("initial.chk");
+    State s = system.getDefaultState();
+    checkpoint.restore(system, s);
+@endcode
+The target State must be for the same System, that is, it must have the same
+subsystems and the same numbers of state variables (after realizing Model
+stage with the restored discrete variables). Errors are reported by throwing
+an exception. The file format is binary and intended for use on the same kind
+of machine with the same build of SimTK; it records the byte order and the
+size of Real and won't load if those differ. **/
+class SimTK_SimTKCOMMON_EXPORT StateCheckpoint {
+public:
+    /** Write a checkpoint of \a state, which must have been realized through
+    at least Model stage, to the given stream. The stream should have been
+    opened in binary mode. An exception is thrown if a discrete variable that
+    affects Instance stage or earlier has a type with no registered
+    serializer. **/
+    static void write(const State& state, std::ostream& out);
+
+    /** Write a checkpoint of \a state to the named file, replacing the file
+    if it already exists. **/
+    static void writeFile(const State& state, const String& fileName);
+
+    /** Map a checkpoint file into memory so that it can be used to restore
+    States. An exception is thrown if the file can't be opened or isn't a
+    valid checkpoint. **/
+    explicit StateCheckpoint(const String& fileName);
+
+    /** Unmap the checkpoint file. **/
+    ~StateCheckpoint();
+
+    /** Make \a state match the checkpoint. \a state must belong to \a system
+    and have been realized through at least Topology stage; typically it is a
+    copy of the System's default State. Discrete variables that affect Model
+    stage are restored first and Model stage realized, which allocates any
+    variables that belong to that stage. Then the rest of the discrete
+    variables, time, and the continuous variables are restored and the State
+    is realized to the stage recorded in the checkpoint. **/
+    void restore(const System& system, State& state) const;
+
+    /** Return the time recorded in the checkpoint. **/
+    Real getTime() const;
+    /** Return the stage to which the checkpointed State had been realized. **/
+    Stage getStage() const;
+    /** Return the number of subsystems recorded in the checkpoint. **/
+    int getNumSubsystems() const;
+    /** Return the name of a subsystem recorded in the checkpoint. **/
+    const String& getSubsystemName(SubsystemIndex subsys) const;
+
+    /** (Advanced) Function that appends the contents of a discrete variable
+    value to a byte array. **/
+    typedef void (*WriteValueFunc)(const AbstractValue& value,
+                                   Array_<char>& out);
+    /** (Advanced) Function that sets a discrete variable value from \a nBytes
+    bytes written by the corresponding WriteValueFunc. It should return
+    false if the data can't be for this value. **/
+    typedef bool (*ReadValueFunc)(const char* data, size_t nBytes,
+                                  AbstractValue& value);
+
+    /** Register functions for saving and restoring discrete variables whose
+    values have the given type (a Value<T> for some T). The type name is
+    recorded in the file and must match when restoring. Registering a type
+    again replaces the previous registration. Registration is not
+    thread-safe; do it before using checkpoints.
+
+    These types are registered already: bool, int, Real, Vec2, Vec3, Vec4,
+    Vec6, SpatialVec, Vector, Vector_<Vec3>, Vector_<SpatialVec>, Array_<bool>,
+    Array_<int>, and Array_<Real>. **/
+    static void registerValueType(const std::type_info& valueType,
+                                  const String&         typeName,
+                                  WriteValueFunc        writeFunc,
+                                  ReadValueFunc         readFunc);
+
+    /** Register a type T that can be saved and restored by copying its
+    bytes, such as a Vec or a struct of scalars. **/
+    template <class T> static void
+    registerPlainType(const String& typeName) {
+        registerValueType(typeid(Value<T>), typeName,
+                          &PlainCodec<T>::write, &PlainCodec<T>::read);
+    }
+
+    /** Register Vector_<T> for a type T that can be copied by bytes. **/
+    template <class T> static void
+    registerVectorType(const String& typeName) {
+        registerValueType(typeid(Value< Vector_<T> >), typeName,
+                          &VectorCodec<T>::write, &VectorCodec<T>::read);
+    }
+
+    /** Register Array_<T> for a type T that can be copied by bytes. **/
+    template <class T> static void
+    registerArrayType(const String& typeName) {
+        registerValueType(typeid(Value< Array_<T> >), typeName,
+                          &ArrayCodec<T>::write, &ArrayCodec<T>::read);
+    }
+
+private:
+    class Impl;
+    StateCheckpoint(const StateCheckpoint&);            // suppress
+    StateCheckpoint& operator=(const StateCheckpoint&); //    "
+
+    static void append(const void* p, size_t n, Array_<char>& out) {
+        const char* c = static_cast<const char*>(p);
+        out.insert(out.end(), c, c+n);
+    }
+
+    template <class T> struct PlainCodec {
+        static void write(const AbstractValue& v, Array_<char>& out)
+        {   append(&Value<T>::downcast(v).get(), sizeof(T), out); }
+        static bool read(const char* data, size_t n, AbstractValue& v) {
+            if (n != sizeof(T)) return false;
+            std::memcpy(&Value<T>::updDowncast(v).upd(), data, n);
+            return true;
+        }
+    };
+
+    template <class T> struct VectorCodec {
+        static void write(const AbstractValue& v, Array_<char>& out) {
+            const Vector_<T>& x = Value< Vector_<T> >::downcast(v).get();
+            for (int i=0; i < x.size(); ++i)
+                append(&x[i], sizeof(T), out);
+        }
+        static bool read(const char* data, size_t n, AbstractValue& v) {
+            if (n % sizeof(T)) return false;
+            Vector_<T>& x = Value< Vector_<T> >::updDowncast(v).upd();
+            x.resize(int(n / sizeof(T)));
+            for (int i=0; i < x.size(); ++i)
+                std::memcpy(&x[i], data + i*sizeof(T), sizeof(T));
+            return true;
+        }
+    };
+
+    template <class T> struct ArrayCodec {
+        static void write(const AbstractValue& v, Array_<char>& out) {
+            const Array_<T>& x = Value< Array_<T> >::downcast(v).get();
+            if (!x.empty()) append(x.cbegin(), x.size()*sizeof(T), out);
+        }
+        static bool read(const char* data, size_t n, AbstractValue& v) {
+            if (n % sizeof(T)) return false;
+            Array_<T>& x = Value< Array_<T> >::updDowncast(v).upd();
+            x.resize(unsigned(n / sizeof(T)));
+            if (n) std::memcpy(x.begin(), data, n);
+            return true;
+        }
+    };
+
+    Impl* impl;
+};
+
+} // namespace SimTK
+
+#endif // SimTK_SimTKCOMMON_STATE_CHECKPOINT_H_
@@ -54,6 +54,79 @@ namespace SimTK {
 // means the actual value object will not be deleted by the destructor; be sure
 // to do that explicitly in the higher-level destructor or you'll have a nasty
 // leak.
+//
+// Values are normally allocated individually on the heap, but when a State is 
+// copied the values that have to be cloned are placed together in a single
+// block of memory owned by the subsystem (a ValueArena), so copying a State 
+// costs one heap allocation per subsystem rather than one per value. That is
+// why deepAssign() and deepDestruct() take the arena as an argument.
+
+//==============================================================================
+//                               VALUE ARENA
+//==============================================================================
+// This is a simple bump allocator for the AbstractValues of one subsystem.
+// Values are constructed in it with AbstractValue::cloneInPlace(), and are
+// never moved. The space for individual values is not reused; the whole 
+// arena becomes available again when the last value in it is destroyed. Any
+// value that doesn't fit, or can't be cloned in place, goes on the heap as
+// usual; destroy() figures out which is which from the address.
+class ValueArena {
+public:
+    ValueArena() : memory(0), begin(0), end(0), next(0), nLive(0) {}
+    ~ValueArena() {assert(nLive==0); ::operator delete(memory);}
+
+    // Make room for values needing a total of nBytes as reported by
+    // getSlotSize(). This is only allowed when the arena is empty.
+    void reserve(size_t nBytes) {
+        assert(nLive == 0);
+        next = begin;
+        if (nBytes <= size_t(end-begin)) 
+            return;
+        ::operator delete(memory);
+        memory = static_cast<char*>(::operator new(nBytes + Alignment-1));
+        begin = next = memory + ((Alignment - size_t(memory)%Alignment) 
+                                 % Alignment);
+        end = begin + nBytes;
+    }
+
+    static size_t getSlotSize(const AbstractValue& v) {
+        const size_t n = v.getCloneSize();
+        return (n + Alignment-1) / Alignment * Alignment;
+    }
+
+    AbstractValue* clone(const AbstractValue& src) {
+        const size_t n = getSlotSize(src);
+        if (n == 0 || n > size_t(end-next))
+            return src.clone();
+        AbstractValue* v = src.cloneInPlace(next);
+        next += n; ++nLive;
+        return v;
+    }
+
+    void destroy(AbstractValue* v) {
+        if (!contains(v)) {delete v; return;}
+        v->~AbstractValue();
+        if (--nLive == 0) next = begin;
+    }
+
+    bool contains(const AbstractValue* v) const {
+        const char* p = reinterpret_cast<const char*>(v);
+        return begin <= p && p < end;
+    }
+
+    bool empty() const {return nLive == 0;}
+private:
+    ValueArena(const ValueArena&);              // suppress
+    ValueArena& operator=(const ValueArena&);   //    "
+
+    static const size_t Alignment = 16;
+
+    char*   memory;         // as allocated
+    char*   begin;          // aligned start of usable space
+    char*   end;
+    char*   next;           // next free byte
+    int     nLive;          // number of values currently in the arena
+};
 
 //==============================================================================
 //                           DISCRETE VAR INFO
@@ -74,22 +147,31 @@ public:
     // Use this to make this entry contain a *copy* of the source value.
     // If the destination already has a value, the new value must be
     // assignment compatible.
-    DiscreteVarInfo& deepAssign(const DiscreteVarInfo& src) {
+    DiscreteVarInfo& deepAssign(const DiscreteVarInfo& src, ValueArena& arena){
         assert(src.isReasonable());
          
         allocationStage   = src.allocationStage;
         invalidatedStage  = src.invalidatedStage;
         autoUpdateEntry   = src.autoUpdateEntry;
         if (value) *value = *src.value;
-        else        value = src.value->clone();
+        else        value = arena.clone(*src.value);
         timeLastUpdated   = src.timeLastUpdated;
         return *this;
     }
 
     // For use in the containing class's destructor.
-    void deepDestruct() {delete value; value=0;}
+    void deepDestruct(ValueArena& arena) 
+    {   if (value) arena.destroy(value); value=0; }
     const Stage& getAllocationStage()  const {return allocationStage;}
 
+    // True if deepAssign() from src would change only the value, which 
+    // would be assigned in place.
+    bool isSameAllocationAs(const DiscreteVarInfo& src) const
+    {   return allocationStage  == src.allocationStage
+            && invalidatedStage == src.invalidatedStage
+            && autoUpdateEntry  == src.autoUpdateEntry
+            && value && value->isCompatible(*src.value); }
+
     // Exchange value pointers (should be from this dv's update cache entry).
     void swapValue(Real updTime, AbstractValue*& other) 
     {   std::swap(value, other); timeLastUpdated=updTime; }
@@ -155,7 +237,7 @@ public:
     // Default copy constructor, copy assignment, destructor are shallow.
 
     // Use this to make this entry contain a *copy* of the source value.
-    CacheEntryInfo& deepAssign(const CacheEntryInfo& src) {
+    CacheEntryInfo& deepAssign(const CacheEntryInfo& src, ValueArena& arena) {
         assert(src.isReasonable());
 
         allocationStage   = src.allocationStage;
@@ -163,15 +245,25 @@ public:
         computedByStage   = src.computedByStage;
         associatedVar     = src.associatedVar;
         if (value) *value = *src.value;
-        else        value = src.value->clone();
+        else        value = arena.clone(*src.value);
         versionWhenLastComputed = src.versionWhenLastComputed;
         return *this;
     }
 
     // For use in the containing class's destructor.
-    void deepDestruct() {delete value; value=0;}
+    void deepDestruct(ValueArena& arena) 
+    {   if (value) arena.destroy(value); value=0; }
     const Stage& getAllocationStage() const {return allocationStage;}
 
+    // True if deepAssign() from src would change only the value, which 
+    // would be assigned in place.
+    bool isSameAllocationAs(const CacheEntryInfo& src) const
+    {   return allocationStage == src.allocationStage
+            && dependsOnStage  == src.dependsOnStage
+            && computedByStage == src.computedByStage
+            && associatedVar   == src.associatedVar
+            && value && value->isCompatible(*src.value); }
+
     // Exchange values with a discrete variable (presumably this
     // cache entry has been determined to be that variable's update
     // entry but we're not checking here).
@@ -225,10 +317,13 @@ public:
     int getNumSlots() const {return nslots;}
 
     // These the the "virtual" methods required by template methods elsewhere.
-    TriggerInfo& deepAssign(const TriggerInfo& src) 
+    TriggerInfo& deepAssign(const TriggerInfo& src, ValueArena&) 
     {   return operator=(src); }
-    void         deepDestruct() {}
+    void         deepDestruct(ValueArena&) {}
     const Stage& getAllocationStage() const {return allocationStage;}
+    bool isSameAllocationAs(const TriggerInfo& src) const
+    {   return allocationStage == src.allocationStage
+            && firstIndex == src.firstIndex && nslots == src.nslots; }
 private:
     // These are fixed at construction.
     Stage                   allocationStage;
@@ -280,10 +375,14 @@ public:
     // there is no heap object owned here.
 
     // These the the "virtual" methods required by template methods elsewhere.
-    ContinuousVarInfo& deepAssign(const ContinuousVarInfo& src) 
+    ContinuousVarInfo& deepAssign(const ContinuousVarInfo& src, ValueArena&) 
     {   return operator=(src); }
-    void               deepDestruct() {}
+    void               deepDestruct(ValueArena&) {}
     const Stage&       getAllocationStage() const {return allocationStage;}
+    bool isSameAllocationAs(const ContinuousVarInfo& src) const
+    {   return allocationStage == src.allocationStage
+            && firstIndex == src.firstIndex 
+            && getNumVars() == src.getNumVars(); }
 private:
     // These are fixed at construction.
     Stage     allocationStage;
@@ -331,10 +430,14 @@ public:
     // there is no heap object owned here.
 
     // These the the "virtual" methods required by template methods elsewhere.
-    ConstraintErrInfo& deepAssign(const ConstraintErrInfo& src) 
+    ConstraintErrInfo& deepAssign(const ConstraintErrInfo& src, ValueArena&) 
     {   return operator=(src); }
-    void               deepDestruct() {}
+    void               deepDestruct(ValueArena&) {}
     const Stage&       getAllocationStage() const {return allocationStage;}
+    bool isSameAllocationAs(const ConstraintErrInfo& src) const
+    {   return allocationStage == src.allocationStage
+            && firstIndex == src.firstIndex 
+            && getNumErrs() == src.getNumErrs(); }
 private:
     // These are fixed at construction.
     Stage     allocationStage;
@@ -369,7 +472,8 @@ public:
 
     // Everything will properly clean itself up except for the AbstractValues
     // stored in the discrete variable and cache entry arrays. Be sure to
-    // delete those prior to allowing the arrays themselves to destruct.
+    // delete those prior to allowing the arrays themselves (and the arena
+    // some of them may live in) to destruct.
     ~PerSubsystemInfo() {
         clearAllStacks();
     }
@@ -391,6 +495,23 @@ public:
         return *this;
     }
 
+    // Utility which makes "this" a copy of the source subsystem exactly as it
+    // was after being realized to stage maxStage. If maxStage >= Model then
+    // all the subsystem-private state variables will be copied, but only
+    // cached computations up through maxStage come through. We clear
+    // our references to global variables regardless -- those will have to
+    // be repaired at the System (State global) level.
+    void copyFrom(const PerSubsystemInfo& src, Stage maxStage);
+
+    // Return true if this subsystem and the source have both been realized 
+    // through Instance stage and have exactly the same state variables, cache
+    // entries, and so on, with values of the same types. Then
+    // assignValuesFrom() has the same effect as copyFrom() through Instance 
+    // stage but just assigns values in place, keeping all our allocations 
+    // including references to global resources.
+    bool hasSameAllocationsAs(const PerSubsystemInfo& src) const;
+    void assignValuesFrom(const PerSubsystemInfo& src);
+
     // Back up to the stage just before g if this subsystem thinks
     // it is already at g or beyond. Note that we may be backing up
     // over many stages here. Careful: invalidating the stage
@@ -553,6 +674,10 @@ public:
     mutable StageVersion stageVersions[Stage::NValid];
 
 private:
+    // Discrete variable and cache entry values cloned from another State are
+    // kept here; see ValueArena above.
+    ValueArena           arena;
+
     // This is for use in constructors and for resetting an existing State into
     // its just-constructed condition.
     void initialize() {
@@ -610,14 +735,6 @@ private:
     // Stage g; that is, invalidate all stages > g. Allocations will be 
     // forgotten as Instance, Model, and Topology stages are invalidated.
     void restoreToStage(Stage g);
-
-    // Utility which makes "this" a copy of the source subsystem exactly as it
-    // was after being realized to stage maxStage. If maxStage >= Model then
-    // all the subsystem-private state variables will be copied, but only
-    // cached computations up through maxStage come through. We clear
-    // our references to global variables regardless -- those will have to
-    // be repaired at the System (State global) level.
-    void copyFrom(const PerSubsystemInfo& src, Stage maxStage);
 };
 
 
@@ -627,8 +744,9 @@ private:
 
 class SimTK_SimTKCOMMON_EXPORT StateImpl {
 public:
-    StateImpl() 
-    :   t(NaN), currentSystemStage(Stage::Empty) {initializeStageVersions();} 
+    StateImpl()
+    :   t(NaN), currentSystemStage(Stage::Empty), nHandles(1)
+    {   initializeStageVersions(); }
 
     // We'll do the copy constructor and assignment explicitly here
     // to get tight control over what's allowed.
@@ -641,6 +759,16 @@ public:
     // Copies all the variables but not the cache.
     StateImpl* clone() const {return new StateImpl(*this);}
 
+    // Copies everything, including the cache, so that the copy is realized
+    // as far as this one is. This is for State's copy-on-write mode.
+    StateImpl* cloneIncludingCache() const;
+
+    // The number of State handles sharing this StateImpl in copy-on-write
+    // mode; normally 1. removeHandle() returns the number remaining.
+    int  getNumHandles() const {return nHandles;}
+    void addHandle()     const {++nHandles;}
+    int  removeHandle()  const {return --nHandles;}
+
     const Stage& getSystemStage() const {return currentSystemStage;}
     Stage&       updSystemStage() const {return currentSystemStage;} // mutable
 
@@ -1549,6 +1677,10 @@ public:
         return dv.getInvalidatedStage();
     } 
 
+    int getNumDiscreteVariables(SubsystemIndex subsys) const {
+        return (int)subsystems[subsys].discreteInfo.size();
+    }
+
     // You can access at any time a variable that was allocated during 
     // realizeTopology(), but don't access others until you have done 
     // realizeModel().
@@ -1856,6 +1988,14 @@ private:
     // and version are the System name and version.
     Array_<PerSubsystemInfo> subsystems;
 
+    // Number of State handles using this StateImpl; not copied.
+    mutable std::atomic<int> nHandles;
+
+    // Return true if this State and the source have both been realized
+    // through Instance stage and have identical allocations, so that
+    // assignment can copy values in place without any heap activity.
+    bool hasSameAllocationsAs(const StateImpl& src) const;
+
     // Return true only if all subsystems are realized to at least Stage g.
     bool allSubsystemsAtLeastAtStage(Stage g) const {
         for (SubsystemIndex i(0); i < (int)subsystems.size(); ++i)
@@ -1872,6 +2012,25 @@ private:
 //==============================================================================
 // These mostly just forward to the StateImpl object.
 
+// Only a State in copy-on-write mode can be sharing its StateImpl, so the
+// common case doesn't need to look at the handle count.
+inline StateImpl& State::updImpl() {
+    assert(impl);
+    if (useCopyOnWrite && impl->getNumHandles() > 1) makeImplPrivate();
+    return *impl;
+}
+inline const StateImpl& State::getImplForWriting() const {
+    assert(impl);
+    if (useCopyOnWrite && impl->getNumHandles() > 1) makeImplPrivate();
+    return *impl;
+}
+inline void State::setUseCopyOnWrite(bool useCopyOnWrite) {
+    // Stop sharing now, since writes won't check for sharing any more.
+    if (!useCopyOnWrite && impl && impl->getNumHandles() > 1)
+        makeImplPrivate();
+    this->useCopyOnWrite = useCopyOnWrite;
+}
+
 inline void State::setNumSubsystems(int i) {
     updImpl().setNumSubsystems(i);
 }
@@ -1903,13 +2062,13 @@ inline void State::invalidateAll(Stage stage) {
     updImpl().invalidateAll(stage);
 }
 inline void State::invalidateAllCacheAtOrAbove(Stage stage) const {
-    getImpl().invalidateAllCacheAtOrAbove(stage);
+    getImplForWriting().invalidateAllCacheAtOrAbove(stage);
 }
 inline void State::advanceSubsystemToStage(SubsystemIndex subsys, Stage stage) const {
-    getImpl().advanceSubsystemToStage(subsys, stage);
+    getImplForWriting().advanceSubsystemToStage(subsys, stage);
 }
 inline void State::advanceSystemToStage(Stage stage) const {
-    getImpl().advanceSystemToStage(stage);
+    getImplForWriting().advanceSystemToStage(stage);
 }
 
 inline StageVersion State::getSystemTopologyStageVersion() const 
@@ -1928,20 +2087,20 @@ inline ZIndex State::allocateZ(SubsystemIndex subsys, const Vector& zInit) {
 
 // Constraint errors and multipliers
 inline QErrIndex State::allocateQErr(SubsystemIndex subsys, int nqerr) const {
-    return getImpl().allocateQErr(subsys, nqerr);
+    return getImplForWriting().allocateQErr(subsys, nqerr);
 }
 inline UErrIndex State::allocateUErr(SubsystemIndex subsys, int nuerr) const {
-    return getImpl().allocateUErr(subsys, nuerr);
+    return getImplForWriting().allocateUErr(subsys, nuerr);
 }
 inline UDotErrIndex State::
 allocateUDotErr(SubsystemIndex subsys, int nudoterr) const {
-    return getImpl().allocateUDotErr(subsys, nudoterr);
+    return getImplForWriting().allocateUDotErr(subsys, nudoterr);
 }
 
 // Event witness functions
 inline EventTriggerByStageIndex State::
 allocateEventTrigger(SubsystemIndex subsys, Stage stage, int nevent) const {
-    return getImpl().allocateEventTrigger(subsys, stage, nevent);
+    return getImplForWriting().allocateEventTrigger(subsys, stage, nevent);
 }
 
 // Discrete Variables
@@ -1973,6 +2132,10 @@ getDiscreteVarInvalidatesStage
     return getImpl().getDiscreteVarInvalidatesStage(subsys, index);
 }
 
+inline int State::
+getNumDiscreteVariables(SubsystemIndex subsys) const {
+    return getImpl().getNumDiscreteVariables(subsys);
+}
 inline const AbstractValue& State::
 getDiscreteVariable(SubsystemIndex subsys, DiscreteVariableIndex index) const {
     return getImpl().getDiscreteVariable(subsys, index);
@@ -1990,7 +2153,7 @@ getDiscreteVarUpdateValue
 inline AbstractValue& State::
 updDiscreteVarUpdateValue
    (SubsystemIndex subsys, DiscreteVariableIndex index) const {
-    return getImpl().updDiscreteVarUpdateValue(subsys, index);
+    return getImplForWriting().updDiscreteVarUpdateValue(subsys, index);
 }
 inline bool State::
 isDiscreteVarUpdateValueRealized
@@ -2000,7 +2163,7 @@ isDiscreteVarUpdateValueRealized
 inline void State::
 markDiscreteVarUpdateValueRealized
    (SubsystemIndex subsys, DiscreteVariableIndex index) const {
-    getImpl().markDiscreteVarUpdateValueRealized(subsys, index);
+    getImplForWriting().markDiscreteVarUpdateValueRealized(subsys, index);
 }
 
 inline AbstractValue& State::
@@ -2018,7 +2181,8 @@ setDiscreteVariable
 inline CacheEntryIndex State::
 allocateCacheEntry(SubsystemIndex subsys, Stage dependsOn, Stage computedBy, 
                    AbstractValue* v) const {
-    return getImpl().allocateCacheEntry(subsys, dependsOn, computedBy, v);
+    return getImplForWriting()
+        .allocateCacheEntry(subsys, dependsOn, computedBy, v);
 }
 
 inline Stage State::
@@ -2031,7 +2195,7 @@ getCacheEntry(SubsystemIndex subsys, CacheEntryIndex index) const {
 }
 inline AbstractValue& State::
 updCacheEntry(SubsystemIndex subsys, CacheEntryIndex index) const {
-    return getImpl().updCacheEntry(subsys, index);
+    return getImplForWriting().updCacheEntry(subsys, index);
 }
 
 inline bool State::
@@ -2040,11 +2204,11 @@ isCacheValueRealized(SubsystemIndex subx, CacheEntryIndex cx) const {
 }
 inline void State::
 markCacheValueRealized(SubsystemIndex subx, CacheEntryIndex cx) const {
-    getImpl().markCacheValueRealized(subx, cx); 
+    getImplForWriting().markCacheValueRealized(subx, cx); 
 }
 inline void State::
 markCacheValueNotRealized(SubsystemIndex subx, CacheEntryIndex cx) const {
-    getImpl().markCacheValueNotRealized(subx, cx); 
+    getImplForWriting().markCacheValueNotRealized(subx, cx); 
 }
 
 // Global Resource Dimensions
@@ -2160,7 +2324,7 @@ getEventTriggersByStage(SubsystemIndex subsys, Stage stage) const {
 }
 inline Vector& State::
 updEventTriggersByStage(SubsystemIndex subsys, Stage stage) const {
-    return getImpl().updEventTriggersByStage(subsys, stage);
+    return getImplForWriting().updEventTriggersByStage(subsys, stage);
 }
 inline const Vector& State::getQ(SubsystemIndex subsys) const {
     return getImpl().getQ(subsys);
@@ -2205,16 +2369,16 @@ inline const Vector& State::getQDotDot(SubsystemIndex subsys) const {
     return getImpl().getQDotDot(subsys);
 }
 inline Vector& State::updQDot(SubsystemIndex subsys) const {
-    return getImpl().updQDot(subsys);
+    return getImplForWriting().updQDot(subsys);
 }
 inline Vector& State::updUDot(SubsystemIndex subsys) const {
-    return getImpl().updUDot(subsys);
+    return getImplForWriting().updUDot(subsys);
 }
 inline Vector& State::updZDot(SubsystemIndex subsys) const {
-    return getImpl().updZDot(subsys);
+    return getImplForWriting().updZDot(subsys);
 }
 inline Vector& State::updQDotDot(SubsystemIndex subsys) const {
-    return getImpl().updQDotDot(subsys);
+    return getImplForWriting().updQDotDot(subsys);
 }
 inline const Vector& State::getQErr(SubsystemIndex subsys) const {
     return getImpl().getQErr(subsys);
@@ -2235,10 +2399,10 @@ inline const Vector& State::getMultipliers(SubsystemIndex subsys) const {
     return getImpl().getMultipliers(subsys);
 }
 inline Vector& State::updQErr(SubsystemIndex subsys) const {
-    return getImpl().updQErr(subsys);
+    return getImplForWriting().updQErr(subsys);
 }
 inline Vector& State::updUErr(SubsystemIndex subsys) const {
-    return getImpl().updUErr(subsys);
+    return getImplForWriting().updUErr(subsys);
 }
 inline Vector& State::updQErrWeights(SubsystemIndex subsys) {
     return updImpl().updQErrWeights(subsys);
@@ -2247,10 +2411,10 @@ inline Vector& State::updUErrWeights(SubsystemIndex subsys) {
     return updImpl().updUErrWeights(subsys);
 }
 inline Vector& State::updUDotErr(SubsystemIndex subsys) const {
-    return getImpl().updUDotErr(subsys);
+    return getImplForWriting().updUDotErr(subsys);
 }
 inline Vector& State::updMultipliers(SubsystemIndex subsys) const {
-    return getImpl().updMultipliers(subsys);
+    return getImplForWriting().updMultipliers(subsys);
 }
 
 inline SystemEventTriggerIndex State::
@@ -2266,10 +2430,10 @@ inline const Vector& State::getEventTriggersByStage(Stage stage) const {
 }
 
 inline Vector& State::updEventTriggers() const {
-    return getImpl().updEventTriggers();
+    return getImplForWriting().updEventTriggers();
 }
 inline Vector& State::updEventTriggersByStage(Stage stage) const {
-    return getImpl().updEventTriggersByStage(stage);
+    return getImplForWriting().updEventTriggersByStage(stage);
 }
 
 inline const Real& State::getTime() const {
@@ -2345,19 +2509,19 @@ inline const Vector& State::getQDotDot() const {
     return getImpl().getQDotDot();
 }
 inline Vector& State::updYDot() const {
-    return getImpl().updYDot();
+    return getImplForWriting().updYDot();
 }
 inline Vector& State::updQDot() const {
-    return getImpl().updQDot();
+    return getImplForWriting().updQDot();
 }
 inline Vector& State::updZDot() const {
-    return getImpl().updZDot();
+    return getImplForWriting().updZDot();
 }
 inline Vector& State::updUDot() const {
-    return getImpl().updUDot();
+    return getImplForWriting().updUDot();
 }
 inline Vector& State::updQDotDot() const {
-    return getImpl().updQDotDot();
+    return getImplForWriting().updQDotDot();
 }
 inline const Vector& State::getYErr() const {
     return getImpl().getYErr();
@@ -2381,13 +2545,13 @@ inline const Vector& State::getMultipliers() const {
     return getImpl().getMultipliers();
 }
 inline Vector& State::updYErr() const {
-    return getImpl().updYErr();
+    return getImplForWriting().updYErr();
 }
 inline Vector& State::updQErr() const {
-    return getImpl().updQErr();
+    return getImplForWriting().updQErr();
 }
 inline Vector& State::updUErr() const {
-    return getImpl().updUErr();
+    return getImplForWriting().updUErr();
 }
 inline Vector& State::updQErrWeights() {
     return updImpl().updQErrWeights();
@@ -2396,10 +2560,10 @@ inline Vector& State::updUErrWeights() {
     return updImpl().updUErrWeights();
 }
 inline Vector& State::updUDotErr() const {
-    return getImpl().updUDotErr();
+    return getImplForWriting().updUDotErr();
 }
 inline Vector& State::updMultipliers() const {
-    return getImpl().updMultipliers();
+    return getImplForWriting().updMultipliers();
 }
 
 inline void State::
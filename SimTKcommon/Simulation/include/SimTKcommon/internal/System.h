@@ -29,6 +29,7 @@
 #include "SimTKcommon/internal/State.h"
 #include "SimTKcommon/internal/Subsystem.h"
 #include "SimTKcommon/internal/SubsystemGuts.h"
+#include "SimTKcommon/internal/RealizeProfiler.h"
 
 #include <cassert>
 
@@ -767,6 +768,22 @@ int getNumHandleEventCalls() const;
 /** This is the total number of calls to reportEvents() regardless
 of the outcome. **/
 int getNumReportEventCalls() const;
+
+    // Realize profiling
+
+/** Turn on or off timing of realize() calls for each Subsystem and Stage,
+and for the force elements and constraints that support it. This is off by 
+default and then costs almost nothing. Results are accumulated until you 
+call resetAllCountersToZero(). @see RealizeProfiler **/
+void setRealizeProfilingEnabled(bool enabled);
+/** Return true if realize() calls are currently being timed. **/
+bool isRealizeProfilingEnabled() const;
+/** Get access to the profiler that holds the realize() timings, so that
+they can be examined or written out as JSON or a Chrome trace. **/
+const RealizeProfiler& getRealizeProfiler() const;
+/** Get writable access to the profiler, for example to set its trace
+capacity. **/
+RealizeProfiler& updRealizeProfiler();
 /**@}**/
 
 
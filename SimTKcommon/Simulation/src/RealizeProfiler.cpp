@@ -0,0 +1,387 @@
+/* -------------------------------------------------------------------------- *
+ *                       Simbody(tm): SimTKcommon                             *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+#include "SimTKcommon/basics.h"
+#include "SimTKcommon/internal/Timing.h"
+#include "SimTKcommon/internal/RealizeProfiler.h"
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+
+using namespace SimTK;
+
+//==============================================================================
+//                          REALIZE PROFILER :: IMPL
+//==============================================================================
+// Everything here is guarded by the lock, since States belonging to the same
+// System may be realized concurrently.
+class RealizeProfiler::Impl {
+public:
+    // An element is identified by its Subsystem, Stage, kind, and index. The
+    // kinds are string literals but may not have unique addresses so are
+    // compared by value.
+    struct ElementKey {
+        ElementKey(SubsystemIndex subsys, Stage g, const char* kind, int index)
+        :   subsys(subsys), stage(g), kind(kind), index(index) {}
+        bool operator<(const ElementKey& other) const {
+            if (subsys != other.subsys) return subsys < other.subsys;
+            if (stage != other.stage) return stage < other.stage;
+            if (index != other.index) return index < other.index;
+            return std::strcmp(kind, other.kind) < 0;
+        }
+        SubsystemIndex  subsys;
+        Stage           stage;
+        const char*     kind;
+        int             index;
+    };
+
+    struct Element {
+        Element(const ElementKey& key) : key(key) {}
+        ElementKey  key;
+        Timing      timing;
+    };
+
+    // One call, for the trace. An invalid subsystem means the whole System;
+    // a negative index means a whole Subsystem.
+    struct TraceEvent {
+        SubsystemIndex  subsys;
+        Stage           stage;
+        const char*     kind;
+        int             index;
+        long long       startNs, durationNs;
+        int             thread;
+    };
+
+    Impl() : traceCapacity(0), traceNext(0), originNs(realTimeInNs()) {}
+
+    void clear() {
+        for (int g=0; g < Stage::NValid; ++g)
+            systemTiming[g] = Timing();
+        subsystemTiming.clear();
+        subsystemNames.clear();
+        elements.clear();
+        elementMap.clear();
+        clearTrace();
+    }
+
+    void clearTrace() {
+        trace.clear();
+        traceNext = 0;
+        threads.clear();
+        originNs = realTimeInNs();
+    }
+
+    Timing& updSubsystemTiming(SubsystemIndex subsys, Stage g,
+                               const char* name) {
+        if (subsys >= (int)subsystemNames.size()) {
+            subsystemNames.resize(subsys+1);
+            subsystemTiming.resize((subsys+1)*Stage::NValid);
+        }
+        if (subsystemNames[subsys].empty())
+            subsystemNames[subsys] = name;
+        return subsystemTiming[subsys*Stage::NValid + g];
+    }
+
+    Timing& updElementTiming(const ElementKey& key) {
+        std::map<ElementKey,int>::const_iterator p = elementMap.find(key);
+        if (p != elementMap.end())
+            return elements[p->second].timing;
+        elementMap.insert(std::make_pair(key, (int)elements.size()));
+        elements.push_back(Element(key));
+        return elements.back().timing;
+    }
+
+    void record(const TraceEvent& event) {
+        if (traceCapacity == 0)
+            return;
+        if ((int)trace.size() < traceCapacity)
+            trace.push_back(event);
+        else
+            trace[traceNext] = event;
+        traceNext = (traceNext+1) % traceCapacity;
+    }
+
+    int getThreadNumber() {
+        const std::thread::id id = std::this_thread::get_id();
+        std::map<std::thread::id,int>::const_iterator p = threads.find(id);
+        if (p != threads.end())
+            return p->second;
+        const int n = (int)threads.size();
+        threads.insert(std::make_pair(id, n));
+        return n;
+    }
+
+    std::mutex                      lock;
+    Timing                          systemTiming[Stage::NValid];
+    Array_<Timing>                  subsystemTiming; // NValid per subsystem
+    Array_<String>                  subsystemNames;
+    Array_<Element>                 elements;
+    std::map<ElementKey,int>        elementMap;      // index into elements
+
+    Array_<TraceEvent>              trace;           // a ring buffer
+    int                             traceCapacity;
+    int                             traceNext;       // oldest if full
+    long long                       originNs;        // trace time zero
+    std::map<std::thread::id,int>   threads;         // numbered as seen
+};
+
+
+
+//==============================================================================
+//                             REALIZE PROFILER
+//==============================================================================
+// The Impl isn't allocated until the profiler is first enabled or given a
+// trace capacity, so that an unused profiler costs nothing. Until then all
+// the results are empty.
+RealizeProfiler::RealizeProfiler() : m_enabled(false), m_impl(0) {}
+RealizeProfiler::~RealizeProfiler() {delete m_impl;}
+
+void RealizeProfiler::setEnabled(bool enabled) {
+    if (enabled && !m_impl) m_impl = new Impl();
+    m_enabled = enabled;
+}
+
+void RealizeProfiler::clear() {
+    if (!m_impl) return;
+    std::lock_guard<std::mutex> guard(m_impl->lock);
+    m_impl->clear();
+}
+
+void RealizeProfiler::setTraceCapacity(int n) {
+    SimTK_APIARGCHECK1_ALWAYS(n >= 0, "RealizeProfiler", "setTraceCapacity",
+        "The trace capacity must be nonnegative but was %d.", n);
+    if (!m_impl) m_impl = new Impl();
+    std::lock_guard<std::mutex> guard(m_impl->lock);
+    m_impl->clearTrace();
+    m_impl->traceCapacity = n;
+}
+
+int RealizeProfiler::getTraceCapacity() const
+{   return m_impl ? m_impl->traceCapacity : 0; }
+
+RealizeProfiler::Timing RealizeProfiler::getSystemTiming(Stage g) const {
+    if (!m_impl) return Timing();
+    std::lock_guard<std::mutex> guard(m_impl->lock);
+    return m_impl->systemTiming[g];
+}
+
+RealizeProfiler::Timing RealizeProfiler::
+getSubsystemTiming(SubsystemIndex subsys, Stage g) const {
+    if (!m_impl) return Timing();
+    std::lock_guard<std::mutex> guard(m_impl->lock);
+    if (subsys >= (int)m_impl->subsystemNames.size())
+        return Timing();
+    return m_impl->subsystemTiming[subsys*Stage::NValid + g];
+}
+
+int RealizeProfiler::getNumElements() const {
+    if (!m_impl) return 0;
+    std::lock_guard<std::mutex> guard(m_impl->lock);
+    return (int)m_impl->elements.size();
+}
+
+SubsystemIndex RealizeProfiler::getElementSubsystem(int i) const {
+    std::lock_guard<std::mutex> guard(m_impl->lock);
+    return m_impl->elements[i].key.subsys;
+}
+
+Stage RealizeProfiler::getElementStage(int i) const {
+    std::lock_guard<std::mutex> guard(m_impl->lock);
+    return m_impl->elements[i].key.stage;
+}
+
+const char* RealizeProfiler::getElementKind(int i) const {
+    std::lock_guard<std::mutex> guard(m_impl->lock);
+    return m_impl->elements[i].key.kind;
+}
+
+int RealizeProfiler::getElementIndex(int i) const {
+    std::lock_guard<std::mutex> guard(m_impl->lock);
+    return m_impl->elements[i].key.index;
+}
+
+RealizeProfiler::Timing RealizeProfiler::getElementTiming(int i) const {
+    std::lock_guard<std::mutex> guard(m_impl->lock);
+    return m_impl->elements[i].timing;
+}
+
+int RealizeProfiler::findElement(SubsystemIndex subsys, Stage g,
+                                 const char* kind, int index) const {
+    if (!m_impl) return -1;
+    std::lock_guard<std::mutex> guard(m_impl->lock);
+    std::map<Impl::ElementKey,int>::const_iterator p =
+        m_impl->elementMap.find(Impl::ElementKey(subsys, g, kind, index));
+    return p == m_impl->elementMap.end() ? -1 : p->second;
+}
+
+
+
+//------------------------------------------------------------------------------
+//                                 OUTPUT
+//------------------------------------------------------------------------------
+// Write s as a quoted JSON string.
+static void writeJSONString(std::ostream& out, const char* s) {
+    out << '"';
+    for (; *s; ++s) {
+        const unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') out << '\\' << (char)c;
+        else if (c < 0x20) {
+            static const char hex[] = "0123456789abcdef";
+            out << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+        } else out << (char)c;
+    }
+    out << '"';
+}
+
+static void writeTimingFields(std::ostream& out,
+                              const RealizeProfiler::Timing& t) {
+    out << "\"calls\": " << t.numCalls << ", \"wallTime\": " << t.wallTime
+        << ", \"cpuTime\": " << t.cpuTime;
+}
+
+// Write a JSON array of {"stage": ..., timings} for the stages in [0,NValid)
+// of the given array that have been called.
+static void writeStageTimings(std::ostream& out,
+                              const RealizeProfiler::Timing* timing) {
+    out << "[";
+    bool first = true;
+    for (int g=0; g < Stage::NValid; ++g) {
+        if (timing[g].numCalls == 0) continue;
+        out << (first ? "" : ", ") << "{\"stage\": \""
+            << Stage(Stage::Level(g)).getName() << "\", ";
+        writeTimingFields(out, timing[g]);
+        out << "}";
+        first = false;
+    }
+    out << "]";
+}
+
+void RealizeProfiler::writeJSON(std::ostream& out) const {
+    Impl empty;
+    Impl& impl = m_impl ? *m_impl : empty;
+    std::lock_guard<std::mutex> guard(impl.lock);
+    const std::streamsize oldPrecision = out.precision(9);
+
+    out << "{\n  \"system\": ";
+    writeStageTimings(out, impl.systemTiming);
+
+    out << ",\n  \"subsystems\": [";
+    for (int i=0; i < (int)impl.subsystemNames.size(); ++i) {
+        out << (i ? ",\n" : "\n") << "    {\"index\": " << i << ", \"name\": ";
+        writeJSONString(out, impl.subsystemNames[i].c_str());
+        out << ", \"stages\": ";
+        writeStageTimings(out, &impl.subsystemTiming[i*Stage::NValid]);
+        out << "}";
+    }
+
+    out << "\n  ],\n  \"elements\": [";
+    for (int i=0; i < (int)impl.elements.size(); ++i) {
+        const Impl::Element& e = impl.elements[i];
+        out << (i ? ",\n" : "\n") << "    {\"subsystem\": " << e.key.subsys
+            << ", \"stage\": \"" << e.key.stage.getName() << "\", \"kind\": ";
+        writeJSONString(out, e.key.kind);
+        out << ", \"index\": " << e.key.index << ", ";
+        writeTimingFields(out, e.timing);
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+
+    out.precision(oldPrecision);
+}
+
+void RealizeProfiler::writeChromeTrace(std::ostream& out) const {
+    Impl empty;
+    Impl& impl = m_impl ? *m_impl : empty;
+    std::lock_guard<std::mutex> guard(impl.lock);
+    const std::streamsize oldPrecision = out.precision(15);
+
+    // The ring buffer holds the oldest event at traceNext once it is full.
+    const int n = (int)impl.trace.size();
+    const int oldest = n < impl.traceCapacity ? 0 : impl.traceNext;
+    out << "[";
+    for (int k=0; k < n; ++k) {
+        const Impl::TraceEvent& e = impl.trace[(oldest+k) % n];
+        const String stageName = e.stage.getName();
+        out << (k ? ",\n" : "\n") << "  {\"name\": ";
+        if (!e.subsys.isValid())
+            writeJSONString(out, ("System " + stageName).c_str());
+        else if (e.index < 0)
+            writeJSONString(out,
+                (impl.subsystemNames[e.subsys] + " " + stageName).c_str());
+        else
+            writeJSONString(out,
+                (String(e.kind) + " " + String(e.index)).c_str());
+        out << ", \"cat\": \""
+            << (!e.subsys.isValid() ? "system"
+                : e.index < 0 ? "subsystem" : "element")
+            << "\", \"ph\": \"X\", \"ts\": " << (e.startNs-impl.originNs)/1e3
+            << ", \"dur\": " << e.durationNs/1e3 << ", \"pid\": 0, \"tid\": "
+            << e.thread << ", \"args\": {\"stage\": \"" << stageName << "\"";
+        if (e.subsys.isValid())
+            out << ", \"subsystem\": " << e.subsys;
+        out << "}}";
+    }
+    out << "\n]\n";
+
+    out.precision(oldPrecision);
+}
+
+
+
+//------------------------------------------------------------------------------
+//                                  SCOPE
+//------------------------------------------------------------------------------
+void RealizeProfiler::Scope::begin(SubsystemIndex subsys, Stage g,
+                                   const char* nameOrKind, int index) {
+    m_subsys      = subsys;
+    m_stage       = g;
+    m_nameOrKind  = nameOrKind;
+    m_index       = index;
+    m_startCpu    = threadCpuTime();
+    m_startWallNs = realTimeInNs();
+}
+
+void RealizeProfiler::Scope::end() {
+    const long long durationNs = realTimeInNs() - m_startWallNs;
+    const double    cpu        = threadCpuTime() - m_startCpu;
+
+    Impl& impl = *m_profiler->m_impl;
+    std::lock_guard<std::mutex> guard(impl.lock);
+    Timing& timing =
+        !m_subsys.isValid() ? impl.systemTiming[m_stage]
+      : m_index < 0 ? impl.updSubsystemTiming(m_subsys, m_stage, m_nameOrKind)
+      : impl.updElementTiming
+            (Impl::ElementKey(m_subsys, m_stage, m_nameOrKind, m_index));
+    ++timing.numCalls;
+    timing.wallTime += durationNs*SimTK_NS_TO_S;
+    timing.cpuTime  += cpu;
+
+    if (impl.traceCapacity) {
+        const Impl::TraceEvent event = {m_subsys, m_stage, m_nameOrKind,
+                                        m_index, m_startWallNs, durationNs,
+                                        impl.getThreadNumber()};
+        impl.record(event);
+    }
+}
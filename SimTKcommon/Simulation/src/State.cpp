@@ -38,26 +38,51 @@ namespace SimTK {
 //                                   STATE
 //==============================================================================
 
-State::State() {
+// Give up this handle's use of a StateImpl, deleting it unless it is shared
+// with other States (in copy-on-write mode).
+static void releaseImpl(StateImpl*& impl) {
+    if (impl && impl->removeHandle() == 0)
+        delete impl;
+    impl = 0;
+}
+
+State::State() : useCopyOnWrite(false) {
     impl = new StateImpl();
 }
 
 // Restore state to default-constructed condition
 void State::clear() {
-    delete impl;
+    releaseImpl(impl);
     impl = new StateImpl();
 }
 State::~State() {
-    delete impl; impl=0;
+    releaseImpl(impl);
 }
 // copy constructor
-State::State(const State& state) {
-    impl = new StateImpl(*state.impl);
+State::State(const State& state) : useCopyOnWrite(state.useCopyOnWrite) {
+    if (useCopyOnWrite) {
+        impl = state.impl;
+        impl->addHandle();
+    } else
+        impl = new StateImpl(*state.impl);
 }
-    
+
 // copy assignment
 State& State::operator=(const State& src) {
     if (&src == this) return *this;
+    if (src.useCopyOnWrite && src.impl) {
+        // Share the source's contents.
+        if (src.impl != impl) {
+            src.impl->addHandle();
+            releaseImpl(impl);
+            impl = src.impl;
+        }
+        useCopyOnWrite = true;
+        return *this;
+    }
+    // We can't overwrite contents that other States are using.
+    if (impl && impl->getNumHandles() > 1)
+        releaseImpl(impl);
     if (!impl) {
         // we're defining this state here (if src is not empty)
         if (src.impl)
@@ -67,11 +92,20 @@ State& State::operator=(const State& src) {
 
     // Assignment or redefinition
     if (src.impl) *impl = *src.impl;
-    else {delete impl; impl=0;}
+    else releaseImpl(impl);
     return *this;
 }
 
 
+// Replace a shared StateImpl with a private copy of everything. Another
+// handle may let go of it meanwhile; then we make an unnecessary copy but
+// the result is still correct.
+void State::makeImplPrivate() const {
+    StateImpl* copy = impl->cloneIncludingCache();
+    releaseImpl(impl);
+    impl = copy;
+}
+
 // See StateImpl.h for inline method implementations.
 
 
@@ -102,69 +136,109 @@ operator<<(std::ostream& o, const State& s) {
 //      deepDestruct()          destroy any owned heap space
 //      getAllocationStage()    return the stage being worked on when this was 
 //                              allocated
+//      isSameAllocationAs()    true if deepAssign() would only assign values
+// The first two take the subsystem's ValueArena in which cloned values are
+// placed when possible.
 // The template type must otherwise support shallow copy semantics so that
 // the Array_ can move them around without causing any heap activity.
 
 // Clear the contents of an allocation stack, freeing up all associated heap 
 // space.
 template <class T>
-static void clearAllocationStack(Array_<T>& stack) {
+static void clearAllocationStack(Array_<T>& stack, ValueArena& arena) {
     for (int i=stack.size()-1; i >= 0; --i)
-        stack[i].deepDestruct();
+        stack[i].deepDestruct(arena);
     stack.clear();
 }
 
 // Resize the given allocation stack, taking care to free the heap space if the
 // size is reduced.
 template <class T>
-static void resizeAllocationStack(Array_<T>& stack, int newSize) {
+static void resizeAllocationStack(Array_<T>& stack, int newSize, 
+                                  ValueArena& arena) {
     assert(newSize >= 0);
     for (int i = stack.size()-1; i >= newSize; --i)
-        stack[i].deepDestruct();
+        stack[i].deepDestruct(arena);
     stack.resize(newSize);
 }
 
 // Keep only those stack entries whose allocation stage is <= the supplied one.
 template <class T>
-static void popAllocationStackBackToStage(Array_<T>& stack, const Stage& g) {
+static void popAllocationStackBackToStage(Array_<T>& stack, const Stage& g,
+                                          ValueArena& arena) {
     unsigned newSize = stack.size();
     while (newSize > 0 && stack[newSize-1].getAllocationStage() > g)
-        stack[--newSize].deepDestruct();
+        stack[--newSize].deepDestruct(arena);
     stack.resize(newSize); 
 }
 
+// Return the number of source entries that a copy through stage g includes.
+template <class T>
+static unsigned countAllocationsThroughStage
+   (const Array_<T>& src, const Stage& g) 
+{
+    unsigned n = src.size();
+    while (n && src[n-1].getAllocationStage() > g)
+        --n;
+    return n;
+}
+
 // Make this allocation stack the same as the source, copying only through the 
 // given stage.
 template <class T>
 static void copyAllocationStackThroughStage
-   (Array_<T>& stack, const Array_<T>& src, const Stage& g) 
+   (Array_<T>& stack, const Array_<T>& src, const Stage& g, ValueArena& arena) 
 {
-    unsigned nVarsToCopy = src.size(); // assume we'll copy all
-    while (nVarsToCopy && src[nVarsToCopy-1].getAllocationStage() > g)
-        --nVarsToCopy;
-    resizeAllocationStack(stack, nVarsToCopy);
+    const unsigned nVarsToCopy = countAllocationsThroughStage(src, g);
+    resizeAllocationStack(stack, nVarsToCopy, arena);
     for (unsigned i=0; i < nVarsToCopy; ++i)
-        stack[i].deepAssign(src[i]);
+        stack[i].deepAssign(src[i], arena);
+}
+
+// Return the arena space needed for the values that copying src into stack
+// through stage g would have to clone, that is, those for entries the stack
+// doesn't already have. Only useful for stacks whose entries hold values.
+template <class T>
+static size_t calcCloneSpaceThroughStage
+   (const Array_<T>& stack, const Array_<T>& src, const Stage& g) 
+{
+    const unsigned nVarsToCopy = countAllocationsThroughStage(src, g);
+    size_t nBytes = 0;
+    for (unsigned i=stack.size(); i < nVarsToCopy; ++i)
+        nBytes += ValueArena::getSlotSize(src[i].getValue());
+    return nBytes;
+}
+
+// Return true if the stacks have entries that differ only in value.
+template <class T>
+static bool allocationStacksMatch(const Array_<T>& stack, const Array_<T>& src)
+{
+    if (stack.size() != src.size())
+        return false;
+    for (unsigned i=0; i < stack.size(); ++i)
+        if (!stack[i].isSameAllocationAs(src[i]))
+            return false;
+    return true;
 }
 
 void PerSubsystemInfo::clearContinuousVars() {
-    clearAllocationStack(qInfo); 
-    clearAllocationStack(uInfo);                                
-    clearAllocationStack(zInfo); 
+    clearAllocationStack(qInfo, arena); 
+    clearAllocationStack(uInfo, arena);                                
+    clearAllocationStack(zInfo, arena); 
 }
 
 void PerSubsystemInfo::clearConstraintErrs() {
-    clearAllocationStack(qerrInfo);
-    clearAllocationStack(uerrInfo);
-    clearAllocationStack(udoterrInfo);
+    clearAllocationStack(qerrInfo, arena);
+    clearAllocationStack(uerrInfo, arena);
+    clearAllocationStack(udoterrInfo, arena);
 }
 
 void PerSubsystemInfo::clearDiscreteVars()
-{   clearAllocationStack(discreteInfo); }
+{   clearAllocationStack(discreteInfo, arena); }
 void PerSubsystemInfo::clearEventTriggers(int g)
-{   clearAllocationStack(triggerInfo[g]); }
+{   clearAllocationStack(triggerInfo[g], arena); }
 void PerSubsystemInfo::clearCache()
-{   clearAllocationStack(cacheInfo); }
+{   clearAllocationStack(cacheInfo, arena); }
 
 void PerSubsystemInfo::clearAllStacks() {
     clearContinuousVars(); clearDiscreteVars();
@@ -174,24 +248,24 @@ void PerSubsystemInfo::clearAllStacks() {
 }
 
 void PerSubsystemInfo::popContinuousVarsBackToStage(const Stage& g) { 
-    popAllocationStackBackToStage(qInfo,g);
-    popAllocationStackBackToStage(uInfo,g);
-    popAllocationStackBackToStage(zInfo,g);
+    popAllocationStackBackToStage(qInfo,g,arena);
+    popAllocationStackBackToStage(uInfo,g,arena);
+    popAllocationStackBackToStage(zInfo,g,arena);
 }
 void PerSubsystemInfo::popDiscreteVarsBackToStage(const Stage& g) 
-{   popAllocationStackBackToStage(discreteInfo,g); }
+{   popAllocationStackBackToStage(discreteInfo,g,arena); }
 
 void PerSubsystemInfo::popConstraintErrsBackToStage(const Stage& g) {
-    popAllocationStackBackToStage(qerrInfo,g);
-    popAllocationStackBackToStage(uerrInfo,g);
-    popAllocationStackBackToStage(udoterrInfo,g);
+    popAllocationStackBackToStage(qerrInfo,g,arena);
+    popAllocationStackBackToStage(uerrInfo,g,arena);
+    popAllocationStackBackToStage(udoterrInfo,g,arena);
 }
 void PerSubsystemInfo::popCacheBackToStage(const Stage& g) 
-{   popAllocationStackBackToStage(cacheInfo,g); }
+{   popAllocationStackBackToStage(cacheInfo,g,arena); }
 
 void PerSubsystemInfo::popEventTriggersBackToStage(const Stage& g) {
     for (int i=0; i < Stage::NValid; ++i)
-        popAllocationStackBackToStage(triggerInfo[i],g); 
+        popAllocationStackBackToStage(triggerInfo[i],g,arena); 
 }
 
 void PerSubsystemInfo::popAllStacksBackToStage(const Stage& g) {
@@ -205,29 +279,37 @@ void PerSubsystemInfo::popAllStacksBackToStage(const Stage& g) {
 void PerSubsystemInfo::copyContinuousVarInfoThroughStage
    (const Array_<ContinuousVarInfo>& src, const Stage& g,
     Array_<ContinuousVarInfo>& dest)
-{   copyAllocationStackThroughStage(dest, src, g); }
+{   copyAllocationStackThroughStage(dest, src, g, arena); }
 
 void PerSubsystemInfo::copyDiscreteVarsThroughStage
    (const Array_<DiscreteVarInfo>& src, const Stage& g)
-{   copyAllocationStackThroughStage(discreteInfo, src, g); }
+{   copyAllocationStackThroughStage(discreteInfo, src, g, arena); }
 
 void PerSubsystemInfo::copyConstraintErrInfoThroughStage
    (const Array_<ConstraintErrInfo>& src, const Stage& g,
     Array_<ConstraintErrInfo>& dest)
-{   copyAllocationStackThroughStage(dest, src, g); }
+{   copyAllocationStackThroughStage(dest, src, g, arena); }
 
 void PerSubsystemInfo::copyCacheThroughStage
    (const Array_<CacheEntryInfo>& src, const Stage& g)
-{   copyAllocationStackThroughStage(cacheInfo, src, g); }
+{   copyAllocationStackThroughStage(cacheInfo, src, g, arena); }
 
 void PerSubsystemInfo::copyEventsThroughStage
    (const Array_<TriggerInfo>& src, const Stage& g,
     Array_<TriggerInfo>& dest)
-{   copyAllocationStackThroughStage(dest, src, g); }
+{   copyAllocationStackThroughStage(dest, src, g, arena); }
 
 void PerSubsystemInfo::copyAllStacksThroughStage
    (const PerSubsystemInfo& src, const Stage& g)
 {
+    // If none of our values are in the arena we can size it to hold all the
+    // values we're about to clone. Otherwise we'll use whatever space is left.
+    if (arena.empty())
+        arena.reserve(calcCloneSpaceThroughStage(discreteInfo, 
+                                                 src.discreteInfo, g)
+                      + calcCloneSpaceThroughStage(cacheInfo, 
+                                                   src.cacheInfo, g));
+
     copyContinuousVarInfoThroughStage(src.qInfo, g, qInfo);
     copyContinuousVarInfoThroughStage(src.uInfo, g, uInfo);
     copyContinuousVarInfoThroughStage(src.zInfo, g, zInfo);
@@ -291,8 +373,10 @@ void PerSubsystemInfo::copyFrom(const PerSubsystemInfo& src, Stage maxStage) {
     for (int i=0; i<=targetStage; ++i)
         stageVersions[i] = src.stageVersions[i];
     // The rest of the stages need to be invalidated in the destination
-    // since we didn't copy any state information from those stages.
-    for (int i=targetStage+1; i<=src.currentStage; ++i)
+    // since we didn't copy any state information from those stages. That
+    // includes stages the source has already backed up from, because a lazy
+    // cache entry computed before then still carries the version it had.
+    for (int i=targetStage+1; i<Stage::NValid; ++i)
         stageVersions[i] = src.stageVersions[i] + 1;
 
     // Subsystem stage should now match what we copied.
@@ -300,6 +384,71 @@ void PerSubsystemInfo::copyFrom(const PerSubsystemInfo& src, Stage maxStage) {
 }
 
 
+// Nothing can be allocated after Instance stage, so if both are at least
+// there the stacks are complete and can be compared directly.
+bool PerSubsystemInfo::hasSameAllocationsAs(const PerSubsystemInfo& src) const {
+    if (currentStage < Stage::Instance || src.currentStage < Stage::Instance
+        || stageVersions[Stage::Topology] != src.stageVersions[Stage::Topology])
+        return false;
+
+    if (!(   allocationStacksMatch(qInfo, src.qInfo)
+          && allocationStacksMatch(uInfo, src.uInfo)
+          && allocationStacksMatch(zInfo, src.zInfo)
+          && allocationStacksMatch(discreteInfo, src.discreteInfo)
+          && allocationStacksMatch(qerrInfo, src.qerrInfo)
+          && allocationStacksMatch(uerrInfo, src.uerrInfo)
+          && allocationStacksMatch(udoterrInfo, src.udoterrInfo)
+          && allocationStacksMatch(cacheInfo, src.cacheInfo)))
+        return false;
+    for (int i=0; i < Stage::NValid; ++i)
+        if (!allocationStacksMatch(triggerInfo[i], src.triggerInfo[i]))
+            return false;
+    return true;
+}
+
+// This is copyFrom(src, Stage::Instance) except that we keep our references
+// to global resources, and that stage versions beyond Instance are raised
+// past both ours and the source's since we keep our own cache entries. Cache
+// entries that depend on later stages can't be valid afterwards, so we don't
+// bother copying their values.
+void PerSubsystemInfo::assignValuesFrom(const PerSubsystemInfo& src) {
+    assert(hasSameAllocationsAs(src));
+    restoreToStage(Stage::Instance);
+
+    name     = src.name;
+    version  = src.version;
+
+    copyContinuousVarInfoThroughStage(src.qInfo, Stage::Instance, qInfo);
+    copyContinuousVarInfoThroughStage(src.uInfo, Stage::Instance, uInfo);
+    copyContinuousVarInfoThroughStage(src.zInfo, Stage::Instance, zInfo);
+    copyDiscreteVarsThroughStage(src.discreteInfo, Stage::Instance);
+    copyConstraintErrInfoThroughStage(src.qerrInfo, Stage::Instance, qerrInfo);
+    copyConstraintErrInfoThroughStage(src.uerrInfo, Stage::Instance, uerrInfo);
+    copyConstraintErrInfoThroughStage(src.udoterrInfo, Stage::Instance, 
+                                      udoterrInfo);
+    // Lazy entries that were never computed in the source (like unused
+    // factorizations) needn't be copied; just make sure ours isn't used.
+    for (unsigned i=0; i < cacheInfo.size(); ++i) {
+        const CacheEntryInfo& ce = src.cacheInfo[i];
+        if (ce.getDependsOnStage() > Stage::Instance)
+            continue;
+        if (ce.isCurrent(src.currentStage, src.stageVersions))
+            cacheInfo[i].deepAssign(ce, arena);
+        else
+            cacheInfo[i].invalidate();
+    }
+    for (int i=0; i < Stage::NValid; ++i)
+        copyEventsThroughStage(src.triggerInfo[i], Stage::Instance, 
+                               triggerInfo[i]);
+
+    for (int i=0; i <= Stage::Instance; ++i)
+        stageVersions[i] = src.stageVersions[i];
+    for (int i=Stage::Instance+1; i < Stage::NValid; ++i)
+        stageVersions[i] = std::max(stageVersions[i], src.stageVersions[i]) + 1;
+}
+
+
+
 //==============================================================================
 //                              STATE IMPL
 //==============================================================================
@@ -309,7 +458,7 @@ void PerSubsystemInfo::copyFrom(const PerSubsystemInfo& src, Stage maxStage) {
 //                           COPY CONSTRUCTOR
 //------------------------------------------------------------------------------
 StateImpl::StateImpl(const StateImpl& src)
-:   currentSystemStage(Stage::Empty)
+:   currentSystemStage(Stage::Empty), nHandles(1)
 {
     initializeStageVersions();
 
@@ -350,6 +499,29 @@ StateImpl::StateImpl(const StateImpl& src)
 //------------------------------------------------------------------------------
 StateImpl& StateImpl::operator=(const StateImpl& src) {
     if (&src == this) return *this;
+
+    // If we're already set up just like the source, as we are when a
+    // State is repeatedly assigned from others of the same System, we can 
+    // copy the values in place rather than tear everything down and 
+    // rebuild it. The result is the same except for stage versions.
+    if (hasSameAllocationsAs(src)) {
+        for (SubsystemIndex i(0); i<(int)subsystems.size(); ++i)
+            subsystems[i].assignValuesFrom(src.subsystems[i]);
+        t           = src.t;
+        y           = src.y;
+        uWeights    = src.uWeights;
+        zWeights    = src.zWeights;
+        qerrWeights = src.qerrWeights;
+        uerrWeights = src.uerrWeights;
+        for (int i=1; i <= Stage::Instance; ++i)
+            systemStageVersions[i] = src.systemStageVersions[i];
+        for (int i=Stage::Instance+1; i < Stage::NValid; ++i)
+            systemStageVersions[i] = 
+                std::max(systemStageVersions[i], src.systemStageVersions[i])+1;
+        currentSystemStage = Stage::Instance;
+        return *this;
+    }
+
     invalidateJustSystemStage(Stage::Topology);
     for (SubsystemIndex i(0); i<(int)subsystems.size(); ++i)
         subsystems[i].invalidateStageJustThisSubsystem(Stage::Topology);
@@ -387,6 +559,69 @@ StateImpl& StateImpl::operator=(const StateImpl& src) {
     return *this;
 }
 
+//------------------------------------------------------------------------------
+//                          CLONE INCLUDING CACHE
+//------------------------------------------------------------------------------
+// Unlike the copy constructor, this copies each subsystem through its current
+// stage and copies the system-level cache entries too, along with all the
+// stage versions. So the copy is realized as far as this one is and the same
+// cache entries are valid in both.
+StateImpl* StateImpl::cloneIncludingCache() const {
+    StateImpl* copy = new StateImpl();
+    copy->subsystems.resize(subsystems.size());
+    for (SubsystemIndex i(0); i<(int)subsystems.size(); ++i)
+        copy->subsystems[i].copyFrom(subsystems[i], Stage::Infinity);
+
+    // Now rebuild the global resources and the subsystems' views into them.
+    if (currentSystemStage >= Stage::Topology) {
+        copy->advanceSystemToStage(Stage::Topology);
+        copy->t = t;
+    }
+    if (currentSystemStage >= Stage::Model) {
+        copy->advanceSystemToStage(Stage::Model);
+        // careful -- don't allow reallocation
+        copy->y        = y;
+        copy->uWeights = uWeights;
+        copy->zWeights = zWeights;
+        copy->ydot     = ydot;
+        copy->qdotdot  = qdotdot;
+    }
+    if (currentSystemStage >= Stage::Instance) {
+        copy->advanceSystemToStage(Stage::Instance);
+        copy->qerrWeights = qerrWeights;
+        copy->uerrWeights = uerrWeights;
+        copy->yerr        = yerr;
+        copy->udoterr     = udoterr;
+        copy->multipliers = multipliers;
+        copy->allTriggers = allTriggers;
+    }
+
+    copy->currentSystemStage = currentSystemStage;
+    for (int i=0; i < Stage::NValid; ++i)
+        copy->systemStageVersions[i] = systemStageVersions[i];
+    return copy;
+}
+
+//------------------------------------------------------------------------------
+//                        HAS SAME ALLOCATIONS AS
+//------------------------------------------------------------------------------
+bool StateImpl::hasSameAllocationsAs(const StateImpl& src) const {
+    if (   currentSystemStage < Stage::Instance 
+        || src.currentSystemStage < Stage::Instance
+        || subsystems.size() != src.subsystems.size()
+        || systemStageVersions[Stage::Topology] 
+           != src.systemStageVersions[Stage::Topology])
+        return false;
+    if (   y.size() != src.y.size() || yerr.size() != src.yerr.size()
+        || udoterr.size() != src.udoterr.size() 
+        || allTriggers.size() != src.allTriggers.size())
+        return false;
+    for (SubsystemIndex i(0); i<(int)subsystems.size(); ++i)
+        if (!subsystems[i].hasSameAllocationsAs(src.subsystems[i]))
+            return false;
+    return true;
+}
+
 //------------------------------------------------------------------------------
 //                     INVALIDATE JUST SYSTEM STAGE
 //------------------------------------------------------------------------------
@@ -0,0 +1,519 @@
+/* -------------------------------------------------------------------------- *
+ *                       Simbody(tm): SimTKcommon                             *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+#include "SimTKcommon/internal/StateCheckpoint.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+using namespace SimTK;
+
+// The checkpoint file format is:
+//      char[8]     magic "SimTKchk"
+//      unsigned    format version
+//      unsigned    byte order marker (0x01020304 as written)
+//      unsigned    sizeof(Real)
+//      int         stage to which the State was realized
+//      Real        time
+//      int         number of subsystems
+// followed by this for each subsystem:
+//      string      subsystem name
+//      int         nq, nu, nz
+//      Real[]      q, u, z
+//      int         number of discrete variables
+// followed by this for each discrete variable:
+//      string      registered type name, empty if the variable was skipped
+//      string      the variable's value as bytes (empty if skipped)
+// where a string is an unsigned length followed by that many bytes. Everything
+// is written in the byte order of the writing machine.
+
+static const char     Magic[8]      = {'S','i','m','T','K','c','h','k'};
+static const unsigned FormatVersion = 1;
+static const unsigned ByteOrder     = 0x01020304;
+
+
+//==============================================================================
+//                          VALUE TYPE REGISTRY
+//==============================================================================
+namespace {
+struct ValueTypeInfo {
+    ValueTypeInfo() : write(0), read(0) {}
+    ValueTypeInfo(const String& name, StateCheckpoint::WriteValueFunc w,
+                  StateCheckpoint::ReadValueFunc r)
+    :   typeName(name), write(w), read(r) {}
+
+    String                          typeName;
+    StateCheckpoint::WriteValueFunc write;
+    StateCheckpoint::ReadValueFunc  read;
+};
+
+// Keyed by the std::type_info name of the Value<T> type.
+typedef std::map<std::string, ValueTypeInfo> ValueTypeRegistry;
+}
+
+class StateCheckpoint::Impl {
+public:
+    explicit Impl(const String& fileName);
+    ~Impl() {unmapFile();}
+
+    // Return the registered serializers for the given value, or null if
+    // there aren't any.
+    static const ValueTypeInfo* findValueType(const AbstractValue& value) {
+        const ValueTypeRegistry& registry = updRegistry();
+        ValueTypeRegistry::const_iterator p =
+            registry.find(typeid(value).name());
+        return p == registry.end() ? 0 : &p->second;
+    }
+
+    static ValueTypeRegistry& updRegistry() {
+        static ValueTypeRegistry registry(makeBuiltInRegistry());
+        return registry;
+    }
+
+    struct DiscreteVarRecord {
+        String      typeName;   // empty if not saved
+        const char* data;
+        size_t      nBytes;
+    };
+
+    struct SubsystemRecord {
+        String      name;
+        int         nq, nu, nz;
+        const char* y;          // q, u, z; unaligned
+        Array_<DiscreteVarRecord> discreteVars;
+    };
+
+    // Set a discrete variable from its checkpoint record if it was saved.
+    static void restoreDiscreteVar(const DiscreteVarRecord& dv,
+                                   const String& subsysName, SubsystemIndex sx,
+                                   DiscreteVariableIndex dx, State& state,
+                                   Array_<char>& current);
+
+    String                  fileName;
+    Stage                   stage;
+    Real                    t;
+    Array_<SubsystemRecord> subsystems;
+
+private:
+    static ValueTypeRegistry makeBuiltInRegistry();
+
+    void mapFile();
+    void unmapFile();
+    void parse();
+
+    // The mapped file.
+    const char* data;
+    size_t      size;
+    #ifdef _WIN32
+    HANDLE      file, mapping;
+    #endif
+};
+
+ValueTypeRegistry StateCheckpoint::Impl::makeBuiltInRegistry() {
+    ValueTypeRegistry r;
+    #define ADD_TYPE(T, Codec, typeName) \
+        r[typeid(Value<T>).name()] = \
+            ValueTypeInfo(typeName, &Codec::write, &Codec::read)
+    ADD_TYPE(bool,       PlainCodec<bool>,        "bool");
+    ADD_TYPE(int,        PlainCodec<int>,         "int");
+    ADD_TYPE(Real,       PlainCodec<Real>,        "Real");
+    ADD_TYPE(Vec2,       PlainCodec<Vec2>,        "Vec2");
+    ADD_TYPE(Vec3,       PlainCodec<Vec3>,        "Vec3");
+    ADD_TYPE(Vec4,       PlainCodec<Vec4>,        "Vec4");
+    ADD_TYPE(Vec6,       PlainCodec<Vec6>,        "Vec6");
+    ADD_TYPE(SpatialVec, PlainCodec<SpatialVec>,  "SpatialVec");
+    ADD_TYPE(Vector,     VectorCodec<Real>,       "Vector");
+    ADD_TYPE(Vector_<Vec3>,       VectorCodec<Vec3>,       "Vector_<Vec3>");
+    ADD_TYPE(Vector_<SpatialVec>, VectorCodec<SpatialVec>,
+             "Vector_<SpatialVec>");
+    ADD_TYPE(Array_<bool>, ArrayCodec<bool>,      "Array_<bool>");
+    ADD_TYPE(Array_<int>,  ArrayCodec<int>,       "Array_<int>");
+    ADD_TYPE(Array_<Real>, ArrayCodec<Real>,      "Array_<Real>");
+    #undef ADD_TYPE
+    return r;
+}
+
+void StateCheckpoint::registerValueType(const std::type_info& valueType,
+                                        const String&         typeName,
+                                        WriteValueFunc        writeFunc,
+                                        ReadValueFunc         readFunc)
+{
+    SimTK_APIARGCHECK_ALWAYS(!typeName.empty() && writeFunc && readFunc,
+        "StateCheckpoint", "registerValueType",
+        "A type name and both functions are required.");
+    Impl::updRegistry()[valueType.name()] =
+        ValueTypeInfo(typeName, writeFunc, readFunc);
+}
+
+
+
+//==============================================================================
+//                                  WRITE
+//==============================================================================
+namespace {
+template <class T> void put(const T& x, Array_<char>& out) {
+    const char* p = reinterpret_cast<const char*>(&x);
+    out.insert(out.end(), p, p+sizeof(T));
+}
+void putString(const char* s, unsigned n, Array_<char>& out) {
+    put(n, out);
+    out.insert(out.end(), s, s+n);
+}
+void putVector(const Vector& v, Array_<char>& out) {
+    for (int i=0; i < v.size(); ++i)
+        put(v[i], out);
+}
+}
+
+void StateCheckpoint::write(const State& state, std::ostream& out) {
+    SimTK_STAGECHECK_GE_ALWAYS(state.getSystemStage(), Stage::Model,
+                               "StateCheckpoint::write()");
+    Array_<char> buf, value;
+    buf.insert(buf.end(), Magic, Magic+8);
+    put(FormatVersion, buf);
+    put(ByteOrder, buf);
+    put(unsigned(sizeof(Real)), buf);
+    put(int(state.getSystemStage()), buf);
+    put(state.getTime(), buf);
+    put(state.getNumSubsystems(), buf);
+
+    for (SubsystemIndex sx(0); sx < state.getNumSubsystems(); ++sx) {
+        const String& name = state.getSubsystemName(sx);
+        putString(name.c_str(), (unsigned)name.size(), buf);
+        put(state.getNQ(sx), buf);
+        put(state.getNU(sx), buf);
+        put(state.getNZ(sx), buf);
+        putVector(state.getQ(sx), buf);
+        putVector(state.getU(sx), buf);
+        putVector(state.getZ(sx), buf);
+
+        const int ndv = state.getNumDiscreteVariables(sx);
+        put(ndv, buf);
+        for (DiscreteVariableIndex dx(0); dx < ndv; ++dx) {
+            const AbstractValue& v = state.getDiscreteVariable(sx, dx);
+            const ValueTypeInfo* info = Impl::findValueType(v);
+            if (!info) {
+                // Skipping a variable that affects Instance stage or earlier
+                // would quietly change the model when restoring.
+                SimTK_ERRCHK2_ALWAYS(
+                    state.getDiscreteVarInvalidatesStage(sx, dx)
+                        > Stage::Instance, "StateCheckpoint::write()",
+                    "Discrete variable %d of subsystem '%s' affects Instance "
+                    "stage or earlier but its type has no registered "
+                    "serializer; see StateCheckpoint::registerValueType().",
+                    (int)dx, name.c_str());
+                putString(0, 0, buf);
+                putString(0, 0, buf);
+                continue;
+            }
+            value.clear();
+            info->write(v, value);
+            putString(info->typeName.c_str(), (unsigned)info->typeName.size(),
+                      buf);
+            putString(value.cbegin(), value.size(), buf);
+        }
+    }
+
+    out.write(buf.cbegin(), buf.size());
+    SimTK_ERRCHK_ALWAYS(out.good(), "StateCheckpoint::write()",
+                        "Error writing the checkpoint.");
+}
+
+void StateCheckpoint::writeFile(const State& state, const String& fileName) {
+    std::ofstream out(fileName.c_str(), std::ios::out | std::ios::binary
+                                        | std::ios::trunc);
+    SimTK_ERRCHK1_ALWAYS(out.good(), "StateCheckpoint::writeFile()",
+        "Can't open file '%s' for writing.", fileName.c_str());
+    write(state, out);
+    out.close();
+    SimTK_ERRCHK1_ALWAYS(out.good(), "StateCheckpoint::writeFile()",
+        "Error writing file '%s'.", fileName.c_str());
+}
+
+
+
+//==============================================================================
+//                                  READ
+//==============================================================================
+StateCheckpoint::StateCheckpoint(const String& fileName)
+:   impl(new Impl(fileName)) {}
+
+StateCheckpoint::~StateCheckpoint() {delete impl;}
+
+StateCheckpoint::Impl::Impl(const String& name)
+:   fileName(name), data(0), size(0) {
+    mapFile();
+    try {parse();}
+    catch (...) {unmapFile(); throw;}
+}
+
+#ifdef _WIN32
+void StateCheckpoint::Impl::mapFile() {
+    file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, 0,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    SimTK_ERRCHK1_ALWAYS(file != INVALID_HANDLE_VALUE, "StateCheckpoint",
+        "Can't open checkpoint file '%s'.", fileName.c_str());
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    size = (size_t)fileSize.QuadPart;
+    mapping = size ? CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0) : 0;
+    data = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0,0,0)
+                   : 0;
+    if (!data) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        SimTK_ERRCHK1_ALWAYS(!"mapped", "StateCheckpoint",
+            "Can't map checkpoint file '%s' into memory.", fileName.c_str());
+    }
+}
+
+void StateCheckpoint::Impl::unmapFile() {
+    if (data) {
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+        CloseHandle(file);
+        data = 0;
+    }
+}
+#else
+void StateCheckpoint::Impl::mapFile() {
+    const int fd = open(fileName.c_str(), O_RDONLY);
+    SimTK_ERRCHK1_ALWAYS(fd >= 0, "StateCheckpoint",
+        "Can't open checkpoint file '%s'.", fileName.c_str());
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        size = (size_t)st.st_size;
+        p = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd); // the mapping remains valid
+    SimTK_ERRCHK1_ALWAYS(p != MAP_FAILED, "StateCheckpoint",
+        "Can't map checkpoint file '%s' into memory.", fileName.c_str());
+    data = static_cast<const char*>(p);
+}
+
+void StateCheckpoint::Impl::unmapFile() {
+    if (data) {
+        munmap(const_cast<char*>(data), size);
+        data = 0;
+    }
+}
+#endif
+
+namespace {
+// Reads items from the mapped file with bounds checking.
+class Cursor {
+public:
+    Cursor(const char* begin, size_t n, const String& fileName)
+    :   p(begin), end(begin+n), fileName(fileName) {}
+
+    const char* skip(size_t n) {
+        SimTK_ERRCHK1_ALWAYS(n <= size_t(end-p), "StateCheckpoint",
+            "Checkpoint file '%s' is truncated or corrupt.", fileName.c_str());
+        const char* here = p;
+        p += n;
+        return here;
+    }
+    template <class T> T get() {
+        T x;
+        std::memcpy(&x, skip(sizeof(T)), sizeof(T));
+        return x;
+    }
+    // Returns the start of the string's bytes.
+    const char* getString(size_t& n) {
+        n = get<unsigned>();
+        return skip(n);
+    }
+    int getCount() {
+        const int n = get<int>();
+        SimTK_ERRCHK1_ALWAYS(n >= 0, "StateCheckpoint",
+            "Checkpoint file '%s' is corrupt.", fileName.c_str());
+        return n;
+    }
+private:
+    const char*     p;
+    const char*     end;
+    const String&   fileName;
+};
+}
+
+void StateCheckpoint::Impl::parse() {
+    Cursor in(data, size, fileName);
+    SimTK_ERRCHK1_ALWAYS(std::memcmp(in.skip(8), Magic, 8) == 0,
+        "StateCheckpoint", "File '%s' is not a State checkpoint.",
+        fileName.c_str());
+    const unsigned version = in.get<unsigned>();
+    SimTK_ERRCHK2_ALWAYS(version == FormatVersion, "StateCheckpoint",
+        "Checkpoint file '%s' has format version %u which isn't supported.",
+        fileName.c_str(), version);
+    const unsigned byteOrder = in.get<unsigned>();
+    const unsigned realSize  = in.get<unsigned>();
+    SimTK_ERRCHK1_ALWAYS(byteOrder == ByteOrder && realSize == sizeof(Real),
+        "StateCheckpoint", "Checkpoint file '%s' was written on an "
+        "incompatible machine or build.", fileName.c_str());
+    const int g = in.get<int>();
+    SimTK_ERRCHK1_ALWAYS(Stage::Model <= g && g <= Stage::HighestRuntime,
+        "StateCheckpoint", "Checkpoint file '%s' is corrupt.",
+        fileName.c_str());
+    stage = Stage(g);
+    t = in.get<Real>();
+
+    subsystems.resize(in.getCount());
+    for (unsigned i=0; i < subsystems.size(); ++i) {
+        SubsystemRecord& ss = subsystems[i];
+        size_t n;
+        const char* name = in.getString(n);
+        ss.name = String(std::string(name, n));
+        ss.nq = in.getCount(); ss.nu = in.getCount(); ss.nz = in.getCount();
+        ss.y = in.skip(size_t(ss.nq + ss.nu + ss.nz) * sizeof(Real));
+        ss.discreteVars.resize(in.getCount());
+        for (unsigned j=0; j < ss.discreteVars.size(); ++j) {
+            DiscreteVarRecord& dv = ss.discreteVars[j];
+            const char* typeName = in.getString(n);
+            dv.typeName = String(std::string(typeName, n));
+            dv.data = in.getString(dv.nBytes);
+        }
+    }
+}
+
+Real  StateCheckpoint::getTime()  const {return impl->t;}
+Stage StateCheckpoint::getStage() const {return impl->stage;}
+int   StateCheckpoint::getNumSubsystems() const
+{   return (int)impl->subsystems.size(); }
+const String& StateCheckpoint::getSubsystemName(SubsystemIndex subsys) const {
+    SimTK_INDEXCHECK_ALWAYS(subsys, getNumSubsystems(),
+                            "StateCheckpoint::getSubsystemName()");
+    return impl->subsystems[subsys].name;
+}
+
+namespace {
+void getVector(const char*& y, Vector& v) {
+    for (int i=0; i < v.size(); ++i, y += sizeof(Real))
+        std::memcpy(&v[i], y, sizeof(Real));
+}
+}
+
+// We only write to the variable (which invalidates its stage) if it has
+// changed.
+void StateCheckpoint::Impl::restoreDiscreteVar
+   (const DiscreteVarRecord& dv, const String& subsysName, SubsystemIndex sx,
+    DiscreteVariableIndex dx, State& state, Array_<char>& current)
+{
+    const char* method = "StateCheckpoint::restore()";
+    if (dv.typeName.empty())
+        return;
+    const AbstractValue& v = state.getDiscreteVariable(sx, dx);
+    const ValueTypeInfo* info = findValueType(v);
+    SimTK_ERRCHK2_ALWAYS(info && info->typeName == dv.typeName, method,
+        "A discrete variable of subsystem '%s' has type '%s' in the "
+        "checkpoint, which doesn't match the State.",
+        subsysName.c_str(), dv.typeName.c_str());
+    current.clear();
+    info->write(v, current);
+    if (current.size() == dv.nBytes
+        && std::memcmp(current.cbegin(), dv.data, dv.nBytes) == 0)
+        return;
+    const bool ok =
+        info->read(dv.data, dv.nBytes, state.updDiscreteVariable(sx, dx));
+    SimTK_ERRCHK2_ALWAYS(ok, method,
+        "Can't restore a discrete variable of type '%s' in subsystem '%s'.",
+        dv.typeName.c_str(), subsysName.c_str());
+}
+
+void StateCheckpoint::restore(const System& system, State& state) const {
+    const char* method = "StateCheckpoint::restore()";
+    SimTK_STAGECHECK_GE_ALWAYS(state.getSystemStage(), Stage::Topology,
+                               method);
+    const Array_<Impl::SubsystemRecord>& subsystems = impl->subsystems;
+    SimTK_ERRCHK2_ALWAYS(state.getNumSubsystems() == (int)subsystems.size(),
+        method, "The checkpoint has %d subsystems but the State has %d.",
+        (int)subsystems.size(), state.getNumSubsystems());
+    for (SubsystemIndex sx(0); sx < (int)subsystems.size(); ++sx)
+        SimTK_ERRCHK2_ALWAYS(subsystems[sx].name == state.getSubsystemName(sx),
+            method,
+            "Checkpoint subsystem '%s' doesn't match State subsystem '%s'.",
+            subsystems[sx].name.c_str(), state.getSubsystemName(sx).c_str());
+
+    // Discrete variables that affect Model stage go first; they were all
+    // allocated at Topology stage so the State has them already. Realizing
+    // Model stage then allocates the rest, and may reset Instance-stage
+    // values (like locked q's) to their defaults, so those are restored
+    // afterwards.
+    Array_<char> current;
+    for (SubsystemIndex sx(0); sx < (int)subsystems.size(); ++sx) {
+        const Impl::SubsystemRecord& ss = subsystems[sx];
+        const int ndv = std::min((int)ss.discreteVars.size(),
+                                 state.getNumDiscreteVariables(sx));
+        for (DiscreteVariableIndex dx(0); dx < ndv; ++dx)
+            if (state.getDiscreteVarInvalidatesStage(sx, dx) <= Stage::Model)
+                Impl::restoreDiscreteVar(ss.discreteVars[dx], ss.name, sx,
+                                         dx, state, current);
+    }
+
+    system.realizeModel(state);
+
+    for (SubsystemIndex sx(0); sx < (int)subsystems.size(); ++sx) {
+        const Impl::SubsystemRecord& ss = subsystems[sx];
+        SimTK_ERRCHK1_ALWAYS(
+            (int)ss.discreteVars.size()==state.getNumDiscreteVariables(sx),
+            method, "Subsystem '%s' has a different number of discrete "
+            "variables than the checkpoint.", ss.name.c_str());
+        for (DiscreteVariableIndex dx(0); dx < (int)ss.discreteVars.size();
+             ++dx)
+            if (state.getDiscreteVarInvalidatesStage(sx, dx) > Stage::Model)
+                Impl::restoreDiscreteVar(ss.discreteVars[dx], ss.name, sx,
+                                         dx, state, current);
+    }
+
+    state.setTime(impl->t);
+    for (SubsystemIndex sx(0); sx < (int)subsystems.size(); ++sx) {
+        const Impl::SubsystemRecord& ss = subsystems[sx];
+        SimTK_ERRCHK1_ALWAYS(ss.nq == state.getNQ(sx) && ss.nu==state.getNU(sx)
+                             && ss.nz == state.getNZ(sx), method,
+            "Subsystem '%s' has different numbers of continuous variables "
+            "than the checkpoint.", ss.name.c_str());
+        const char* y = ss.y;
+        getVector(y, state.updQ(sx));
+        getVector(y, state.updU(sx));
+        getVector(y, state.updZ(sx));
+    }
+
+    // Leave the State realized exactly as far as the checkpointed one was.
+    system.realize(state, impl->stage);
+    if (state.getSystemStage() > impl->stage)
+        state.invalidateAll(impl->stage.next());
+}
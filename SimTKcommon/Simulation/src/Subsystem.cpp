@@ -200,12 +200,19 @@ Subsystem::Guts* Subsystem::Guts::clone() const {
     return cloneImpl();
 }
 
+// Realization is timed by the containing System's profiler; this is nearly
+// free when the profiler is disabled.
+static const RealizeProfiler& getProfiler(const Subsystem::Guts& guts)
+{   return guts.getSystem().getRealizeProfiler(); }
+
 //------------------------------------------------------------------------------
 //                     REALIZE SUBSYSTEM TOPOLOGY
 //------------------------------------------------------------------------------
 void Subsystem::Guts::realizeSubsystemTopology(State& s) const {
     SimTK_STAGECHECK_EQ_ALWAYS(getStage(s), Stage::Empty, 
         "Subsystem::Guts::realizeSubsystemTopology()");
+    RealizeProfiler::Scope scope(getProfiler(*this), getMySubsystemIndex(),
+                                 Stage::Topology, getName().c_str());
     realizeSubsystemTopologyImpl(s);
 
     // Realize this Subsystem's Measures.
@@ -226,6 +233,8 @@ void Subsystem::Guts::realizeSubsystemModel(State& s) const {
     SimTK_STAGECHECK_GE_ALWAYS(getStage(s), Stage::Topology, 
         "Subsystem::Guts::realizeSubsystemModel()");
     if (getStage(s) < Stage::Model) {
+        RealizeProfiler::Scope scope(getProfiler(*this), getMySubsystemIndex(),
+                                     Stage::Model, getName().c_str());
         realizeSubsystemModelImpl(s);
 
         // Realize this Subsystem's Measures.
@@ -243,6 +252,8 @@ void Subsystem::Guts::realizeSubsystemInstance(const State& s) const {
     SimTK_STAGECHECK_GE_ALWAYS(getStage(s), Stage(Stage::Instance).prev(), 
         "Subsystem::Guts::realizeSubsystemInstance()");
     if (getStage(s) < Stage::Instance) {
+        RealizeProfiler::Scope scope(getProfiler(*this), getMySubsystemIndex(),
+                                     Stage::Instance, getName().c_str());
         realizeSubsystemInstanceImpl(s);
 
         // Realize this Subsystem's Measures.
@@ -260,6 +271,8 @@ void Subsystem::Guts::realizeSubsystemTime(const State& s) const {
     SimTK_STAGECHECK_GE_ALWAYS(getStage(s), Stage(Stage::Time).prev(), 
         "Subsystem::Guts::realizeTime()");
     if (getStage(s) < Stage::Time) {
+        RealizeProfiler::Scope scope(getProfiler(*this), getMySubsystemIndex(),
+                                     Stage::Time, getName().c_str());
         realizeSubsystemTimeImpl(s);
 
         // Realize this Subsystem's Measures.
@@ -277,6 +290,8 @@ void Subsystem::Guts::realizeSubsystemPosition(const State& s) const {
     SimTK_STAGECHECK_GE_ALWAYS(getStage(s), Stage(Stage::Position).prev(), 
         "Subsystem::Guts::realizeSubsystemPosition()");
     if (getStage(s) < Stage::Position) {
+        RealizeProfiler::Scope scope(getProfiler(*this), getMySubsystemIndex(),
+                                     Stage::Position, getName().c_str());
         realizeSubsystemPositionImpl(s);
 
         // Realize this Subsystem's Measures.
@@ -294,6 +309,8 @@ void Subsystem::Guts::realizeSubsystemVelocity(const State& s) const {
     SimTK_STAGECHECK_GE_ALWAYS(getStage(s), Stage(Stage::Velocity).prev(), 
         "Subsystem::Guts::realizeSubsystemVelocity()");
     if (getStage(s) < Stage::Velocity) {
+        RealizeProfiler::Scope scope(getProfiler(*this), getMySubsystemIndex(),
+                                     Stage::Velocity, getName().c_str());
         realizeSubsystemVelocityImpl(s);
 
         // Realize this Subsystem's Measures.
@@ -311,6 +328,8 @@ void Subsystem::Guts::realizeSubsystemDynamics(const State& s) const {
     SimTK_STAGECHECK_GE_ALWAYS(getStage(s), Stage(Stage::Dynamics).prev(), 
         "Subsystem::Guts::realizeSubsystemDynamics()");
     if (getStage(s) < Stage::Dynamics) {
+        RealizeProfiler::Scope scope(getProfiler(*this), getMySubsystemIndex(),
+                                     Stage::Dynamics, getName().c_str());
         realizeSubsystemDynamicsImpl(s);
 
         // Realize this Subsystem's Measures.
@@ -328,6 +347,8 @@ void Subsystem::Guts::realizeSubsystemAcceleration(const State& s) const {
     SimTK_STAGECHECK_GE_ALWAYS(getStage(s), Stage(Stage::Acceleration).prev(), 
         "Subsystem::Guts::realizeSubsystemAcceleration()");
     if (getStage(s) < Stage::Acceleration) {
+        RealizeProfiler::Scope scope(getProfiler(*this), getMySubsystemIndex(),
+                                     Stage::Acceleration, getName().c_str());
         realizeSubsystemAccelerationImpl(s);
 
         // Realize this Subsystem's Measures.
@@ -345,6 +366,8 @@ void Subsystem::Guts::realizeSubsystemReport(const State& s) const {
     SimTK_STAGECHECK_GE_ALWAYS(getStage(s), Stage(Stage::Report).prev(), 
         "Subsystem::Guts::realizeSubsystemReport()");
     if (getStage(s) < Stage::Report) {
+        RealizeProfiler::Scope scope(getProfiler(*this), getMySubsystemIndex(),
+                                     Stage::Report, getName().c_str());
         realizeSubsystemReportImpl(s);
 
         // Realize this Subsystem's Measures.
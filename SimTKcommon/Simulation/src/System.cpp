@@ -112,7 +112,10 @@ System& System::setUseUniformBackground(bool useUniformBackground)
 bool System::getUseUniformBackground() const
 {   return getSystemGuts().getRep().getUseUniformBackground(); }
 
-void System::resetAllCountersToZero() {updSystemGuts().updRep().resetAllCounters();}
+void System::resetAllCountersToZero() {
+    updSystemGuts().updRep().resetAllCounters();
+    updSystemGuts().updRep().realizeProfiler.clear();
+}
 int System::getNumRealizationsOfThisStage(Stage g) const {return getSystemGuts().getRep().nRealizationsOfStage[g];}
 int System::getNumRealizeCalls() const {return getSystemGuts().getRep().nRealizeCalls;}
 
@@ -128,6 +131,15 @@ int System::getNumUProjections() const {return getSystemGuts().getRep().nUProjec
 int System::getNumQErrorEstimateProjections() const {return getSystemGuts().getRep().nQErrEstProjections;}
 int System::getNumUErrorEstimateProjections() const {return getSystemGuts().getRep().nUErrEstProjections;}
 
+void System::setRealizeProfilingEnabled(bool enabled)
+{   updSystemGuts().updRep().realizeProfiler.setEnabled(enabled); }
+bool System::isRealizeProfilingEnabled() const
+{   return getSystemGuts().getRep().realizeProfiler.isEnabled(); }
+const RealizeProfiler& System::getRealizeProfiler() const
+{   return getSystemGuts().getRep().realizeProfiler; }
+RealizeProfiler& System::updRealizeProfiler()
+{   return updSystemGuts().updRep().realizeProfiler; }
+
 int System::getNumHandlerCallsThatChangedStage(Stage g) const {return getSystemGuts().getRep().nHandlerCallsThatChangedStage[g];}
 int System::getNumHandleEventCalls() const {return getSystemGuts().getRep().nHandleEventsCalls;}
 int System::getNumReportEventCalls() const {return getSystemGuts().getRep().nReportEventsCalls;}
@@ -393,6 +405,8 @@ void System::Guts::realizeModel(State& s) const {
         getSystemTopologyCacheVersion(), s.getSystemTopologyStageVersion(),
         "System", getName(), "System::Guts::realizeModel()");
     if (s.getSystemStage() < Stage::Model) {
+        RealizeProfiler::Scope scope(getRep().realizeProfiler, 
+                                     Stage::Model);
         // Allow the subclass to do its processing.
         realizeModelImpl(s);
         // Realize any subsystems that the subclass didn't already take care of.
@@ -415,6 +429,8 @@ void System::Guts::realizeInstance(const State& s) const {
     SimTK_STAGECHECK_GE_ALWAYS(s.getSystemStage(), Stage(Stage::Instance).prev(), 
         "System::Guts::realizeInstance()");
     if (s.getSystemStage() < Stage::Instance) {
+        RealizeProfiler::Scope scope(getRep().realizeProfiler, 
+                                     Stage::Instance);
         realizeInstanceImpl(s);    // take care of the Subsystems
         // Realize any subsystems that the subclass didn't already take care of.
         for (SubsystemIndex i(0); i<getNumSubsystems(); ++i)
@@ -436,6 +452,8 @@ void System::Guts::realizeTime(const State& s) const {
     SimTK_STAGECHECK_GE_ALWAYS(s.getSystemStage(), Stage(Stage::Time).prev(), 
         "System::Guts::realizeTime()");
     if (s.getSystemStage() < Stage::Time) {
+        RealizeProfiler::Scope scope(getRep().realizeProfiler, 
+                                     Stage::Time);
         // Allow the subclass to do processing.
         realizeTimeImpl(s);
         // Realize any subsystems that the subclass didn't already take care of.
@@ -458,6 +476,8 @@ void System::Guts::realizePosition(const State& s) const {
     SimTK_STAGECHECK_GE_ALWAYS(s.getSystemStage(), Stage(Stage::Position).prev(), 
         "System::Guts::realizePosition()");
     if (s.getSystemStage() < Stage::Position) {
+        RealizeProfiler::Scope scope(getRep().realizeProfiler, 
+                                     Stage::Position);
         // Allow the subclass to do processing.
         realizePositionImpl(s);
         // Realize any subsystems that the subclass didn't already take care of.
@@ -480,6 +500,8 @@ void System::Guts::realizeVelocity(const State& s) const {
     SimTK_STAGECHECK_GE_ALWAYS(s.getSystemStage(), Stage(Stage::Velocity).prev(), 
         "System::Guts::realizeVelocity()");
     if (s.getSystemStage() < Stage::Velocity) {
+        RealizeProfiler::Scope scope(getRep().realizeProfiler, 
+                                     Stage::Velocity);
         // Allow the subclass to do processing.
         realizeVelocityImpl(s);
         // Realize any subsystems that the subclass didn't already take care of.
@@ -502,6 +524,8 @@ void System::Guts::realizeDynamics(const State& s) const {
     SimTK_STAGECHECK_GE_ALWAYS(s.getSystemStage(), Stage(Stage::Dynamics).prev(), 
         "System::Guts::realizeDynamics()");
     if (s.getSystemStage() < Stage::Dynamics) {
+        RealizeProfiler::Scope scope(getRep().realizeProfiler, 
+                                     Stage::Dynamics);
         // Allow the subclass to do processing.
         realizeDynamicsImpl(s);
         // Realize any subsystems that the subclass didn't already take care of.
@@ -524,6 +548,8 @@ void System::Guts::realizeAcceleration(const State& s) const {
     SimTK_STAGECHECK_GE_ALWAYS(s.getSystemStage(), Stage(Stage::Acceleration).prev(), 
         "System::Guts::realizeAcceleration()");
     if (s.getSystemStage() < Stage::Acceleration) {
+        RealizeProfiler::Scope scope(getRep().realizeProfiler, 
+                                     Stage::Acceleration);
         // Allow the subclass to do processing.
         realizeAccelerationImpl(s);
         // Realize any subsystems that the subclass didn't already take care of.
@@ -546,6 +572,8 @@ void System::Guts::realizeReport(const State& s) const {
     SimTK_STAGECHECK_GE_ALWAYS(s.getSystemStage(), Stage(Stage::Report).prev(), 
         "System::Guts::realizeReport()");
     if (s.getSystemStage() < Stage::Report) {
+        RealizeProfiler::Scope scope(getRep().realizeProfiler, 
+                                     Stage::Report);
         // Allow the subclass to do processing.
         realizeReportImpl(s);
         // Realize any subsystems that the subclass didn't already take care of.
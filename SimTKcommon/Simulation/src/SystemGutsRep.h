@@ -214,6 +214,9 @@ private:
     mutable int nHandleEventsCalls;
     mutable int nReportEventsCalls;
 
+    // Timing of realize() calls; disabled unless the user asks for it.
+    RealizeProfiler realizeProfiler;
+
     void resetAllCounters() {
         for (int i=0; i<Stage::NValid; ++i)
             nRealizationsOfStage[i] = nHandlerCallsThatChangedStage[i] = 0;
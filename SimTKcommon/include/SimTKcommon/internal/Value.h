@@ -31,6 +31,8 @@
 
 #include <limits>
 #include <typeinfo>
+#include <type_traits>
+#include <new>
 #include <sstream>
 
 namespace SimTK {
@@ -51,6 +53,17 @@ public:
     AbstractValue& operator=(const AbstractValue& v) { compatibleAssign(v); return *this; }
     
     virtual AbstractValue* clone() const = 0;
+
+    /** (Advanced) Return the number of bytes of memory needed for
+    cloneInPlace() to construct a copy of this object, or zero if it can't be
+    copied that way, in which case use clone(). The memory must be aligned on a
+    16-byte boundary. **/
+    virtual size_t getCloneSize() const { return 0; }
+
+    /** (Advanced) Copy construct this object into caller-supplied memory of at
+    least getCloneSize() bytes; see above. The caller is responsible for
+    calling the copy's destructor explicitly and must not delete it. **/
+    virtual AbstractValue* cloneInPlace(void*) const { return 0; }
 };
 
 inline std::ostream& 
@@ -95,6 +108,16 @@ public:
     { return "Value<" + getTypeName() + ">"; }
     
     AbstractValue* clone() const { return new Value(*this); }
+
+    // A class derived from Value<T> would be sliced here so it must provide
+    // these methods itself if it wants them.
+    size_t getCloneSize() const {
+        return typeid(*this) == typeid(Value) 
+               && std::alignment_of<Value>::value <= 16 ? sizeof(Value) : 0;
+    }
+    AbstractValue* cloneInPlace(void* mem) const 
+    {   return new(mem) Value(*this); }
+
     SimTK_DOWNCAST(Value,AbstractValue);
 protected:
     T thing;
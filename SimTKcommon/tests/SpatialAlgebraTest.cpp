@@ -23,6 +23,7 @@
 
 #include "SimTKcommon.h"
 #include "SimTKcommon/Testing.h"
+#include "SpatialKernels.h" // private to the library
 
 using namespace SimTK;
 
@@ -48,6 +49,29 @@ void testPhiMatrix() {
     SimTK_TEST_EQ(m1*~phi, m1*(~phi).toSpatialMat());
 }
 
+// The paired cross product kernel must match the ordinary cross product; 
+// exactly unless fused multiply-add is permitted.
+void testCross2Kernel() {
+    for (int i=0; i < 100; ++i) {
+        const Vec3 a = Test::randVec3(), b = Test::randVec3();
+        const Vec3 c = Test::randVec3(), d = Test::randVec3();
+        Vec3 axb, cxd;
+        Impl::cross2(a, b, c, d, axb, cxd);
+        SimTK_TEST_EQ(axb, a % b);
+        SimTK_TEST_EQ(cxd, c % d);
+        #if SimTK_SPATIAL_KERNELS != 2
+        SimTK_TEST(axb == a % b);
+        SimTK_TEST(cxd == c % d);
+        #endif
+
+        // Arguments can be aliased with results.
+        Vec3 x = a, y = c;
+        Impl::cross2(x, b, y, d, x, y);
+        SimTK_TEST_EQ(x, a % b);
+        SimTK_TEST_EQ(y, c % d);
+    }
+}
+
 // TODO: this isn't a real regression test but it does catch
 // compilation problems.
 void testMiscSpatialAlgebra() {
@@ -183,6 +207,7 @@ int main()
 {
     SimTK_START_TEST("SpatialAlgebraTest");
         SimTK_SUBTEST(testPhiMatrix);
+        SimTK_SUBTEST(testCross2Kernel);
         SimTK_SUBTEST(testMiscSpatialAlgebra);
     SimTK_END_TEST();
 }
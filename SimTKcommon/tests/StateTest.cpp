@@ -176,6 +176,233 @@ void testCacheValidity() {
 
 }
 
+template <class T> static const T&
+getDV(const State& s, SubsystemIndex sx, DiscreteVariableIndex dx)
+{   return Value<T>::downcast(s.getDiscreteVariable(sx, dx)).get(); }
+template <class T> static const T&
+getCE(const State& s, SubsystemIndex sx, CacheEntryIndex cx)
+{   return Value<T>::downcast(s.getCacheEntry(sx, cx)).get(); }
+
+// Values cloned when a State is copied are kept in a per-subsystem arena
+// rather than allocated individually. Make sure copies, assignments, and
+// invalidation all still behave properly with a mix of value types.
+void testCopyValues() {
+    const SubsystemIndex Sub0(0), Sub1(1);
+    State s;
+    s.setNumSubsystems(2);
+
+    const DiscreteVariableIndex dvReal = 
+        s.allocateDiscreteVariable(Sub0, Stage::Position, new Value<Real>(2));
+    const DiscreteVariableIndex dvAuto = 
+        s.allocateAutoUpdateDiscreteVariable(Sub1, Stage::Velocity,
+                                             new Value<Vec3>(Vec3(1,2,3)),
+                                             Stage::Position);
+    const CacheEntryIndex cxString = s.allocateCacheEntry(Sub0, 
+        Stage::Model, Stage::Time, new Value<String>("hello"));
+    const CacheEntryIndex cxVector = s.allocateCacheEntry(Sub1, 
+        Stage::Model, Stage::Time, new Value<Vector>(Vector(5, 3.)));
+
+    for (int g=Stage::Topology; g <= Stage::Model; ++g) {
+        s.advanceSubsystemToStage(Sub0, Stage(g));
+        s.advanceSubsystemToStage(Sub1, Stage(g));
+        s.advanceSystemToStage(Stage(g));
+    }
+    // Allocated at Instance stage.
+    const CacheEntryIndex cxInt = s.allocateLazyCacheEntry(Sub0, 
+        Stage::Instance, new Value<int>(7));
+    s.advanceSubsystemToStage(Sub0, Stage::Instance);
+    s.advanceSubsystemToStage(Sub1, Stage::Instance);
+    s.advanceSystemToStage(Stage::Instance);
+    Value<String>::updDowncast(s.updCacheEntry(Sub0, cxString)) = "there";
+    Value<int>::updDowncast(s.updCacheEntry(Sub0, cxInt)) = 8;
+    s.markCacheValueRealized(Sub0, cxString);
+    s.markCacheValueRealized(Sub1, cxVector);
+    s.markCacheValueRealized(Sub0, cxInt);
+
+    State copy(s);
+    SimTK_TEST(getDV<Real>(copy, Sub0, dvReal) == 2);
+    SimTK_TEST(getCE<String>(copy, Sub0, cxString) == "there");
+    SimTK_TEST(getCE<Vector>(copy, Sub1, cxVector)[4] == 3);
+    SimTK_TEST(getCE<int>(copy, Sub0, cxInt) == 8);
+    SimTK_TEST(&copy.getCacheEntry(Sub0, cxString) 
+               != &s.getCacheEntry(Sub0, cxString));
+
+    // The copy is independent of the original.
+    Value<Real>::updDowncast(copy.updDiscreteVariable(Sub0, dvReal)).upd() = 3;
+    Value<Vector>::updDowncast(copy.updCacheEntry(Sub1, cxVector)).upd()[0] = 4;
+    SimTK_TEST(getDV<Real>(s, Sub0, dvReal) == 2);
+    SimTK_TEST(getCE<Vector>(s, Sub1, cxVector)[0] == 3);
+
+    // Auto-update swaps the discrete variable value with its update cache 
+    // entry.
+    for (int g=Stage::Time; g <= Stage::Position; ++g) {
+        copy.advanceSubsystemToStage(Sub0, Stage(g));
+        copy.advanceSubsystemToStage(Sub1, Stage(g));
+        copy.advanceSystemToStage(Stage(g));
+    }
+    Value<Vec3>::updDowncast(copy.updDiscreteVarUpdateValue(Sub1, dvAuto))
+        = Vec3(4,5,6);
+    copy.markDiscreteVarUpdateValueRealized(Sub1, dvAuto);
+    copy.autoUpdateDiscreteVariables();
+    SimTK_TEST(getDV<Vec3>(copy, Sub1, dvAuto) == Vec3(4,5,6));
+    SimTK_TEST(getDV<Vec3>(s, Sub1, dvAuto) == Vec3(1,2,3));
+
+    // Backing up past Instance stage throws away the Instance-stage entry;
+    // it can then be allocated again.
+    copy.invalidateAll(Stage::Instance);
+    const CacheEntryIndex cxInt2 = copy.allocateLazyCacheEntry(Sub0, 
+        Stage::Instance, new Value<int>(9));
+    SimTK_TEST(cxInt2 == cxInt);
+
+    // Copy again over the copy.
+    copy = s;
+    SimTK_TEST(getDV<Real>(copy, Sub0, dvReal) == 2);
+    SimTK_TEST(getDV<Vec3>(copy, Sub1, dvAuto) == Vec3(1,2,3));
+    SimTK_TEST(getCE<int>(copy, Sub0, cxInt) == 8);
+
+    // And a copy of a copy.
+    State copy2(copy);
+    SimTK_TEST(getCE<Vector>(copy2, Sub1, cxVector)[4] == 3);
+}
+
+// Values are copied in place using this AbstractValue method.
+void testCloneInPlace() {
+    const Value<Vec3> v(Vec3(1,2,3));
+    const AbstractValue& av = v;
+    SimTK_TEST(av.getCloneSize() == sizeof(Value<Vec3>));
+    double mem[8];
+    AbstractValue* p = av.cloneInPlace(mem);
+    SimTK_TEST((void*)p == (void*)mem);
+    SimTK_TEST(Value<Vec3>::downcast(*p).get() == Vec3(1,2,3));
+    p->~AbstractValue();
+}
+
+// Advance all the subsystems and then the system through stage g, as
+// realize() would.
+static void realizeStateTo(const State& s, Stage g) {
+    for (Stage k = s.getSystemStage().next(); k <= g; k = k.next()) {
+        for (SubsystemIndex i(0); i < s.getNumSubsystems(); ++i)
+            s.advanceSubsystemToStage(i, k);
+        s.advanceSystemToStage(k);
+    }
+}
+
+// In copy-on-write mode a copy shares the source's contents, including the
+// cache, until one of them is written.
+void testCopyOnWrite() {
+    const SubsystemIndex Sub0(0), Sub1(1);
+    State s;
+    s.setNumSubsystems(2);
+    s.allocateQ(Sub0, Vector(2, 1.));
+    s.allocateU(Sub1, Vector(3, 2.));
+    const CacheEntryIndex cx = s.allocateCacheEntry(Sub0,
+        Stage::Position, Stage::Dynamics, new Value<Real>(0));
+
+    s.setUseCopyOnWrite(true);
+    SimTK_TEST(s.getUseCopyOnWrite());
+    realizeStateTo(s, Stage::Position);
+    Value<Real>::updDowncast(s.updCacheEntry(Sub0, cx)) = 2*s.getQ()[0];
+    s.markCacheValueRealized(Sub0, cx);
+
+    // The copy refers to the same contents and is realized just as far.
+    State snap(s);
+    SimTK_TEST(snap.getUseCopyOnWrite());
+    SimTK_TEST(&snap.getQ()[0] == &s.getQ()[0]);
+    SimTK_TEST(snap.getSystemStage() == Stage::Position);
+    SimTK_TEST(Value<Real>::downcast(snap.getCacheEntry(Sub0, cx)).get() == 2);
+
+    // Writing to the original gives it a private copy; the snapshot is
+    // unaffected.
+    s.updQ()[0] = 3;
+    SimTK_TEST(&snap.getQ()[0] != &s.getQ()[0]);
+    SimTK_TEST(s.getSystemStage() == Stage::Time);
+    SimTK_TEST(s.getQ()[0] == 3);
+    SimTK_TEST(snap.getSystemStage() == Stage::Position);
+    SimTK_TEST(snap.getQ()[0] == 1);
+    SimTK_TEST(Value<Real>::downcast(snap.getCacheEntry(Sub0, cx)).get() == 2);
+
+    // Realizing writes too. The private copy keeps the realization and cache.
+    State snap2(snap);
+    SimTK_TEST(&snap2.getQ()[0] == &snap.getQ()[0]);
+    realizeStateTo(snap2, Stage::Velocity);
+    SimTK_TEST(&snap2.getQ()[0] != &snap.getQ()[0]);
+    SimTK_TEST(snap2.getSystemStage() == Stage::Velocity);
+    SimTK_TEST(snap.getSystemStage() == Stage::Position);
+    SimTK_TEST(snap2.getU()[2] == 2);
+    SimTK_TEST(Value<Real>::downcast(snap2.getCacheEntry(Sub0, cx)).get()
+               == 2);
+
+    // Rolling back is just an assignment.
+    s = snap;
+    SimTK_TEST(&s.getQ()[0] == &snap.getQ()[0]);
+    SimTK_TEST(s.getQ()[0] == 1 && s.getSystemStage() == Stage::Position);
+
+    // Copies from a State that isn't in copy-on-write mode are ordinary
+    // ones, even into a State that is sharing its contents.
+    // Leaving copy-on-write mode stops the sharing right away.
+    State plain(s);
+    plain.setUseCopyOnWrite(false);
+    SimTK_TEST(&plain.getQ()[0] != &s.getQ()[0]);
+    SimTK_TEST(plain.getSystemStage() == Stage::Position);
+    State deep(plain);
+    SimTK_TEST(!deep.getUseCopyOnWrite());
+    SimTK_TEST(&deep.getQ()[0] != &plain.getQ()[0]);
+    SimTK_TEST(deep.getSystemStage() == Stage::Instance);
+    s = plain;
+    SimTK_TEST(&s.getQ()[0] != &plain.getQ()[0]);
+    SimTK_TEST(s.getSystemStage() == Stage::Instance);
+    SimTK_TEST(snap.getSystemStage() == Stage::Position);
+    SimTK_TEST(plain.getSystemStage() == Stage::Position);
+}
+
+// Assigning to a State that already has the same variables and cache entries
+// as the source copies values into the existing storage.
+void testAssignInPlace() {
+    const SubsystemIndex Sub0(0), Sub1(1);
+    State s;
+    s.setNumSubsystems(2);
+    s.allocateQ(Sub0, Vector(2, 1.));
+    s.allocateU(Sub1, Vector(3, 2.));
+    const DiscreteVariableIndex dx = s.allocateDiscreteVariable(Sub1,
+        Stage::Position, new Value<int>(5));
+    const CacheEntryIndex cx = s.allocateCacheEntry(Sub0,
+        Stage::Position, Stage::Dynamics, new Value<Real>(0));
+    realizeStateTo(s, Stage::Position);
+    Value<Real>::updDowncast(s.updCacheEntry(Sub0, cx)) = 2*s.getQ()[0];
+    s.markCacheValueRealized(Sub0, cx);
+
+    State other(s);
+    realizeStateTo(other, Stage::Velocity);
+    const Real* q = &other.getQ()[0];
+    const AbstractValue* dv = &other.getDiscreteVariable(Sub1, dx);
+
+    s.updQ()[1] = 7; s.setTime(3);
+    Value<int>::updDowncast(s.updDiscreteVariable(Sub1, dx)) = 6;
+    realizeStateTo(s, Stage::Position);
+    Value<Real>::updDowncast(s.updCacheEntry(Sub0, cx)) = 4;
+    s.markCacheValueRealized(Sub0, cx);
+
+    other = s;
+    SimTK_TEST(&other.getQ()[0] == q);
+    SimTK_TEST(&other.getDiscreteVariable(Sub1, dx) == dv);
+    SimTK_TEST(other.getSystemStage() == Stage::Instance);
+    SimTK_TEST(other.getQ()[1] == 7 && other.getTime() == 3);
+    SimTK_TEST(Value<int>::downcast(other.getDiscreteVariable(Sub1, dx)) == 6);
+    // Cache entries beyond Instance stage are invalid, just as they are
+    // after an ordinary copy.
+    realizeStateTo(other, Stage::Position);
+    SimTK_TEST(!other.isCacheValueRealized(Sub0, cx));
+
+    // A State with different variables is rebuilt as before.
+    State different;
+    different.setNumSubsystems(2);
+    different.allocateQ(Sub0, Vector(4, 1.));
+    realizeStateTo(different, Stage::Velocity);
+    different = s;
+    SimTK_TEST(different.getNQ() == 2 && different.getQ()[1] == 7);
+    SimTK_TEST(different.getSystemStage() == Stage::Instance);
+}
+
 void testMisc() {
     State s;
     s.setNumSubsystems(1);
@@ -253,5 +480,9 @@ int main() {
         //SimTK_SUBTEST(testLowestModified);
         SimTK_SUBTEST(testCacheValidity);
         SimTK_SUBTEST(testMisc);
+        SimTK_SUBTEST(testCopyOnWrite);
+        SimTK_SUBTEST(testAssignInPlace);
+        SimTK_SUBTEST(testCopyValues);
+        SimTK_SUBTEST(testCloneInPlace);
     SimTK_END_TEST();
 }
@@ -326,6 +326,52 @@ void testArticulatedInertia() {
     SimTK_TEST_EQ(abi.shiftInPlace(-shiftVec).toSpatialMat(), mabi);
 }
 
+// In double precision the articulated inertia shift uses the SIMD kernel
+// from SpatialKernels.h. Unless fused multiply-add is permitted it must give
+// exactly the same answer as the scalar formula.
+void testArticulatedInertiaShiftKernel() {
+    for (int i=0; i < 100; ++i) {
+        const SymMat33 M = Test::randSymMat33();
+        const Mat33    F = Test::randMat33();
+        const SymMat33 J = Test::randSymMat33();
+        const Vec3     s = Test::randVec3();
+        const ArticulatedInertia abi(M, F, J);
+        const ArticulatedInertia shifted = abi.shift(s);
+        ArticulatedInertia inPlace(abi);
+        inPlace.shiftInPlace(s);
+
+        const Mat33    Fp = F + s % M;
+        const SymMat33 Jp = J + halfCrossDiff(s, ~F, Fp);
+        SimTK_TEST(shifted.getMass() == M);
+        SimTK_TEST_EQ(shifted.getMassMoment(), Fp);
+        SimTK_TEST_EQ(shifted.getInertia(), Jp);
+        #if SimTK_SPATIAL_KERNELS != 2
+        SimTK_TEST(shifted.getMassMoment() == Fp);
+        SimTK_TEST(shifted.getInertia() == Jp);
+        SimTK_TEST(inPlace.getMassMoment() == Fp);
+        SimTK_TEST(inPlace.getInertia() == Jp);
+        #endif
+    }
+}
+
+// Shifting a spatial inertia to a new origin must account for the center of
+// mass location; compare with the equivalent rigid body shift matrix.
+void testSpatialInertia() {
+    const Real mass = 1.7;
+    const Vec3 com = Test::randVec3();
+    const UnitInertia centralG(1.2, 1.1, 1.3, .01, -.02, .03);
+    const SpatialInertia M(mass, com, centralG.shiftFromCentroid(com));
+
+    const Vec3 shiftVec = Test::randVec3();
+    const PhiMatrix phi(-shiftVec);
+    const SpatialMat mShiftedByPhi = phi*M.toSpatialMat()*~phi;
+
+    const SpatialInertia shiftM = M.shift(shiftVec);
+    SimTK_TEST_EQ(shiftM.getMassCenter(), com - shiftVec);
+    SimTK_TEST_EQ(shiftM.toSpatialMat(), mShiftedByPhi);
+    SimTK_TEST_EQ(shiftM.shift(-shiftVec).toSpatialMat(), M.toSpatialMat());
+}
+
 void testManualABIShift(const ArticulatedInertia& abi, const Array_<Vec3>& shifts, Real& out) {
     SpatialMat mabi = abi.toSpatialMat();
 
@@ -368,6 +414,8 @@ int main() {
         SimTK_SUBTEST(testInertia);
         SimTK_SUBTEST(testHalfCross);
         SimTK_SUBTEST(testArticulatedInertia);
+        SimTK_SUBTEST(testArticulatedInertiaShiftKernel);
+        SimTK_SUBTEST(testSpatialInertia);
 
         // Speed tests.
         shifts.resize(NSHIFTS);
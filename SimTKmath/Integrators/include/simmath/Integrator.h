@@ -111,6 +111,16 @@ constraint errors. Given an accuracy specification (like 0.1%), the integrators
 here are expected to solve for y(t) such that the local error 
 |W*yerr|_RMS <= accuracy, and |T*c(t,y)|_RMS <= accuracy at all times.
 
+<h3>Memory allocation</h3>
+
+The explicit Runge-Kutta integrators (RungeKutta2, RungeKutta3, 
+RungeKuttaMerson, and RungeKuttaFeldberg) keep their workspace between steps. 
+Once the first few steps have sized it, further calls to stepTo() or stepBy() 
+make no heap allocations as long as the System's topology and Instance-stage 
+variables don't change, and no element of the System allocates on its own 
+(for example, a System with constraints, or one with contact, may still 
+allocate).
+
 TODO: isolation tolerances for witnesses; dealing with simultaneity.
 **/
 class SimTK_SIMMATH_EXPORT Integrator {
@@ -528,7 +528,7 @@ bool AbstractIntegratorRep::takeOneStep(Real tMax, Real tReport)
               nz = advanced.getNZ(), 
               ny = nq+nu+nz;
     
-    Vector yErrEst(ny);
+    yErrEst.resize(ny);
     bool stepSucceeded = false;
     do {
         // If we lose more than a small fraction of the step size we wanted
@@ -309,7 +309,11 @@ public:
         const Real cy1 = d*d*(3-2*d), cy0 = 1-cy1;
         const Real hdd1 = h*d*(d-1), cf1=hdd1*d, cf0=cf1-hdd1;
 
-        yt = cy0*y0 + cy1*y1 + cf0*f0 + cf1*f1; // + O(h^4)
+        // Written as a loop rather than a Vector expression so that no
+        // temporaries are allocated.
+        yt.resize(y0.size());
+        for (int i=0; i < y0.size(); ++i)
+            yt[i] = cy0*y0[i] + cy1*y1[i] + cf0*f0[i] + cf1*f1[i]; // + O(h^4)
     }
 
     // We have bracketed a zero crossing for some function f(t)
@@ -454,22 +458,21 @@ public:
     Real calcErrorNorm(const State& s, const Vector& yErrEst, 
                        int& worstY) const {
         const int nq=s.getNQ(), nu=s.getNU(), nz=s.getNZ();
+        // Copy the parts rather than making views; views are allocated on
+        // the heap and this is done every step.
+        copyPart(yErrEst, 0,     nq, errEstQ);
+        copyPart(yErrEst, nq,    nu, errEstU);
+        copyPart(yErrEst, nq+nu, nz, errEstZ);
         int worstQ, worstU, worstZ;
         Real qNorm, uNorm, zNorm, maxNorm;
         if (userUseInfinityNorm == 1) {
-            qNorm = calcWeightedInfNormQ(s, s.getUWeights(), yErrEst(0,nq),
-                                         worstQ);
-            uNorm = calcWeightedInfNorm(getPreviousUScale(), yErrEst(nq,nu),
-                                        worstU);
-            zNorm = calcWeightedInfNorm(getPreviousZScale(), yErrEst(nq+nu,nz),
-                                        worstZ);
+            qNorm = calcWeightedInfNormQ(s, s.getUWeights(), errEstQ, worstQ);
+            uNorm = calcWeightedInfNorm(getPreviousUScale(), errEstU, worstU);
+            zNorm = calcWeightedInfNorm(getPreviousZScale(), errEstZ, worstZ);
         } else {
-            qNorm = calcWeightedRMSNormQ(s, s.getUWeights(), yErrEst(0,nq),
-                                         worstQ);
-            uNorm = calcWeightedRMSNorm(getPreviousUScale(), yErrEst(nq,nu),
-                                        worstU);
-            zNorm = calcWeightedRMSNorm(getPreviousZScale(), yErrEst(nq+nu,nz),
-                                        worstZ);
+            qNorm = calcWeightedRMSNormQ(s, s.getUWeights(), errEstQ, worstQ);
+            uNorm = calcWeightedRMSNorm(getPreviousUScale(), errEstU, worstU);
+            zNorm = calcWeightedRMSNorm(getPreviousZScale(), errEstZ, worstZ);
         }
 
         // Find the largest of the three norms and report the corresponding
@@ -507,28 +510,32 @@ public:
         assert(Wu.size() == nu);
         dqw.resize(nq);
         if (nq==0) return;
-        Vector du(nu);
-        system.multiplyByNPInv(state, dq, du);
-        du.rowScaleInPlace(Wu);
-        system.multiplyByN(state, du, dqw);
+        duWork.resize(nu);
+        system.multiplyByNPInv(state, dq, duWork);
+        for (int i=0; i < nu; ++i) // rowScaleInPlace() would make views
+            duWork[i] *= Wu[i];
+        system.multiplyByN(state, duWork, dqw);
     }
     // Calculate |Wq*dq|_RMS=|N*Wu*pinv(N)*dq|_RMS
     Real calcWeightedRMSNormQ(const State& state, const Vector& Wu,
                               const Vector& dq, int& worstQ) const
     {
-        const int nq = state.getNQ();
-        Vector dqw(nq);
-        scaleDQ(state, Wu, dq, dqw);
-        return dqw.normRMS(&worstQ);
+        scaleDQ(state, Wu, dq, dqwWork);
+        return dqwWork.normRMS(&worstQ);
     }
     // Calculate |Wq*dq|_Inf=|N*Wu*pinv(N)*dq|_Inf
     Real calcWeightedInfNormQ(const State& state, const Vector& Wu,
                               const Vector& dq, int& worstQ) const
     {
-        const int nq = state.getNQ();
-        Vector dqw(nq);
-        scaleDQ(state, Wu, dq, dqw);
-        return dqw.normInf(&worstQ);
+        scaleDQ(state, Wu, dq, dqwWork);
+        return dqwWork.normInf(&worstQ);
+    }
+
+    // Copy v(start,n) into part, which is resized only if necessary.
+    static void copyPart(const Vector& v, int start, int n, Vector& part) {
+        part.resize(n);
+        for (int i=0; i < n; ++i)
+            part[i] = v[start+i];
     }
 
     // TODO: these utilities don't really belong here
@@ -661,13 +668,19 @@ protected:
     // values. This scaling is frozen during a step attempt.
     void saveTimeAndStateAsPrevious(const State& s) {
         const int nq = s.getNQ(), nu = s.getNU(), nz = s.getNZ();
+        const bool sameLayout = yPrev.size() == s.getNY() 
+            && qPrev.size() == nq && uPrev.size() == nu && zPrev.size() == nz;
 
         tPrev        = s.getTime();
 
+        // If the sizes haven't changed yPrev is copied in place and the
+        // existing views are still good.
         yPrev        = s.getY();
-        qPrev.viewAssign(yPrev(0,     nq));
-        uPrev.viewAssign(yPrev(nq,    nu));
-        zPrev.viewAssign(yPrev(nq+nu, nz));
+        if (!sameLayout) {
+            qPrev.viewAssign(yPrev(0,     nq));
+            uPrev.viewAssign(yPrev(nq,    nu));
+            zPrev.viewAssign(yPrev(nq+nu, nz));
+        }
 
         calcRelativeScaling(s.getU(), s.getUWeights(), uScalePrev); 
         calcRelativeScaling(s.getZ(), s.getZWeights(), zScalePrev);
@@ -680,11 +693,16 @@ protected:
     // be realized through Acceleration stage.
     void saveStateDerivsAsPrevious(const State& s) {
         const int nq = s.getNQ(), nu = s.getNU(), nz = s.getNZ();
+        const bool sameLayout = ydotPrev.size() == s.getNY() 
+            && qdotPrev.size() == nq && udotPrev.size() == nu 
+            && zdotPrev.size() == nz;
 
         ydotPrev     = s.getYDot();
-        qdotPrev.viewAssign(ydotPrev(0,     nq));
-        udotPrev.viewAssign(ydotPrev(nq,    nu));
-        zdotPrev.viewAssign(ydotPrev(nq+nu, nz));
+        if (!sameLayout) {
+            qdotPrev.viewAssign(ydotPrev(0,     nq));
+            udotPrev.viewAssign(ydotPrev(nq,    nu));
+            zdotPrev.viewAssign(ydotPrev(nq+nu, nz));
+        }
 
         qdotdotPrev  = s.getQDotDot();
         triggersPrev = s.getEventTriggers();
@@ -760,6 +778,16 @@ protected:
         }
     }
 
+    // Return a view of yErrEst(start,n), reusing the given view if it
+    // already refers to that part of yErrEst.
+    static Vector& updErrEstPart(Vector& yErrEst, int start, int n, 
+                                 Vector& view) {
+        if (!(view.size() == n && n > 0 && view.getContiguousScalarData() 
+              == yErrEst.getContiguousScalarData() + start))
+            view.viewAssign(yErrEst(start, n));
+        return view;
+    }
+
     // State should have had its q's prescribed and realized through Position
     // stage. This will attempt to project q's and the q part of the yErrEst
     // (if yErrEst is not length zero). Returns false if we fail which you
@@ -787,8 +815,9 @@ protected:
         // Nothing happens here if position constraints were already satisfied
         // unless we set the ForceProjection option above.
         if (yErrEst.size()) {
-            VectorView qErrEst = yErrEst(0, s.getNQ());
-            getSystem().projectQ(s, qErrEst, options, results);
+            getSystem().projectQ(s, updErrEstPart(yErrEst, 0, s.getNQ(), 
+                                                  qErrEstView),
+                                 options, results);
         } else {
             getSystem().projectQ(s, yErrEst, options, results);
         }
@@ -830,8 +859,9 @@ protected:
         // Nothing happens here if velocity constraints were already satisfied
         // unless we set the ForceProjection option above.
         if (yErrEst.size()) {
-            VectorView uErrEst = yErrEst(s.getNQ(), s.getNU());
-            getSystem().projectU(s, uErrEst, options, results);
+            getSystem().projectU(s, updErrEstPart(yErrEst, s.getNQ(), 
+                                                  s.getNU(), uErrEstView),
+                                 options, results);
         } else {
             getSystem().projectU(s, yErrEst, options, results);
         }
@@ -877,10 +907,9 @@ protected:
         system.prescribeQ(s);
         system.realize(s, Stage::Position);
 
-        Vector dummy; // no error estimate to project
         ProjectResults results;
         ++statsQProjectionFailures; // assume failure, then fix if no throw
-        system.projectQ(s, dummy, options, results);
+        system.projectQ(s, noErrEst, options, results);
         --statsQProjectionFailures; // false alarm -- it succeeded
         if (results.getAnyChangeMade())
             ++statsQProjections;
@@ -890,7 +919,7 @@ protected:
 
         results.clear();
         ++statsUProjectionFailures; // assume failure, then fix if no throw
-        system.projectU(s, dummy, options, results);
+        system.projectU(s, noErrEst, options, results);
         --statsUProjectionFailures; // false alarm -- it succeeded
         if (results.getAnyChangeMade())
             ++statsUProjections;
@@ -1109,6 +1138,15 @@ private:
     Vector qPrev, uPrev, zPrev;
     Vector qdotPrev, udotPrev, zdotPrev;
 
+    // Workspace kept here so that taking a step doesn't have to allocate
+    // heap memory once these have been sized. qErrEstView and uErrEstView
+    // are views into the most recently projected error estimate; 
+    // noErrEst is always empty.
+    mutable Vector errEstQ, errEstU, errEstZ;
+    mutable Vector duWork, dqwWork;
+    Vector qErrEstView, uErrEstView;
+    Vector noErrEst;
+
     // We'll leave the various arrays above sized as they are and full
     // of garbage. They'll be resized when first assigned to something
     // meaningful.
@@ -110,45 +110,57 @@ bool RungeKuttaFeldbergIntegratorRep::attemptODEStep
     if (ytmp[0].size() != y0.size())
         for (int i=0; i<NTemps; ++i)
             ytmp[i].resize(y0.size());
-    Vector& ysave = ytmp[0]; // rename temps
-    Vector& fa    = ytmp[1];
-    Vector& fb    = ytmp[2];
+    const Vector& f1 = ytmp[0]; // rename temps
+    const Vector& f2 = ytmp[1];
+    const Vector& f3 = ytmp[2];
+    const Vector& f4 = ytmp[3];
+    const Vector& f5 = ytmp[4];
+    Vector&       y  = ytmp[5]; // stage values
 
     const Real h = t1-t0;
+    const int  ny = y0.size();
 
-    // Calculate the intermediate states.
+    // Calculate the intermediate states. These are done with loops rather
+    // than Vector expressions so that no temporaries are allocated.
     
-    setAdvancedStateAndRealizeDerivatives(t0 + h*C21, 
-        y0 + h*C22*f0);
+    for (int i=0; i<ny; ++i) 
+        y[i] = y0[i] + h*C22*f0[i];
+    setAdvancedStateAndRealizeDerivatives(t0 + h*C21, y);
     ytmp[0] = getAdvancedState().getYDot();
 
-    setAdvancedStateAndRealizeDerivatives(t0 + h*C31, 
-        y0 + h*C32*f0 + h*C33*ytmp[0]);
+    for (int i=0; i<ny; ++i) 
+        y[i] = y0[i] + h*(C32*f0[i] + C33*f1[i]);
+    setAdvancedStateAndRealizeDerivatives(t0 + h*C31, y);
     ytmp[1] = getAdvancedState().getYDot();
 
-    setAdvancedStateAndRealizeDerivatives(t0 + h*C41, 
-        y0 + h*C42*f0 + h*C43*ytmp[0] + h*C44*ytmp[1]);
+    for (int i=0; i<ny; ++i) 
+        y[i] = y0[i] + h*(C42*f0[i] + C43*f1[i] + C44*f2[i]);
+    setAdvancedStateAndRealizeDerivatives(t0 + h*C41, y);
     ytmp[2] = getAdvancedState().getYDot();
 
-    setAdvancedStateAndRealizeDerivatives(t0 + h*C51, 
-        y0 + h*C52*f0 + h*C53*ytmp[0] + h*C54*ytmp[1] + h*C55*ytmp[2]);
+    for (int i=0; i<ny; ++i) 
+        y[i] = y0[i] + h*(C52*f0[i] + C53*f1[i] + C54*f2[i] + C55*f3[i]);
+    setAdvancedStateAndRealizeDerivatives(t0 + h*C51, y);
     ytmp[3] = getAdvancedState().getYDot();
 
-    setAdvancedStateAndRealizeDerivatives(t0 + h*C61, 
-        y0 + h*C62*f0 + h*C63*ytmp[0] + h*C64*ytmp[1] + h*C65*ytmp[2] 
-           + h*C66*ytmp[3]);
+    for (int i=0; i<ny; ++i) 
+        y[i] = y0[i] + h*(C62*f0[i] + C63*f1[i] + C64*f2[i] + C65*f3[i] 
+                          + C66*f4[i]);
+    setAdvancedStateAndRealizeDerivatives(t0 + h*C61, y);
     ytmp[4] = getAdvancedState().getYDot();
     
     // Calculate the final state but don't evaluate the derivatives. That
     // would be a wasted stage since the caller will muck with the state before
     // the end of the step.
-    setAdvancedStateAndRealizeKinematics(t1, 
-        y0 + h*CY1*f0 + h*CY2*ytmp[1] + h*CY3*ytmp[2] + h*CY4*ytmp[3]);
+    for (int i=0; i<ny; ++i) 
+        y[i] = y0[i] + h*(CY1*f0[i] + CY2*f2[i] + CY3*f3[i] + CY4*f4[i]);
+    setAdvancedStateAndRealizeKinematics(t1, y);
     // YErr is valid now, but not YDot.
     
     // Calculate the error estimate.
-    y1err = h*CE1*f0 + h*CE2*ytmp[1] + h*CE3*ytmp[2] + h*CE4*ytmp[3] 
-                     + h*CE5*ytmp[4];
+    for (int i=0; i<ny; ++i) 
+        y1err[i] = h*(CE1*f0[i] + CE2*f2[i] + CE3*f3[i] + CE4*f4[i] 
+                      + CE5*f5[i]);
 
     return true;
 }
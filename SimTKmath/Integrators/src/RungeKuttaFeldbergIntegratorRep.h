@@ -41,7 +41,7 @@ protected:
     bool attemptODEStep
        (Real t1, Vector& yErrEst, int& errOrder, int& numIterations);
 private:    
-    static const int NTemps = 5;
+    static const int NTemps = 6;
     Vector ytmp[NTemps];
 };
 
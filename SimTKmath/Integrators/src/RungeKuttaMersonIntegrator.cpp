@@ -99,20 +99,29 @@ bool RungeKuttaMersonIntegratorRep::attemptODEStep
     Vector& ysave = ytmp[0]; // rename temps
     Vector& fa    = ytmp[1];
     Vector& fb    = ytmp[2];
+    Vector& y     = ytmp[3]; // stage values
 
     const Real h = t1-t0;
+    const int  ny = y0.size();
 
-    setAdvancedStateAndRealizeDerivatives(t0+h/3, y0 + (h/3)*f0);
+    // The stage values are calculated with loops rather than Vector 
+    // expressions so that no temporaries are allocated.
+
+    for (int i=0; i<ny; ++i) y[i] = y0[i] + (h/3)*f0[i];
+    setAdvancedStateAndRealizeDerivatives(t0+h/3, y);
     fa = getAdvancedState().getYDot(); // fa=f1
 
-    setAdvancedStateAndRealizeDerivatives(t0+h/3, y0 + (h/6)*(f0+fa)); // f0+f1
+    for (int i=0; i<ny; ++i) y[i] = y0[i] + (h/6)*(f0[i]+fa[i]); // f0+f1
+    setAdvancedStateAndRealizeDerivatives(t0+h/3, y);
     fa = getAdvancedState().getYDot(); // fa=f2
 
-    setAdvancedStateAndRealizeDerivatives(t0+h/2, y0 + (h/8)*(f0 + 3*fa)); // f0+3f2
+    for (int i=0; i<ny; ++i) y[i] = y0[i] + (h/8)*(f0[i] + 3*fa[i]); // f0+3f2
+    setAdvancedStateAndRealizeDerivatives(t0+h/2, y);
     fb = getAdvancedState().getYDot(); // fb=f3
 
     // We'll need this for error estimation.
-    ysave = y0 + (h/2)*(f0 - 3*fa + 4*fb); // f0-3f2+4f3
+    for (int i=0; i<ny; ++i) // f0-3f2+4f3
+        ysave[i] = y0[i] + (h/2)*(f0[i] - 3*fa[i] + 4*fb[i]);
     setAdvancedStateAndRealizeDerivatives(t1, ysave);
     fa = getAdvancedState().getYDot(); // fa=f4
 
@@ -121,7 +130,8 @@ bool RungeKuttaMersonIntegratorRep::attemptODEStep
     // Evaluate through kinematics only; it is a waste of a stage to 
     // evaluate derivatives here since the caller will muck with this before
     // the end of the step.
-    setAdvancedStateAndRealizeKinematics(t1, y0 + (h/6)*(f0 + 4*fb + fa));
+    for (int i=0; i<ny; ++i) y[i] = y0[i] + (h/6)*(f0[i] + 4*fb[i] + fa[i]);
+    setAdvancedStateAndRealizeKinematics(t1, y);
     // YErr is valid now
 
     // This is an embedded 3rd-order estimate y1hat=y(t0+h)+O(h^4). (Apparently
@@ -71,7 +71,10 @@ FactorQTZ::FactorQTZ( const FactorQTZ& c ) {
 }
 // copy assignment operator
 FactorQTZ& FactorQTZ::operator=(const FactorQTZ& rhs) {
-    rep = rhs.rep->clone();
+    if (&rhs != this) {
+        delete rep;
+        rep = rhs.rep->clone();
+    }
     return *this;
 }
 
@@ -79,23 +82,33 @@ template <typename ELT>
 void FactorQTZ::inverse( Matrix_<ELT>& inverse ) const {
     rep->inverse( inverse );
 }
+// If the current rep was made for the same element type, refactor in place
+// so that its storage gets reused; otherwise replace it.
+template < class ELT, class RC >
+static void factorIntoRep( FactorQTZRepBase*& rep, const Matrix_<ELT>& m, 
+                           RC rcond ){
+    typedef FactorQTZRep<typename CNT<ELT>::StdNumber> Rep;
+    if (Rep* same = dynamic_cast<Rep*>(rep)) {
+        same->refactor(m, rcond);
+        return;
+    }
+    delete rep;
+    rep = new Rep(m, rcond);
+}
+
 template < class ELT >
 void FactorQTZ::factor( const Matrix_<ELT>& m ){
-    delete rep;
-  
     // if user does not supply rcond set it to max(nRow,nCol)*(eps)^7/8 (similar to matlab)
     int mnmax = (m.nrow() > m.ncol()) ? m.nrow() : m.ncol();
-    rep = new FactorQTZRep<typename CNT<ELT>::StdNumber>(m, mnmax*NTraits<typename CNT<ELT>::Precision>::getSignificant());
+    factorIntoRep(rep, m, mnmax*NTraits<typename CNT<ELT>::Precision>::getSignificant());
 }
 template < class ELT >
 void FactorQTZ::factor( const Matrix_<ELT>& m, double rcond ){
-    delete rep;
-    rep = new FactorQTZRep<typename CNT<ELT>::StdNumber>(m, rcond );
+    factorIntoRep(rep, m, rcond);
 }
 template < class ELT >
 void FactorQTZ::factor( const Matrix_<ELT>& m, float rcond ){
-    delete rep;
-    rep = new FactorQTZRep<typename CNT<ELT>::StdNumber>(m, rcond );
+    factorIntoRep(rep, m, rcond);
 }
 template < class ELT >
 FactorQTZ::FactorQTZ( const Matrix_<ELT>& m ) {
@@ -177,6 +190,36 @@ FactorQTZRepBase* FactorQTZRep<T>::clone() const {
    return( new FactorQTZRep<T>(*this) );
 }
 
+// Grow a work space if it is too small; LAPACK is happy with extra room.
+template <typename T>
+static void growWorkSpace( TypedWorkSpace<T>& ws, int n ) {
+    if (ws.size < n) ws.resize(n);
+}
+
+template <typename T >
+    template < typename ELT >
+void FactorQTZRep<T>::refactor( const Matrix_<ELT>& mat, 
+                                typename CNT<T>::TReal rc ) {
+    nRow  = mat.nrow();
+    nCol  = mat.ncol();
+    mn    = std::min(nRow, nCol);
+    maxmn = std::max(nRow, nCol);
+    rcond = rc;
+    scaleLinSys = false;
+    isFactored = false;
+    rank = 0;
+    actualRCond = 0;
+
+    growWorkSpace(pivots, nCol);
+    growWorkSpace(qtz, nRow*nCol);
+    growWorkSpace(tauGEQP3, mn);
+    growWorkSpace(tauORMQR, mn);
+    for(int i=0; i<nCol; ++i) 
+        pivots.data[i] = 0;
+    FactorQTZRep<T>::factor( mat );
+    isFactored = true;
+}
+
 template <typename T >
 FactorQTZRep<T>::~FactorQTZRep() {}
 
@@ -191,14 +234,16 @@ void FactorQTZRep<T>::solve( const Vector_<T>& b, Vector_<T> &x ) const {
         b.size(), nRow );
 
 
-    Matrix_<T> m(maxmn,1);
-
+    solveRHS.resize(maxmn,1);
     for(int i=0;i<b.size();i++) {
-        m(i,0) = b(i);
+        solveRHS(i,0) = b[i];
+    }
+    solveX.resize(nCol, 1);
+    doSolve( solveRHS, solveX );
+    x.resize(nCol);
+    for(int i=0;i<nCol;i++) {
+        x[i] = solveX(i,0);
     }
-    Matrix_<T> r(nCol, 1 );
-    doSolve( m, r );
-    x.copyAssign(r);
 }
 
 template <typename T >
@@ -211,10 +256,9 @@ void FactorQTZRep<T>::solve(  const Matrix_<T>& b, Matrix_<T>& x ) const {
         b.nrow(), nRow );
 
     x.resize(nCol, b.ncol() );
-    Matrix_<T> tb;
-    tb.resize(maxmn, b.ncol() );
-    for(int j=0;j<b.ncol();j++) for(int i=0;i<b.nrow();i++) tb(i,j) = b(i,j);
-    doSolve(tb, x);
+    solveRHS.resize(maxmn, b.ncol() );
+    for(int j=0;j<b.ncol();j++) for(int i=0;i<b.nrow();i++) solveRHS(i,j) = b(i,j);
+    doSolve(solveRHS, x);
 }
 
 template <typename T >
@@ -228,7 +272,7 @@ void FactorQTZRep<T>::doSolve(Matrix_<T>& b, Matrix_<T>& x) const {
     typename CNT<T>::TReal rhsScaleF; // scale factor applied to right hand side
     bool scaleRHS = false; // true if right hand side should be scaled
 
-    if (rank == 0) return;
+    if (rank == 0) {x = T(0); return;}
 
     // Ask the experts for their optimal workspace sizes. The size parameters
     // here must match the calls below.
@@ -242,7 +286,7 @@ void FactorQTZRep<T>::doSolve(Matrix_<T>& b, Matrix_<T>& x) const {
                               b.nrow(), &workSz, -1, info );
     const int lwork2 = (int)NTraits<T>::real(workSz);
     
-    TypedWorkSpace<T> work(std::max(lwork1, lwork2));
+    growWorkSpace(solveWork, std::max(lwork1, lwork2));
 
     // compute norm of RHS
     bnrm = (RealType)LapackInterface::lange<T>('M', m, nrhs, &b(0,0), b.nrow());
@@ -266,7 +310,7 @@ void FactorQTZRep<T>::doSolve(Matrix_<T>& b, Matrix_<T>& x) const {
     // b1 = Q'*b0
     LapackInterface::ormqr<T>('L', 'T', nRow, b.ncol(), mn, qtz.data, 
                               nRow, tauGEQP3.data, &b(0,0), b.nrow(), 
-                              work.data, work.size, info );
+                              solveWork.data, solveWork.size, info );
     // b2 = T^-1*b1 = T^-1 * Q' * b0
     LapackInterface::trsm<T>('L', 'U', 'N', 'N', rank, b.ncol(), 1.0, 
                              qtz.data, nRow, &b(0,0), b.nrow() );
@@ -281,16 +325,17 @@ void FactorQTZRep<T>::doSolve(Matrix_<T>& b, Matrix_<T>& x) const {
         // b3 = Z'*b2 = Z'*T^-1*Q'*b0
         LapackInterface::ormrz<T>('L', 'T', nCol, b.ncol(), rank, nCol-rank, 
                                   qtz.data, nRow, tauORMQR.data, &b(0,0), 
-                                  b.nrow(), work.data, work.size, info );
+                                  b.nrow(), solveWork.data, solveWork.size, 
+                                  info );
     }
 
     // adjust for pivoting
-    Array_<T> b_pivot(n);
+    bPivot.resize(n);
     for(int j = 0; j<nrhs; ++j) {
         for(int i = 0; i<n; ++i)
-            b_pivot[pivots.data[i]-1] = b(i,j);
+            bPivot[pivots.data[i]-1] = b(i,j);
 
-        LapackInterface::copy<T>(n, b_pivot.begin(), 1, &x(0,j), 1 );
+        LapackInterface::copy<T>(n, bPivot.begin(), 1, &x(0,j), 1 );
     }
 
     // compensate for scaling of linear system 
@@ -349,7 +394,7 @@ void FactorQTZRep<T>::factor(const Matrix_<ELT>&mat )  {
     LapackInterface::geqp3<T>(nRow, nCol, 0, nRow, 0, 0, &workSz, -1, info);
     const int lwork2 = (int)NTraits<T>::real(workSz);
    
-    TypedWorkSpace<T> work(std::max(lwork1, lwork2));
+    growWorkSpace(work, std::max(lwork1, lwork2));
 
     LapackInterface::getMachinePrecision<RealType>( smlnum, bignum);
 
@@ -388,7 +433,7 @@ void FactorQTZRep<T>::factor(const Matrix_<ELT>&mat )  {
             RealType smaxpr,sminpr;
 
             // Determine rank using incremental condition estimate
-            Array_<T> xSmall(mn), xLarge(mn); // temporaries
+            xSmall.resize(mn); xLarge.resize(mn);
             xSmall[0] = xLarge[0] = 1;
             for (rank=1,smaxpr=0.0,sminpr=1.0; 
                  rank<mn && smaxpr*rcond < sminpr; ) 
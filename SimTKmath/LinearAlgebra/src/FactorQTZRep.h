@@ -123,6 +123,9 @@ public:
    ~FactorQTZRep();
 
    template < class ELT > void factor(const Matrix_<ELT>& ); 
+   // Factor a new matrix, reusing this rep's storage when it is big enough.
+   template < class ELT > void refactor(const Matrix_<ELT>&, 
+                                        typename CNT<T>::TReal );
    void inverse( Matrix_<T>& ) const; 
    void solve( const Vector_<T>& b, Vector_<T>& x ) const;
    void solve( const Matrix_<T>& b, Matrix_<T>& x ) const;
@@ -145,6 +148,15 @@ private:
    TypedWorkSpace<T>        tauGEQP3;
    TypedWorkSpace<T>        tauORMQR;
 
+   // Scratch space kept between calls so that refactoring and solving
+   // same-sized systems don't allocate. The solve() scratch means that
+   // one factorization can't be used by several threads at once.
+   TypedWorkSpace<T>            work;
+   Array_<T>                    xSmall, xLarge;
+   mutable TypedWorkSpace<T>    solveWork;
+   mutable Matrix_<T>           solveRHS, solveX;
+   mutable Array_<T>            bPivot;
+
 }; // end class FactorQTZRep
 
 } // namespace SimTK
@@ -884,7 +884,8 @@ double LapackInterface::lange<float>( const char& norm, const int& m, const int&
  
 template <> 
 double LapackInterface::lange<double>( const char& norm, const int& m, const int& n, const double* a, const int& lda ){
-     TypedWorkSpace<double> work(m);
+     // Only the infinity norm uses the work array.
+     TypedWorkSpace<double> work(norm=='I' || norm=='i' ? m : 0);
      return( dlange_( norm, m, n, a, lda, work.data, 1 ) ); 
 }
  
@@ -910,7 +911,7 @@ double LapackInterface::lange<std::complex<float> >( const char& norm, const int
  
 template <> 
 double LapackInterface::lange<std::complex<double> >( const char& norm, const int& m, const int& n, const std::complex<double>* a, const int& lda) {
-     TypedWorkSpace<double> work(m);
+     TypedWorkSpace<double> work(norm=='I' || norm=='i' ? m : 0);
      return( zlange_( norm, m, n, a, lda, work.data, 1 ) );
 }
  
@@ -80,6 +80,27 @@ public:
     bool isDisabledByDefault() const;
     /*@}*/
 
+    /**@name                   Multithreading
+    If the containing GeneralForceSubsystem has been asked to evaluate its
+    force elements in parallel, this force element's calcForce() method may be
+    called on a worker thread concurrently with other force elements. That is
+    fine for force elements that only read the State and write into the force
+    arrays they are given, which includes all the built-in ones. A force
+    element that modifies shared data, or that triggers lazy evaluation of
+    cache entries it doesn't own (for example by asking the matter subsystem
+    for articulated body inertias), should opt out here.
+    @see GeneralForceSubsystem::setUseParallelForceEvaluation() **/
+    /*@{*/
+    /** Specify whether this force element may be evaluated concurrently with
+    other force elements. This is true by default. If you set it false, this
+    force element is always evaluated on the thread that is realizing the
+    State. This can be changed at any time and does not invalidate anything. **/
+    void setParallelEvaluationAllowed(bool allowed);
+    /** Return whether this force element may be evaluated concurrently with
+    other force elements. **/
+    bool isParallelEvaluationAllowed() const;
+    /*@}*/
+
     /**@name                   Advanced methods
     Don't use these unless you're sure you know what you're doing. They aren't
     normally necessary but can be handy sometimes, especially when debugging
@@ -167,6 +188,7 @@ public:
     class TwoPointLinearSpring;
     class TwoPointLinearDamper;
     class TwoPointConstantForce;
+    class TwoPointSpringBundle;
     class MobilityLinearSpring;
     class MobilityLinearDamper;
     class MobilityConstantForce;
@@ -174,6 +196,7 @@ public:
     class MobilityDiscreteForce;
     class DiscreteForces;
     class LinearBushing;
+    class NonbondedPairForce;
     class ConstantForce;
     class ConstantTorque;
     class GlobalDamper;
@@ -185,6 +208,7 @@ public:
     class TwoPointLinearSpringImpl;
     class TwoPointLinearDamperImpl;
     class TwoPointConstantForceImpl;
+    class TwoPointSpringBundleImpl;
     class MobilityLinearSpringImpl;
     class MobilityLinearDamperImpl;
     class MobilityConstantForceImpl;
@@ -192,6 +216,7 @@ public:
     class MobilityDiscreteForceImpl;
     class DiscreteForcesImpl;
     class LinearBushingImpl;
+    class NonbondedPairForceImpl;
     class ConstantForceImpl;
     class ConstantTorqueImpl;
     class GlobalDamperImpl;
@@ -40,7 +40,9 @@ Force class definition. **/
 #include "simbody/internal/Force_MobilityLinearDamper.h"
 #include "simbody/internal/Force_MobilityLinearSpring.h"
 #include "simbody/internal/Force_MobilityLinearStop.h"
+#include "simbody/internal/Force_NonbondedPairForce.h"
 #include "simbody/internal/Force_Thermostat.h"
+#include "simbody/internal/Force_TwoPointSpringBundle.h"
 
 #endif // SimTK_SIMBODY_FORCE_BUILTINS_H_
 
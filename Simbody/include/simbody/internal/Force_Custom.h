@@ -247,6 +247,32 @@ public:
     virtual bool dependsOnlyOnPositions() const {
         return false;
     }
+    /**
+     * Get the last Stage whose results this force depends on. If this is Stage::Time (the force depends only on
+     * time and parameters), Stage::Position (time and q) or Stage::Velocity (time, q, and u), the
+     * GeneralForceSubsystem keeps a cached sum of the forces of all the elements in that class and won't call
+     * calcForce() again until the State has been changed at or below that Stage. Return Stage::Dynamics if the
+     * force depends on anything else, such as auxiliary variables (z) or discrete variables that invalidate
+     * Dynamics stage. The default implementation returns Stage::Position if dependsOnlyOnPositions() returns
+     * true and Stage::Dynamics otherwise.
+     */
+    virtual Stage getDependencyStage() const {
+        return dependsOnlyOnPositions() ? Stage::Position : Stage::Dynamics;
+    }
+    /**
+     * If this force is always applied to the same few bodies or mobilizers, you can override this to say which
+     * ones by appending their MobilizedBodyIndex values to \a bodies (for forces applied through \a bodyForces)
+     * and \a mobilizers (for forces applied to any of a mobilizer's mobilities through \a mobilityForces), and
+     * returning true. Your calcForce() must then never write into any other entries of the force arrays, and
+     * must not apply particle forces. This allows the GeneralForceSubsystem to avoid work on the untouched
+     * entries, and to evaluate force elements that don't share any bodies concurrently without private force
+     * arrays. This is called once at realizeTopology(). The default implementation returns false, meaning any
+     * body or mobility might be affected.
+     */
+    virtual bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                                   Array_<MobilizedBodyIndex>& mobilizers) const {
+        return false;
+    }
     /** The following methods may optionally be overridden to do specialized 
     realization for a Force. **/
     //@{
@@ -0,0 +1,216 @@
+#ifndef SimTK_SIMBODY_FORCE_NONBONDED_PAIR_FORCE_H_
+#define SimTK_SIMBODY_FORCE_NONBONDED_PAIR_FORCE_H_
+
+/* -------------------------------------------------------------------------- *
+ *                               Simbody(tm)                                  *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+#include "SimTKcommon.h"
+#include "simbody/internal/Force.h"
+
+/** @file
+This contains the user-visible API ("handle" class) for the SimTK::Force
+subclass Force::NonbondedPairForce and is logically part of Force.h. The file
+assumes that Force.h will have included all necessary declarations. **/
+
+namespace SimTK {
+
+/** Short-range pairwise forces among many interaction sites, each a station
+fixed on a body, such as the atoms of a coarse-grained molecular model. (For
+a free particle, use a body with a point mass and put a site at its origin.)
+Every pair of sites on different bodies that are closer than the cutoff
+distance interacts through each of the pair potentials that have been added
+to this force element; see PairPotential for the built-in potentials and for
+how to write your own. Sites on the same body never interact.
+
+Rather than looking at all n^2 pairs, this force element keeps a Verlet
+neighbor list of the pairs closer than the cutoff plus a "skin" distance,
+found using a grid of cells at least that large. The list is built the first
+time it is needed and then reused until some site has moved more than half
+the skin distance from where it was when the list was built, since until
+then no pair that wasn't on the list can have come within the cutoff. A
+larger skin means fewer rebuilds but more pairs to check on each evaluation.
+The list is kept in the State's cache so it goes along with copies of the
+State.
+
+Optionally the pairs can be evaluated on multiple threads. The sites are
+divided into groups of neighboring cells and each group accumulates the
+forces it calculates into private arrays, which are then added together in
+group order so that the result doesn't depend on thread scheduling. It can
+differ in roundoff from the serial result and with the number of threads.
+
+The potentials depend only on the site positions so this force element's
+forces are cached by the force subsystem until the positions change. **/
+class SimTK_SIMBODY_EXPORT Force::NonbondedPairForce : public Force {
+public:
+    class PairPotential;
+    class LennardJones;
+    class SoftSphere;
+    class CoulombCutoff;
+
+    /** The properties of an interaction site that the pair potentials may
+    use. Each potential uses only the ones it needs. **/
+    struct SiteProperties {
+        SiteProperties(Real charge=0, Real radius=0, Real wellDepth=0)
+        :   charge(charge), radius(radius), wellDepth(wellDepth) {}
+        Real charge;    ///< Partial charge, used by CoulombCutoff.
+        Real radius;    ///< Size, used by LennardJones and SoftSphere.
+        Real wellDepth; ///< Lennard-Jones well depth epsilon.
+    };
+
+    /** Create a %NonbondedPairForce force element with no sites or
+    potentials.
+
+    @param forces   Subsystem to which this force element should be added.
+    @param matter   Subsystem containing the mobilized bodies on which the
+                    sites will be placed.
+    @param cutoff   Sites further apart than this don't interact; must be
+                    positive.
+    @param skin     Extra distance added to the cutoff when building the
+                    neighbor list; must be nonnegative. **/
+    NonbondedPairForce(GeneralForceSubsystem&          forces,
+                       const SimbodyMatterSubsystem&   matter,
+                       Real                            cutoff,
+                       Real                            skin);
+
+    /** Default constructor creates an empty handle. **/
+    NonbondedPairForce() {}
+
+    /** Add an interaction site at the given station on a body, given in
+    the body frame. This is a topology change.
+    @return The index of the new site, starting at 0. **/
+    int addSite(const MobilizedBody& body, const Vec3& station,
+                const SiteProperties& properties);
+
+    /** Return the number of sites that have been added. **/
+    int getNumSites() const;
+
+    /** Get the properties of site \a i. **/
+    const SiteProperties& getSiteProperties(int i) const;
+
+    /** Add a pair potential to be evaluated for every pair of sites within
+    the cutoff. This force element takes over ownership of the potential.
+    This is a topology change.
+    @return The index of the new potential, starting at 0. **/
+    int adoptPotential(PairPotential* potential);
+
+    /** Return the number of pair potentials that have been added. **/
+    int getNumPotentials() const;
+
+    /** Get the cutoff distance. **/
+    Real getCutoff() const;
+    /** Get the skin distance used for the neighbor list. **/
+    Real getSkin() const;
+
+    /** Enable or disable evaluating the pairs on multiple threads. Changing
+    this is not a topology change. If parallel evaluation is enabled but this
+    force element is itself being evaluated on a worker thread (because the
+    force subsystem is evaluating force elements in parallel) it just
+    evaluates the pairs serially.
+    @param useParallel  Whether to evaluate the pairs in parallel.
+    @param numThreads   The number of threads to use; if this is 0 or
+                        negative the number of processors is used. **/
+    void setUseParallelEvaluation(bool useParallel, int numThreads=0);
+    /** Return true if parallel evaluation has been enabled. **/
+    bool getUseParallelEvaluation() const;
+
+    /** Return the number of pairs currently in the neighbor list kept in
+    this \a state (zero if none has been built yet). Some may be further apart
+    than the cutoff. **/
+    int getNumNeighborPairs(const State& state) const;
+    /** Return the number of times the neighbor list has been built in this
+    \a state and the states it was copied from. **/
+    int getNumNeighborListBuilds(const State& state) const;
+
+    /** @cond **/
+    SimTK_INSERT_DERIVED_HANDLE_DECLARATIONS(NonbondedPairForce,
+                                             NonbondedPairForceImpl, Force);
+    /** @endcond **/
+};
+
+/** Abstract base class for pair potentials used by a NonbondedPairForce.
+To write your own, derive from this class and implement calcEnergy() and
+clone(). Potentials may be evaluated concurrently on several threads so
+calcEnergy() must not modify anything. **/
+class SimTK_SIMBODY_EXPORT Force::NonbondedPairForce::PairPotential {
+public:
+    virtual ~PairPotential() {}
+    /** Return a new copy of this potential. **/
+    virtual PairPotential* clone() const = 0;
+    /** Calculate the interaction energy of two sites at distance \a r (which
+    will be positive and less than \a cutoff) and its derivative dE/dr. **/
+    virtual Real calcEnergy(Real r, Real cutoff,
+                            const SiteProperties& site1,
+                            const SiteProperties& site2,
+                            Real& dEdr) const = 0;
+};
+
+/** Lennard-Jones 12-6 potential, truncated at the cutoff and shifted so
+that the energy goes to zero there. The sum of the two sites' radii is the
+distance rm at which the energy is minimum, and the well depth e is the
+geometric mean of theirs: E = e ((rm/r)^12 - 2 (rm/r)^6) - E(cutoff). **/
+class SimTK_SIMBODY_EXPORT Force::NonbondedPairForce::LennardJones
+:   public Force::NonbondedPairForce::PairPotential {
+public:
+    LennardJones* clone() const override {return new LennardJones(*this);}
+    Real calcEnergy(Real r, Real cutoff,
+                    const SiteProperties& site1, const SiteProperties& site2,
+                    Real& dEdr) const override;
+};
+
+/** Purely repulsive harmonic contact between two spheres whose radii are
+the site radii: E = k/2 (r1+r2-r)^2 if the spheres overlap, otherwise 0.
+The cutoff must be at least the largest sum of two radii. **/
+class SimTK_SIMBODY_EXPORT Force::NonbondedPairForce::SoftSphere
+:   public Force::NonbondedPairForce::PairPotential {
+public:
+    /** Create a soft-sphere potential with the given stiffness k. **/
+    explicit SoftSphere(Real stiffness) : k(stiffness) {}
+    SoftSphere* clone() const override {return new SoftSphere(*this);}
+    Real calcEnergy(Real r, Real cutoff,
+                    const SiteProperties& site1, const SiteProperties& site2,
+                    Real& dEdr) const override;
+private:
+    Real k;
+};
+
+/** Coulomb interaction between the two sites' charges, truncated at the
+cutoff and shifted so that the energy goes to zero there:
+E = ke q1 q2 (1/r - 1/cutoff). The force is not shifted so is discontinuous
+at the cutoff. **/
+class SimTK_SIMBODY_EXPORT Force::NonbondedPairForce::CoulombCutoff
+:   public Force::NonbondedPairForce::PairPotential {
+public:
+    /** Create a Coulomb potential with Coulomb's constant ke in the units
+    being used (for example 138.935456 kJ nm/(mol e^2)). **/
+    explicit CoulombCutoff(Real coulombConstant) : ke(coulombConstant) {}
+    CoulombCutoff* clone() const override {return new CoulombCutoff(*this);}
+    Real calcEnergy(Real r, Real cutoff,
+                    const SiteProperties& site1, const SiteProperties& site2,
+                    Real& dEdr) const override;
+private:
+    Real ke;
+};
+
+} // namespace SimTK
+
+#endif // SimTK_SIMBODY_FORCE_NONBONDED_PAIR_FORCE_H_
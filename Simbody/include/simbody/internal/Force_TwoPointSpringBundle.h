@@ -0,0 +1,125 @@
+#ifndef SimTK_SIMBODY_FORCE_TWO_POINT_SPRING_BUNDLE_H_
+#define SimTK_SIMBODY_FORCE_TWO_POINT_SPRING_BUNDLE_H_
+
+/* -------------------------------------------------------------------------- *
+ *                               Simbody(tm)                                  *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+#include "SimTKcommon.h"
+#include "simbody/internal/Force.h"
+
+/** @file
+This contains the user-visible API ("handle" class) for the SimTK::Force
+subclass Force::TwoPointSpringBundle and is logically part of Force.h. The file
+assumes that Force.h will have included all necessary declarations. **/
+
+namespace SimTK {
+
+/** A single force element containing any number of linear spring-dampers,
+each acting between a station on one body and a station on another. This is
+intended for models like mass-spring meshes and tensegrity structures that
+have tens of thousands of springs, where a separate TwoPointLinearSpring and
+TwoPointLinearDamper for each would cost a force element, a handle, and a
+virtual call apiece.
+
+Each spring i has stiffness k, rest length x0, and damping c. If d is the
+unit vector from point1 to point2, x their current separation, and v the
+rate at which the separation is increasing, the spring applies the tension
+t = k(x-x0) + c v as a force t*d on point1 and -t*d on point2. It contributes
+potential energy k(x-x0)^2/2. It is an error for the two points to become
+coincident, since we can't determine a direction for the force then.
+
+The spring parameters are stored as a structure of arrays and the tensions
+are evaluated for all the springs at once, using SIMD instructions when the
+library was built to use them (see BUILD_INST_SET); the results are then
+added into the body forces. Springs can be individually disabled in a State.
+The enabled flags are Instance-stage state variables like those of whole
+force elements, so changing one requires Instance stage to be realized
+again. If none of the springs have damping, the force depends only on
+positions and is cached by the GeneralForceSubsystem accordingly.
+
+@see Force::TwoPointLinearSpring, Force::TwoPointLinearDamper **/
+class SimTK_SIMBODY_EXPORT Force::TwoPointSpringBundle : public Force {
+public:
+    /** Create an empty %TwoPointSpringBundle force element; use addSpring()
+    to fill it in.
+
+    @param forces   Subsystem to which this force element should be added.
+    @param matter   Subsystem containing the mobilized bodies to which the
+                    springs will be attached. **/
+    TwoPointSpringBundle(GeneralForceSubsystem&          forces,
+                         const SimbodyMatterSubsystem&   matter);
+
+    /** Default constructor creates an empty handle. **/
+    TwoPointSpringBundle() {}
+
+    /** Add a spring-damper to this bundle. This is a topology change so
+    realizeTopology() must be called again before the containing System can
+    be used.
+
+    @param  body1       The first body to which the spring is attached.
+    @param  station1    The location on \a body1, in its body frame.
+    @param  body2       The second body to which the spring is attached.
+    @param  station2    The location on \a body2, in its body frame.
+    @param  stiffness   The spring constant k; must be nonnegative.
+    @param  restLength  The unstretched length x0; must be nonnegative.
+    @param  damping     The damping coefficient c; must be nonnegative.
+    @return The index of the new spring within this bundle, starting at 0. **/
+    int addSpring(const MobilizedBody& body1, const Vec3& station1,
+                  const MobilizedBody& body2, const Vec3& station2,
+                  Real stiffness, Real restLength, Real damping = 0);
+
+    /** Return the number of springs that have been added to this bundle. **/
+    int getNumSprings() const;
+
+    /** Get the spring constant k of spring \a i. **/
+    Real getStiffness(int i) const;
+    /** Get the unstretched length x0 of spring \a i. **/
+    Real getRestLength(int i) const;
+    /** Get the damping coefficient c of spring \a i. **/
+    Real getDamping(int i) const;
+
+    /** Enable or disable spring \a i in the given \a state. All springs are
+    initially enabled. This invalidates Stage::Instance in \a state. **/
+    void setSpringIsEnabled(State& state, int i, bool enabled) const;
+    /** Enable or disable all the springs in the given \a state at once.
+    This invalidates Stage::Instance in \a state. **/
+    void setAllSpringsAreEnabled(State& state, bool enabled) const;
+    /** Return true if spring \a i is enabled in the given \a state. **/
+    bool isSpringEnabled(const State& state, int i) const;
+    /** Return the number of springs that are enabled in the given \a state. **/
+    int getNumEnabledSprings(const State& state) const;
+
+    /** Calculate the current tension t = k(x-x0) + c v in spring \a i,
+    whether or not it is enabled. The \a state must have been realized
+    through Stage::Velocity. **/
+    Real calcTension(const State& state, int i) const;
+
+    /** @cond **/
+    SimTK_INSERT_DERIVED_HANDLE_DECLARATIONS(TwoPointSpringBundle,
+                                             TwoPointSpringBundleImpl, Force);
+    /** @endcond **/
+};
+
+} // namespace SimTK
+
+#endif // SimTK_SIMBODY_FORCE_TWO_POINT_SPRING_BUNDLE_H_
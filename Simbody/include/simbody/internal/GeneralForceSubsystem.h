@@ -86,6 +86,46 @@ public:
     void setForceIsDisabled
        (State& state, ForceIndex index, bool shouldBeDisabled) const;
 
+    /** (Advanced) Request that the force elements be evaluated on multiple
+    threads during Dynamics-stage realization. The enabled force elements
+    are divided into contiguous groups, one per thread, and each group
+    accumulates into its own private force arrays. These are then added into
+    the System's force arrays in group order, so results are deterministic
+    for a given number of threads, although they may differ in the last bits
+    from serial evaluation since the sums are taken in a different order.
+    Force elements that have opted out with 
+    Force::setParallelEvaluationAllowed() are evaluated serially on the
+    calling thread. If there are fewer than 
+    getMinForcesForParallelEvaluation() force elements eligible for parallel
+    evaluation, they are all evaluated serially.
+
+    This is off by default. This pays off only when there are many force
+    elements or some expensive ones; the private force arrays are full length
+    so must be zeroed and summed for every thread. Changing this setting does
+    not invalidate anything.
+
+    @param[in]  useParallel
+        Set true to enable multithreaded force evaluation, false to disable
+        it.
+    @param[in]  numThreads
+        The number of worker threads to use. If this is zero or negative the
+        number of available processors is used.
+    @see getUseParallelForceEvaluation() **/
+    void setUseParallelForceEvaluation(bool useParallel, int numThreads=0);
+    /** Return whether multithreaded force evaluation has been enabled with
+    setUseParallelForceEvaluation(). **/
+    bool getUseParallelForceEvaluation() const;
+    /** (Advanced) Set the minimum number of enabled force elements eligible
+    for parallel evaluation that are needed before they will actually be
+    evaluated in parallel when parallel force evaluation is enabled. The 
+    default is 32.
+    @see setUseParallelForceEvaluation() **/
+    void setMinForcesForParallelEvaluation(int minForces);
+    /** Return the minimum number of force elements required for parallel
+    evaluation.
+    @see setMinForcesForParallelEvaluation() **/
+    int getMinForcesForParallelEvaluation() const;
+
     /** Every Subsystem is owned by a System; a GeneralForceSubsystem expects
     to be owned by a MultibodySystem. This method returns a const reference
     to the containing MultibodySystem and will throw an exception if there is
@@ -81,6 +81,18 @@ public:
         return calcPotentialEnergy(s)+calcKineticEnergy(s);
     }
 
+    /// Realize a collection of States of this system through the given
+    /// stage. This has the same effect as calling realize() for each of them,
+    /// but the position and velocity kinematics are calculated for all the
+    /// States together in one sweep through the tree, with the work divided
+    /// among threads if SimbodyMatterSubsystem::setUseParallelTreeSweeps() is
+    /// on. The States may be at different stages to begin with. Results are
+    /// identical to realizing them separately. If realizing any of the States
+    /// throws an exception, the exception is passed on and all the States
+    /// remain valid; those that weren't finished are left at a lower stage.
+    void realizeEnsemble(const ArrayViewConst_<State>& states,
+                         Stage stage = Stage::HighestRuntime) const;
+
     // These methods are for use by our constituent subsystems to communicate 
     // with each other and with the MultibodySystem as a whole.
 
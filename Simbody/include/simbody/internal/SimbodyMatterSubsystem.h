@@ -205,6 +205,239 @@ void setShowDefaultGeometry(bool show);
 geometry that can be used to visualize this multibody system. **/
 bool getShowDefaultGeometry() const;
 
+/** (Advanced) Request that the base-to-tip and tip-to-base sweeps over the
+multibody tree be run on multiple threads. Two strategies are used:
+  - <em>Branch</em> parallelism: when the tree consists of several independent
+    subtrees (for example the limbs of a humanoid, or several robots sharing
+    a workcell), each subtree is swept as a single task and only the bodies
+    nearer the base (the "trunk") are processed serially. When the topology
+    is realized (or this setting is changed) the subtrees are assigned to
+    threads so as to balance their total number of mobilities, and this
+    strategy is chosen whenever that balance is good enough to pay off.
+  - <em>Level</em> parallelism: otherwise, bodies at a given level of the tree
+    depend only on bodies at the adjacent level, so each level can be
+    processed in parallel; levels are still processed in order. This pays off
+    only for wide levels (for example hundreds of bodies attached directly to
+    Ground), so levels with fewer than getMinNodesPerParallelLevel() bodies
+    are processed serially.
+
+A single unbranched chain cannot benefit from either strategy. Systems with
+fewer than getMinNodesPerParallelLevel() bodies in total are always processed
+serially.
+
+This is off by default. Note that if you enable this option then any Custom
+mobilizers you have defined must be safe to evaluate concurrently. Changing
+this setting does not invalidate anything; results are the same either way.
+
+@param[in]  useParallel
+    Set true to enable multithreaded tree sweeps, false to disable them.
+@param[in]  numThreads
+    The number of worker threads to use. If this is zero or negative the
+    number of available processors is used.
+@see getUseParallelTreeSweeps(), setMinNodesPerParallelLevel() **/
+void setUseParallelTreeSweeps(bool useParallel, int numThreads=0);
+/** Return whether multithreaded tree sweeps have been enabled with
+setUseParallelTreeSweeps(). **/
+bool getUseParallelTreeSweeps() const;
+/** (Advanced) Set the minimum number of bodies a level of the multibody tree
+must contain for that level to be processed in parallel when parallel tree
+sweeps are enabled; this is also the minimum total number of bodies for
+branch parallelism to be used. The default is 32.
+@see setUseParallelTreeSweeps() **/
+void setMinNodesPerParallelLevel(int minNodes);
+/** Return the minimum number of bodies in a level of the tree required for
+that level to be processed in parallel.
+@see setMinNodesPerParallelLevel() **/
+int getMinNodesPerParallelLevel() const;
+/** (Advanced) Return true if parallel tree sweeps are enabled and this tree
+was found to divide well enough into independent branches that the sweeps are
+being done branch-by-branch; false means they are done level-by-level (or
+serially, if parallel sweeps are off). The choice is made when the topology
+is realized, so this is meaningful only after that.
+@see setUseParallelTreeSweeps(), getNumParallelTreeSweepBranchGroups() **/
+bool isUsingBranchParallelTreeSweeps() const;
+/** (Advanced) If isUsingBranchParallelTreeSweeps() is true, return the
+number of groups of branches the tree was divided into, each swept as a
+single task; otherwise return 0. This is at most the number of threads. **/
+int getNumParallelTreeSweepBranchGroups() const;
+
+/** (Advanced) Control whether the bodies at each level of the multibody tree
+are processed in groups of the same mobilizer type during tree sweeps. Each
+group is then handled by a single call to code specialized for that mobilizer
+type, rather than making a separate virtual function call for each body.
+The arithmetic done for each body is identical either way so results are the
+same. In our measurements (see TestMultibodyPerformance) the difference in
+speed is within the noise, even for levels with hundreds of identical
+mobilizers, so this is off by default. Changing this setting does not
+invalidate anything.
+@see getUseTypeBatchedTreeSweeps() **/
+void setUseTypeBatchedTreeSweeps(bool batched);
+/** Return whether tree sweeps process bodies in groups of the same mobilizer
+type; see setUseTypeBatchedTreeSweeps(). **/
+bool getUseTypeBatchedTreeSweeps() const;
+
+/** (Advanced) Request that position realization recalculate kinematics only
+for the parts of the multibody tree that could have changed. Normally
+realizePosition() recalculates the transforms and other position kinematics
+of every body. With this option set, each State remembers the q's from which
+its kinematics were last calculated, and only bodies for which one of those
+q's has changed, together with all their outboard bodies, are recalculated;
+the others keep their cached values. Constraint position errors and
+everything after the tree kinematics are calculated as usual.
+
+This pays off when only a few q's change between realizations, for example
+when a finite difference Jacobian is calculated by perturbing one q at a
+time, or when a controller or an assembly step moves only part of a large
+system. It costs a comparison of the q's and a little memory in each State.
+Results are identical either way. Any change at Instance stage or earlier
+(such as a change in mass properties) causes all bodies to be recalculated at
+the next realization. Custom mobilizers must calculate their transforms
+from their q's and Instance-stage information only, as is required anyway.
+This is off by default; changing it does not invalidate anything.
+@see getUseIncrementalPositionRealization(),
+getNumBodyPositionRealizations() **/
+void setUseIncrementalPositionRealization(bool incremental);
+/** Return whether incremental position realization has been enabled; see
+setUseIncrementalPositionRealization(). **/
+bool getUseIncrementalPositionRealization() const;
+/** (Advanced) Return the number of times position kinematics have been
+calculated for a body (including Ground) since construction or the last call
+to resetPositionRealizationStatistics(). Without incremental realization this
+increases by the number of bodies for each position realization.
+@see setUseIncrementalPositionRealization() **/
+int getNumBodyPositionRealizations() const;
+/** (Advanced) Reset the count returned by getNumBodyPositionRealizations() to
+zero. **/
+void resetPositionRealizationStatistics();
+
+/** (Advanced) Request that forward dynamics reuse the factorization of the
+constraint-space matrix W=G*M^-1*~G from a previous configuration when
+calculating constraint multipliers ("modified Newton"). W is always factored
+only once per configuration and reused for all the acceleration calculations
+(and impulse calculations) made at that configuration, but it still has to be
+recalculated and refactored at every integrator stage, which costs O(m*n)
+time to form and O(m^3) to factor for m constraint equations. With this
+option we instead iterate with the old factorization, correcting the
+multipliers using O(m+n) operators, until the constraint acceleration errors
+are negligible. Only if that fails to converge in a few iterations do we form
+and factor W at the current configuration, which is then saved for reuse at
+later steps.
+
+This pays off for systems with many constraints whose configuration changes
+little from step to step. It is off by default. The results are the same to
+within a tight tolerance either way, and changing this setting does not
+invalidate anything.
+@see getUseModifiedNewtonForMultipliers(), solveForConstraintImpulses(),
+     getNumMultiplierFactorizations() **/
+void setUseModifiedNewtonForMultipliers(bool useModifiedNewton);
+/** Return whether modified Newton reuse of the constraint-space matrix
+factorization has been enabled with setUseModifiedNewtonForMultipliers(). **/
+bool getUseModifiedNewtonForMultipliers() const;
+
+/** (Advanced) Return the number of times the constraint-space matrix
+G*M^-1*~G has been formed and factored since construction or the last call
+to resetMultiplierStatistics(). Statistics are collected whether or not
+modified Newton reuse is enabled, for all States used with this subsystem.
+@see getNumMultiplierReuses(), setUseModifiedNewtonForMultipliers() **/
+int getNumMultiplierFactorizations() const;
+/** (Advanced) Return the number of multiplier solves that were completed
+using a factorization computed at a different configuration, without
+refactoring. This is always zero unless modified Newton reuse is enabled.
+@see getNumMultiplierFactorizations() **/
+int getNumMultiplierReuses() const;
+/** (Advanced) Reset the multiplier statistics counts to zero. **/
+void resetMultiplierStatistics();
+
+/** (Advanced) Request that the linear systems involving constraints be
+solved by independent blocks. This applies to the constraint-space matrix 
+G*M^-1*~G used for constraint multipliers and impulses, and to the constraint
+matrices used in position and velocity projection. Normally each of these is
+factored as a single dense matrix, which for m constraint equations costs
+O(m^3) time, whether or not the constraints interact.
+
+Bodies in different branches of the multibody tree (descended from different
+children of Ground) don't interact dynamically, so constraints that do not
+connect those branches, directly or through other constraints, form
+independent blocks. With this option set each block is factored separately:
+diagonal blocks of G*M^-1*~G with a Cholesky factorization, and projection
+blocks with the same rank-revealing method used for the whole matrix. If a
+Cholesky factorization shows that its block is rank deficient (due to 
+redundant constraints), that block falls back to the rank-revealing method.
+Results are the same to within numerical precision either way.
+
+This pays off for systems with many separately-grounded constrained 
+mechanisms, such as bundles of ropes or multiple robots in a workcell. It is
+off by default; changing it does not invalidate anything.
+@see getUseBlockConstraintSolver() **/
+void setUseBlockConstraintSolver(bool useBlocks);
+/** Return whether constraint linear systems are to be solved by independent
+blocks; see setUseBlockConstraintSolver(). **/
+bool getUseBlockConstraintSolver() const;
+/** (Advanced) Return the number of independent blocks the block constraint
+solver found for the constraints enabled in \a state, which must be realized
+through Instance stage. Returns zero if the block solver is not in use.
+@see setUseBlockConstraintSolver() **/
+int getNumConstraintBlocks(const State& state) const;
+/** (Advanced) Return the number of blocks of G*M^-1*~G in the factorization
+for the current configuration that were found to be rank deficient (because
+of redundant constraints) and were therefore factored with the rank-revealing
+method rather than Cholesky. The factorization is calculated if necessary.
+Returns zero if the block solver is not in use or there are no constraints.
+@see setUseBlockConstraintSolver() **/
+int getNumRankDeficientConstraintBlocks(const State& state) const;
+
+/** (Advanced) Allow position and velocity constraint projection to reuse
+the factored constraint matrix from an earlier projection ("modified 
+Newton"). Normally each position projection iteration forms and factors the
+weighted position constraint matrix at the current q, and each velocity 
+projection factors its constraint matrix once. With this option set, the
+most recent factorization is saved in the State and used for later
+projections (and later iterations) for as long as every iteration with it
+reduces the constraint error norm by at least the factor given by
+getProjectionReuseTolerance(). When that fails, the matrix is refactored at
+the current configuration and the new factorization is saved.
+
+Integrators project after every step from a nearby configuration, so this
+can avoid most factorizations. The projected result satisfies the constraints
+to the same accuracy but is not necessarily identical, since the least
+squares correction is calculated from a slightly different matrix. The
+ProjectOptions::ForceFullNewton option disables reuse for a particular
+projection. This is off by default; changing it does not invalidate anything.
+@see setProjectionReuseTolerance(), getNumProjectQFactorizations() **/
+void setUseModifiedNewtonForProjection(bool useModifiedNewton);
+/** Return whether reuse of projection factorizations has been enabled with
+setUseModifiedNewtonForProjection(). **/
+bool getUseModifiedNewtonForProjection() const;
+/** (Advanced) Set the convergence rate that a projection iteration using an
+out-of-date factorization must achieve: the constraint error norm must be 
+reduced to at most \a tol times its previous value or the matrix will be 
+refactored. Must be in (0,1]; the default is 0.25. Smaller values refactor
+more often. @see setUseModifiedNewtonForProjection() **/
+void setProjectionReuseTolerance(Real tol);
+/** Return the current projection reuse tolerance.
+@see setProjectionReuseTolerance() **/
+Real getProjectionReuseTolerance() const;
+
+/** (Advanced) Return the number of times the position constraint projection
+matrix has been factored since construction or the last call to
+resetProjectionStatistics(). Statistics are collected whether or not reuse is
+enabled, for all States used with this subsystem. 
+@see getNumProjectQReuses(), setUseModifiedNewtonForProjection() **/
+int getNumProjectQFactorizations() const;
+/** (Advanced) Return the number of position projection iterations that used a
+factorization computed at a different configuration.
+@see getNumProjectQFactorizations() **/
+int getNumProjectQReuses() const;
+/** (Advanced) Return the number of times the velocity constraint projection
+matrix has been factored. @see getNumProjectQFactorizations() **/
+int getNumProjectUFactorizations() const;
+/** (Advanced) Return the number of velocity projection iterations that used
+a factorization saved by an earlier projection.
+@see getNumProjectUFactorizations() **/
+int getNumProjectUReuses() const;
+/** (Advanced) Reset all the projection statistics counts to zero. **/
+void resetProjectionStatistics();
+
 /** The number of bodies includes all mobilized bodies \e including Ground,
 which is the 0th mobilized body. (Note: if special particle handling were
 implmemented, the count here would \e not include particles.) Bodies and their
@@ -1259,6 +1492,17 @@ realization of composite-body or articulated-body inertias.
   \c Stage::Position **/
 void multiplyByM(const State& state, const Vector& a, Vector& Ma) const;
 
+/** Alternate signature for multiplying the mass matrix by each of the k
+columns of an n X k matrix A, producing the n X k result M*A in O(n*k) time.
+The result is identical to calling multiplyByM() separately on each column, 
+but the multibody tree is traversed only once for all the columns, which is
+considerably faster. Neither matrix need have contiguous storage, and MA may
+be the same matrix as A.
+@par Required stage
+  \c Stage::Position 
+@see multiplyByM(const State&,const Vector&,Vector&) **/
+void multiplyByM(const State& state, const Matrix& A, Matrix& MA) const;
+
 /** This operator calculates in O(n) time the product M^-1*v where M is the 
 system mass matrix and v is a supplied vector with one entry per u-space
 mobility. If v is a set of generalized forces f, the result is a generalized 
@@ -1342,6 +1586,22 @@ void multiplyByMInv(const State& state,
     const Vector&               v,
     Vector&                     MinvV) const;
 
+/** Alternate signature for multiplying the inverse mass matrix by each of the
+k columns of an n X k matrix F, producing the n X k result M^-1*F in O(n*k) 
+time. The result is identical to calling multiplyByMInv() separately on each 
+column, including the treatment of prescribed mobilities, but the multibody 
+tree is traversed only once for all the columns, which is considerably faster.
+Use this when you need M^-1 times a Jacobian transpose or other multi-column
+matrix. Neither matrix need have contiguous storage, and MInvF may be the same
+matrix as F.
+@par Required stage
+  \c Stage::Position 
+@see multiplyByMInv(const State&,const Vector&,Vector&), 
+     solveUsingMassMatrixFactorization() **/
+void multiplyByMInv(const State& state,
+    const Matrix&               F,
+    Matrix&                     MInvF) const;
+
 /** This operator explicitly calculates the n X n mass matrix M. Note that this
 is inherently an O(n^2) operation since the mass matrix has n^2 elements 
 (although only n(n+1)/2 are unique due to symmetry). <em>DO NOT USE THIS CALL 
@@ -1368,6 +1628,103 @@ with the calcM() method.
 @see multiplyByMInv(), calcM() **/
 void calcMInv(const State&, Matrix& MInv) const;
 
+/** Solve M*X=F for X using a sparse factorization of the mass matrix, where
+F is an n X k matrix of k right-hand sides. As for multiplyByMInv(), M here is
+really the part of the mass matrix corresponding to free (non-prescribed)
+mobilities; rows of F corresponding to prescribed mobilities are ignored and
+the same rows of X are returned zero. 
+
+<h3>Implementation</h3>
+The first time this is called for a given configuration q, the mass matrix is
+factored as M=~L*D*L where L is unit lower triangular and D diagonal. Because
+of the tree structure of the multibody system, L has the same sparsity pattern
+as M and no fill-in occurs; the factorization is calculated in O(n*d) time and
+stored compactly in O(n*d) space, where d is the depth of the tree measured in
+mobilities. The factorization is saved in the State cache until q changes, so
+subsequent solves cost only O(n*d) per right-hand side. You can force 
+realization of the factorization with realizeMassMatrixFactorization().
+
+<h3>Performance</h3>
+For a single right-hand side, multiplyByMInv() is O(n) and is usually the 
+better choice. This method is preferable when you need to solve with many 
+right-hand sides at the same configuration, as when forming operational space
+inertias J*M^-1*~J, or when the tree is shallow so that n*d is close to n. 
+It does not require articulated body inertias. Neither F nor X need have 
+contiguous storage, and X may be the same matrix as F.
+
+@par Required stage
+  \c Stage::Position 
+
+@see multiplyByMInv(), calcMInv(), realizeMassMatrixFactorization() **/
+void solveUsingMassMatrixFactorization(const State&  state,
+                                       const Matrix& F,
+                                       Matrix&       X) const;
+
+/** Alternate signature for solving with a single right-hand side f. The 
+result is identical to multiplyByMInv() to within roundoff error.
+@see solveUsingMassMatrixFactorization(const State&,const Matrix&,Matrix&) **/
+void solveUsingMassMatrixFactorization(const State&  state,
+                                       const Vector& f,
+                                       Vector&       x) const;
+
+/** Calculate the 3*nt X 3*nt inverse operational space inertia 
+Lambda^-1=JS*M^-1*~JS for a set of nt station tasks, where JS is the station 
+task Jacobian that would be returned by calcStationJacobian() for the same 
+tasks. Lambda^-1 is also known as the operational space compliance matrix; it
+maps forces applied at the stations to the resulting station accelerations. 
+The 3x3 block at (i,j) gives the acceleration of station i due to a force 
+applied at station j. If there is prescribed motion, M^-1 here is the inverse 
+of the free block of M as for multiplyByMInv().
+
+@param[in]      state
+    A State that has already been realized through Position stage.
+@param[in]      onBodyB
+    An array of nt mobilized bodies (one per task) to which the stations of 
+    interest are fixed. These may be in any order and the same body may appear
+    more than once.
+@param[in]      stationPInB
+    The array of nt station points P of interest (one per task), each 
+    corresponding to one of the bodies B from \a onBodyB, given as vectors from
+    each body B's origin Bo to its station P, expressed in frame B.
+@param[out]     LambdaInv
+    The resulting inverse operational space inertia, resized if necessary. 
+    Use a factorization of it if you need Lambda itself.
+
+<h3>Performance discussion</h3>
+This requires O(n*nt) time and does not form JS or M^-1; each column of ~JS 
+is generated by an O(n) operator and then all the columns are multiplied by 
+M^-1 in a single sweep that also yields the resulting station accelerations.
+It is considerably faster than forming JS and using multiplyByMInv() and is 
+preferable for large n. The result is saved in the \a state cache along with 
+the list of tasks, so if you call this again with the same tasks before the 
+next change to the generalized coordinates q, the saved value is returned.
+
+@par Required stage
+  \c Stage::Position 
+@see calcStationJacobian(), calcFrameOperationalSpaceInertiaInverse() **/
+void calcStationOperationalSpaceInertiaInverse
+   (const State&                        state,
+    const Array_<MobilizedBodyIndex>&   onBodyB,
+    const Array_<Vec3>&                 stationPInB,
+    Matrix&                             LambdaInv) const;
+
+/** Calculate the 6*nt X 6*nt inverse operational space inertia 
+Lambda^-1=JF*M^-1*~JF for a set of nt frame tasks, where JF is the frame task
+Jacobian that would be returned by calcFrameJacobian() for the same tasks. 
+Each task has six rows and columns, with the angular part first, so that 
+Lambda^-1 maps a set of spatial forces (moment, force) applied at the frame 
+origins to the resulting spatial accelerations of the frames (angular, 
+linear). See calcStationOperationalSpaceInertiaInverse() for details; the 
+performance and caching behavior are the same. 
+@par Required stage
+  \c Stage::Position 
+@see calcFrameJacobian(), calcStationOperationalSpaceInertiaInverse() **/
+void calcFrameOperationalSpaceInertiaInverse
+   (const State&                        state,
+    const Array_<MobilizedBodyIndex>&   onBodyB,
+    const Array_<Vec3>&                 originAoInB,
+    Matrix&                             LambdaInv) const;
+
 /** This operator calculates in O(m*n) time the m X m "projected inverse mass 
 matrix" or "constraint compliance matrix" W=G*M^-1*~G, where G (mXn) is the 
 acceleration-level constraint Jacobian mapped to generalized coordinates,
@@ -1424,9 +1781,10 @@ are solving the equation
 for \e impulse, where W=G*M^-1*~G is the "projected inverse mass matrix" as 
 described for calcProjectedMInv(). In general W is singular due to constraint
 redundancies, so the solution for \e impulse is not unique. Simbody handles 
-redundant constraints by finding least squares solutions, and this operator 
-method duplicates the method Simbody uses for determining the rank and 
-performing the factorization of W. 
+redundant constraints by finding least squares solutions, and this operator
+method uses the same factorization of W that Simbody uses for calculating
+constraint multipliers. That factorization is saved in the \a state so W is
+formed and factored only once for a given configuration.
 
 @param[in]      state
     The State whose generalized coordinates and speeds define the matrix W.
@@ -1636,6 +1994,63 @@ matrix-vector product ~G*v in O(n) time without explicitly forming ~G.
 @see calcG(), multiplyByGTranspose() **/
 void calcGTranspose(const State&, Matrix& Gt) const;
 
+/** Calculate the m X n acceleration-level constraint Jacobian G = [P;V;A] in
+compressed sparse row (CSR) format, storing only the elements that can be
+nonzero. Each row of G belongs to a single %Constraint and can involve only
+that %Constraint's constrained mobilities, and the mobilities on the paths from
+its constrained bodies inward to its Ancestor body, so G is usually very
+sparse. This is the recommended way to provide G to external sparse solvers.
+
+@param[in]      state
+    A State realized through Velocity stage (or Position stage if the system
+    has only position constraints).
+@param[out]     rowStart
+    Resized to length m+1. Row i of G occupies elements rowStart[i] up to but
+    not including rowStart[i+1] of \a colIndex and \a values; rowStart[m] is
+    the number of stored elements nnz.
+@param[out]     colIndex
+    Resized to length nnz. The mobility (column) index of each stored element;
+    these are in increasing order within each row.
+@param[out]     values
+    Resized to length nnz. The value of each stored element. Some of these
+    may be zero, depending on the configuration.
+
+@par Implementation
+Rows are generated using the constraint force methods as for calcGTranspose(),
+but only the mobilities participating in each %Constraint are visited, so the
+cost is proportional to the number of stored elements rather than m*n. To
+within numerical error the result is identical to calcG() for non-working
+constraints.
+@see calcGTransposeSparse(), calcG(), calcGTranspose() **/
+void calcGSparse(const State&   state,
+                 Array_<int>&   rowStart,
+                 Array_<int>&   colIndex,
+                 Array_<Real>&  values) const;
+
+/** Calculate the n X m transpose ~G of the acceleration-level constraint
+Jacobian in compressed sparse row format, which is the same thing as G in
+compressed sparse column (CSC) format.
+
+@param[in]      state
+    A State realized through Velocity stage (or Position stage if the system
+    has only position constraints).
+@param[out]     colStart
+    Resized to length n+1. Column j of G (row j of ~G) occupies elements
+    colStart[j] up to but not including colStart[j+1] of \a rowIndex and
+    \a values.
+@param[out]     rowIndex
+    Resized to length nnz. The constraint equation (row of G) index of each
+    stored element; these are in increasing order within each column.
+@param[out]     values
+    Resized to length nnz. The value of each stored element.
+
+The stored elements are the same ones returned by calcGSparse(), reordered.
+@see calcGSparse(), calcGTranspose() **/
+void calcGTransposeSparse(const State&  state,
+                          Array_<int>&  colStart,
+                          Array_<int>&  rowIndex,
+                          Array_<Real>& values) const;
+
 
 /** Calculate in O(n) time the product Pq*qlike where Pq is the mp X nq 
 position (holonomic) constraint Jacobian and \a qlike is a "q-like" 
@@ -2475,6 +2890,16 @@ computed unless specifically requested.
 @see invalidateCompositeBodyInertias() **/
 void realizeCompositeBodyInertias(const State&) const;
 
+/** This method checks whether the sparse factorization of the mass matrix has
+already been computed since the last change to a Position stage state variable
+(q) and if so returns immediately at little cost; otherwise, it computes the
+factorization used by solveUsingMassMatrixFactorization(). The factorization
+is not otherwise computed unless specifically requested.
+@par Required stage
+  \c Stage::Position 
+@see solveUsingMassMatrixFactorization(), invalidateMassMatrixFactorization() **/
+void realizeMassMatrixFactorization(const State&) const;
+
 /** This method checks whether articulated body inertias have already been 
 computed since the last change to a Position stage state variable (q) and if so 
 returns immediately at little cost; otherwise, it initiates the relatively 
@@ -2626,6 +3051,11 @@ realizeCompositeBodyInertias(), which otherwise will not recalculate them
 if called repeatedly. **/
 void invalidateCompositeBodyInertias(const State& state) const;
 
+/** This is useful for timing computation time for 
+realizeMassMatrixFactorization(), which otherwise will not recalculate the
+factorization if called repeatedly. **/
+void invalidateMassMatrixFactorization(const State& state) const;
+
 /** This is useful for timing computation time for 
 realizeArticulatedBodyInertias(), which otherwise will not recalculate them
 if called repeatedly. Note that this also invalidates Dynamics stage and 
@@ -2931,6 +2931,11 @@ void ConstraintImpl::realizeInstance(const State& s) const {
         std::unique(cInfo.participatingQ.begin(), cInfo.participatingQ.end());
     cInfo.participatingQ.erase(newEnd, cInfo.participatingQ.end());
 
+    std::sort(cInfo.participatingU.begin(), cInfo.participatingU.end());
+    Array_<UIndex>::iterator newUEnd =
+        std::unique(cInfo.participatingU.begin(), cInfo.participatingU.end());
+    cInfo.participatingU.erase(newUEnd, cInfo.participatingU.end());
+
     realizeInstanceVirtual(s); // delegate to concrete constraint
 }
 
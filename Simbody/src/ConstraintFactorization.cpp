@@ -0,0 +1,198 @@
+/* -------------------------------------------------------------------------- *
+ *                               Simbody(tm)                                  *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+#include "SimTKcommon.h"
+#include "SimTKmath.h"
+
+#include "ConstraintFactorization.h"
+
+#include <cmath>
+
+namespace SimTK {
+
+void ConstraintFactorization::factor(const Matrix& A, Real rcondTol) {
+    nRows = A.nrow(); nCols = A.ncol();
+    byBlocks = false;
+    blocks.clear();
+    wholeQTZ.factor<Real>(A, rcondTol);
+}
+
+void ConstraintFactorization::factorBlocks
+   (const Matrix&                   A,
+    const Array_< Array_<int> >&    rows,
+    const Array_< Array_<int> >&    cols,
+    bool                            isSymmetric,
+    Real                            rcondTol)
+{
+    assert(rows.size() == cols.size());
+    nRows = A.nrow(); nCols = A.ncol();
+    byBlocks = true;
+    blocks.resize(rows.size());
+
+    Matrix Ab;
+    for (unsigned k=0; k < rows.size(); ++k) {
+        Block& blk = blocks[k];
+        blk.rows = rows[k]; blk.cols = cols[k];
+        const int mb = (int)blk.rows.size(), nb = (int)blk.cols.size();
+        Ab.resize(mb, nb);
+        for (int j=0; j < nb; ++j)
+            for (int i=0; i < mb; ++i)
+                Ab(i,j) = A(blk.rows[i], blk.cols[j]);
+        factorBlock(Ab, isSymmetric, rcondTol, blk);
+    }
+}
+
+void ConstraintFactorization::factorBlocks
+   (int                             m,
+    int                             n,
+    const Array_<Matrix>&           Ab,
+    const Array_< Array_<int> >&    rows,
+    const Array_< Array_<int> >&    cols,
+    bool                            isSymmetric,
+    Real                            rcondTol)
+{
+    assert(rows.size() == cols.size() && Ab.size() == rows.size());
+    nRows = m; nCols = n;
+    byBlocks = true;
+    blocks.resize(rows.size());
+
+    for (unsigned k=0; k < rows.size(); ++k) {
+        Block& blk = blocks[k];
+        blk.rows = rows[k]; blk.cols = cols[k];
+        assert(Ab[k].nrow() == (int)blk.rows.size() 
+               && Ab[k].ncol() == (int)blk.cols.size());
+        factorBlock(Ab[k], isSymmetric, rcondTol, blk);
+    }
+}
+
+void ConstraintFactorization::factorBlock
+   (const Matrix& Ab, bool isSymmetric, Real rcondTol, Block& blk)
+{
+    const int mb = Ab.nrow(), nb = Ab.ncol();
+    blk.useCholesky = false;
+    blk.rank = 0;
+    if (mb == 0 || nb == 0)
+        return; // nothing to do; solution is zero here
+
+    if (isSymmetric) {
+        // Cholesky factorization Ab=L*~L. We give up as soon as we see a
+        // pivot that is small relative to the largest diagonal element,
+        // since that means the block is (nearly) rank deficient.
+        assert(mb == nb);
+        Real maxDiag = 0;
+        for (int i=0; i < mb; ++i)
+            maxDiag = std::max(maxDiag, Ab(i,i));
+        const Real pivotTol = rcondTol * maxDiag;
+
+        blk.L.resize(mb, mb);
+        blk.L.setToZero();
+        bool ok = maxDiag > 0;
+        for (int j=0; ok && j < mb; ++j) {
+            Real d = Ab(j,j);
+            for (int k=0; k < j; ++k)
+                d -= square(blk.L(j,k));
+            if (d <= pivotTol) {ok = false; break;}
+            const Real ljj = std::sqrt(d);
+            blk.L(j,j) = ljj;
+            for (int i=j+1; i < mb; ++i) {
+                Real s = Ab(i,j);
+                for (int k=0; k < j; ++k)
+                    s -= blk.L(i,k)*blk.L(j,k);
+                blk.L(i,j) = s / ljj;
+            }
+        }
+        if (ok) {
+            blk.useCholesky = true;
+            blk.rank = mb;
+            return;
+        }
+        blk.L.resize(0,0); // fall through to QTZ
+    }
+
+    blk.qtz.factor<Real>(Ab, rcondTol);
+    blk.rank = blk.qtz.getRank();
+}
+
+void ConstraintFactorization::solve(const Vector& b, Vector& x) const {
+    assert(b.size() == nRows);
+    if (!byBlocks) {
+        wholeQTZ.solve(b, x);
+        return;
+    }
+
+    x.resize(nCols);
+    x.setToZero();
+    Vector bb, xb;
+    for (unsigned k=0; k < blocks.size(); ++k) {
+        const Block& blk = blocks[k];
+        const int mb = (int)blk.rows.size(), nb = (int)blk.cols.size();
+        if (mb == 0 || nb == 0)
+            continue;
+        bb.resize(mb);
+        for (int i=0; i < mb; ++i)
+            bb[i] = b[blk.rows[i]];
+
+        if (blk.useCholesky) {
+            // Solve L*y=bb, then ~L*xb=y, in place.
+            xb = bb;
+            for (int i=0; i < mb; ++i) {
+                Real s = xb[i];
+                for (int j=0; j < i; ++j)
+                    s -= blk.L(i,j)*xb[j];
+                xb[i] = s / blk.L(i,i);
+            }
+            for (int i=mb-1; i >= 0; --i) {
+                Real s = xb[i];
+                for (int j=i+1; j < mb; ++j)
+                    s -= blk.L(j,i)*xb[j];
+                xb[i] = s / blk.L(i,i);
+            }
+        } else
+            blk.qtz.solve(bb, xb);
+
+        for (int j=0; j < nb; ++j)
+            x[blk.cols[j]] = xb[j];
+    }
+}
+
+int ConstraintFactorization::getRank() const {
+    if (!byBlocks)
+        return wholeQTZ.getRank();
+    int rank = 0;
+    for (unsigned k=0; k < blocks.size(); ++k)
+        rank += blocks[k].rank;
+    return rank;
+}
+
+int ConstraintFactorization::getNumRankDeficientBlocks() const {
+    int n = 0;
+    for (unsigned k=0; k < blocks.size(); ++k) {
+        const Block& blk = blocks[k];
+        if (!blk.useCholesky && !blk.rows.empty() && !blk.cols.empty()
+            && blk.rank < std::min((int)blk.rows.size(), (int)blk.cols.size()))
+            ++n;
+    }
+    return n;
+}
+
+} // namespace SimTK
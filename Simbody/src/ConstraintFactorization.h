@@ -0,0 +1,117 @@
+#ifndef SimTK_SIMBODY_CONSTRAINT_FACTORIZATION_H_
+#define SimTK_SIMBODY_CONSTRAINT_FACTORIZATION_H_
+
+/* -------------------------------------------------------------------------- *
+ *                               Simbody(tm)                                  *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+/* This is the linear algebra backend used by SimbodyMatterSubsystemRep for
+constraint-space systems: the constraint multiplier matrix G M^-1 ~G and the
+weighted constraint matrices factored for position and velocity projection.
+
+By default the whole matrix is factored with FactorQTZ, which handles
+redundant constraints by finding least squares (minimum norm) solutions.
+Alternatively the caller can supply a partition of the rows and columns into
+independent blocks, meaning that every element outside of the diagonal blocks
+is known to be zero. Then each block is factored separately, costing the sum
+of the cubes of the block sizes rather than the cube of their sum. Square
+blocks of a symmetric matrix are first tried with a Cholesky factorization;
+if that detects rank deficiency we fall back to FactorQTZ for that block.
+Since the blocks are independent, the minimum norm least squares solution of
+the whole system is made up of the minimum norm solutions of the blocks. */
+
+#include "SimTKcommon.h"
+#include "SimTKmath.h"
+
+namespace SimTK {
+
+class ConstraintFactorization {
+public:
+    ConstraintFactorization() : nRows(0), nCols(0), byBlocks(false) {}
+
+    /* Factor all of the mXn matrix A using FactorQTZ, treating any
+    singular values below rcondTol relative to the largest as zero. */
+    void factor(const Matrix& A, Real rcondTol);
+
+    /* Factor only the diagonal blocks A(rows[k],cols[k]) of the mXn matrix
+    A; all other elements must be zero. Row and column lists must be disjoint
+    but need not cover all the rows and columns; any that are missing are
+    treated as zero. If isSymmetric is set, each column list must be the same
+    as its row list and A must be positive semidefinite. */
+    void factorBlocks(const Matrix&                 A,
+                      const Array_< Array_<int> >&  rows,
+                      const Array_< Array_<int> >&  cols,
+                      bool                          isSymmetric,
+                      Real                          rcondTol);
+
+    /* Same, but for an mXn matrix A that is never formed; the caller instead
+    supplies the diagonal blocks Ab[k]=A(rows[k],cols[k]). */
+    void factorBlocks(int                           m,
+                      int                           n,
+                      const Array_<Matrix>&         Ab,
+                      const Array_< Array_<int> >&  rows,
+                      const Array_< Array_<int> >&  cols,
+                      bool                          isSymmetric,
+                      Real                          rcondTol);
+
+    /* Solve A*x=b for x in the least squares sense using the most recent
+    factorization. b must have m elements; x is resized to n. */
+    void solve(const Vector& b, Vector& x) const;
+
+    int getNumRows() const {return nRows;}
+    int getNumCols() const {return nCols;}
+
+    /* Return the estimated rank of the factored matrix (the sum of the
+    ranks of the blocks if factored by blocks). */
+    int getRank() const;
+
+    /* Return true if the most recent factorization was done by blocks. */
+    bool isFactoredByBlocks() const {return byBlocks;}
+    /* Return the number of blocks in a block factorization. */
+    int getNumBlocks() const {return (int)blocks.size();}
+    /* Return the number of blocks whose estimated rank is less than their
+    smaller dimension; symmetric blocks like that are the ones for which we
+    had to fall back from Cholesky to FactorQTZ. */
+    int getNumRankDeficientBlocks() const;
+
+private:
+    struct Block {
+        Block() : useCholesky(false), rank(0) {}
+        Array_<int> rows, cols;
+        bool        useCholesky;
+        Matrix      L;      // lower triangle if useCholesky
+        FactorQTZ   qtz;    // otherwise
+        int         rank;
+    };
+
+    static void factorBlock(const Matrix& Ab, bool isSymmetric,
+                            Real rcondTol, Block& blk);
+
+    int             nRows, nCols;
+    bool            byBlocks;
+    FactorQTZ       wholeQTZ;   // if not factored by blocks
+    Array_<Block>   blocks;
+};
+
+} // namespace SimTK
+
+#endif // SimTK_SIMBODY_CONSTRAINT_FACTORIZATION_H_
@@ -43,6 +43,11 @@ void Force::setDisabledByDefault(bool shouldBeDisabled)
 bool Force::isDisabledByDefault() const
 {   return getImpl().isDisabledByDefault(); }
 
+void Force::setParallelEvaluationAllowed(bool allowed)
+{   updImpl().setParallelEvaluationAllowed(allowed); }
+bool Force::isParallelEvaluationAllowed() const
+{   return getImpl().isParallelEvaluationAllowed(); }
+
 void Force::disable(State& state) const 
 {   getForceSubsystem().setForceIsDisabled(state, getForceIndex(), true); }
 void Force::enable(State& state) const 
@@ -34,7 +34,7 @@ namespace SimTK {
 // This is what a Force handle points to.
 class ForceImpl : public PIMPLImplementation<Force, ForceImpl> {
 public:
-    ForceImpl() : forces(0), defaultDisabled(false) {}
+    ForceImpl() : forces(0), defaultDisabled(false), parallelAllowed(true) {}
     ForceImpl(const ForceImpl& clone) {*this = clone;}
 
     void setDisabledByDefault(bool shouldBeDisabled) 
@@ -44,11 +44,40 @@ public:
     bool isDisabledByDefault() const 
     {   return defaultDisabled; }
 
+    // This is not a topology change; it only affects scheduling.
+    void setParallelEvaluationAllowed(bool allowed)
+    {   parallelAllowed = allowed; }
+
+    bool isParallelEvaluationAllowed() const
+    {   return parallelAllowed; }
+
     virtual ~ForceImpl() {}
     virtual ForceImpl* clone() const = 0;
     virtual bool dependsOnlyOnPositions() const {
         return false;
     }
+
+    // Return the last stage whose results this force element's calcForce()
+    // depends on. If that is Time, Position, or Velocity the force subsystem
+    // caches the element's forces and won't call calcForce() again until
+    // that stage has been invalidated. Return Stage::Dynamics (the default
+    // unless dependsOnlyOnPositions() is true) if the forces depend on
+    // anything else, such as auxiliary state variables, Dynamics-stage
+    // discrete variables, or other force elements.
+    virtual Stage getDependencyStage() const {
+        return dependsOnlyOnPositions() ? Stage::Position : Stage::Dynamics;
+    }
+
+    // A force element that knows ahead of time which mobilized bodies it 
+    // applies body forces to, and which mobilizers it applies mobility forces
+    // to, should append their indices here and return true. It then promises
+    // never to write into any other entries of the force arrays, nor to apply
+    // any particle forces. The default returns false meaning the element may
+    // touch anything. This is called after the element's realizeTopology().
+    virtual bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                                   Array_<MobilizedBodyIndex>& mobilizers) const
+    {   return false; }
+
     ForceIndex getForceIndex() const {return index;}
     const GeneralForceSubsystem& getForceSubsystem() const 
     {   assert(forces); return *forces; }
@@ -95,6 +124,10 @@ private:
     // by default.
     bool                   defaultDisabled;
 
+    // Whether calcForce() may be called concurrently with other force 
+    // elements when the force subsystem is evaluating forces in parallel.
+    bool                   parallelAllowed;
+
         // TOPOLOGY "CACHE"
     // Nothing in the base Impl class.
 };
@@ -121,6 +154,10 @@ public:
                    Vector_<Vec3>&       particleForces, 
                    Vector&              mobilityForces) const override;
     Real calcPotentialEnergy(const State& state) const override;
+    bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                           Array_<MobilizedBodyIndex>& mobilizers) const
+                           override
+    {   bodies.push_back(body1); bodies.push_back(body2); return true; }
 
     void calcDecorativeGeometryAndAppend(const State& s, Stage stage, 
                                          Array_<DecorativeGeometry>& geom) 
@@ -146,6 +183,10 @@ public:
     }
     void calcForce(const State& state, Vector_<SpatialVec>& bodyForces, Vector_<Vec3>& particleForces, Vector& mobilityForces) const;
     Real calcPotentialEnergy(const State& state) const;
+    Stage getDependencyStage() const {return Stage::Velocity;}
+    bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                           Array_<MobilizedBodyIndex>& mobilizers) const
+    {   bodies.push_back(body1); bodies.push_back(body2); return true; }
 private:
     const SimbodyMatterSubsystem& matter;
     const MobilizedBodyIndex body1, body2;
@@ -169,6 +210,9 @@ public:
     }
     void calcForce(const State& state, Vector_<SpatialVec>& bodyForces, Vector_<Vec3>& particleForces, Vector& mobilityForces) const;
     Real calcPotentialEnergy(const State& state) const;
+    bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                           Array_<MobilizedBodyIndex>& mobilizers) const
+    {   bodies.push_back(body1); bodies.push_back(body2); return true; }
 private:
     const SimbodyMatterSubsystem& matter;
     const MobilizedBodyIndex body1, body2;
@@ -205,6 +249,10 @@ friend class MobilityLinearSpring;
                    Vector_<Vec3>& particleForces, Vector& mobilityForces) const
                    override;
     Real calcPotentialEnergy(const State& state) const override;
+    bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                           Array_<MobilizedBodyIndex>& mobilizers) const
+                           override
+    {   mobilizers.push_back(m_mobodIx); return true; }
 
     // Allocate the discrete state variable for the parameters. 
     void realizeTopology(State& s) const override {
@@ -255,6 +303,10 @@ friend class MobilityLinearDamper;
                    Vector_<Vec3>& particleForces, Vector& mobilityForces) const
                    override;
     Real calcPotentialEnergy(const State& state) const override;
+    bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                           Array_<MobilizedBodyIndex>& mobilizers) const
+                           override
+    {   mobilizers.push_back(m_mobodIx); return true; }
 
     // Allocate the discrete state variable for the parameters. 
     void realizeTopology(State& s) const override {
@@ -312,6 +364,10 @@ friend class MobilityConstantForce;
                    override;
 
     Real calcPotentialEnergy(const State& state) const override {return 0;}
+    bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                           Array_<MobilizedBodyIndex>& mobilizers) const
+                           override
+    {   mobilizers.push_back(m_mobodIx); return true; }
 
     // Allocate the discrete state variable for the force. 
     void realizeTopology(State& s) const override {
@@ -368,6 +424,10 @@ friend class MobilityLinearStop;
 
     // We're not bothering to cache P.E. -- just recalculate it when asked.
     Real calcPotentialEnergy(const State& state) const override; 
+    bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                           Array_<MobilizedBodyIndex>& mobilizers) const
+                           override
+    {   mobilizers.push_back(m_mobodIx); return true; }
 
     // Allocate the state variables and cache entry. 
     void realizeTopology(State& s) const override {
@@ -429,6 +489,10 @@ public:
 
     // This force element does not store potential energy.
     Real calcPotentialEnergy(const State& state) const override {return 0;}
+    bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                           Array_<MobilizedBodyIndex>& mobilizers) const
+                           override
+    {   mobilizers.push_back(m_mobodIx); return true; }
 
     // Allocate the needed state variable and record its index.
     void realizeTopology(State& state) const override;
@@ -515,6 +579,9 @@ public:
     }
     void calcForce(const State& state, Vector_<SpatialVec>& bodyForces, Vector_<Vec3>& particleForces, Vector& mobilityForces) const;
     Real calcPotentialEnergy(const State& state) const;
+    bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                           Array_<MobilizedBodyIndex>& mobilizers) const
+    {   bodies.push_back(body); return true; }
 private:
     const SimbodyMatterSubsystem& matter;
     const MobilizedBodyIndex body;
@@ -537,6 +604,9 @@ public:
     }
     void calcForce(const State& state, Vector_<SpatialVec>& bodyForces, Vector_<Vec3>& particleForces, Vector& mobilityForces) const;
     Real calcPotentialEnergy(const State& state) const;
+    bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                           Array_<MobilizedBodyIndex>& mobilizers) const
+    {   bodies.push_back(body); return true; }
 private:
     const SimbodyMatterSubsystem& matter;
     const MobilizedBodyIndex body;
@@ -556,6 +626,7 @@ public:
     }
     void calcForce(const State& state, Vector_<SpatialVec>& bodyForces, Vector_<Vec3>& particleForces, Vector& mobilityForces) const;
     Real calcPotentialEnergy(const State& state) const;
+    Stage getDependencyStage() const {return Stage::Velocity;}
 private:
     const SimbodyMatterSubsystem& matter;
     Real damping;
@@ -608,6 +679,14 @@ public:
     bool dependsOnlyOnPositions() const {
         return implementation->dependsOnlyOnPositions();
     }
+    Stage getDependencyStage() const override {
+        return implementation->getDependencyStage();
+    }
+    bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                           Array_<MobilizedBodyIndex>& mobilizers) const
+                           override {
+        return implementation->getForceFootprint(bodies, mobilizers);
+    }
     void calcForce(const State& state, Vector_<SpatialVec>& bodyForces, 
                    Vector_<Vec3>& particleForces, Vector& mobilityForces) 
                    const override;
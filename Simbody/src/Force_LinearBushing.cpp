@@ -66,9 +66,17 @@ public:
     bool dependsOnlyOnPositions() const {
         return false;
     }
+    // The parameters are Instance-stage variables and the dissipated energy
+    // is only an output, so the force depends only on q and u.
+    Stage getDependencyStage() const {
+        return Stage::Velocity;
+    }
     void calcForce(const State& state, Vector_<SpatialVec>& bodyForces,
                    Vector_<Vec3>& particleForces, Vector& mobilityForces) const;
     Real calcPotentialEnergy(const State& state) const;
+    bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                           Array_<MobilizedBodyIndex>& mobilizers) const
+    {   bodies.push_back(body1x); bodies.push_back(body2x); return true; }
 
     // Allocate the position and velocity cache entries. These are all
     // lazy-evaluation entries - be sure to check whether they have already
@@ -0,0 +1,512 @@
+/* -------------------------------------------------------------------------- *
+ *                               Simbody(tm)                                  *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+#include "SimTKcommon.h"
+
+#include "simbody/internal/common.h"
+#include "simbody/internal/MobilizedBody.h"
+#include "simbody/internal/SimbodyMatterSubsystem.h"
+#include "simbody/internal/Force_NonbondedPairForce.h"
+
+#include "ForceImpl.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace SimTK {
+
+namespace {
+// Integer coordinates of a neighbor-list grid cell (Vec only takes
+// floating point elements).
+struct Vec3int {
+    explicit Vec3int(int v=0) {c[0]=c[1]=c[2]=v;}
+    int& operator[](int d)       {return c[d];}
+    int  operator[](int d) const {return c[d];}
+    int c[3];
+};
+}
+
+//------------------------------------------------------------------------------
+//                          BUILT-IN PAIR POTENTIALS
+//------------------------------------------------------------------------------
+
+// E = e ((rm/r)^12 - 2 (rm/r)^6); dE/dr = 12 e/r ((rm/r)^6 - (rm/r)^12).
+Real Force::NonbondedPairForce::LennardJones::
+calcEnergy(Real r, Real cutoff, const SiteProperties& site1,
+           const SiteProperties& site2, Real& dEdr) const {
+    const Real rm  = site1.radius + site2.radius;
+    const Real e   = std::sqrt(site1.wellDepth * site2.wellDepth);
+    const Real a6  = square(cube(rm/r)),      a12  = square(a6);
+    const Real c6  = square(cube(rm/cutoff)), c12  = square(c6);
+    dEdr = 12*e/r * (a6 - a12);
+    return e*(a12 - 2*a6) - e*(c12 - 2*c6);
+}
+
+Real Force::NonbondedPairForce::SoftSphere::
+calcEnergy(Real r, Real cutoff, const SiteProperties& site1,
+           const SiteProperties& site2, Real& dEdr) const {
+    const Real overlap = site1.radius + site2.radius - r;
+    if (overlap <= 0) {dEdr = 0; return 0;}
+    dEdr = -k*overlap;
+    return k*square(overlap)/2;
+}
+
+Real Force::NonbondedPairForce::CoulombCutoff::
+calcEnergy(Real r, Real cutoff, const SiteProperties& site1,
+           const SiteProperties& site2, Real& dEdr) const {
+    const Real kqq = ke * site1.charge * site2.charge;
+    dEdr = -kqq/square(r);
+    return kqq*(1/r - 1/cutoff);
+}
+
+
+
+//------------------------------------------------------------------------------
+//                         NONBONDED PAIR FORCE IMPL
+//------------------------------------------------------------------------------
+class Force::NonbondedPairForceImpl : public ForceImpl {
+public:
+    typedef Force::NonbondedPairForce::SiteProperties SiteProperties;
+    typedef Force::NonbondedPairForce::PairPotential  PairPotential;
+
+    // The Verlet neighbor list and the scratch space used to evaluate it.
+    // This is kept in a cache entry that depends only on Instance stage so
+    // that it survives changes to the positions; we decide for ourselves
+    // when it is out of date by looking at how far the sites have moved.
+    //
+    // The sites are sorted by cell; order[a] is the site at sorted position
+    // a and cellOf[a] its cell. The partners of that site are
+    // partner[pairStart[a]] up to partner[pairStart[a+1]], and each pair
+    // appears only once.
+    struct NeighborList {
+        NeighborList() : built(false), numBuilds(0) {}
+
+        bool                    built;
+        int                     numBuilds;
+        Array_<Vec3>            refPos;     // site positions at last build
+        Array_<int>             order, cellOf, cellStart;
+        Array_<int>             pairStart, partner;
+
+        // Workspace for evaluation, indexed by site.
+        Array_<Vec3>            p_G;        // site location in Ground
+        Array_<Vec3>            s_G;        // site from body origin, in G
+        Array_<Vec3>            siteForces;
+        Array_<int>             groupStart; // in sorted positions
+        Array_< Array_<Vec3> >  groupForces;
+        Array_<Real>            groupEnergy;
+    };
+
+    NonbondedPairForceImpl(const SimbodyMatterSubsystem& matter,
+                           Real cutoff, Real skin)
+    :   matter(matter), cutoff(cutoff), skin(skin),
+        executor(0), numThreads(0) {}
+
+    // The copy gets its own executor if one is in use.
+    NonbondedPairForceImpl(const NonbondedPairForceImpl& src)
+    :   ForceImpl(src), matter(src.matter), cutoff(src.cutoff),
+        skin(src.skin), body(src.body), station(src.station),
+        properties(src.properties), potentials(src.potentials),
+        executor(0), numThreads(0), neighborListIx(src.neighborListIx)
+    {   if (src.executor) setUseParallelEvaluation(true, src.numThreads); }
+
+    ~NonbondedPairForceImpl() {delete executor;}
+
+    NonbondedPairForceImpl* clone() const override {
+        return new NonbondedPairForceImpl(*this);
+    }
+
+    int addSite(const MobilizedBody& mobod, const Vec3& stationInB,
+                const SiteProperties& props) {
+        invalidateTopologyCache();
+        body.push_back(mobod.getMobilizedBodyIndex());
+        station.push_back(stationInB);
+        properties.push_back(props);
+        return (int)body.size() - 1;
+    }
+
+    int adoptPotential(PairPotential* potential) {
+        invalidateTopologyCache();
+        potentials.push_back(ClonePtr<PairPotential>(potential));
+        return (int)potentials.size() - 1;
+    }
+
+    void setUseParallelEvaluation(bool useParallel, int nThreads) {
+        delete executor;
+        executor = 0;
+        numThreads = 0;
+        if (useParallel) {
+            if (nThreads <= 0)
+                nThreads = ParallelExecutor::getNumProcessors();
+            executor = new ParallelExecutor(nThreads);
+            numThreads = nThreads;
+        }
+    }
+
+    bool dependsOnlyOnPositions() const override {return true;}
+
+    bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                           Array_<MobilizedBodyIndex>& mobilizers) const
+                           override {
+        Array_<MobilizedBodyIndex> mine(body.begin(), body.end());
+        std::sort(mine.begin(), mine.end());
+        mine.erase(std::unique(mine.begin(), mine.end()), mine.end());
+        bodies.insert(bodies.end(), mine.begin(), mine.end());
+        return true;
+    }
+
+    void realizeTopology(State& state) const override {
+        neighborListIx = getForceSubsystem().allocateCacheEntry(state,
+            Stage::Instance, Stage::Infinity, new Value<NeighborList>());
+    }
+
+    void calcForce(const State&         state,
+                   Vector_<SpatialVec>& bodyForces,
+                   Vector_<Vec3>&       particleForces,
+                   Vector&              mobilityForces) const override;
+    Real calcPotentialEnergy(const State& state) const override;
+
+    const NeighborList& getNeighborList(const State& state) const
+    {   return Value<NeighborList>::downcast
+            (getForceSubsystem().getCacheEntry(state, neighborListIx)); }
+    NeighborList& updNeighborList(const State& state) const
+    {   return Value<NeighborList>::updDowncast
+            (getForceSubsystem().updCacheEntry(state, neighborListIx)); }
+
+    // Evaluate the pairs belonging to sorted positions first up to last,
+    // adding the forces into f (indexed by site) and returning the energy.
+    Real accumulatePairs(const NeighborList& nl, int first, int last,
+                         Vec3* f) const;
+
+private:
+friend class Force::NonbondedPairForce;
+
+    // Find the current site locations and rebuild the neighbor list if it
+    // hasn't been built or some site has moved more than half the skin.
+    void ensureNeighborListValid(const State& state, NeighborList& nl) const;
+    void buildNeighborList(NeighborList& nl) const;
+
+    // Divide the sorted sites into up to numThreads groups at cell
+    // boundaries, with roughly the same number of pairs in each.
+    void divideIntoGroups(NeighborList& nl) const;
+
+    const SimbodyMatterSubsystem&   matter;
+    const Real                      cutoff, skin;
+
+    // TOPOLOGY STATE
+    Array_<MobilizedBodyIndex>      body;
+    Array_<Vec3>                    station;
+    Array_<SiteProperties>          properties;
+    Array_< ClonePtr<PairPotential> > potentials;
+
+    // Not part of the topology; we own the executor, if any.
+    ParallelExecutor*               executor;
+    int                             numThreads;
+
+    // TOPOLOGY CACHE
+    mutable CacheEntryIndex         neighborListIx; // NeighborList
+};
+
+// This is required by Value<T>.
+inline std::ostream& operator<<
+   (std::ostream& o, const Force::NonbondedPairForceImpl::NeighborList&)
+{   assert(!"implemented"); return o; }
+
+namespace {
+// Worker-thread task that evaluates one group of sorted sites into that
+// group's private force array.
+class PairGroupTask : public ParallelExecutor::Task {
+public:
+    typedef Force::NonbondedPairForceImpl::NeighborList NeighborList;
+
+    PairGroupTask(const Force::NonbondedPairForceImpl& impl, NeighborList& nl)
+    :   impl(impl), nl(nl) {}
+
+    void execute(int group) override {
+        Array_<Vec3>& f = nl.groupForces[group];
+        std::fill(f.begin(), f.end(), Vec3(0));
+        nl.groupEnergy[group] = impl.accumulatePairs
+           (nl, nl.groupStart[group], nl.groupStart[group+1], f.begin());
+    }
+private:
+    const Force::NonbondedPairForceImpl&    impl;
+    NeighborList&                           nl;
+};
+}
+
+void Force::NonbondedPairForceImpl::
+ensureNeighborListValid(const State& state, NeighborList& nl) const {
+    const int n = (int)body.size();
+    nl.p_G.resize(n);
+    nl.s_G.resize(n);
+    for (int i=0; i < n; ++i) {
+        const Transform& X_GB =
+            matter.getMobilizedBody(body[i]).getBodyTransform(state);
+        nl.s_G[i] = X_GB.R() * station[i];
+        nl.p_G[i] = X_GB.p() + nl.s_G[i];
+    }
+
+    bool rebuild = !nl.built;
+    const Real maxMove2 = square(skin/2);
+    for (int i=0; i < n && !rebuild; ++i)
+        rebuild = (nl.p_G[i] - nl.refPos[i]).normSqr() > maxMove2;
+    if (rebuild)
+        buildNeighborList(nl);
+}
+
+// Bin the sites into a grid of cells at least cutoff+skin on a side, then
+// look for the partners of each site only in its own and adjacent cells.
+void Force::NonbondedPairForceImpl::buildNeighborList(NeighborList& nl) const {
+    const int  n = (int)body.size();
+    const Real rList = cutoff + skin;
+
+    Vec3 lo(Infinity), hi(-Infinity);
+    for (int i=0; i < n; ++i)
+        for (int d=0; d < 3; ++d) {
+            lo[d] = std::min(lo[d], nl.p_G[i][d]);
+            hi[d] = std::max(hi[d], nl.p_G[i][d]);
+        }
+
+    // Don't let the grid get much bigger than the number of sites if they
+    // are spread thinly.
+    Vec3int nCells(1);
+    for (int d=0; d < 3 && n; ++d)
+        nCells[d] = std::max(1, (int)std::min(Real(1024),
+                                              (hi[d]-lo[d])/rList));
+    while ((long long)nCells[0]*nCells[1]*nCells[2] > 2LL*n + 8)
+        for (int d=0; d < 3; ++d)
+            nCells[d] = std::max(1, nCells[d]/2);
+    Vec3 width;
+    for (int d=0; d < 3; ++d)
+        width[d] = nCells[d] > 1 ? (hi[d]-lo[d])/nCells[d] : Real(1);
+
+    Array_<Vec3int> cellOfSite(n);
+    for (int i=0; i < n; ++i)
+        for (int d=0; d < 3; ++d)
+            cellOfSite[i][d] = nCells[d] == 1 ? 0 : std::min(nCells[d]-1,
+                (int)((nl.p_G[i][d]-lo[d])/width[d]));
+
+    // Sort the sites by cell, keeping them in index order within a cell.
+    const int numCells = nCells[0]*nCells[1]*nCells[2];
+    #define CELL_ID(c) (((c)[2]*nCells[1] + (c)[1])*nCells[0] + (c)[0])
+    nl.cellStart.assign(numCells+1, 0);
+    for (int i=0; i < n; ++i)
+        ++nl.cellStart[CELL_ID(cellOfSite[i])+1];
+    for (int c=0; c < numCells; ++c)
+        nl.cellStart[c+1] += nl.cellStart[c];
+    Array_<int> next(nl.cellStart.begin(), nl.cellStart.end()-1);
+    nl.order.resize(n);
+    nl.cellOf.resize(n);
+    for (int i=0; i < n; ++i) {
+        const int c = CELL_ID(cellOfSite[i]);
+        nl.cellOf[next[c]] = c;
+        nl.order[next[c]++] = i;
+    }
+
+    // Every pair closer than the list radius is found from the site that
+    // comes first in sorted order.
+    const Real rList2 = square(rList);
+    nl.pairStart.resize(n+1);
+    nl.partner.clear();
+    nl.pairStart[0] = 0;
+    for (int a=0; a < n; ++a) {
+        const int     i = nl.order[a];
+        const Vec3int& ci = cellOfSite[i];
+        Vec3int cj;
+        for (cj[2]=std::max(0,ci[2]-1);
+             cj[2] <= std::min(nCells[2]-1,ci[2]+1); ++cj[2])
+        for (cj[1]=std::max(0,ci[1]-1);
+             cj[1] <= std::min(nCells[1]-1,ci[1]+1); ++cj[1])
+        for (cj[0]=std::max(0,ci[0]-1);
+             cj[0] <= std::min(nCells[0]-1,ci[0]+1); ++cj[0]) {
+            const int c = CELL_ID(cj);
+            for (int b = std::max(a+1, nl.cellStart[c]);
+                 b < nl.cellStart[c+1]; ++b) {
+                const int j = nl.order[b];
+                if (body[j] != body[i]
+                    && (nl.p_G[j]-nl.p_G[i]).normSqr() < rList2)
+                    nl.partner.push_back(j);
+            }
+        }
+        nl.pairStart[a+1] = (int)nl.partner.size();
+    }
+    #undef CELL_ID
+
+    nl.refPos = nl.p_G;
+    nl.built = true;
+    ++nl.numBuilds;
+}
+
+void Force::NonbondedPairForceImpl::divideIntoGroups(NeighborList& nl) const {
+    const int n = (int)body.size();
+    const int numPairs = nl.pairStart[n];
+    const int nGroups = std::max(1, std::min(numThreads, n));
+    nl.groupStart.resize(nGroups+1);
+    nl.groupStart[0] = 0;
+    for (int g=1; g < nGroups; ++g) {
+        const int target = (int)((long long)g*numPairs/nGroups);
+        int a = (int)(std::lower_bound(nl.pairStart.begin(),
+                                       nl.pairStart.end()-1, target)
+                      - nl.pairStart.begin());
+        while (a > 0 && a < n && nl.cellOf[a] == nl.cellOf[a-1])
+            ++a;
+        nl.groupStart[g] = std::max(a, nl.groupStart[g-1]);
+    }
+    nl.groupStart[nGroups] = n;
+}
+
+Real Force::NonbondedPairForceImpl::
+accumulatePairs(const NeighborList& nl, int first, int last, Vec3* f) const {
+    const Real cutoff2 = square(cutoff);
+    Real pe = 0;
+    for (int a=first; a < last; ++a) {
+        const int i = nl.order[a];
+        for (int m=nl.pairStart[a]; m < nl.pairStart[a+1]; ++m) {
+            const int  j  = nl.partner[m];
+            const Vec3 r  = nl.p_G[j] - nl.p_G[i];
+            const Real r2 = r.normSqr();
+            if (r2 >= cutoff2) continue;
+            const Real d = std::sqrt(r2);
+            Real dEdr = 0;
+            for (unsigned p=0; p < potentials.size(); ++p) {
+                Real dEdrp;
+                pe += potentials[p]->calcEnergy(d, cutoff, properties[i],
+                                                properties[j], dEdrp);
+                dEdr += dEdrp;
+            }
+            const Vec3 fi = (dEdr/d) * r; // force on site i
+            f[i] += fi;
+            f[j] -= fi;
+        }
+    }
+    return pe;
+}
+
+void Force::NonbondedPairForceImpl::
+calcForce(const State&         state,
+          Vector_<SpatialVec>& bodyForces,
+          Vector_<Vec3>&       /*particleForces*/,
+          Vector&              /*mobilityForces*/) const
+{
+    NeighborList& nl = updNeighborList(state);
+    ensureNeighborListValid(state, nl);
+    const int n = (int)body.size();
+    if (n == 0)
+        return;
+
+    nl.siteForces.assign(n, Vec3(0));
+    if (executor && !ParallelExecutor::isWorkerThread()) {
+        divideIntoGroups(nl);
+        const int nGroups = (int)nl.groupStart.size() - 1;
+        nl.groupForces.resize(nGroups);
+        nl.groupEnergy.resize(nGroups);
+        for (int g=0; g < nGroups; ++g)
+            nl.groupForces[g].resize(n);
+        PairGroupTask task(*this, nl);
+        executor->execute(task, nGroups);
+        for (int g=0; g < nGroups; ++g)
+            for (int i=0; i < n; ++i)
+                nl.siteForces[i] += nl.groupForces[g][i];
+    } else
+        accumulatePairs(nl, 0, n, nl.siteForces.begin());
+
+    for (int i=0; i < n; ++i) {
+        const Vec3& f = nl.siteForces[i];
+        bodyForces[body[i]] += SpatialVec(nl.s_G[i] % f, f);
+    }
+}
+
+Real Force::NonbondedPairForceImpl::
+calcPotentialEnergy(const State& state) const {
+    NeighborList& nl = updNeighborList(state);
+    ensureNeighborListValid(state, nl);
+    const int n = (int)body.size();
+    nl.siteForces.assign(n, Vec3(0));
+    return accumulatePairs(nl, 0, n, nl.siteForces.begin());
+}
+
+
+
+//---------------------------- NonbondedPairForce ------------------------------
+//------------------------------------------------------------------------------
+
+SimTK_INSERT_DERIVED_HANDLE_DEFINITIONS(Force::NonbondedPairForce,
+                                        Force::NonbondedPairForceImpl, Force);
+
+Force::NonbondedPairForce::NonbondedPairForce
+   (GeneralForceSubsystem& forces, const SimbodyMatterSubsystem& matter,
+    Real cutoff, Real skin)
+:   Force(new NonbondedPairForceImpl(matter, cutoff, skin)) {
+    SimTK_ERRCHK2_ALWAYS(cutoff > 0 && skin >= 0,
+        "Force::NonbondedPairForce::ctor()",
+        "The cutoff must be positive and the skin nonnegative but they were"
+        " %g and %g.", (double)cutoff, (double)skin);
+    updImpl().setForceSubsystem(forces, forces.adoptForce(*this));
+}
+
+int Force::NonbondedPairForce::
+addSite(const MobilizedBody& body, const Vec3& station,
+        const SiteProperties& properties)
+{   return updImpl().addSite(body, station, properties); }
+
+int Force::NonbondedPairForce::getNumSites() const
+{   return (int)getImpl().body.size(); }
+
+const Force::NonbondedPairForce::SiteProperties&
+Force::NonbondedPairForce::getSiteProperties(int i) const {
+    SimTK_INDEXCHECK_ALWAYS(i, getNumSites(),
+        "Force::NonbondedPairForce::getSiteProperties()");
+    return getImpl().properties[i];
+}
+
+int Force::NonbondedPairForce::adoptPotential(PairPotential* potential) {
+    SimTK_APIARGCHECK_ALWAYS(potential != 0, "Force::NonbondedPairForce",
+        "adoptPotential", "The potential must not be null.");
+    return updImpl().adoptPotential(potential);
+}
+
+int Force::NonbondedPairForce::getNumPotentials() const
+{   return (int)getImpl().potentials.size(); }
+
+Real Force::NonbondedPairForce::getCutoff() const
+{   return getImpl().cutoff; }
+Real Force::NonbondedPairForce::getSkin() const
+{   return getImpl().skin; }
+
+void Force::NonbondedPairForce::
+setUseParallelEvaluation(bool useParallel, int numThreads)
+{   updImpl().setUseParallelEvaluation(useParallel, numThreads); }
+
+bool Force::NonbondedPairForce::getUseParallelEvaluation() const
+{   return getImpl().executor != 0; }
+
+int Force::NonbondedPairForce::getNumNeighborPairs(const State& state) const {
+    const NonbondedPairForceImpl::NeighborList& nl =
+        getImpl().updNeighborList(state);
+    return nl.built ? (int)nl.partner.size() : 0;
+}
+
+int Force::NonbondedPairForce::
+getNumNeighborListBuilds(const State& state) const
+{   return getImpl().updNeighborList(state).numBuilds; }
+
+} // namespace SimTK
@@ -0,0 +1,436 @@
+/* -------------------------------------------------------------------------- *
+ *                               Simbody(tm)                                  *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+#include "SimTKcommon.h"
+#include "SpatialKernels.h"
+
+#include "simbody/internal/common.h"
+#include "simbody/internal/MobilizedBody.h"
+#include "simbody/internal/SimbodyMatterSubsystem.h"
+#include "simbody/internal/Force_TwoPointSpringBundle.h"
+
+#include "ForceImpl.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace SimTK {
+
+//------------------------------------------------------------------------------
+//                            SPRING TENSION KERNEL
+//------------------------------------------------------------------------------
+// Given the separation vectors d=p2-p1 and relative velocities v=v2-v1 of n
+// springs as a structure of arrays, along with their parameters, calculate
+// the force f=t*d/|d| that each spring applies to its first point, where
+// t=k(|d|-x0) + c (v . d/|d|) is the tension. The SIMD versions perform the
+// same operations in the same order as the scalar code so give identical
+// results; see SpatialKernels.h.
+
+template <class P> static void
+calcSpringForcesScalar(int i, int n,
+                       const P* dx, const P* dy, const P* dz,
+                       const P* vx, const P* vy, const P* vz,
+                       const P* k,  const P* x0, const P* c,
+                       P* fx, P* fy, P* fz)
+{
+    for (; i < n; ++i) {
+        const P len = std::sqrt(dx[i]*dx[i] + dy[i]*dy[i] + dz[i]*dz[i]);
+        const P ux = dx[i]/len, uy = dy[i]/len, uz = dz[i]/len;
+        const P vn = vx[i]*ux + vy[i]*uy + vz[i]*uz;
+        const P t  = k[i]*(len - x0[i]) + c[i]*vn;
+        fx[i] = t*ux; fy[i] = t*uy; fz[i] = t*uz;
+    }
+}
+
+static void calcSpringForces(int n,
+                             const float* dx, const float* dy, const float* dz,
+                             const float* vx, const float* vy, const float* vz,
+                             const float* k,  const float* x0, const float* c,
+                             float* fx, float* fy, float* fz)
+{   calcSpringForcesScalar(0, n, dx,dy,dz, vx,vy,vz, k,x0,c, fx,fy,fz); }
+
+static void calcSpringForces(int n,
+                             const double* dx, const double* dy,
+                             const double* dz, const double* vx,
+                             const double* vy, const double* vz,
+                             const double* k,  const double* x0,
+                             const double* c,
+                             double* fx, double* fy, double* fz)
+{
+    int i = 0;
+#ifdef SimTK_SPATIAL_KERNELS_AVX
+    for (; i+4 <= n; i += 4) {
+        const __m256d x = _mm256_loadu_pd(dx+i), y = _mm256_loadu_pd(dy+i),
+                      z = _mm256_loadu_pd(dz+i);
+        const __m256d len = _mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(
+            _mm256_mul_pd(x,x), _mm256_mul_pd(y,y)), _mm256_mul_pd(z,z)));
+        const __m256d ux = _mm256_div_pd(x,len), uy = _mm256_div_pd(y,len),
+                      uz = _mm256_div_pd(z,len);
+        const __m256d vn = _mm256_add_pd(_mm256_add_pd(
+            _mm256_mul_pd(_mm256_loadu_pd(vx+i), ux),
+            _mm256_mul_pd(_mm256_loadu_pd(vy+i), uy)),
+            _mm256_mul_pd(_mm256_loadu_pd(vz+i), uz));
+        const __m256d t = _mm256_add_pd(
+            _mm256_mul_pd(_mm256_loadu_pd(k+i),
+                          _mm256_sub_pd(len, _mm256_loadu_pd(x0+i))),
+            _mm256_mul_pd(_mm256_loadu_pd(c+i), vn));
+        _mm256_storeu_pd(fx+i, _mm256_mul_pd(t,ux));
+        _mm256_storeu_pd(fy+i, _mm256_mul_pd(t,uy));
+        _mm256_storeu_pd(fz+i, _mm256_mul_pd(t,uz));
+    }
+#endif
+#ifdef SimTK_SPATIAL_KERNELS_SSE2
+    for (; i+2 <= n; i += 2) {
+        const __m128d x = _mm_loadu_pd(dx+i), y = _mm_loadu_pd(dy+i),
+                      z = _mm_loadu_pd(dz+i);
+        const __m128d len = _mm_sqrt_pd(_mm_add_pd(_mm_add_pd(
+            _mm_mul_pd(x,x), _mm_mul_pd(y,y)), _mm_mul_pd(z,z)));
+        const __m128d ux = _mm_div_pd(x,len), uy = _mm_div_pd(y,len),
+                      uz = _mm_div_pd(z,len);
+        const __m128d vn = _mm_add_pd(_mm_add_pd(
+            _mm_mul_pd(_mm_loadu_pd(vx+i), ux),
+            _mm_mul_pd(_mm_loadu_pd(vy+i), uy)),
+            _mm_mul_pd(_mm_loadu_pd(vz+i), uz));
+        const __m128d t = _mm_add_pd(
+            _mm_mul_pd(_mm_loadu_pd(k+i),
+                       _mm_sub_pd(len, _mm_loadu_pd(x0+i))),
+            _mm_mul_pd(_mm_loadu_pd(c+i), vn));
+        _mm_storeu_pd(fx+i, _mm_mul_pd(t,ux));
+        _mm_storeu_pd(fy+i, _mm_mul_pd(t,uy));
+        _mm_storeu_pd(fz+i, _mm_mul_pd(t,uz));
+    }
+#endif
+    calcSpringForcesScalar(i, n, dx,dy,dz, vx,vy,vz, k,x0,c, fx,fy,fz);
+}
+
+
+
+//------------------------------------------------------------------------------
+//                       TWO POINT SPRING BUNDLE IMPL
+//------------------------------------------------------------------------------
+class Force::TwoPointSpringBundleImpl : public ForceImpl {
+public:
+    // The springs that are enabled in a State, with their parameters copied
+    // into contiguous arrays in the same order. This is an Instance-stage
+    // cache entry since the enabled flags are Instance-stage variables.
+    struct ActiveSprings {
+        Array_<int>     spring;
+        Array_<Real>    k, x0, c;
+    };
+
+    // Per-State scratch space for calcForce(), one entry per active spring.
+    // The station vectors (from body origin, expressed in Ground) are saved
+    // from the gather for use in the scatter.
+    struct Workspace {
+        Array_<Real>    dx, dy, dz, vx, vy, vz, fx, fy, fz;
+        Array_<Vec3>    s1_G, s2_G;
+    };
+
+    explicit TwoPointSpringBundleImpl(const SimbodyMatterSubsystem& matter)
+    :   matter(matter) {}
+
+    TwoPointSpringBundleImpl* clone() const override {
+        return new TwoPointSpringBundleImpl(*this);
+    }
+
+    int addSpring(const MobilizedBody& b1, const Vec3& s1,
+                  const MobilizedBody& b2, const Vec3& s2,
+                  Real stiffness, Real restLength, Real damping) {
+        invalidateTopologyCache();
+        body1.push_back(b1.getMobilizedBodyIndex());
+        body2.push_back(b2.getMobilizedBodyIndex());
+        station1.push_back(s1);
+        station2.push_back(s2);
+        k.push_back(stiffness);
+        x0.push_back(restLength);
+        c.push_back(damping);
+        return (int)k.size() - 1;
+    }
+
+    int getNumSprings() const {return (int)k.size();}
+
+    bool hasDamping() const {
+        for (unsigned i=0; i < c.size(); ++i)
+            if (c[i] != 0) return true;
+        return false;
+    }
+
+    bool dependsOnlyOnPositions() const override {return !hasDamping();}
+    Stage getDependencyStage() const override
+    {   return hasDamping() ? Stage::Velocity : Stage::Position; }
+
+    bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                           Array_<MobilizedBodyIndex>& mobilizers) const
+                           override {
+        Array_<MobilizedBodyIndex> mine(body1.begin(), body1.end());
+        mine.insert(mine.end(), body2.begin(), body2.end());
+        std::sort(mine.begin(), mine.end());
+        mine.erase(std::unique(mine.begin(), mine.end()), mine.end());
+        bodies.insert(bodies.end(), mine.begin(), mine.end());
+        return true;
+    }
+
+    void calcForce(const State&         state,
+                   Vector_<SpatialVec>& bodyForces,
+                   Vector_<Vec3>&       particleForces,
+                   Vector&              mobilityForces) const override;
+    Real calcPotentialEnergy(const State& state) const override;
+
+    Real calcTension(const State& state, int i) const;
+
+    void realizeTopology(State& state) const override {
+        const GeneralForceSubsystem& forces = getForceSubsystem();
+        enabledIx = forces.allocateDiscreteVariable(state, Stage::Instance,
+            new Value< Array_<bool> >(Array_<bool>(getNumSprings(), true)));
+        activeIx = forces.allocateCacheEntry(state, Stage::Instance,
+            new Value<ActiveSprings>());
+        workspaceIx = forces.allocateCacheEntry(state, Stage::Instance,
+            Stage::Infinity, new Value<Workspace>());
+    }
+
+    // Gather the enabled springs' parameters.
+    void realizeInstance(const State& state) const override {
+        const Array_<bool>& enabled = getEnabled(state);
+        ActiveSprings& active = Value<ActiveSprings>::updDowncast
+            (getForceSubsystem().updCacheEntry(state, activeIx));
+        active.spring.clear();
+        active.k.clear(); active.x0.clear(); active.c.clear();
+        for (int i=0; i < getNumSprings(); ++i) {
+            if (!enabled[i]) continue;
+            active.spring.push_back(i);
+            active.k.push_back(k[i]);
+            active.x0.push_back(x0[i]);
+            active.c.push_back(c[i]);
+        }
+    }
+
+    const Array_<bool>& getEnabled(const State& state) const
+    {   return Value< Array_<bool> >::downcast
+            (getForceSubsystem().getDiscreteVariable(state, enabledIx)); }
+    Array_<bool>& updEnabled(State& state) const
+    {   return Value< Array_<bool> >::updDowncast
+            (getForceSubsystem().updDiscreteVariable(state, enabledIx)); }
+
+private:
+friend class Force::TwoPointSpringBundle;
+
+    const ActiveSprings& getActiveSprings(const State& state) const
+    {   return Value<ActiveSprings>::downcast
+            (getForceSubsystem().getCacheEntry(state, activeIx)); }
+    Workspace& updWorkspace(const State& state) const
+    {   return Value<Workspace>::updDowncast
+            (getForceSubsystem().updCacheEntry(state, workspaceIx)); }
+
+    // Return the locations of spring i's stations relative to their body
+    // origins, and the vector from the first station to the second, all
+    // expressed in Ground.
+    void findStations(const State& state, int i,
+                      Vec3& s1_G, Vec3& s2_G, Vec3& d_G) const {
+        const Transform& X_GB1 =
+            matter.getMobilizedBody(body1[i]).getBodyTransform(state);
+        const Transform& X_GB2 =
+            matter.getMobilizedBody(body2[i]).getBodyTransform(state);
+        s1_G = X_GB1.R() * station1[i];
+        s2_G = X_GB2.R() * station2[i];
+        d_G  = (X_GB2.p() + s2_G) - (X_GB1.p() + s1_G);
+    }
+
+    // Return the velocity of spring i's second station relative to its first,
+    // given the stations as found by findStations().
+    Vec3 findRelativeVelocity(const State& state, int i,
+                              const Vec3& s1_G, const Vec3& s2_G) const {
+        const SpatialVec& V_GB1 =
+            matter.getMobilizedBody(body1[i]).getBodyVelocity(state);
+        const SpatialVec& V_GB2 =
+            matter.getMobilizedBody(body2[i]).getBodyVelocity(state);
+        return (V_GB2[1] + V_GB2[0] % s2_G) - (V_GB1[1] + V_GB1[0] % s1_G);
+    }
+
+    const SimbodyMatterSubsystem&   matter;
+
+    // TOPOLOGY STATE
+    Array_<MobilizedBodyIndex>      body1, body2;
+    Array_<Vec3>                    station1, station2;
+    Array_<Real>                    k, x0, c;
+
+    // TOPOLOGY CACHE
+    mutable DiscreteVariableIndex   enabledIx;      // Array_<bool>(nsprings)
+    mutable CacheEntryIndex         activeIx;       // ActiveSprings
+    mutable CacheEntryIndex         workspaceIx;    // Workspace
+};
+
+// These are required by Value<T>.
+inline std::ostream& operator<<
+   (std::ostream& o, const Force::TwoPointSpringBundleImpl::ActiveSprings&)
+{   assert(!"implemented"); return o; }
+inline std::ostream& operator<<
+   (std::ostream& o, const Force::TwoPointSpringBundleImpl::Workspace&)
+{   assert(!"implemented"); return o; }
+
+// Gather the geometry of the enabled springs into the workspace arrays,
+// calculate all their forces at once, then scatter the forces into the
+// bodies. If there is no damping we don't look at velocities at all; the
+// relative velocity arrays are just left at zero.
+void Force::TwoPointSpringBundleImpl::
+calcForce(const State&         state,
+          Vector_<SpatialVec>& bodyForces,
+          Vector_<Vec3>&       /*particleForces*/,
+          Vector&              /*mobilityForces*/) const
+{
+    const ActiveSprings& active = getActiveSprings(state);
+    const int n = (int)active.spring.size();
+    if (n == 0)
+        return;
+
+    const bool damped = hasDamping();
+    Workspace& ws = updWorkspace(state);
+    ws.dx.resize(n); ws.dy.resize(n); ws.dz.resize(n);
+    ws.vx.resize(n); ws.vy.resize(n); ws.vz.resize(n);
+    ws.fx.resize(n); ws.fy.resize(n); ws.fz.resize(n);
+    ws.s1_G.resize(n); ws.s2_G.resize(n);
+
+    for (int j=0; j < n; ++j) {
+        const int i = active.spring[j];
+        Vec3 d_G;
+        findStations(state, i, ws.s1_G[j], ws.s2_G[j], d_G);
+        ws.dx[j] = d_G[0]; ws.dy[j] = d_G[1]; ws.dz[j] = d_G[2];
+        const Vec3 v_G = damped
+            ? findRelativeVelocity(state, i, ws.s1_G[j], ws.s2_G[j])
+            : Vec3(0);
+        ws.vx[j] = v_G[0]; ws.vy[j] = v_G[1]; ws.vz[j] = v_G[2];
+    }
+
+    calcSpringForces(n, ws.dx.cbegin(), ws.dy.cbegin(), ws.dz.cbegin(),
+                     ws.vx.cbegin(), ws.vy.cbegin(), ws.vz.cbegin(),
+                     active.k.cbegin(), active.x0.cbegin(), active.c.cbegin(),
+                     ws.fx.begin(), ws.fy.begin(), ws.fz.begin());
+
+    for (int j=0; j < n; ++j) {
+        const int i = active.spring[j];
+        const Vec3 f1_G(ws.fx[j], ws.fy[j], ws.fz[j]);
+        bodyForces[body1[i]] += SpatialVec(ws.s1_G[j] % f1_G, f1_G);
+        bodyForces[body2[i]] -= SpatialVec(ws.s2_G[j] % f1_G, f1_G);
+    }
+}
+
+Real Force::TwoPointSpringBundleImpl::
+calcPotentialEnergy(const State& state) const {
+    const ActiveSprings& active = getActiveSprings(state);
+    Real pe = 0;
+    for (unsigned j=0; j < active.spring.size(); ++j) {
+        Vec3 s1_G, s2_G, d_G;
+        findStations(state, active.spring[j], s1_G, s2_G, d_G);
+        const Real stretch = d_G.norm() - active.x0[j];
+        pe += active.k[j]*square(stretch);
+    }
+    return pe/2;
+}
+
+Real Force::TwoPointSpringBundleImpl::
+calcTension(const State& state, int i) const {
+    Vec3 s1_G, s2_G, d_G;
+    findStations(state, i, s1_G, s2_G, d_G);
+    const Real len = d_G.norm();
+    Real t = k[i]*(len - x0[i]);
+    if (c[i] != 0)
+        t += c[i]*dot(findRelativeVelocity(state, i, s1_G, s2_G), d_G/len);
+    return t;
+}
+
+
+
+//--------------------------- TwoPointSpringBundle -----------------------------
+//------------------------------------------------------------------------------
+
+SimTK_INSERT_DERIVED_HANDLE_DEFINITIONS(Force::TwoPointSpringBundle,
+                                        Force::TwoPointSpringBundleImpl, Force);
+
+Force::TwoPointSpringBundle::TwoPointSpringBundle
+   (GeneralForceSubsystem& forces, const SimbodyMatterSubsystem& matter)
+:   Force(new TwoPointSpringBundleImpl(matter)) {
+    updImpl().setForceSubsystem(forces, forces.adoptForce(*this));
+}
+
+int Force::TwoPointSpringBundle::
+addSpring(const MobilizedBody& body1, const Vec3& station1,
+          const MobilizedBody& body2, const Vec3& station2,
+          Real stiffness, Real restLength, Real damping) {
+    SimTK_ERRCHK_ALWAYS(stiffness >= 0 && restLength >= 0 && damping >= 0,
+        "Force::TwoPointSpringBundle::addSpring()",
+        "Stiffness, rest length, and damping must be nonnegative.");
+    return updImpl().addSpring(body1, station1, body2, station2,
+                               stiffness, restLength, damping);
+}
+
+int Force::TwoPointSpringBundle::getNumSprings() const
+{   return getImpl().getNumSprings(); }
+
+Real Force::TwoPointSpringBundle::getStiffness(int i) const {
+    SimTK_INDEXCHECK_ALWAYS(i, getNumSprings(),
+                            "Force::TwoPointSpringBundle::getStiffness()");
+    return getImpl().k[i];
+}
+Real Force::TwoPointSpringBundle::getRestLength(int i) const {
+    SimTK_INDEXCHECK_ALWAYS(i, getNumSprings(),
+                            "Force::TwoPointSpringBundle::getRestLength()");
+    return getImpl().x0[i];
+}
+Real Force::TwoPointSpringBundle::getDamping(int i) const {
+    SimTK_INDEXCHECK_ALWAYS(i, getNumSprings(),
+                            "Force::TwoPointSpringBundle::getDamping()");
+    return getImpl().c[i];
+}
+
+void Force::TwoPointSpringBundle::
+setSpringIsEnabled(State& state, int i, bool enabled) const {
+    SimTK_INDEXCHECK_ALWAYS(i, getNumSprings(),
+                            "Force::TwoPointSpringBundle::setSpringIsEnabled()");
+    getImpl().updEnabled(state)[i] = enabled;
+}
+
+void Force::TwoPointSpringBundle::
+setAllSpringsAreEnabled(State& state, bool enabled) const {
+    Array_<bool>& flags = getImpl().updEnabled(state);
+    std::fill(flags.begin(), flags.end(), enabled);
+}
+
+bool Force::TwoPointSpringBundle::
+isSpringEnabled(const State& state, int i) const {
+    SimTK_INDEXCHECK_ALWAYS(i, getNumSprings(),
+                            "Force::TwoPointSpringBundle::isSpringEnabled()");
+    return getImpl().getEnabled(state)[i];
+}
+
+int Force::TwoPointSpringBundle::
+getNumEnabledSprings(const State& state) const {
+    const Array_<bool>& flags = getImpl().getEnabled(state);
+    return (int)std::count(flags.begin(), flags.end(), true);
+}
+
+Real Force::TwoPointSpringBundle::calcTension(const State& state, int i) const {
+    SimTK_INDEXCHECK_ALWAYS(i, getNumSprings(),
+                            "Force::TwoPointSpringBundle::calcTension()");
+    return getImpl().calcTension(state, i);
+}
+
+} // namespace SimTK
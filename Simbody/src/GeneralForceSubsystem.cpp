@@ -33,30 +33,205 @@
 #include "simbody/internal/ForceSubsystemGuts.h"
 #include "simbody/internal/GeneralForceSubsystem.h"
 #include "simbody/internal/SimbodyMatterSubsystem.h"
+#include "simbody/internal/MobilizedBody.h"
 #include "simbody/internal/MultibodySystem.h"
 
 #include "ForceImpl.h"
 
 
+#include <algorithm>
+
+
 namespace SimTK {
 
+// Force elements are classified by the last stage their forces depend on
+// (see ForceImpl::getDependencyStage()). Each of the first NumForceCaches 
+// classes gets its own cached force sum; the others are evaluated at every
+// realizeDynamics(). These also say which of the enabled force elements
+// GeneralForceSubsystemRep::calcForces() should evaluate.
+enum ForceSelection {
+    TimeForces,             // depend at most on time and parameters
+    PositionForces,         // depend at most on time and q
+    VelocityForces,         // depend at most on time, q, and u
+    NumForceCaches,
+    UncachedForces = NumForceCaches, // depend on anything else
+    AllForces               // every enabled force element
+};
+
+static ForceSelection getForceCacheClass(const ForceImpl& impl) {
+    const Stage g = impl.getDependencyStage();
+    return g <= Stage::Time     ? TimeForces 
+         : g == Stage::Position ? PositionForces
+         : g == Stage::Velocity ? VelocityForces
+         :                        UncachedForces;
+}
+
+// The stage at which each cached force class must be recalculated.
+static Stage getForceCacheStage(int which) {
+    static const Stage stages[NumForceCaches] = 
+        {Stage::Time, Stage::Position, Stage::Velocity};
+    return stages[which];
+}
+
+// Cache entries and footprint information for one class of cached force
+// elements. The valid flag is allocated at the class's stage and reset when
+// that stage is realized; the force arrays are Dynamics-stage entries whose
+// contents survive invalidation. If every force element in the class
+// declared a footprint, only the listed bodies and mobilizers (sorted, with
+// no duplicates) can have nonzero entries in the cached arrays.
+struct ForceCache {
+    ForceCache() : haveFootprints(true) {}
+
+    void invalidateIndices() {
+        isValidIndex.invalidate();
+        rigidBodyForceIndex.invalidate();
+        mobilityForceIndex.invalidate();
+        particleForceIndex.invalidate();
+    }
+
+    CacheEntryIndex             isValidIndex;
+    CacheEntryIndex             rigidBodyForceIndex;
+    CacheEntryIndex             mobilityForceIndex;
+    CacheEntryIndex             particleForceIndex;
+    bool                        haveFootprints;
+    Array_<MobilizedBodyIndex>  bodies;
+    Array_<MobilizedBodyIndex>  mobilizers;
+};
+
+// Private force arrays for parallel force evaluation, one set per group of
+// force elements, plus the lists of force elements being evaluated. Force 
+// elements with declared footprints are listed by color and don't need
+// private arrays; colorEnd[c] is one past the last entry of color c in 
+// colorList. This is kept in a cache entry rather than in the subsystem so 
+// that States can be realized concurrently, and so that it needn't be 
+// reallocated every time.
+struct ParallelForceWorkspace {
+    Array_<ForceIndex>              colorList;
+    Array_<int>                     colorEnd;
+    Array_<ForceIndex>              forceList;
+    Array_< Vector_<SpatialVec> >   rigidBodyForces;
+    Array_< Vector_<Vec3> >         particleForces;
+    Array_< Vector >                mobilityForces;
+};
+
+namespace {
+// Worker-thread task that evaluates one contiguous group of the force 
+// elements in the workspace's force list, accumulating into that group's 
+// private force arrays.
+class ParallelForceTask : public ParallelExecutor::Task {
+public:
+    ParallelForceTask(const Array_<Force*>& forces, const State& s,
+                      ParallelForceWorkspace& ws, int groupSize,
+                      const RealizeProfiler& profiler, SubsystemIndex subsys)
+    :   forces(forces), s(s), ws(ws), groupSize(groupSize), 
+        profiler(profiler), subsys(subsys) {}
+
+    void execute(int group) override {
+        Vector_<SpatialVec>& rigidBodyForces = ws.rigidBodyForces[group];
+        Vector_<Vec3>&       particleForces  = ws.particleForces[group];
+        Vector&              mobilityForces  = ws.mobilityForces[group];
+        rigidBodyForces = SpatialVec(Vec3(0), Vec3(0));
+        particleForces  = Vec3(0);
+        mobilityForces  = 0;
+
+        const int first = group*groupSize;
+        const int last  = std::min(first+groupSize, (int)ws.forceList.size());
+        for (int k=first; k < last; ++k) {
+            const ForceIndex i = ws.forceList[k];
+            RealizeProfiler::Scope scope(profiler, subsys, Stage::Dynamics,
+                                         "Force", i);
+            forces[i]->getImpl().calcForce
+               (s, rigidBodyForces, particleForces, mobilityForces);
+        }
+    }
+private:
+    const Array_<Force*>&       forces;
+    const State&                s;
+    ParallelForceWorkspace&     ws;
+    const int                   groupSize;
+    const RealizeProfiler&      profiler;
+    const SubsystemIndex        subsys;
+};
+
+// Worker-thread task that evaluates one contiguous group of a list of force 
+// elements, none of which share a body or mobilizer, accumulating directly
+// into the given force arrays.
+class ColoredForceTask : public ParallelExecutor::Task {
+public:
+    ColoredForceTask(const Array_<Force*>& forces, const State& s,
+                     const ForceIndex* list, int n, int groupSize,
+                     Vector_<SpatialVec>& rigidBodyForces,
+                     Vector_<Vec3>& particleForces, Vector& mobilityForces,
+                     const RealizeProfiler& profiler, SubsystemIndex subsys)
+    :   forces(forces), s(s), list(list), n(n), groupSize(groupSize),
+        rigidBodyForces(rigidBodyForces), particleForces(particleForces),
+        mobilityForces(mobilityForces), profiler(profiler), subsys(subsys) {}
+
+    void execute(int group) override {
+        const int first = group*groupSize;
+        const int last  = std::min(first+groupSize, n);
+        for (int k=first; k < last; ++k) {
+            RealizeProfiler::Scope scope(profiler, subsys, Stage::Dynamics,
+                                         "Force", list[k]);
+            forces[list[k]]->getImpl().calcForce
+               (s, rigidBodyForces, particleForces, mobilityForces);
+        }
+    }
+private:
+    const Array_<Force*>&       forces;
+    const State&                s;
+    const ForceIndex* const     list;
+    const int                   n;
+    const int                   groupSize;
+    Vector_<SpatialVec>&        rigidBodyForces;
+    Vector_<Vec3>&              particleForces;
+    Vector&                     mobilityForces;
+    const RealizeProfiler&      profiler;
+    const SubsystemIndex        subsys;
+};
+}
+
 // There is some tricky caching being done here for forces that have overridden
-// dependsOnlyOnPositions() (and returned "true"). This is probably only worth
-// doing for very expensive position-only forces like atomic force fields. We
-// try not to incur any overhead if there are no such forces in the System.
-// Note in particular that Force::Gravity does its own caching so doesn't make
-// use of this service.
+// getDependencyStage() or dependsOnlyOnPositions() to say that they don't 
+// depend on everything. Their forces are summed into a separate cache for 
+// each dependency stage (Time, Position, Velocity) so that only the classes
+// whose stage has been invalidated need to be recalculated; for example, 
+// changing a Dynamics-stage discrete variable recalculates only the 
+// Dynamics-dependent forces. This is probably only worth doing for expensive
+// forces like atomic force fields. We try not to incur any overhead for a
+// class with no force elements in it. Note in particular that Force::Gravity
+// does its own caching so doesn't make use of this service.
 class GeneralForceSubsystemRep : public ForceSubsystem::Guts {
 public:
     GeneralForceSubsystemRep()
-     : ForceSubsystemRep("GeneralForceSubsystem", "0.0.1")
+     : ForceSubsystemRep("GeneralForceSubsystem", "0.0.1"),
+       forceExecutor(0), numForceThreads(0), minForcesForParallelEvaluation(32)
+    {
+    }
+
+    // The copy gets its own executor if one is in use.
+    GeneralForceSubsystemRep(const GeneralForceSubsystemRep& src)
+     : ForceSubsystemRep(src), forces(src.forces),
+       forceEnabledIndex(src.forceEnabledIndex),
+       parallelForceWorkspaceIndex(src.parallelForceWorkspaceIndex),
+       forceCacheClass(src.forceCacheClass),
+       forceHasFootprint(src.forceHasFootprint),
+       forcesByColor(src.forcesByColor),
+       forceColorStart(src.forceColorStart),
+       forceExecutor(0), numForceThreads(0), 
+       minForcesForParallelEvaluation(src.minForcesForParallelEvaluation)
     {
+        for (int k = 0; k < NumForceCaches; ++k)
+            forceCache[k] = src.forceCache[k];
+        if (src.forceExecutor)
+            setUseParallelForceEvaluation(true, src.numForceThreads);
     }
     
     ~GeneralForceSubsystemRep() {
         // Delete in reverse order to be nice to heap system.
         for (int i = (int)forces.size()-1; i >= 0; --i)
             delete forces[i]; 
+        delete forceExecutor;
     }
     
     ForceIndex adoptForce(Force& force) {
@@ -98,16 +273,266 @@ public:
         if (forceEnabled[index] != shouldEnable) {
             forceEnabled[index] = shouldEnable;
 
-            // If we're caching position-dependent forces, make sure they are
+            // If this force element's forces are cached, make sure they are
             // marked invalid here.
-            if (cachedForcesAreValidCacheIndex.isValid()) {
+            const int which = forceCacheClass[index];
+            if (which < NumForceCaches 
+                && forceCache[which].isValidIndex.isValid()) {
                 Value<bool>::updDowncast
-                   (updCacheEntry(s, cachedForcesAreValidCacheIndex)) = false;
+                   (updCacheEntry(s, forceCache[which].isValidIndex)) = false;
             }
         }
     }
 
-    
+    // Return true if force element i is one of those selected by "which".
+    bool isSelected(int i, ForceSelection which) const {
+        return which == AllForces || forceCacheClass[i] == which;
+    }
+
+    // Mark the cached forces for class "which" invalid if we have any.
+    void invalidateForceCache(const State& s, ForceSelection which) const {
+        if (forceCache[which].isValidIndex.isValid()) {
+            Value<bool>::updDowncast
+               (updCacheEntry(s, forceCache[which].isValidIndex)) = false;
+        }
+    }
+
+
+    void setUseParallelForceEvaluation(bool useParallel, int numThreads) {
+        delete forceExecutor;
+        forceExecutor = 0;
+        numForceThreads = 0;
+        if (useParallel) {
+            if (numThreads <= 0)
+                numThreads = ParallelExecutor::getNumProcessors();
+            forceExecutor = new ParallelExecutor(numThreads);
+            numForceThreads = numThreads;
+        }
+    }
+
+    bool getUseParallelForceEvaluation() const {return forceExecutor != 0;}
+
+    void setMinForcesForParallelEvaluation(int minForces) {
+        SimTK_APIARGCHECK1_ALWAYS(minForces >= 1, "GeneralForceSubsystem",
+            "setMinForcesForParallelEvaluation",
+            "The minimum number of forces must be at least 1 but was %d.",
+            minForces);
+        minForcesForParallelEvaluation = minForces;
+    }
+
+    int getMinForcesForParallelEvaluation() const
+    {   return minForcesForParallelEvaluation; }
+
+    // Call calcForce() for each of the enabled force elements that is 
+    // selected by "which", adding its forces into the given arrays. If
+    // parallel evaluation is on, and there are enough force elements that
+    // permit it, they are evaluated concurrently. Those with a declared 
+    // footprint are done a color at a time, writing directly into the given
+    // arrays since no two force elements of a color touch the same entries.
+    // The rest are divided into one group per thread and evaluated into the
+    // group's private arrays, which are then added into the given arrays in
+    // group order. Either way the result doesn't depend on thread 
+    // scheduling.
+    void calcForces(const State& s, const Array_<bool>& forceEnabled,
+                    ForceSelection which,
+                    Vector_<SpatialVec>& rigidBodyForces,
+                    Vector_<Vec3>&       particleForces,
+                    Vector&              mobilityForces) const
+    {
+        const RealizeProfiler& profiler = getSystem().getRealizeProfiler();
+
+        int numParallel = 0;
+        if (forceExecutor && !ParallelExecutor::isWorkerThread()) {
+            for (int i = 0; i < (int)forces.size(); ++i) {
+                const ForceImpl& impl = forces[i]->getImpl();
+                if (forceEnabled[i] && isSelected(i, which)
+                    && impl.isParallelEvaluationAllowed())
+                    ++numParallel;
+            }
+        }
+        const bool inParallel = 
+            numParallel > 0 && numParallel >= minForcesForParallelEvaluation;
+
+        // Do the serial ones now and collect the ones without footprints.
+        ParallelForceWorkspace* ws = inParallel 
+            ? &Value<ParallelForceWorkspace>::updDowncast
+                    (updCacheEntry(s, parallelForceWorkspaceIndex)).upd()
+            : 0;
+        if (ws) ws->forceList.clear();
+        for (int i = 0; i < (int)forces.size(); ++i) {
+            if (!forceEnabled[i]) continue;
+            if (!isSelected(i, which)) continue;
+            const ForceImpl& impl = forces[i]->getImpl();
+            if (ws && impl.isParallelEvaluationAllowed()) {
+                if (!forceHasFootprint[i]) 
+                    ws->forceList.push_back(ForceIndex(i));
+                continue;
+            }
+            RealizeProfiler::Scope scope(profiler, getMySubsystemIndex(),
+                                         Stage::Dynamics, "Force", i);
+            impl.calcForce(s, rigidBodyForces, particleForces, 
+                              mobilityForces);
+        }
+        if (!ws)
+            return;
+
+        // Collect the force elements that have footprints, by color.
+        const int numColors = (int)forceColorStart.size() - 1;
+        ws->colorList.clear();
+        ws->colorEnd.clear();
+        for (int c = 0; c < numColors; ++c) {
+            for (int k = forceColorStart[c]; k < forceColorStart[c+1]; ++k) {
+                const ForceIndex i = forcesByColor[k];
+                const ForceImpl& impl = forces[i]->getImpl();
+                if (forceEnabled[i] && isSelected(i, which)
+                    && impl.isParallelEvaluationAllowed())
+                    ws->colorList.push_back(i);
+            }
+            ws->colorEnd.push_back((int)ws->colorList.size());
+        }
+
+        int first = 0;
+        for (int c = 0; c < numColors; ++c) {
+            const int n = ws->colorEnd[c] - first;
+            if (n) {
+                const int nGroups   = std::min(n, numForceThreads);
+                const int groupSize = (n + nGroups - 1) / nGroups;
+                const int nUsed     = (n + groupSize - 1) / groupSize;
+                ColoredForceTask task(forces, s, &ws->colorList[first], n,
+                                      groupSize, rigidBodyForces, 
+                                      particleForces, mobilityForces, 
+                                      profiler, getMySubsystemIndex());
+                if (nUsed == 1) task.execute(0);
+                else forceExecutor->execute(task, nUsed);
+            }
+            first = ws->colorEnd[c];
+        }
+
+        const int numPrivate = (int)ws->forceList.size();
+        if (numPrivate == 0)
+            return;
+
+        // Size the private arrays on this thread; this is only needed the
+        // first time.
+        const int nGroups   = std::min(numPrivate, numForceThreads);
+        const int groupSize = (numPrivate + nGroups - 1) / nGroups;
+        const int nUsed     = (numPrivate + groupSize - 1) / groupSize;
+        ws->rigidBodyForces.resize(nUsed);
+        ws->particleForces.resize(nUsed);
+        ws->mobilityForces.resize(nUsed);
+        for (int g = 0; g < nUsed; ++g) {
+            ws->rigidBodyForces[g].resize(rigidBodyForces.size());
+            ws->particleForces[g].resize(particleForces.size());
+            ws->mobilityForces[g].resize(mobilityForces.size());
+        }
+
+        ParallelForceTask task(forces, s, *ws, groupSize, profiler, 
+                               getMySubsystemIndex());
+        forceExecutor->execute(task, nUsed);
+
+        for (int g = 0; g < nUsed; ++g) {
+            rigidBodyForces += ws->rigidBodyForces[g];
+            particleForces  += ws->particleForces[g];
+            mobilityForces  += ws->mobilityForces[g];
+        }
+    }
+
+    // Ask each force element for its footprint. Those that have one are
+    // colored greedily so that no two force elements of the same color
+    // share a body or a mobilizer, and we note which bodies and mobilizers
+    // are touched by the force elements of each cached force class.
+    void collectForceFootprints() const {
+        const int nf = (int)forces.size();
+        forceHasFootprint.assign(nf, false);
+        for (int k = 0; k < NumForceCaches; ++k) {
+            forceCache[k].haveFootprints = true;
+            forceCache[k].bodies.clear();
+            forceCache[k].mobilizers.clear();
+        }
+
+        // Resource 2*mbx is body mbx's body force; 2*mbx+1 is its mobilizer.
+        Array_<int>             forceColor(nf, -1);
+        Array_< Array_<int> >   colorsOfResource;
+        Array_<int>             resources;
+        Array_<bool>            taken;
+        Array_<MobilizedBodyIndex> bodies, mobilizers;
+        int numColors = 0;
+        for (int i = 0; i < nf; ++i) {
+            const ForceImpl& impl = forces[i]->getImpl();
+            bodies.clear(); mobilizers.clear();
+            forceHasFootprint[i] = impl.getForceFootprint(bodies, mobilizers);
+            if (forceCacheClass[i] < NumForceCaches) {
+                ForceCache& cache = forceCache[forceCacheClass[i]];
+                if (!forceHasFootprint[i])
+                    cache.haveFootprints = false;
+                cache.bodies.insert(cache.bodies.end(),
+                                    bodies.begin(), bodies.end());
+                cache.mobilizers.insert(cache.mobilizers.end(),
+                                        mobilizers.begin(), mobilizers.end());
+            }
+            if (!forceHasFootprint[i])
+                continue;
+
+            resources.clear();
+            for (unsigned k = 0; k < bodies.size(); ++k)
+                resources.push_back(2*bodies[k]);
+            for (unsigned k = 0; k < mobilizers.size(); ++k)
+                resources.push_back(2*mobilizers[k] + 1);
+
+            taken.assign(numColors+1, false);
+            for (unsigned k = 0; k < resources.size(); ++k) {
+                const int r = resources[k];
+                if (r >= (int)colorsOfResource.size())
+                    colorsOfResource.resize(r+1);
+                for (unsigned j = 0; j < colorsOfResource[r].size(); ++j)
+                    taken[colorsOfResource[r][j]] = true;
+            }
+            int color = 0;
+            while (taken[color]) ++color;
+            if (color == numColors) ++numColors;
+            forceColor[i] = color;
+            for (unsigned k = 0; k < resources.size(); ++k)
+                colorsOfResource[resources[k]].push_back(color);
+        }
+
+        // Sort the force elements by color, keeping them in index order 
+        // within a color.
+        forceColorStart.assign(numColors+1, 0);
+        for (int i = 0; i < nf; ++i)
+            if (forceColor[i] >= 0) ++forceColorStart[forceColor[i]+1];
+        for (int c = 0; c < numColors; ++c)
+            forceColorStart[c+1] += forceColorStart[c];
+        forcesByColor.resize(forceColorStart[numColors]);
+        Array_<int> next(forceColorStart.begin(), forceColorStart.end()-1);
+        for (int i = 0; i < nf; ++i)
+            if (forceColor[i] >= 0) 
+                forcesByColor[next[forceColor[i]]++] = ForceIndex(i);
+
+        for (int k = 0; k < NumForceCaches; ++k) {
+            sortUnique(forceCache[k].bodies);
+            sortUnique(forceCache[k].mobilizers);
+        }
+    }
+
+    // If every force element in a cached class declared a footprint then
+    // only those entries of its cache can ever be nonzero, provided the
+    // cache has already been sized.
+    static bool isSparse(const ForceCache& cache,
+                         const SimbodyMatterSubsystem& matter,
+                         const Vector_<SpatialVec>& rigidBodyForceCache,
+                         const Vector_<Vec3>& particleForceCache,
+                         const Vector& mobilityForceCache) {
+        return cache.haveFootprints
+            && rigidBodyForceCache.size() == matter.getNumBodies()
+            && particleForceCache.size()  == matter.getNumParticles()
+            && mobilityForceCache.size()  == matter.getNumMobilities();
+    }
+
+    static void sortUnique(Array_<MobilizedBodyIndex>& a) {
+        std::sort(a.begin(), a.end());
+        a.erase(std::unique(a.begin(), a.end()), a.end());
+    }
+
     // These override default implementations of virtual methods in the 
     // Subsystem::Guts class.
 
@@ -116,21 +541,21 @@ public:
 
     int realizeSubsystemTopologyImpl(State& s) const  override {
         forceEnabledIndex.invalidate();
-        cachedForcesAreValidCacheIndex.invalidate();
-        rigidBodyForceCacheIndex.invalidate();
-        mobilityForceCacheIndex.invalidate();
-        particleForceCacheIndex.invalidate();
+        for (int k = 0; k < NumForceCaches; ++k)
+            forceCache[k].invalidateIndices();
+        parallelForceWorkspaceIndex.invalidate();
 
         // Some forces are disabled by default; initialize the enabled flags
-        // accordingly. Also, see if we're going to need to do any caching
-        // on behalf of any forces that don't depend on velocities. 
+        // accordingly. Also, see which classes of cached forces we're going
+        // to need on behalf of forces that don't depend on everything.
         Array_<bool> forceEnabled(getNumForces());
-        bool someForceElementNeedsCaching = false;
+        bool someForceElementNeedsCaching[NumForceCaches] = {false};
+        forceCacheClass.resize(forces.size());
         for (int i = 0; i < (int)forces.size(); ++i) {
             forceEnabled[i] = !(forces[i]->isDisabledByDefault());
-            if (!someForceElementNeedsCaching)
-                someForceElementNeedsCaching = 
-                    forces[i]->getImpl().dependsOnlyOnPositions();
+            forceCacheClass[i] = getForceCacheClass(forces[i]->getImpl());
+            if (forceCacheClass[i] < NumForceCaches)
+                someForceElementNeedsCaching[forceCacheClass[i]] = true;
         }
 
         forceEnabledIndex = allocateDiscreteVariable(s, Stage::Instance, 
@@ -139,20 +564,30 @@ public:
         // Note that we'll allocate these even if all the needs-caching 
         // elements are presently disabled. That way they'll be around when
         // the force gets enabled.
-        if (someForceElementNeedsCaching) {
-            cachedForcesAreValidCacheIndex = 
-                allocateCacheEntry(s, Stage::Position, new Value<bool>());
-            rigidBodyForceCacheIndex = allocateCacheEntry(s, Stage::Dynamics, 
+        for (int k = 0; k < NumForceCaches; ++k) {
+            if (!someForceElementNeedsCaching[k])
+                continue;
+            ForceCache& cache = forceCache[k];
+            cache.isValidIndex = allocateCacheEntry(s, getForceCacheStage(k),
+                new Value<bool>());
+            cache.rigidBodyForceIndex = allocateCacheEntry(s, Stage::Dynamics, 
                 new Value<Vector_<SpatialVec> >());
-            mobilityForceCacheIndex = allocateCacheEntry(s, Stage::Dynamics, 
+            cache.mobilityForceIndex = allocateCacheEntry(s, Stage::Dynamics, 
                 new Value<Vector>());
-            particleForceCacheIndex = allocateCacheEntry(s, Stage::Dynamics, 
+            cache.particleForceIndex = allocateCacheEntry(s, Stage::Dynamics, 
                 new Value<Vector_<Vec3> >());
         }
 
+        // This is always allocated since parallel evaluation can be turned
+        // on at any time; it stays empty until then.
+        parallelForceWorkspaceIndex = allocateCacheEntry(s, Stage::Dynamics,
+            new Value<ParallelForceWorkspace>());
+
         // We must realizeTopology() even if the force is disabled by default.
         for (int i = 0; i < (int) forces.size(); ++i)
             forces[i]->getImpl().realizeTopology(s);
+
+        collectForceFootprints();
         return 0;
     }
 
@@ -176,6 +611,9 @@ public:
     int realizeSubsystemTimeImpl(const State& s) const override {
         const Array_<bool>& enabled = Value<Array_<bool> >::downcast
             (getDiscreteVariable(s, forceEnabledIndex));
+        // If we're caching time-dependent forces, make sure they are
+        // marked invalid here.
+        invalidateForceCache(s, TimeForces);
         for (int i = 0; i < (int) forces.size(); ++i)
             if (enabled[i]) forces[i]->getImpl().realizeTime(s);
         return 0;
@@ -186,10 +624,7 @@ public:
             (getDiscreteVariable(s, forceEnabledIndex));
         // If we're caching position-dependent forces, make sure they are
         // marked invalid here.
-        if (cachedForcesAreValidCacheIndex.isValid()) {
-            Value<bool>::updDowncast
-               (updCacheEntry(s, cachedForcesAreValidCacheIndex)) = false;
-        }
+        invalidateForceCache(s, PositionForces);
         for (int i = 0; i < (int) forces.size(); ++i)
             if (enabled[i]) forces[i]->getImpl().realizePosition(s);
         return 0;
@@ -198,6 +633,8 @@ public:
     int realizeSubsystemVelocityImpl(const State& s) const override {
         const Array_<bool>& enabled = Value<Array_<bool> >::downcast
             (getDiscreteVariable(s, forceEnabledIndex));
+        // Same for velocity-dependent forces.
+        invalidateForceCache(s, VelocityForces);
         for (int i = 0; i < (int) forces.size(); ++i)
             if (enabled[i]) forces[i]->getImpl().realizeVelocity(s);
         return 0;
@@ -220,79 +657,97 @@ public:
         Vector&                mobilityForces  = 
                                     mbs.updMobilityForces (s, Stage::Dynamics);
 
-        // Short circuit if we're not doing any caching here. Note that we're
-        // checking whether the *index* is valid (i.e. does the cache entry
-        // exist?), not the contents.
-        if (!cachedForcesAreValidCacheIndex.isValid()) {
-            for (int i = 0; i < (int)forces.size(); ++i) {
-                if (forceEnabled[i]) 
-                    forces[i]->getImpl().calcForce
-                       (s, rigidBodyForces, particleForces, mobilityForces);
+        // Recalculate the cached forces of any class whose stage has been
+        // invalidated since we last did it. Note that we're checking whether
+        // the *index* is valid (i.e. does the cache entry exist?) before
+        // looking at the contents.
+        for (int k = 0; k < NumForceCaches; ++k) {
+            const ForceCache& cache = forceCache[k];
+            if (!cache.isValidIndex.isValid())
+                continue;
+            bool& cachedForcesAreValid = Value<bool>::updDowncast
+                                    (updCacheEntry(s, cache.isValidIndex));
+            if (cachedForcesAreValid)
+                continue;
+
+            Vector_<SpatialVec>&    
+                rigidBodyForceCache = Value<Vector_<SpatialVec> >::updDowncast
+                                 (updCacheEntry(s, cache.rigidBodyForceIndex));
+            Vector_<Vec3>&         
+                particleForceCache  = Value<Vector_<Vec3> >::updDowncast
+                                 (updCacheEntry(s, cache.particleForceIndex));
+            Vector&                 
+                mobilityForceCache  = Value<Vector>::updDowncast
+                                 (updCacheEntry(s, cache.mobilityForceIndex));
+
+            if (isSparse(cache, matter, rigidBodyForceCache, 
+                         particleForceCache, mobilityForceCache)) {
+                for (unsigned b = 0; b < cache.bodies.size(); ++b)
+                    rigidBodyForceCache[cache.bodies[b]] = 
+                        SpatialVec(Vec3(0), Vec3(0));
+                for (unsigned m = 0; m < cache.mobilizers.size(); ++m) {
+                    const MobilizedBody& mobod = 
+                        matter.getMobilizedBody(cache.mobilizers[m]);
+                    const int u0 = mobod.getFirstUIndex(s);
+                    for (int j = 0; j < mobod.getNumU(s); ++j)
+                        mobilityForceCache[u0+j] = 0;
+                }
+            } else {
+                rigidBodyForceCache.resize(matter.getNumBodies());
+                rigidBodyForceCache = SpatialVec(Vec3(0), Vec3(0));
+                particleForceCache.resize(matter.getNumParticles());
+                particleForceCache = Vec3(0);
+                mobilityForceCache.resize(matter.getNumMobilities());
+                mobilityForceCache = 0;
             }
 
-            // Allow forces to do their own realization, but wait until all
-            // forces have executed calcForce(). TODO: not sure if that is
-            // necessary (sherm 20130716).
-            for (int i = 0; i < (int)forces.size(); ++i)
-                if (forceEnabled[i]) 
-                    forces[i]->getImpl().realizeDynamics(s);     
-            return 0;
+            calcForces(s, forceEnabled, ForceSelection(k),
+                       rigidBodyForceCache, particleForceCache, 
+                       mobilityForceCache);
+            cachedForcesAreValid = true;
         }
 
-        // OK, we're doing some caching. This is a little messier. 
-
-        // Get access to subsystem force cache entries.
-        bool& cachedForcesAreValid = Value<bool>::downcast
-                          (updCacheEntry(s, cachedForcesAreValidCacheIndex));
-
-        Vector_<SpatialVec>&    
-            rigidBodyForceCache = Value<Vector_<SpatialVec> >::downcast
-                                 (updCacheEntry(s, rigidBodyForceCacheIndex));
-        Vector_<Vec3>&         
-            particleForceCache  = Value<Vector_<Vec3> >::downcast
-                                 (updCacheEntry(s, particleForceCacheIndex));
-        Vector&                 
-            mobilityForceCache  = Value<Vector>::downcast
-                                 (updCacheEntry(s, mobilityForceCacheIndex));
-
-
-        if (!cachedForcesAreValid) {
-            // We need to calculate the velocity independent forces.
-            rigidBodyForceCache.resize(matter.getNumBodies());
-            rigidBodyForceCache = SpatialVec(Vec3(0), Vec3(0));
-            particleForceCache.resize(matter.getNumParticles());
-            particleForceCache = Vec3(0);
-            mobilityForceCache.resize(matter.getNumMobilities());
-            mobilityForceCache = 0;
-
-            // Run through all the forces, accumulating directly into the
-            // force arrays or indirectly into the cache as appropriate.
-            for (int i = 0; i < (int) forces.size(); ++i) {
-                if (!forceEnabled[i]) continue;
-                const ForceImpl& impl = forces[i]->getImpl();
-                if (impl.dependsOnlyOnPositions())
-                    impl.calcForce(s, rigidBodyForceCache, particleForceCache, 
-                                      mobilityForceCache);
-                else // ordinary velocity dependent force
-                    impl.calcForce(s, rigidBodyForces, particleForces, 
-                                      mobilityForces);
-            }
-            cachedForcesAreValid = true;
-        } else {
-            // Cache already valid; just need to do the non-cached ones.
-            for (int i = 0; i < (int) forces.size(); ++i) {
-                if (!forceEnabled[i]) continue;
-                const ForceImpl& impl = forces[i]->getImpl();
-                if (!impl.dependsOnlyOnPositions())
-                    impl.calcForce(s, rigidBodyForces, particleForces, 
-                                      mobilityForces);
+        // Evaluate the uncached forces directly into the force arrays. If
+        // all the caches were already valid these are the only ones we need
+        // to do.
+        calcForces(s, forceEnabled, UncachedForces,
+                   rigidBodyForces, particleForces, mobilityForces);
+
+        // Accumulate the values from the caches into the global arrays, 
+        // always in the same order.
+        for (int k = 0; k < NumForceCaches; ++k) {
+            const ForceCache& cache = forceCache[k];
+            if (!cache.isValidIndex.isValid())
+                continue;
+            const Vector_<SpatialVec>&
+                rigidBodyForceCache = Value<Vector_<SpatialVec> >::downcast
+                                 (updCacheEntry(s, cache.rigidBodyForceIndex));
+            const Vector_<Vec3>&
+                particleForceCache  = Value<Vector_<Vec3> >::downcast
+                                 (updCacheEntry(s, cache.particleForceIndex));
+            const Vector&
+                mobilityForceCache  = Value<Vector>::downcast
+                                 (updCacheEntry(s, cache.mobilityForceIndex));
+
+            if (isSparse(cache, matter, rigidBodyForceCache, 
+                         particleForceCache, mobilityForceCache)) {
+                for (unsigned b = 0; b < cache.bodies.size(); ++b) {
+                    const MobilizedBodyIndex mbx = cache.bodies[b];
+                    rigidBodyForces[mbx] += rigidBodyForceCache[mbx];
+                }
+                for (unsigned m = 0; m < cache.mobilizers.size(); ++m) {
+                    const MobilizedBody& mobod = 
+                        matter.getMobilizedBody(cache.mobilizers[m]);
+                    const int u0 = mobod.getFirstUIndex(s);
+                    for (int j = 0; j < mobod.getNumU(s); ++j)
+                        mobilityForces[u0+j] += mobilityForceCache[u0+j];
+                }
+            } else {
+                rigidBodyForces += rigidBodyForceCache;
+                particleForces  += particleForceCache;
+                mobilityForces  += mobilityForceCache;
             }
         }
-
-        // Accumulate the values from the cache into the global arrays.
-        rigidBodyForces += rigidBodyForceCache;
-        particleForces += particleForceCache;
-        mobilityForces += mobilityForceCache;
         
         // Allow forces to do their own Dynamics-stage realization. Note that
         // this *follows* all the calcForce() calls.
@@ -352,12 +807,31 @@ private:
     // This instance-stage variable holds a bool for each force element.
     mutable DiscreteVariableIndex   forceEnabledIndex;
 
-    // This set of cache entries is allocated only if some force element
-    // overrode dependsOnlyOnPositions().
-    mutable CacheEntryIndex         cachedForcesAreValidCacheIndex;
-    mutable CacheEntryIndex         rigidBodyForceCacheIndex;
-    mutable CacheEntryIndex         mobilityForceCacheIndex;
-    mutable CacheEntryIndex         particleForceCacheIndex;
+    // This holds a ParallelForceWorkspace.
+    mutable CacheEntryIndex         parallelForceWorkspaceIndex;
+
+    // The ForceSelection class of each force element, and the cache entries
+    // and footprint unions for each cached class. A class's cache entries
+    // are allocated only if some force element belongs to it.
+    mutable Array_<int>             forceCacheClass;
+    mutable ForceCache              forceCache[NumForceCaches];
+
+    // Force element footprints; see collectForceFootprints(). The force
+    // elements that declared a footprint are listed by color in 
+    // forcesByColor, with color c occupying entries forceColorStart[c] up
+    // to forceColorStart[c+1].
+    mutable Array_<bool>                forceHasFootprint;
+    mutable Array_<ForceIndex>          forcesByColor;
+    mutable Array_<int>                 forceColorStart;
+
+        // MULTITHREADING
+
+    // These are not part of the topology; they can be changed at any time
+    // and have no effect on results beyond roundoff. The executor is null
+    // unless parallel force evaluation has been requested; we own it.
+    ParallelExecutor*               forceExecutor;
+    int                             numForceThreads;
+    int                             minForcesForParallelEvaluation;
 };
 
     ///////////////////////////
@@ -420,6 +894,19 @@ void GeneralForceSubsystem::setForceIsDisabled
    (State& state, ForceIndex index, bool disabled) const 
 {   getRep().setForceIsDisabled(state, index, disabled); }
 
+void GeneralForceSubsystem::
+setUseParallelForceEvaluation(bool useParallel, int numThreads)
+{   updRep().setUseParallelForceEvaluation(useParallel, numThreads); }
+
+bool GeneralForceSubsystem::getUseParallelForceEvaluation() const
+{   return getRep().getUseParallelForceEvaluation(); }
+
+void GeneralForceSubsystem::setMinForcesForParallelEvaluation(int minForces)
+{   updRep().setMinForcesForParallelEvaluation(minForces); }
+
+int GeneralForceSubsystem::getMinForcesForParallelEvaluation() const
+{   return getRep().getMinForcesForParallelEvaluation(); }
+
 const MultibodySystem& GeneralForceSubsystem::getMultibodySystem() const
 {   return MultibodySystem::downcast(getSystem()); }
 
@@ -144,6 +144,38 @@ MultibodySystem::calcKineticEnergy(const State& s) const {
     return getMatterSubsystem().getRep().calcKineticEnergy(s);
 }
 
+// Each stage through Velocity is done for all the States before going on to
+// the next. The matter subsystem's tree kinematics sweeps are done for the
+// whole ensemble first; realizing the stage then picks up the rest.
+void MultibodySystem::realizeEnsemble(const ArrayViewConst_<State>& states,
+                                      Stage stage) const {
+    const SimbodyMatterSubsystemRep& matter = getMatterSubsystem().getRep();
+    const int n = (int)states.size();
+    Array_<const State*> ensemble; ensemble.reserve(n);
+    for (int g=Stage::Position; g <= Stage::Velocity && g <= stage; ++g) {
+        ensemble.clear();
+        for (int k=0; k < n; ++k) {
+            if (states[k].getSystemStage() >= Stage(g))
+                continue;
+            realize(states[k], Stage(g).prev());
+            ensemble.push_back(&states[k]);
+        }
+        int k = 0;
+        try {
+            matter.realizeTreeEnsemble(ensemble, Stage(g));
+            for (; k < (int)ensemble.size(); ++k)
+                realize(*ensemble[k], Stage(g));
+        } catch (...) {
+            // The States we didn't finish must not think they're done.
+            for (; k < (int)ensemble.size(); ++k)
+                matter.cancelTreeEnsemble(*ensemble[k], Stage(g));
+            throw;
+        }
+    }
+    for (int k=0; k < n; ++k)
+        realize(states[k], stage);
+}
+
 const Vector_<SpatialVec>& 
 MultibodySystem::getRigidBodyForces(const State& s, Stage g) const {
     return getRep().getRigidBodyForces(s,g);
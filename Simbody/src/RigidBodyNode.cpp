@@ -31,6 +31,7 @@
 #include "SimbodyMatterSubsystemRep.h"
 #include "RigidBodyNode.h"
 #include "RigidBodyNodeSpec.h"
+#include "SpatialKernels.h"
 
 
 //////////////////////////////////////////////
@@ -43,6 +44,116 @@ void RigidBodyNode::addChild(RigidBodyNode* child) {
 
 
 
+//==============================================================================
+//                            TYPE-BATCHED SWEEPS
+//==============================================================================
+// Default implementations just call the virtual method for each node.
+
+void RigidBodyNode::realizePositionBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBStateDigest&                    sbs) const
+{
+    for (int i=0; i < n; ++i)
+        nodes[i]->realizePosition(sbs);
+}
+
+void RigidBodyNode::realizeVelocityBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBStateDigest&                    sbs) const
+{
+    for (int i=0; i < n; ++i)
+        nodes[i]->realizeVelocity(sbs);
+}
+
+void RigidBodyNode::realizeDynamicsBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const SBStateDigest&                    sbs) const
+{
+    for (int i=0; i < n; ++i)
+        nodes[i]->realizeDynamics(abc, sbs);
+}
+
+void RigidBodyNode::realizeArticulatedBodyInertiasInwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    SBArticulatedBodyInertiaCache&          abc) const
+{
+    for (int i=0; i < n; ++i)
+        nodes[i]->realizeArticulatedBodyInertiasInward(ic, pc, abc);
+}
+
+void RigidBodyNode::calcUDotPass1InwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const SBDynamicsCache&                  dc,
+    const Real*                             jointForces,
+    const SpatialVec*                       bodyForces,
+    const Real*                             allUDot,
+    SpatialVec*                             allZ,
+    SpatialVec*                             allGepsilon,
+    Real*                                   allEpsilon) const
+{
+    for (int i=0; i < n; ++i)
+        nodes[i]->calcUDotPass1Inward(ic, pc, abc, dc, jointForces, bodyForces, allUDot, allZ, allGepsilon, allEpsilon);
+}
+
+void RigidBodyNode::calcUDotPass2OutwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const SBTreeVelocityCache&              vc,
+    const SBDynamicsCache&                  dc,
+    const Real*                             epsilonTmp,
+    SpatialVec*                             allA_GB,
+    Real*                                   allUDot,
+    Real*                                   allTau) const
+{
+    for (int i=0; i < n; ++i)
+        nodes[i]->calcUDotPass2Outward(ic, pc, abc, vc, dc, epsilonTmp, allA_GB, allUDot, allTau);
+}
+
+void RigidBodyNode::multiplyByMInvPass1InwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const Real*                             f,
+    SpatialVec*                             allZ,
+    SpatialVec*                             allGepsilon,
+    Real*                                   allEpsilon) const
+{
+    for (int i=0; i < n; ++i)
+        nodes[i]->multiplyByMInvPass1Inward(ic, pc, abc, f, allZ, allGepsilon, allEpsilon);
+}
+
+void RigidBodyNode::multiplyByMInvPass2OutwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const Real*                             epsilonTmp,
+    SpatialVec*                             allA_GB,
+    Real*                                   allUDot) const
+{
+    for (int i=0; i < n; ++i)
+        nodes[i]->multiplyByMInvPass2Outward(ic, pc, abc, epsilonTmp, allA_GB, allUDot);
+}
+
+
+
 //==============================================================================
 //                    CALC JOINT INDEPENDENT KINEMATICS POS
 //==============================================================================
@@ -107,10 +218,21 @@ RigidBodyNode::calcJointIndependentKinematicsVel(
 
     const SpatialVec& V_GP   = parent->getV_GB(vc); // parent P's velocity in G
     const SpatialVec& V_PB_G = getV_PB_G(vc); // child B's vel in P, exp. in G
-    const PhiMatrixTranspose PhiT = ~getPhi(pc); // shift outwards
+    const SpatialVec& A_GP   = parent->getTotalCoriolisAcceleration(vc);
+    const Vec3&       l      = getPhi(pc).l();
+
+    // The cross products below are done in independent pairs using the
+    // SIMD kernel cross2(); results are the same as the spatial algebra
+    // operators noted in the comments.
+
+    // Shift parent velocity and coriolis acceleration outwards:
+    // ~Phi*V_GP and ~Phi*A_GP (the latter is used at the end).
+    Vec3 wxl, axl;
+    Impl::cross2(V_GP[0], l, A_GP[0], l, wxl, axl); // 18 flops
 
     // calc spatial velocity of B's origin Bo in G (angular,linear)
-    const SpatialVec V_GB = PhiT*V_GP + V_PB_G; // 18 flops
+    const SpatialVec V_GB(V_GP[0] + V_PB_G[0],             // 6 flops
+                          (V_GP[1] + wxl) + V_PB_G[1]);     // = ~Phi*V_GP+V_PB_G
     updV_GB(vc) = V_GB;
 
     const Vec3& w_GB = V_GB[0]; // for convenience
@@ -122,9 +244,11 @@ RigidBodyNode::calcJointIndependentKinematicsVel(
     // it is needed in inverse dynamics but does not require articulated body 
     // inertias to be calculated. This could be deferred until needed but
     // probably isn't worth the trouble.
-    updGyroscopicForce(vc) = getMass() *                   // 6 flops
-        SpatialVec( w_GB % (getUnitInertia_OB_G(pc)*w_GB), // moment (24 flops)
-                   (w_GB % (w_GB % getCB_G(pc))));         // force  (18 flops)
+    //      moment = m * w_GB % (G_Bo*w_GB)
+    //      force  = m * w_GB % (w_GB % p_BBc)
+    Vec3 wxGw, wxc, wxwxc;
+    Impl::cross2(w_GB, getUnitInertia_OB_G(pc)*w_GB,       // 33 flops
+                 w_GB, getCB_G(pc), wxGw, wxc);
 
 
     // Parent velocity.
@@ -161,17 +285,22 @@ RigidBodyNode::calcJointIndependentKinematicsVel(
     // Note: despite all the ground-relative velocities here, this is just
     // the contribution of the cross-joint velocity, but reexpressed in G.
     const SpatialVec& VD_PB_G = getVD_PB_G(vc);
+    Vec3 wxdv;
+    Impl::cross2(w_GB, wxc, w_GP, v_GB-v_GP, wxwxc, wxdv); // 21 flops
+
+    updGyroscopicForce(vc) = getMass() * SpatialVec(wxGw, wxwxc); // 6 flops
+
     const SpatialVec  Amob(VD_PB_G[0], 
-                           VD_PB_G[1] + w_GP % (v_GB-v_GP)); // 15 flops
+                           VD_PB_G[1] + wxdv); // = VD_PB_G + (0, w_GP % (v_GB-v_GP))
 
     updMobilizerCoriolisAcceleration(vc) = Amob;
 
     // Finally, the total coriolis acceleration (normally just called "coriolis
     // acceleration"!) of body B is the total coriolis acceleration of its 
     // parent shifted outward, plus B's local contribution that we just 
-    // calculated.
+    // calculated: ~Phi*A_GP + Amob.
     updTotalCoriolisAcceleration(vc) =
-        PhiT * parent->getTotalCoriolisAcceleration(vc) + Amob; // 18 flops
+        SpatialVec(A_GP[0] + Amob[0], (A_GP[1] + axl) + Amob[1]); // 9 flops
 }
 
 
@@ -555,6 +555,77 @@ virtual void multiplyByMInvPass2Outward(
     SpatialVec*                             allA_GB,
     Real*                                   allUDot) const=0;
 
+// These apply one of the tree sweep methods above to each of a batch of n
+// nodes, which must all have exactly the same concrete type as this node and
+// must not depend on one another (for example, all at the same level of the
+// tree). They are called on the first node of the batch. The default
+// implementations just make the virtual call for each node. RigidBodyNodeSpec
+// and RBNodeFinal override these so that there is one virtual call per batch
+// rather than per node, with the mobilizer-specific methods bound statically.
+virtual void realizePositionBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBStateDigest&                    sbs) const;
+virtual void realizeVelocityBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBStateDigest&                    sbs) const;
+virtual void realizeDynamicsBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const SBStateDigest&                    sbs) const;
+virtual void realizeArticulatedBodyInertiasInwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    SBArticulatedBodyInertiaCache&          abc) const;
+virtual void calcUDotPass1InwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const SBDynamicsCache&                  dc,
+    const Real*                             jointForces,
+    const SpatialVec*                       bodyForces,
+    const Real*                             allUDot,
+    SpatialVec*                             allZ,
+    SpatialVec*                             allGepsilon,
+    Real*                                   allEpsilon) const;
+virtual void calcUDotPass2OutwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const SBTreeVelocityCache&              vc,
+    const SBDynamicsCache&                  dc,
+    const Real*                             epsilonTmp,
+    SpatialVec*                             allA_GB,
+    Real*                                   allUDot,
+    Real*                                   allTau) const;
+virtual void multiplyByMInvPass1InwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const Real*                             f,
+    SpatialVec*                             allZ,
+    SpatialVec*                             allGepsilon,
+    Real*                                   allEpsilon) const;
+virtual void multiplyByMInvPass2OutwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const Real*                             epsilonTmp,
+    SpatialVec*                             allA_GB,
+    Real*                                   allUDot) const;
+
 // Also serves as pass 1 for inverse dynamics.
 virtual void calcBodyAccelerationsFromUdotOutward(
     const SBTreePositionCache&  pc,
@@ -584,6 +655,84 @@ virtual void multiplyByMPass2Inward(
     Real*                       allTau) const
   { SimTK_THROW2(Exception::UnimplementedVirtualMethod, "RigidBodeNode", "multiplyByMPass2Inward"); }
 
+// These two passes calculate the columns [col0,col1) of M^-1 at once by
+// applying the multiplyByMInv() passes to those columns of the identity
+// matrix simultaneously. Each node deals only with the columns from its own
+// first u onwards, since earlier columns are known by symmetry. On the inward
+// pass, only columns belonging to the node's subtree can be nonzero; this
+// node's subtree columns all lie in [uIndex,allColEnd[nodeNum]), which this
+// pass sets. allZPlus and allA_GB are nb X (col1-col0) arrays stored by node,
+// with element (nodeNum,col) at [nodeNum*(col1-col0) + col-col0]; they may
+// share storage. MInv is a contiguous nu X nu matrix with column c starting
+// at MInv[c*nu]. Pass 1 leaves epsilon in this node's rows of MInv; pass 2
+// replaces it with the result.
+virtual void calcMInvPass1Inward(
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    int                                     nu,
+    int                                     col0,
+    int                                     col1,
+    int*                                    allColEnd,
+    SpatialVec*                             allZPlus,
+    Real*                                   MInv) const
+  { SimTK_THROW2(Exception::UnimplementedVirtualMethod, "RigidBodeNode", "calcMInvPass1Inward"); }
+virtual void calcMInvPass2Outward(
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    int                                     nu,
+    int                                     col0,
+    int                                     col1,
+    const int*                              allColEnd,
+    SpatialVec*                             allA_GB,
+    Real*                                   MInv) const
+  { SimTK_THROW2(Exception::UnimplementedVirtualMethod, "RigidBodeNode", "calcMInvPass2Outward"); }
+
+// These are the multiplyByMInv() and multiplyByM() passes applied to ncol
+// right-hand sides at once, so that the tree is swept only once and each node
+// fetches its geometry once for all the columns. The inputs and outputs are 
+// contiguous nu X ncol matrices with column c starting at [c*nu]; input and
+// output may be the same matrix. The temporaries are nb X ncol arrays stored
+// by node, with element (nodeNum,c) at [nodeNum*ncol+c]. For M^-1, pass 1 
+// leaves epsilon in this node's rows of MInvF; pass 2 replaces it with the 
+// result.
+virtual void multiplyByMInvMultiPass1Inward(
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    int                                     nu,
+    int                                     ncol,
+    const Real*                             F,
+    SpatialVec*                             allZPlus,
+    Real*                                   MInvF) const
+  { SimTK_THROW2(Exception::UnimplementedVirtualMethod, "RigidBodeNode", "multiplyByMInvMultiPass1Inward"); }
+virtual void multiplyByMInvMultiPass2Outward(
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    int                                     nu,
+    int                                     ncol,
+    SpatialVec*                             allA_GB,
+    Real*                                   MInvF) const
+  { SimTK_THROW2(Exception::UnimplementedVirtualMethod, "RigidBodeNode", "multiplyByMInvMultiPass2Outward"); }
+
+virtual void multiplyByMMultiPass1Outward(
+    const SBTreePositionCache&  pc,
+    int                         nu,
+    int                         ncol,
+    const Real*                 A,
+    SpatialVec*                 allA_GB) const
+  { SimTK_THROW2(Exception::UnimplementedVirtualMethod, "RigidBodeNode", "multiplyByMMultiPass1Outward"); }
+virtual void multiplyByMMultiPass2Inward(
+    const SBTreePositionCache&  pc,
+    int                         nu,
+    int                         ncol,
+    const SpatialVec*           allA_GB,
+    SpatialVec*                 allF,
+    Real*                       MA) const
+  { SimTK_THROW2(Exception::UnimplementedVirtualMethod, "RigidBodeNode", "multiplyByMMultiPass2Inward"); }
+
 
 virtual void setVelFromSVel(const SBStateDigest&,
                             const SpatialVec&, Vector& u) const {SimTK_THROW2(Exception::UnimplementedVirtualMethod, "RigidBodeNode", "setVelFromSVel");}
@@ -554,6 +554,193 @@ RigidBodyNodeSpec<dof, noR_FM, noX_MB, noR_PF>::multiplyByMInvPass2Outward(
 
 
 
+//==============================================================================
+//                                 CALC M INV
+//==============================================================================
+// These are the above multiplyByMInv() passes applied to a block of columns
+// of the identity matrix at once; see RigidBodyNode.h for the arguments. The
+// calculation for column c is exactly the same as multiplyByMInv() would do 
+// with f=e_c, except that we skip work on columns where we know the answer is
+// zero or can get it by symmetry. The total cost is still O(n^2) but with a
+// much smaller constant than n separate multiplyByMInv() calls.
+
+// Pass 1, to be called from tip to base. Only columns of this node's subtree
+// can be nonzero here, and those all have column numbers at least as large as
+// this node's first u.
+template<int dof, bool noR_FM, bool noX_MB, bool noR_PF> void
+RigidBodyNodeSpec<dof, noR_FM, noX_MB, noR_PF>::calcMInvPass1Inward(
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    int                                     nu,
+    int                                     col0,
+    int                                     col1,
+    int*                                    allColEnd,
+    SpatialVec*                             allZPlus,
+    Real*                                   MInv) const
+{
+    const int   firstCol = uIndex;
+    const int   width    = col1 - col0;
+    int&        colEnd   = allColEnd[nodeNum];
+    SpatialVec* zPlus    = &allZPlus[nodeNum*width];
+
+    colEnd = firstCol + dof;
+    for (unsigned i=0; i<children.size(); i++)
+        colEnd = std::max(colEnd, allColEnd[children[i]->getNodeNum()]);
+
+    const int cBegin = std::max(firstCol, col0), cEnd = std::min(colEnd, col1);
+    for (int c=cBegin; c < cEnd; ++c)
+        zPlus[c-col0] = SpatialVec(Vec3(0), Vec3(0));
+
+    for (unsigned i=0; i<children.size(); i++) {
+        const MobilizedBodyIndex child     = children[i]->getNodeNum();
+        const PhiMatrix&         phiChild  = children[i]->getPhi(pc);
+        const SpatialVec*        zPlusChild = &allZPlus[child*width];
+        const int childEnd = std::min(allColEnd[child], col1);
+        const int childBegin = std::max((int)children[i]->getUIndex(), col0);
+        for (int c=childBegin; c < childEnd; ++c)
+            zPlus[c-col0] += phiChild * zPlusChild[c-col0]; // 18 flops
+    }
+
+    if (isUDotKnown(ic))
+        return; // prescribed; zPlus = z
+
+    const HType& H = getH(pc);
+    const HType& G = getG(abc);
+    for (int c=cBegin; c < cEnd; ++c) {
+        Vec<dof>& eps = Vec<dof>::updAs(&MInv[c*nu + firstCol]);
+        eps = -(~H*zPlus[c-col0]);              // 12*dof flops
+        if (c < firstCol + dof) eps[c-firstCol] += 1;
+        zPlus[c-col0] += G*eps;                 // 12*dof flops
+    }
+}
+
+// Pass 2, to be called from base to tip. All columns in the block from this
+// node's first u onwards are calculated; the earlier ones are zero or known by
+// symmetry. The parent's first u is no later than ours so it has already
+// calculated all the columns we need.
+template<int dof, bool noR_FM, bool noX_MB, bool noR_PF> void 
+RigidBodyNodeSpec<dof, noR_FM, noX_MB, noR_PF>::calcMInvPass2Outward(
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    int                                     nu,
+    int                                     col0,
+    int                                     col1,
+    const int*                              allColEnd,
+    SpatialVec*                             allA_GB,
+    Real*                                   MInv) const
+{
+    const int           firstCol = uIndex;
+    const int           colEnd   = allColEnd[nodeNum];
+    const int           width    = col1 - col0;
+    SpatialVec*         A_GB     = &allA_GB[nodeNum*width];
+    const SpatialVec*   A_GP     = &allA_GB[parent->getNodeNum()*width];
+
+    const bool isPrescribed = isUDotKnown(ic);
+    const HType&        H   = getH(pc);
+    const PhiMatrix&    phi = getPhi(pc);
+    const Mat<dof,dof>& DI  = getDI(abc);
+    const HType&        G   = getG(abc);
+
+    for (int c=std::max(firstCol, col0); c < col1; ++c) {
+        Vec<dof>& udot = Vec<dof>::updAs(&MInv[c*nu + firstCol]);
+        // Shift parent's acceleration outward (Ground==0). 12 flops
+        const SpatialVec APlus = ~phi * A_GP[c-col0];
+        if (isPrescribed) {
+            udot         = 0;
+            A_GB[c-col0] = APlus;
+        } else {
+            // epsilon is zero outside this node's subtree.
+            if (c < colEnd) udot = DI*udot - ~G*APlus;  // 2dof^2+11dof flops
+            else            udot = -(~G*APlus);         // 11dof flops
+            A_GB[c-col0] = APlus + H*udot;              // 12 dof flops
+        }
+    }
+}
+
+
+
+//==============================================================================
+//                     MULTIPLY BY M INV (MULTIPLE COLUMNS)
+//==============================================================================
+// These are the multiplyByMInv() passes applied to ncol right-hand sides at
+// once; see RigidBodyNode.h for the arguments. The arithmetic for each column
+// is identical to multiplyByMInv() but we only visit each node once.
+
+// Pass 1, to be called from tip to base.
+template<int dof, bool noR_FM, bool noX_MB, bool noR_PF> void
+RigidBodyNodeSpec<dof, noR_FM, noX_MB, noR_PF>::multiplyByMInvMultiPass1Inward(
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    int                                     nu,
+    int                                     ncol,
+    const Real*                             F,
+    SpatialVec*                             allZPlus,
+    Real*                                   MInvF) const
+{
+    SpatialVec* zPlus = &allZPlus[nodeNum*ncol];
+
+    for (int c=0; c < ncol; ++c)
+        zPlus[c] = SpatialVec(Vec3(0), Vec3(0));
+
+    for (unsigned i=0; i<children.size(); i++) {
+        const PhiMatrix&  phiChild   = children[i]->getPhi(pc);
+        const SpatialVec* zPlusChild = &allZPlus[children[i]->getNodeNum()*ncol];
+        for (int c=0; c < ncol; ++c)
+            zPlus[c] += phiChild * zPlusChild[c]; // 18 flops
+    }
+
+    if (isUDotKnown(ic))
+        return; // prescribed; zPlus = z
+
+    const HType& H = getH(pc);
+    const HType& G = getG(abc);
+    for (int c=0; c < ncol; ++c) {
+        const Vec<dof>& f   = Vec<dof>::getAs(&F[c*nu + uIndex]);
+        Vec<dof>&       eps = Vec<dof>::updAs(&MInvF[c*nu + uIndex]);
+        eps = f - ~H*zPlus[c];  // 12*dof flops (f may be eps)
+        zPlus[c] += G*eps;      // 12*dof flops
+    }
+}
+
+// Pass 2, to be called from base to tip.
+template<int dof, bool noR_FM, bool noX_MB, bool noR_PF> void 
+RigidBodyNodeSpec<dof, noR_FM, noX_MB, noR_PF>::multiplyByMInvMultiPass2Outward(
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    int                                     nu,
+    int                                     ncol,
+    SpatialVec*                             allA_GB,
+    Real*                                   MInvF) const
+{
+    SpatialVec*         A_GB = &allA_GB[nodeNum*ncol];
+    const SpatialVec*   A_GP = &allA_GB[parent->getNodeNum()*ncol];
+
+    const bool isPrescribed = isUDotKnown(ic);
+    const HType&        H   = getH(pc);
+    const PhiMatrix&    phi = getPhi(pc);
+    const Mat<dof,dof>& DI  = getDI(abc);
+    const HType&        G   = getG(abc);
+
+    for (int c=0; c < ncol; ++c) {
+        Vec<dof>& udot = Vec<dof>::updAs(&MInvF[c*nu + uIndex]);
+        // Shift parent's acceleration outward (Ground==0). 12 flops
+        const SpatialVec APlus = ~phi * A_GP[c];
+        if (isPrescribed) {
+            udot    = 0;
+            A_GB[c] = APlus;
+        } else {
+            udot    = DI*udot - ~G*APlus;   // 2dof^2 + 11 dof flops
+            A_GB[c] = APlus + H*udot;       // 12 dof flops
+        }
+    }
+}
+
+
+
 //==============================================================================
 //                     CALC BODY ACCELERATIONS FROM UDOT
 //==============================================================================
@@ -695,6 +882,57 @@ RigidBodyNodeSpec<dof, noR_FM, noX_MB, noR_PF>::multiplyByMPass2Inward(
     tau = ~getH(pc)*F;          // 11*dof flops
 }
 
+// These are the above two passes applied to ncol columns at once; see
+// RigidBodyNode.h for the arguments. Call base to tip.
+template<int dof, bool noR_FM, bool noX_MB, bool noR_PF> void 
+RigidBodyNodeSpec<dof, noR_FM, noX_MB, noR_PF>::multiplyByMMultiPass1Outward(
+    const SBTreePositionCache&  pc,
+    int                         nu,
+    int                         ncol,
+    const Real*                 A,
+    SpatialVec*                 allA_GB) const
+{
+    SpatialVec*       A_GB = &allA_GB[nodeNum*ncol];
+    const SpatialVec* A_GP = &allA_GB[parent->getNodeNum()*ncol];
+    const HType&      H    = getH(pc);
+    const PhiMatrix&  phi  = getPhi(pc);
+
+    for (int c=0; c < ncol; ++c) {
+        const Vec<dof>& udot = Vec<dof>::getAs(&A[c*nu + uIndex]);
+        A_GB[c] = ~phi*A_GP[c] + H*udot;  // 12*dof+12 flops
+    }
+}
+
+// Call tip to base after calling multiplyByMMultiPass1Outward() for each
+// rigid body.
+template<int dof, bool noR_FM, bool noX_MB, bool noR_PF> void
+RigidBodyNodeSpec<dof, noR_FM, noX_MB, noR_PF>::multiplyByMMultiPass2Inward(
+    const SBTreePositionCache&  pc,
+    int                         nu,
+    int                         ncol,
+    const SpatialVec*           allA_GB,
+    SpatialVec*                 allF,   // temp
+    Real*                       MA) const 
+{
+    const SpatialVec*     A_GB = &allA_GB[nodeNum*ncol];
+    SpatialVec*           F    = &allF[nodeNum*ncol];
+    const SpatialInertia& Mk   = getMk_G(pc);
+    const HType&          H    = getH(pc);
+
+    for (int c=0; c < ncol; ++c)
+        F[c] = Mk*A_GB[c];      // 45 flops
+
+    for (unsigned i=0; i<children.size(); ++i) {
+        const PhiMatrix&  phiChild = children[i]->getPhi(pc);
+        const SpatialVec* FChild   = &allF[children[i]->getNodeNum()*ncol];
+        for (int c=0; c < ncol; ++c)
+            F[c] += phiChild * FChild[c]; // 18 flops
+    }
+
+    for (int c=0; c < ncol; ++c)
+        Vec<dof>::updAs(&MA[c*nu + uIndex]) = ~H*F[c]; // 11*dof flops
+}
+
 
 
 //==============================================================================
@@ -860,6 +1098,109 @@ RigidBodyNodeSpec<dof, noR_FM, noX_MB, noR_PF>::setVelFromSVel(
     toU(u) = ~getH(pc) * (sVel - (~getPhi(pc) * parent->getV_GB(mc)));
 }
 
+//==============================================================================
+//                            TYPE-BATCHED SWEEPS
+//==============================================================================
+// Every node in a batch has the same concrete type as this one, and none of
+// the concrete node types override the RigidBodyNodeSpec sweep methods, so
+// we can call those directly rather than through the virtual function table.
+// These sweeps make no mobilizer-specific calls, so the fixed-size dof
+// computations can be inlined into the loop. The position and velocity
+// batches are in RBNodeFinal.
+
+template<int dof, bool noR_FM, bool noX_MB, bool noR_PF> void
+RigidBodyNodeSpec<dof, noR_FM, noX_MB, noR_PF>::realizeDynamicsBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const SBStateDigest&                    sbs) const
+{
+    for (int i=0; i < n; ++i)
+        sameType(nodes[i]).RigidBodyNodeSpec::realizeDynamics(abc, sbs);
+}
+
+template<int dof, bool noR_FM, bool noX_MB, bool noR_PF> void
+RigidBodyNodeSpec<dof, noR_FM, noX_MB, noR_PF>::realizeArticulatedBodyInertiasInwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    SBArticulatedBodyInertiaCache&          abc) const
+{
+    for (int i=0; i < n; ++i)
+        sameType(nodes[i]).RigidBodyNodeSpec::realizeArticulatedBodyInertiasInward(ic, pc, abc);
+}
+
+template<int dof, bool noR_FM, bool noX_MB, bool noR_PF> void
+RigidBodyNodeSpec<dof, noR_FM, noX_MB, noR_PF>::calcUDotPass1InwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const SBDynamicsCache&                  dc,
+    const Real*                             jointForces,
+    const SpatialVec*                       bodyForces,
+    const Real*                             allUDot,
+    SpatialVec*                             allZ,
+    SpatialVec*                             allGepsilon,
+    Real*                                   allEpsilon) const
+{
+    for (int i=0; i < n; ++i)
+        sameType(nodes[i]).RigidBodyNodeSpec::calcUDotPass1Inward(ic, pc, abc, dc, jointForces, bodyForces, allUDot, allZ, allGepsilon, allEpsilon);
+}
+
+template<int dof, bool noR_FM, bool noX_MB, bool noR_PF> void
+RigidBodyNodeSpec<dof, noR_FM, noX_MB, noR_PF>::calcUDotPass2OutwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const SBTreeVelocityCache&              vc,
+    const SBDynamicsCache&                  dc,
+    const Real*                             epsilonTmp,
+    SpatialVec*                             allA_GB,
+    Real*                                   allUDot,
+    Real*                                   allTau) const
+{
+    for (int i=0; i < n; ++i)
+        sameType(nodes[i]).RigidBodyNodeSpec::calcUDotPass2Outward(ic, pc, abc, vc, dc, epsilonTmp, allA_GB, allUDot, allTau);
+}
+
+template<int dof, bool noR_FM, bool noX_MB, bool noR_PF> void
+RigidBodyNodeSpec<dof, noR_FM, noX_MB, noR_PF>::multiplyByMInvPass1InwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const Real*                             f,
+    SpatialVec*                             allZ,
+    SpatialVec*                             allGepsilon,
+    Real*                                   allEpsilon) const
+{
+    for (int i=0; i < n; ++i)
+        sameType(nodes[i]).RigidBodyNodeSpec::multiplyByMInvPass1Inward(ic, pc, abc, f, allZ, allGepsilon, allEpsilon);
+}
+
+template<int dof, bool noR_FM, bool noX_MB, bool noR_PF> void
+RigidBodyNodeSpec<dof, noR_FM, noX_MB, noR_PF>::multiplyByMInvPass2OutwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const Real*                             epsilonTmp,
+    SpatialVec*                             allA_GB,
+    Real*                                   allUDot) const
+{
+    for (int i=0; i < n; ++i)
+        sameType(nodes[i]).RigidBodyNodeSpec::multiplyByMInvPass2Outward(ic, pc, abc, epsilonTmp, allA_GB, allUDot);
+}
+
+
+
     ////////////////////
     // INSTANTIATIONS //
     ////////////////////
@@ -47,6 +47,8 @@
 #include "SimbodyMatterSubsystemRep.h"
 #include "RigidBodyNode.h"
 
+#include <typeinfo>
+
 /**
  * This still-abstract class is a skeleton implementation of a built-in 
  * mobilizer, with the number of mobilities (dofs, u's) specified as a template 
@@ -215,7 +217,15 @@ void realizeInstance(const SBStateDigest& sbs) const
 // Set a new configuration and calculate the consequent kinematics.
 // Must call base-to-tip.
 void realizePosition(const SBStateDigest& sbs) const 
+{   realizePositionAs<RigidBodyNodeSpec>(sbs); }
+
+// This is the implementation of realizePosition(). The mobilizer-specific
+// methods are called through a Node reference; when Node is a final class
+// (RBNodeFinal below) those calls are bound statically and can be inlined.
+template <class Node>
+void realizePositionAs(const SBStateDigest& sbs) const
 {
+    const Node& node = static_cast<const Node&>(*this);
     const SBModelVars&      mv   = sbs.getModelVars();
     const SBModelCache&     mc   = sbs.getModelCache();
     const SBInstanceCache&  ic   = sbs.getInstanceCache();
@@ -240,7 +250,7 @@ void realizePosition(const SBStateDigest& sbs) const
     Real*       qerr0 = nqerr  ? &allQErr[ic.firstQuaternionQErrSlot
                                           + mbInfo.quaternionPoolIndex]     
                                : 0;
-    performQPrecalculations(sbs, q0, nq, qpool0, nqpool, qerr0, nqerr);
+    node.performQPrecalculations(sbs, q0, nq, qpool0, nqpool, qerr0, nqerr);
 
     // Now that we've done the necessary precalculations, calculate the cross-
     // mobilizer transform X_FM without recalculating anything. For reversed 
@@ -249,10 +259,10 @@ void realizePosition(const SBStateDigest& sbs) const
 
     if (isReversed()) {
         Transform X_MF;
-        calcX_FM(sbs, q0, nq, qpool0, nqpool, X_MF);
+        node.calcX_FM(sbs, q0, nq, qpool0, nqpool, X_MF);
         updX_FM(pc) = ~X_MF;
     } else 
-        calcX_FM(sbs, q0, nq, qpool0, nqpool, updX_FM(pc));
+        node.calcX_FM(sbs, q0, nq, qpool0, nqpool, updX_FM(pc));
 
     // With X_FM in the cache, and X_GP for the parent already calculated (we're doing
     // an outward pass), we can calculate X_PB and X_GB now.
@@ -262,8 +272,8 @@ void realizePosition(const SBStateDigest& sbs) const
     // default implementation of the reversed method just calls the forward method
     // and then reverses it. For some mobilizers that is unreasonably expensive.
     // REMINDER: our H matrix definition is transposed from Jain and Schwieters.
-    if (isReversed()) calcReverseMobilizerH_FM       (sbs, updH_FM(pc));
-    else              calcAcrossJointVelocityJacobian(sbs, updH_FM(pc));
+    if (isReversed()) node.calcReverseMobilizerH_FM       (sbs, updH_FM(pc));
+    else              node.calcAcrossJointVelocityJacobian(sbs, updH_FM(pc));
 
     // Here we're using the cross-mobilizer hinge matrix H_FM that we just 
     // calculated to compute H(==H_PB_G), the equivalent hinge matrix between 
@@ -291,7 +301,13 @@ void realizePosition(const SBStateDigest& sbs) const
 //   VD_PB_G acceleration remainder term HDot*u, expr. in G
 // The code is the same for all joints, although parametrized by ndof.
 void realizeVelocity(const SBStateDigest& sbs) const 
+{   realizeVelocityAs<RigidBodyNodeSpec>(sbs); }
+
+// Implementation of realizeVelocity(); see realizePositionAs().
+template <class Node>
+void realizeVelocityAs(const SBStateDigest& sbs) const
 {
+    const Node& node = static_cast<const Node&>(*this);
     const SBModelVars&          mv = sbs.getModelVars();
     const SBTreePositionCache&  pc = sbs.getTreePositionCache();
     SBTreeVelocityCache&        vc = sbs.updTreeVelocityCache();
@@ -299,14 +315,14 @@ void realizeVelocity(const SBStateDigest& sbs) const
     const Vec<dof>&             u = fromU(allU);
 
     // Mobilizer specific.
-    calcQDot(sbs, &allU[uIndex], &sbs.updQDot()[qIndex]);
+    node.calcQDot(sbs, &allU[uIndex], &sbs.updQDot()[qIndex]);
 
     updV_FM(vc)    = getH_FM(pc) * u;   // 6*dof flops
     updV_PB_G(vc)  = getH(pc)    * u;   // 6*dof flops
 
     // REMINDER: our H matrix definition is transposed from Jain and Schwieters.
-    if (isReversed()) calcReverseMobilizerHDot_FM       (sbs, updHDot_FM(vc));
-    else              calcAcrossJointVelocityJacobianDot(sbs, updHDot_FM(vc));
+    if (isReversed()) node.calcReverseMobilizerHDot_FM       (sbs, updHDot_FM(vc));
+    else              node.calcAcrossJointVelocityJacobianDot(sbs, updHDot_FM(vc));
 
     // Here we're using the cross-mobilizer hinge matrix derivative HDot_FM 
     // that we just calculated to compute HDot(==HDot_PB_G), the derivative
@@ -728,6 +744,76 @@ void multiplyByMInvPass2Outward(
     SpatialVec*                 allA_GB,
     Real*                       allUDot) const override;
 
+// Type-batched sweeps; see RigidBodyNode. These don't call any mobilizer-
+// specific methods so they can be done here; the position and velocity
+// sweeps do, so they are batched in RBNodeFinal below.
+void realizeDynamicsBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const SBStateDigest&                    sbs) const override;
+
+void realizeArticulatedBodyInertiasInwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    SBArticulatedBodyInertiaCache&          abc) const override;
+
+void calcUDotPass1InwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const SBDynamicsCache&                  dc,
+    const Real*                             jointForces,
+    const SpatialVec*                       bodyForces,
+    const Real*                             allUDot,
+    SpatialVec*                             allZ,
+    SpatialVec*                             allGepsilon,
+    Real*                                   allEpsilon) const override;
+
+void calcUDotPass2OutwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const SBTreeVelocityCache&              vc,
+    const SBDynamicsCache&                  dc,
+    const Real*                             epsilonTmp,
+    SpatialVec*                             allA_GB,
+    Real*                                   allUDot,
+    Real*                                   allTau) const override;
+
+void multiplyByMInvPass1InwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const Real*                             f,
+    SpatialVec*                             allZ,
+    SpatialVec*                             allGepsilon,
+    Real*                                   allEpsilon) const override;
+
+void multiplyByMInvPass2OutwardBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBInstanceCache&                  ic,
+    const SBTreePositionCache&              pc,
+    const SBArticulatedBodyInertiaCache&    abc,
+    const Real*                             epsilonTmp,
+    SpatialVec*                             allA_GB,
+    Real*                                   allUDot) const override;
+
+// Used by the batched methods: all nodes in a batch are the same type as this.
+const RigidBodyNodeSpec& sameType(const RigidBodyNode* node) const {
+    assert(typeid(*node) == typeid(*this));
+    return *static_cast<const RigidBodyNodeSpec*>(node);
+}
+
 // Also serves as pass 1 for inverse dynamics.
 void calcBodyAccelerationsFromUdotOutward(
     const SBTreePositionCache&  pc,
@@ -754,6 +840,105 @@ void multiplyByMPass2Inward(
     SpatialVec*                 allFTmp,
     Real*                       allTau) const;
 
+void calcMInvPass1Inward(
+    const SBInstanceCache&      ic,
+    const SBTreePositionCache&  pc,
+    const SBArticulatedBodyInertiaCache&,
+    int                         nu,
+    int                         col0,
+    int                         col1,
+    int*                        allColEnd,
+    SpatialVec*                 allZPlus,
+    Real*                       MInv) const override;
+
+void calcMInvPass2Outward(
+    const SBInstanceCache&      ic,
+    const SBTreePositionCache&  pc,
+    const SBArticulatedBodyInertiaCache&,
+    int                         nu,
+    int                         col0,
+    int                         col1,
+    const int*                  allColEnd,
+    SpatialVec*                 allA_GB,
+    Real*                       MInv) const override;
+
+void multiplyByMInvMultiPass1Inward(
+    const SBInstanceCache&      ic,
+    const SBTreePositionCache&  pc,
+    const SBArticulatedBodyInertiaCache&,
+    int                         nu,
+    int                         ncol,
+    const Real*                 F,
+    SpatialVec*                 allZPlus,
+    Real*                       MInvF) const override;
+
+void multiplyByMInvMultiPass2Outward(
+    const SBInstanceCache&      ic,
+    const SBTreePositionCache&  pc,
+    const SBArticulatedBodyInertiaCache&,
+    int                         nu,
+    int                         ncol,
+    SpatialVec*                 allA_GB,
+    Real*                       MInvF) const override;
+
+void multiplyByMMultiPass1Outward(
+    const SBTreePositionCache&  pc,
+    int                         nu,
+    int                         ncol,
+    const Real*                 A,
+    SpatialVec*                 allA_GB) const override;
+void multiplyByMMultiPass2Inward(
+    const SBTreePositionCache&  pc,
+    int                         nu,
+    int                         ncol,
+    const SpatialVec*           allA_GB,
+    SpatialVec*                 allF,
+    Real*                       MA) const override;
+
+};
+
+/**
+Every concrete node derived from RigidBodyNodeSpec is created as an
+RBNodeFinal<ThatNode>. Because this class is final, calls to the mobilizer-
+specific methods (calcX_FM(), calcQDot(), the H matrix methods, etc.) made
+through a reference to it are bound statically, so the position and velocity
+sweeps below call them directly, not through the virtual function table.
+**/
+template <class Node>
+class RBNodeFinal final : public Node {
+public:
+using Node::Node;
+
+void realizePosition(const SBStateDigest& sbs) const override
+{   this->template realizePositionAs<RBNodeFinal>(sbs); }
+
+void realizeVelocity(const SBStateDigest& sbs) const override
+{   this->template realizeVelocityAs<RBNodeFinal>(sbs); }
+
+void realizePositionBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBStateDigest&                    sbs) const override
+{
+    for (int i=0; i < n; ++i)
+        sameType(nodes[i]).template realizePositionAs<RBNodeFinal>(sbs);
+}
+
+void realizeVelocityBatch(
+    const RigidBodyNode* const*             nodes,
+    int                                     n,
+    const SBStateDigest&                    sbs) const override
+{
+    for (int i=0; i < n; ++i)
+        sameType(nodes[i]).template realizeVelocityAs<RBNodeFinal>(sbs);
+}
+
+private:
+// All nodes in a batch are the same type as this.
+const RBNodeFinal& sameType(const RigidBodyNode* node) const {
+    assert(typeid(*node) == typeid(*this));
+    return *static_cast<const RBNodeFinal*>(node);
+}
 };
 
 #endif // SimTK_SIMBODY_RIGID_BODY_NODE_SPEC_H_
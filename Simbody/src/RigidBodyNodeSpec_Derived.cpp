@@ -45,21 +45,22 @@
 // Note: _Translation is handled separately so we can special case
 // a lone particle for speed if we find one.
 
-// A macro for instantiating rigid body nodes.
+// A macro for instantiating rigid body nodes. Each is made final with
+// RBNodeFinal so that its tree sweeps call the mobilizer methods directly.
 #define INSTANTIATE(CLASS, ...) \
     bool noX_MB = (getDefaultOutboardFrame().p() == 0 && getDefaultOutboardFrame().R() == Mat33(1)); \
     bool noR_PF = (getDefaultInboardFrame().R() == Mat33(1)); \
     if (noX_MB) { \
         if (noR_PF) \
-            return new CLASS<true, true> (__VA_ARGS__); \
+            return new RBNodeFinal< CLASS<true, true> > (__VA_ARGS__); \
         else \
-            return new CLASS<true, false> (__VA_ARGS__); \
+            return new RBNodeFinal< CLASS<true, false> > (__VA_ARGS__); \
     } \
     else { \
         if (noR_PF) \
-            return new CLASS<false, true> (__VA_ARGS__); \
+            return new RBNodeFinal< CLASS<false, true> > (__VA_ARGS__); \
         else \
-            return new CLASS<false, false> (__VA_ARGS__); \
+            return new RBNodeFinal< CLASS<false, false> > (__VA_ARGS__); \
     }
 
     /////////////////////////////////////////////////////////
@@ -257,15 +258,15 @@ RigidBodyNode* MobilizedBody::FreeLineImpl::createRigidBodyNode(
 #define INSTANTIATE_CUSTOM(DOF, ...) \
     if (noX_MB) { \
         if (noR_PF) \
-            return new RBNodeCustom<DOF, true, true> (__VA_ARGS__); \
+            return new RBNodeFinal< RBNodeCustom<DOF, true, true> > (__VA_ARGS__); \
         else \
-            return new RBNodeCustom<DOF, true, false> (__VA_ARGS__); \
+            return new RBNodeFinal< RBNodeCustom<DOF, true, false> > (__VA_ARGS__); \
     } \
     else { \
         if (noR_PF) \
-            return new RBNodeCustom<DOF, false, true> (__VA_ARGS__); \
+            return new RBNodeFinal< RBNodeCustom<DOF, false, true> > (__VA_ARGS__); \
         else \
-            return new RBNodeCustom<DOF, false, false> (__VA_ARGS__); \
+            return new RBNodeFinal< RBNodeCustom<DOF, false, false> > (__VA_ARGS__); \
     }
 
 RigidBodyNode* MobilizedBody::CustomImpl::createRigidBodyNode(
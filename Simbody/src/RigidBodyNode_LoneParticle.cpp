@@ -359,6 +359,108 @@ void multiplyByMInvPass2Outward(
     }
 }
 
+// A lone particle has no children and its M^-1 block is just 1/m on the
+// diagonal; it is uncoupled from everything else.
+void calcMInvPass1Inward(
+        const SBInstanceCache&                  ic,
+        const SBTreePositionCache&              pc,
+        const SBArticulatedBodyInertiaCache&    abc,
+        int                                     nu,
+        int                                     col0,
+        int                                     col1,
+        int*                                    allColEnd,
+        SpatialVec*                             allZPlus,
+        Real*                                   MInv) const override
+{
+    allColEnd[nodeNum] = uIndex + 3;
+}
+
+void calcMInvPass2Outward(
+        const SBInstanceCache&                  ic,
+        const SBTreePositionCache&              pc,
+        const SBArticulatedBodyInertiaCache&    abc,
+        int                                     nu,
+        int                                     col0,
+        int                                     col1,
+        const int*                              allColEnd,
+        SpatialVec*                             allA_GB,
+        Real*                                   MInv) const override
+{
+    const Real oom = isUDotKnown(ic) ? Real(0) : 1/getMass();
+    SpatialVec* A_GB = &allA_GB[nodeNum*(col1-col0)];
+    for (int c=std::max((int)uIndex, col0); c < col1; ++c) {
+        Vec3& udot = Vec3::updAs(&MInv[c*nu + uIndex]);
+        udot = 0;
+        if (c < uIndex + 3) udot[c-uIndex] = oom;
+        A_GB[c-col0] = SpatialVec(Vec3(0), udot);
+    }
+}
+
+// Multiple right-hand side versions of the above.
+void multiplyByMInvMultiPass1Inward(
+        const SBInstanceCache&                  ic,
+        const SBTreePositionCache&              pc,
+        const SBArticulatedBodyInertiaCache&    abc,
+        int                                     nu,
+        int                                     ncol,
+        const Real*                             F,
+        SpatialVec*                             allZPlus,
+        Real*                                   MInvF) const override
+{
+    if (isUDotKnown(ic)) // prescribed
+        return;
+
+    for (int c=0; c < ncol; ++c)
+        Vec3::updAs(&MInvF[c*nu + uIndex]) = Vec3::getAs(&F[c*nu + uIndex]);
+}
+
+void multiplyByMInvMultiPass2Outward(
+        const SBInstanceCache&                  ic,
+        const SBTreePositionCache&              pc,
+        const SBArticulatedBodyInertiaCache&    abc,
+        int                                     nu,
+        int                                     ncol,
+        SpatialVec*                             allA_GB,
+        Real*                                   MInvF) const override
+{
+    const bool isPrescribed = isUDotKnown(ic);
+    SpatialVec* A_GB = &allA_GB[nodeNum*ncol];
+    for (int c=0; c < ncol; ++c) {
+        Vec3& udot = Vec3::updAs(&MInvF[c*nu + uIndex]);
+        if (isPrescribed) udot = 0;
+        else              udot /= getMass();
+        A_GB[c] = SpatialVec(Vec3(0), udot);
+    }
+}
+
+void multiplyByMMultiPass1Outward(
+        const SBTreePositionCache&  pc,
+        int                         nu,
+        int                         ncol,
+        const Real*                 A,
+        SpatialVec*                 allA_GB) const override
+{
+    SpatialVec* A_GB = &allA_GB[nodeNum*ncol];
+    for (int c=0; c < ncol; ++c)
+        A_GB[c] = SpatialVec(Vec3(0), Vec3::getAs(&A[c*nu + uIndex]));
+}
+
+void multiplyByMMultiPass2Inward(
+        const SBTreePositionCache&  pc,
+        int                         nu,
+        int                         ncol,
+        const SpatialVec*           allA_GB,
+        SpatialVec*                 allF,
+        Real*                       MA) const override
+{
+    const SpatialVec* A_GB = &allA_GB[nodeNum*ncol];
+    SpatialVec*       F    = &allF[nodeNum*ncol];
+    for (int c=0; c < ncol; ++c) {
+        F[c] = getMk_G(pc)*A_GB[c];
+        Vec3::updAs(&MA[c*nu + uIndex]) = F[c][1];
+    }
+}
+
 // Also serves as pass 1 for inverse dynamics.
 void calcBodyAccelerationsFromUdotOutward(
         const SBTreePositionCache&  pc,
@@ -406,12 +508,13 @@ void multiplyByMPass2Inward(
     tau = F[1];
 }
 
+// H is constant for a lone particle; we can't use the storage in the
+// position cache since we don't fill it in.
 const SpatialVec& getHCol(const SBTreePositionCache& pc, int j) const {
-    Mat<2,3,Vec3> H = Mat<2,3,Vec3>::getAs(&pc.storageForH[2*uIndex]);
-    SpatialVec& col = H(j);
-    col = SpatialVec(Vec3(0), Vec3(0));
-    col[1][j] = 1;
-    return col;
+    static const SpatialVec cols[3] = {SpatialVec(Vec3(0), Vec3(1,0,0)),
+                                       SpatialVec(Vec3(0), Vec3(0,1,0)),
+                                       SpatialVec(Vec3(0), Vec3(0,0,1))};
+    return cols[j];
 }
 
 const SpatialVec& getH_FMCol(const SBTreePositionCache& pc, int j) const {
@@ -460,13 +563,13 @@ RigidBodyNode* MobilizedBody::TranslationImpl::createRigidBodyNode(
     bool noR_PF = (getDefaultInboardFrame().R() == Mat33(1));
     if (noX_MB) {
         if (noR_PF)
-            return new RBNodeTranslate<true, true> (
+            return new RBNodeFinal< RBNodeTranslate<true, true> > (
                 getDefaultRigidBodyMassProperties(),
                 getDefaultInboardFrame(),getDefaultOutboardFrame(),
                 isReversed(),
                 nextUSlot,nextUSqSlot,nextQSlot);
         else
-            return new RBNodeTranslate<true, false> (
+            return new RBNodeFinal< RBNodeTranslate<true, false> > (
                 getDefaultRigidBodyMassProperties(),
                 getDefaultInboardFrame(),getDefaultOutboardFrame(),
                 isReversed(),
@@ -474,13 +577,13 @@ RigidBodyNode* MobilizedBody::TranslationImpl::createRigidBodyNode(
     }
     else {
         if (noR_PF)
-            return new RBNodeTranslate<false, true> (
+            return new RBNodeFinal< RBNodeTranslate<false, true> > (
                 getDefaultRigidBodyMassProperties(),
                 getDefaultInboardFrame(),getDefaultOutboardFrame(),
                 isReversed(),
                 nextUSlot,nextUSqSlot,nextQSlot);
         else
-            return new RBNodeTranslate<false, false> (
+            return new RBNodeFinal< RBNodeTranslate<false, false> > (
                 getDefaultRigidBodyMassProperties(),
                 getDefaultInboardFrame(),getDefaultOutboardFrame(),
                 isReversed(),
@@ -257,6 +257,84 @@ public:
         allA_GB[0] = 0;
     }
 
+    // Same for calcMInv(), except that Ground's A_GB is a row of entries,
+    // one per column in the block.
+    void calcMInvPass1Inward(
+        const SBInstanceCache&,
+        const SBTreePositionCache&,
+        const SBArticulatedBodyInertiaCache&,
+        int                         nu,
+        int                         col0,
+        int                         col1,
+        int*                        allColEnd,
+        SpatialVec*                 allZPlus,
+        Real*                       MInv) const override
+    {
+    }
+
+    void calcMInvPass2Outward(
+        const SBInstanceCache&,
+        const SBTreePositionCache&,
+        const SBArticulatedBodyInertiaCache&,
+        int                         nu,
+        int                         col0,
+        int                         col1,
+        const int*                  allColEnd,
+        SpatialVec*                 allA_GB,
+        Real*                       MInv) const override
+    {
+        for (int c=col0; c < col1; ++c)
+            allA_GB[c-col0] = SpatialVec(Vec3(0), Vec3(0));
+    }
+
+    // Same for multiple right-hand sides.
+    void multiplyByMInvMultiPass1Inward(
+        const SBInstanceCache&,
+        const SBTreePositionCache&,
+        const SBArticulatedBodyInertiaCache&,
+        int                         nu,
+        int                         ncol,
+        const Real*                 F,
+        SpatialVec*                 allZPlus,
+        Real*                       MInvF) const override
+    {
+    }
+
+    void multiplyByMInvMultiPass2Outward(
+        const SBInstanceCache&,
+        const SBTreePositionCache&,
+        const SBArticulatedBodyInertiaCache&,
+        int                         nu,
+        int                         ncol,
+        SpatialVec*                 allA_GB,
+        Real*                       MInvF) const override
+    {
+        for (int c=0; c < ncol; ++c)
+            allA_GB[c] = SpatialVec(Vec3(0), Vec3(0));
+    }
+
+    void multiplyByMMultiPass1Outward(
+        const SBTreePositionCache&  pc,
+        int                         nu,
+        int                         ncol,
+        const Real*                 A,
+        SpatialVec*                 allA_GB) const override
+    {
+        for (int c=0; c < ncol; ++c)
+            allA_GB[c] = SpatialVec(Vec3(0), Vec3(0));
+    }
+
+    // Nobody needs the forces on Ground here.
+    void multiplyByMMultiPass2Inward(
+        const SBTreePositionCache&  pc,
+        int                         nu,
+        int                         ncol,
+        const SpatialVec*           allA_GB,
+        SpatialVec*                 allF,
+        Real*                       MA) const override
+    {
+    }
+
     // Also serves as pass 1 for inverse dynamics.
     void calcBodyAccelerationsFromUdotOutward(
         const SBTreePositionCache&  pc,
@@ -567,6 +645,142 @@ public:
         A_GB = APlus;
     }
 
+    // A weld has no columns of its own in M^-1 but must pass along its 
+    // children's zPlus inward and its parent's accelerations outward.
+    void calcMInvPass1Inward(
+        const SBInstanceCache&,
+        const SBTreePositionCache&  pc,
+        const SBArticulatedBodyInertiaCache&,
+        int                         nu,
+        int                         col0,
+        int                         col1,
+        int*                        allColEnd,
+        SpatialVec*                 allZPlus,
+        Real*                       MInv) const override
+    {
+        const int   width  = col1 - col0;
+        int&        colEnd = allColEnd[nodeNum];
+        SpatialVec* zPlus  = &allZPlus[nodeNum*width];
+
+        colEnd = uIndex;
+        for (unsigned i=0; i<children.size(); i++)
+            colEnd = std::max(colEnd, allColEnd[children[i]->getNodeNum()]);
+
+        const int cEnd = std::min(colEnd, col1);
+        for (int c=std::max((int)uIndex, col0); c < cEnd; ++c)
+            zPlus[c-col0] = SpatialVec(Vec3(0), Vec3(0));
+
+        for (unsigned i=0; i<children.size(); i++) {
+            const MobilizedBodyIndex child = children[i]->getNodeNum();
+            const PhiMatrix&  phiChild   = children[i]->getPhi(pc);
+            const SpatialVec* zPlusChild = &allZPlus[child*width];
+            const int childEnd = std::min(allColEnd[child], col1);
+            for (int c=std::max((int)children[i]->getUIndex(), col0);
+                 c < childEnd; ++c)
+                zPlus[c-col0] += phiChild * zPlusChild[c-col0]; // 18 flops
+        }
+    }
+
+    void calcMInvPass2Outward(
+        const SBInstanceCache&,
+        const SBTreePositionCache&  pc,
+        const SBArticulatedBodyInertiaCache&,
+        int                         nu,
+        int                         col0,
+        int                         col1,
+        const int*                  allColEnd,
+        SpatialVec*                 allA_GB,
+        Real*                       MInv) const override
+    {
+        const int         width = col1 - col0;
+        SpatialVec*       A_GB  = &allA_GB[nodeNum*width];
+        const SpatialVec* A_GP  = &allA_GB[parent->getNodeNum()*width];
+        const PhiMatrix&  phi   = getPhi(pc);
+
+        for (int c=std::max((int)uIndex, col0); c < col1; ++c)
+            A_GB[c-col0] = ~phi * A_GP[c-col0]; // 12 flops
+    }
+
+    // Same for multiple right-hand sides.
+    void multiplyByMInvMultiPass1Inward(
+        const SBInstanceCache&,
+        const SBTreePositionCache&  pc,
+        const SBArticulatedBodyInertiaCache&,
+        int                         nu,
+        int                         ncol,
+        const Real*                 F,
+        SpatialVec*                 allZPlus,
+        Real*                       MInvF) const override
+    {
+        SpatialVec* zPlus = &allZPlus[nodeNum*ncol];
+
+        for (int c=0; c < ncol; ++c)
+            zPlus[c] = SpatialVec(Vec3(0), Vec3(0));
+
+        for (unsigned i=0; i<children.size(); i++) {
+            const PhiMatrix&  phiChild = children[i]->getPhi(pc);
+            const SpatialVec* zPlusChild = 
+                &allZPlus[children[i]->getNodeNum()*ncol];
+            for (int c=0; c < ncol; ++c)
+                zPlus[c] += phiChild * zPlusChild[c]; // 18 flops
+        }
+    }
+
+    void multiplyByMInvMultiPass2Outward(
+        const SBInstanceCache&,
+        const SBTreePositionCache&  pc,
+        const SBArticulatedBodyInertiaCache&,
+        int                         nu,
+        int                         ncol,
+        SpatialVec*                 allA_GB,
+        Real*                       MInvF) const override
+    {
+        SpatialVec*       A_GB = &allA_GB[nodeNum*ncol];
+        const SpatialVec* A_GP = &allA_GB[parent->getNodeNum()*ncol];
+        const PhiMatrix&  phi  = getPhi(pc);
+
+        for (int c=0; c < ncol; ++c)
+            A_GB[c] = ~phi * A_GP[c]; // 12 flops
+    }
+
+    void multiplyByMMultiPass1Outward(
+        const SBTreePositionCache&  pc,
+        int                         nu,
+        int                         ncol,
+        const Real*                 A,
+        SpatialVec*                 allA_GB) const override
+    {
+        SpatialVec*       A_GB = &allA_GB[nodeNum*ncol];
+        const SpatialVec* A_GP = &allA_GB[parent->getNodeNum()*ncol];
+        const PhiMatrix&  phi  = getPhi(pc);
+
+        for (int c=0; c < ncol; ++c)
+            A_GB[c] = ~phi * A_GP[c]; // 12 flops
+    }
+
+    void multiplyByMMultiPass2Inward(
+        const SBTreePositionCache&  pc,
+        int                         nu,
+        int                         ncol,
+        const SpatialVec*           allA_GB,
+        SpatialVec*                 allF,
+        Real*                       MA) const override
+    {
+        const SpatialVec*     A_GB = &allA_GB[nodeNum*ncol];
+        SpatialVec*           F    = &allF[nodeNum*ncol];
+        const SpatialInertia& Mk   = getMk_G(pc);
+
+        for (int c=0; c < ncol; ++c)
+            F[c] = Mk*A_GB[c];
+
+        for (unsigned i=0; i<children.size(); ++i) {
+            const PhiMatrix&  phiChild = children[i]->getPhi(pc);
+            const SpatialVec* FChild   = &allF[children[i]->getNodeNum()*ncol];
+            for (int c=0; c < ncol; ++c)
+                F[c] += phiChild * FChild[c];
+        }
+    }
+
     // Also serves as pass 1 for inverse dynamics.
     void calcBodyAccelerationsFromUdotOutward(
         const SBTreePositionCache&  pc,
@@ -288,7 +288,7 @@ stepTo(Real time) {
     // This is the unconstrained acceleration; we'll be overwriting udot and
     // A_GB with their final values below.
     matterRep.calcTreeForwardDynamicsOperator
-       (s, f, Fp, F, 0, 0, tac, udot, qdotdot, udotErr);
+       (s, f, Fp, F, 0, 0, tac, udot, qdotdot, udotErr, 0);
     m_deltaU = h*udot;
 
     // Calculate verr = G*deltaU; the end-of-step constraint error due to 
@@ -333,7 +333,7 @@ stepTo(Real time) {
     // Now calculate final udot = M\(f-fc + ~J*(F-Fc-C)) and corresponding
     // body accelerations A_GB.
     matterRep.calcTreeForwardDynamicsOperator
-       (s, f, Fp, F, &fc, &Fc, tac, udot, qdotdot, udotErr);
+       (s, f, Fp, F, &fc, &Fc, tac, udot, qdotdot, udotErr, 0);
     m_deltaU = h*udot;
 
     // Update auxiliary states z, invalidating Stage::Dynamics.
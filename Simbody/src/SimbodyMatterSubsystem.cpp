@@ -107,6 +107,125 @@ void SimbodyMatterSubsystem::setShowDefaultGeometry(bool show) {
     updRep().setShowDefaultGeometry(show);
 }
 
+void SimbodyMatterSubsystem::
+setUseParallelTreeSweeps(bool useParallel, int numThreads) {
+    updRep().setUseParallelTreeSweeps(useParallel, numThreads);
+}
+
+bool SimbodyMatterSubsystem::getUseParallelTreeSweeps() const {
+    return getRep().getUseParallelTreeSweeps();
+}
+
+void SimbodyMatterSubsystem::setMinNodesPerParallelLevel(int minNodes) {
+    updRep().setMinNodesPerParallelLevel(minNodes);
+}
+
+int SimbodyMatterSubsystem::getMinNodesPerParallelLevel() const {
+    return getRep().getMinNodesPerParallelLevel();
+}
+
+bool SimbodyMatterSubsystem::isUsingBranchParallelTreeSweeps() const {
+    return getRep().isUsingBranchParallelTreeSweeps();
+}
+
+int SimbodyMatterSubsystem::getNumParallelTreeSweepBranchGroups() const {
+    return getRep().isUsingBranchParallelTreeSweeps()
+        ? getRep().getNumTreeSweepBranchBins() : 0;
+}
+
+void SimbodyMatterSubsystem::setUseTypeBatchedTreeSweeps(bool batched) {
+    updRep().setUseTypeBatchedTreeSweeps(batched);
+}
+
+bool SimbodyMatterSubsystem::getUseTypeBatchedTreeSweeps() const {
+    return getRep().getUseTypeBatchedTreeSweeps();
+}
+
+void SimbodyMatterSubsystem::
+setUseIncrementalPositionRealization(bool incremental) {
+    updRep().setUseIncrementalPositionRealization(incremental);
+}
+
+bool SimbodyMatterSubsystem::getUseIncrementalPositionRealization() const {
+    return getRep().getUseIncrementalPositionRealization();
+}
+
+int SimbodyMatterSubsystem::getNumBodyPositionRealizations() const {
+    return getRep().getNumBodyPositionRealizations();
+}
+void SimbodyMatterSubsystem::resetPositionRealizationStatistics() {
+    updRep().resetPositionRealizationStatistics();
+}
+
+void SimbodyMatterSubsystem::
+setUseModifiedNewtonForMultipliers(bool useModifiedNewton) {
+    updRep().setUseModifiedNewtonForMultipliers(useModifiedNewton);
+}
+
+bool SimbodyMatterSubsystem::getUseModifiedNewtonForMultipliers() const {
+    return getRep().getUseModifiedNewtonForMultipliers();
+}
+
+int SimbodyMatterSubsystem::getNumMultiplierFactorizations() const {
+    return getRep().getNumMultiplierFactorizations();
+}
+int SimbodyMatterSubsystem::getNumMultiplierReuses() const {
+    return getRep().getNumMultiplierReuses();
+}
+void SimbodyMatterSubsystem::resetMultiplierStatistics() {
+    updRep().resetMultiplierStatistics();
+}
+
+void SimbodyMatterSubsystem::setUseBlockConstraintSolver(bool useBlocks) {
+    updRep().setUseBlockConstraintSolver(useBlocks);
+}
+
+bool SimbodyMatterSubsystem::getUseBlockConstraintSolver() const {
+    return getRep().getUseBlockConstraintSolver();
+}
+
+int SimbodyMatterSubsystem::getNumConstraintBlocks(const State& s) const {
+    return getRep().getNumConstraintBlocks(s);
+}
+
+int SimbodyMatterSubsystem::
+getNumRankDeficientConstraintBlocks(const State& s) const {
+    return getRep().getNumRankDeficientConstraintBlocks(s);
+}
+
+void SimbodyMatterSubsystem::
+setUseModifiedNewtonForProjection(bool useModifiedNewton) {
+    updRep().setUseModifiedNewtonForProjection(useModifiedNewton);
+}
+
+bool SimbodyMatterSubsystem::getUseModifiedNewtonForProjection() const {
+    return getRep().getUseModifiedNewtonForProjection();
+}
+
+void SimbodyMatterSubsystem::setProjectionReuseTolerance(Real tol) {
+    updRep().setProjectionReuseTolerance(tol);
+}
+
+Real SimbodyMatterSubsystem::getProjectionReuseTolerance() const {
+    return getRep().getProjectionReuseTolerance();
+}
+
+int SimbodyMatterSubsystem::getNumProjectQFactorizations() const {
+    return getRep().getNumProjectQFactorizations();
+}
+int SimbodyMatterSubsystem::getNumProjectQReuses() const {
+    return getRep().getNumProjectQReuses();
+}
+int SimbodyMatterSubsystem::getNumProjectUFactorizations() const {
+    return getRep().getNumProjectUFactorizations();
+}
+int SimbodyMatterSubsystem::getNumProjectUReuses() const {
+    return getRep().getNumProjectUReuses();
+}
+void SimbodyMatterSubsystem::resetProjectionStatistics() {
+    updRep().resetProjectionStatistics();
+}
+
 
 ConstraintIndex SimbodyMatterSubsystem::
 adoptConstraint(Constraint& child) {return updRep().adoptConstraint(child);}
@@ -182,7 +301,7 @@ void SimbodyMatterSubsystem::calcAcceleration
 
     getRep().calcLoopForwardDynamicsOperator(state, 
         appliedMobilityForces, appliedParticleForces, appliedBodyForces,
-        tac, cac, udot, qdotdot, multipliers, udotErr);
+        tac, cac, udot, qdotdot, multipliers, udotErr, 0);
 
     A_GB = tac.bodyAccelerationInGround;
 }
@@ -421,6 +540,57 @@ void SimbodyMatterSubsystem::multiplyByM(const State&  state,
         Ma = *cMa;
 }
 
+// The matrix implementation methods require storage that is contiguous by
+// columns.
+static bool hasContiguousColumns(const Matrix& m) {
+    return m.hasContiguousData() && (m.nrow() < 2 || &m(1,0) == &m(0,0)+1);
+}
+
+// Check arguments, copy in/out of contiguous Matrices if necessary, call the
+// implementation method to calculate F = M*A.
+void SimbodyMatterSubsystem::multiplyByM(const State&  state, 
+                                         const Matrix& A, 
+                                         Matrix&       MA) const
+{
+    const SimbodyMatterSubsystemRep& rep = getRep();
+    const int nu = rep.getNU(state);
+    const int ncol = A.ncol();
+
+    SimTK_ERRCHK2_ALWAYS(A.nrow() == nu,
+        "SimbodyMatterSubsystem::multiplyByM()",
+        "Argument 'A' had %d rows but should have the same number of rows"
+        " as the number of mobilities (generalized speeds u) %d.", 
+        A.nrow(), nu);
+
+    MA.resize(nu, ncol);
+    if (nu==0 || ncol==0) return;
+
+    // Assume at first that both Matrices are contiguous.
+    const Matrix* cA    = &A;
+    Matrix*       cMA   = &MA;
+    bool needToCopyBack = false;
+
+    // We'll allocate these or not as needed.
+    Matrix contig_A, contig_MA;
+
+    if (!hasContiguousColumns(A)) {
+        contig_A.resize(nu, ncol); // contiguous memory
+        contig_A.updBlock(0, 0, nu, ncol) = A; // copy, prevent reallocation
+        cA = (const Matrix*)&contig_A;
+    }
+
+    if (!hasContiguousColumns(MA)) {
+        contig_MA.resize(nu, ncol); // contiguous memory
+        cMA = (Matrix*)&contig_MA;
+        needToCopyBack = true;
+    }
+
+    rep.multiplyByM(state, *cA, *cMA);
+
+    if (needToCopyBack)
+        MA = *cMA;
+}
+
 
 
 //==============================================================================
@@ -470,6 +640,51 @@ void SimbodyMatterSubsystem::multiplyByMInv(const State&    state,
         MInvV = *cMInvV;
 }
 
+// Check arguments, copy in/out of contiguous Matrices if necessary, call the
+// implementation method to calculate A = M^-1*F.
+void SimbodyMatterSubsystem::multiplyByMInv(const State&    state,
+                                            const Matrix&   F,
+                                            Matrix&         MInvF) const
+{
+    const SimbodyMatterSubsystemRep& rep = getRep();
+    const int nu = rep.getNU(state);
+    const int ncol = F.ncol();
+
+    SimTK_ERRCHK2_ALWAYS(F.nrow() == nu,
+        "SimbodyMatterSubsystem::multiplyByMInv()",
+        "Argument 'F' had %d rows but should have the same number of rows"
+        " as the number of mobilities (generalized speeds u) %d.", 
+        F.nrow(), nu);
+
+    MInvF.resize(nu, ncol);
+    if (nu==0 || ncol==0) return;
+
+    // Assume at first that both Matrices are contiguous.
+    const Matrix* cF    = &F;
+    Matrix*       cMInvF = &MInvF;
+    bool needToCopyBack = false;
+
+    // We'll allocate these or not as needed.
+    Matrix contig_F, contig_MInvF;
+
+    if (!hasContiguousColumns(F)) {
+        contig_F.resize(nu, ncol); // contiguous memory
+        contig_F.updBlock(0, 0, nu, ncol) = F; // copy, prevent reallocation
+        cF = (const Matrix*)&contig_F;
+    }
+
+    if (!hasContiguousColumns(MInvF)) {
+        contig_MInvF.resize(nu, ncol); // contiguous memory
+        cMInvF = (Matrix*)&contig_MInvF;
+        needToCopyBack = true;
+    }
+
+    rep.multiplyByMInv(state, *cF, *cMInvF);
+
+    if (needToCopyBack)
+        MInvF = *cMInvF;
+}
+
 
 
 void SimbodyMatterSubsystem::calcM(const State& s, Matrix& M) const 
@@ -478,6 +693,87 @@ void SimbodyMatterSubsystem::calcM(const State& s, Matrix& M) const
 void SimbodyMatterSubsystem::calcMInv(const State& s, Matrix& MInv) const 
 {   getRep().calcMInv(s, MInv); }
 
+void SimbodyMatterSubsystem::
+solveUsingMassMatrixFactorization(const State&  state,
+                                  const Matrix& F,
+                                  Matrix&       X) const
+{
+    const SimbodyMatterSubsystemRep& rep = getRep();
+    const int nu = rep.getNU(state);
+
+    SimTK_ERRCHK2_ALWAYS(F.nrow() == nu,
+        "SimbodyMatterSubsystem::solveUsingMassMatrixFactorization()",
+        "Argument 'F' had %d rows but should have the same number of rows"
+        " as the number of mobilities (generalized speeds u) %d.", 
+        F.nrow(), nu);
+
+    rep.solveUsingMassMatrixFactorization(state, F, X);
+}
+
+void SimbodyMatterSubsystem::
+solveUsingMassMatrixFactorization(const State&  state,
+                                  const Vector& f,
+                                  Vector&       x) const
+{
+    const SimbodyMatterSubsystemRep& rep = getRep();
+    const int nu = rep.getNU(state);
+
+    SimTK_ERRCHK2_ALWAYS(f.size() == nu,
+        "SimbodyMatterSubsystem::solveUsingMassMatrixFactorization()",
+        "Argument 'f' had length %d but should have the same length"
+        " as the number of mobilities (generalized speeds u) %d.", 
+        f.size(), nu);
+
+    rep.solveUsingMassMatrixFactorization(state, f, x);
+}
+
+//==============================================================================
+//                 CALC OPERATIONAL SPACE INERTIA INVERSE
+//==============================================================================
+void SimbodyMatterSubsystem::calcStationOperationalSpaceInertiaInverse
+   (const State&                        state,
+    const Array_<MobilizedBodyIndex>&   onBodyB,
+    const Array_<Vec3>&                 stationPInB,
+    Matrix&                             LambdaInv) const
+{
+    const SimbodyMatterSubsystemRep& rep = getRep();
+    const int nb = rep.getNumBodies();
+    const int nt = (int)onBodyB.size(); // number of tasks
+
+    SimTK_ERRCHK2_ALWAYS(stationPInB.size() == nt,
+        "SimbodyMatterSubsystem::calcStationOperationalSpaceInertiaInverse()",
+        "The given number of task bodies (%d) and station tasks (%d) must "
+        "be the same.", nt, (int)stationPInB.size());
+    for (int task=0; task < nt; ++task)
+        SimTK_INDEXCHECK(onBodyB[task], nb,
+        "SimbodyMatterSubsystem::calcStationOperationalSpaceInertiaInverse()");
+
+    rep.calcOperationalSpaceInertiaInverse(state, false, onBodyB, stationPInB,
+                                           LambdaInv);
+}
+
+void SimbodyMatterSubsystem::calcFrameOperationalSpaceInertiaInverse
+   (const State&                        state,
+    const Array_<MobilizedBodyIndex>&   onBodyB,
+    const Array_<Vec3>&                 originAoInB,
+    Matrix&                             LambdaInv) const
+{
+    const SimbodyMatterSubsystemRep& rep = getRep();
+    const int nb = rep.getNumBodies();
+    const int nt = (int)onBodyB.size(); // number of tasks
+
+    SimTK_ERRCHK2_ALWAYS(originAoInB.size() == nt,
+        "SimbodyMatterSubsystem::calcFrameOperationalSpaceInertiaInverse()",
+        "The given number of task bodies (%d) and frame tasks (%d) must "
+        "be the same.", nt, (int)originAoInB.size());
+    for (int task=0; task < nt; ++task)
+        SimTK_INDEXCHECK(onBodyB[task], nb,
+        "SimbodyMatterSubsystem::calcFrameOperationalSpaceInertiaInverse()");
+
+    rep.calcOperationalSpaceInertiaInverse(state, true, onBodyB, originAoInB,
+                                           LambdaInv);
+}
+
 
 // Note: the implementation methods that generate matrices do *not* require 
 // contiguous storage, so we can just forward to them with no preliminaries.
@@ -496,6 +792,15 @@ void SimbodyMatterSubsystem::calcG(const State& s, Matrix& G) const
 {   getRep().calcPVA(s, true, true, true, G); }
 void SimbodyMatterSubsystem::calcGTranspose(const State& s, Matrix& Gt) const 
 {   getRep().calcPVATranspose(s, true, true, true, Gt); }
+void SimbodyMatterSubsystem::
+calcGSparse(const State& s, Array_<int>& rowStart, Array_<int>& colIndex,
+            Array_<Real>& values) const
+{   getRep().calcPVASparse(s, true, true, true, rowStart, colIndex, values); }
+void SimbodyMatterSubsystem::
+calcGTransposeSparse(const State& s, Array_<int>& colStart,
+                     Array_<int>& rowIndex, Array_<Real>& values) const
+{   getRep().calcPVATransposeSparse(s, true, true, true,
+                                    colStart, rowIndex, values); }
 void SimbodyMatterSubsystem::calcPq(const State& s, Matrix& Pq) const 
 {   getRep().calcPq(s,Pq); }
 void SimbodyMatterSubsystem::calcPqTranspose(const State& s, Matrix& Pqt) const 
@@ -2007,6 +2312,10 @@ void SimbodyMatterSubsystem::realizeCompositeBodyInertias(const State& s) const
     getRep().realizeCompositeBodyInertias(s);
 }
 
+void SimbodyMatterSubsystem::realizeMassMatrixFactorization(const State& s) const {
+    getRep().realizeMassMatrixFactorization(s);
+}
+
 void SimbodyMatterSubsystem::realizeArticulatedBodyInertias(const State& s) const {
     getRep().realizeArticulatedBodyInertias(s);
 }
@@ -2016,6 +2325,10 @@ void SimbodyMatterSubsystem::invalidateCompositeBodyInertias(const State& s) con
     getRep().invalidateCompositeBodyInertias(s);
 }
 
+void SimbodyMatterSubsystem::invalidateMassMatrixFactorization(const State& s) const {
+    getRep().invalidateMassMatrixFactorization(s);
+}
+
 void SimbodyMatterSubsystem::invalidateArticulatedBodyInertias(const State& s) const {
     getRep().invalidateArticulatedBodyInertias(s);
 }
@@ -38,17 +38,666 @@
 #include "MobilizedBodyImpl.h"
 #include "ConstraintImpl.h"
 
+#include <algorithm>
+#include <cstring>
 #include <string>
 #include <iostream>
+#include <typeinfo>
+#include <utility>
 using std::cout; using std::endl;
 
 SimbodyMatterSubsystemRep::SimbodyMatterSubsystemRep(const SimbodyMatterSubsystemRep& src)
-  : SimTK::Subsystem::Guts("SimbodyMatterSubsystemRep", "X.X.X")
+  : SimTK::Subsystem::Guts("SimbodyMatterSubsystemRep", "X.X.X"),
+    treeSweepExecutor(0), numTreeSweepThreads(0),
+    minNodesPerParallelLevel(32), useTypeBatchedTreeSweeps(false),
+    useIncrementalPositionRealization(false),
+    useModifiedNewtonForMultipliers(false),
+    useBlockConstraintSolver(false),
+    useModifiedNewtonForProjection(false), projectionReuseTolerance(0.25)
 {
     assert(!"SimbodyMatterSubsystemRep copy constructor ... TODO!");
 }
 
 
+
+//==============================================================================
+//                               TREE SWEEPS
+//==============================================================================
+// Nodes within a level of the tree depend only on their parents (for outward
+// sweeps) or their children (for inward sweeps), which are all in an adjacent
+// level. So all the nodes in a level can be processed concurrently, provided
+// each node writes only into its own slots in the cache arrays, which is the
+// case for all the RigidBodyNode realize and operator methods. Levels must
+// still be processed one at a time, in order.
+//
+// Alternatively, if the tree splits into several independent subtrees
+// ("branches") of similar size, each thread can sweep a set of whole branches
+// with no synchronization at all until the branches join at the trunk. We
+// prefer that when it is well balanced since it needs only a single join per
+// sweep rather than one per level.
+//
+// Optionally, nodes within a level are visited in runs of nodes of the same
+// concrete type, each of which is processed by a single call to a batched
+// RigidBodyNode method rather than one virtual call per node; see
+// setUseTypeBatchedTreeSweeps(). Branch sweeps can't do that since the nodes
+// in a branch have to be visited in order.
+
+namespace {
+// By default a NodeOp is applied to a run of same-type nodes one node at a
+// time. Operators that have a type-batched RigidBodyNode method provide a
+// batch() method and say so with SimTK_NODE_OP_HAS_BATCH below.
+template <class NodeOp>
+struct NodeBatch {
+    static void apply(const NodeOp& op, const RigidBodyNode* const* nodes,
+                      int n) 
+    {   for (int j=0; j < n; ++j) op(*nodes[j]); }
+};
+
+#define SimTK_NODE_OP_HAS_BATCH(NodeOp)                                     \
+template <> struct NodeBatch<NodeOp> {                                      \
+    static void apply(const NodeOp& op, const RigidBodyNode* const* nodes,  \
+                      int n)                                                \
+    {   op.batch(nodes, n); }                                               \
+};
+
+// Apply a NodeOp to nodes [first,last) of a level. If batchEnd is supplied
+// the level's nodes are sorted by type and batchEnd[j] is one past the last
+// node with the same type as node j.
+template <class NodeOp>
+void applyToNodes(const RBNodePtrList& nodes, const Array_<int>* batchEnd,
+                  int first, int last, const NodeOp& op) 
+{
+    if (!batchEnd) {
+        for (int j=first; j < last; ++j)
+            op(*nodes[j]);
+        return;
+    }
+    for (int j=first; j < last; ) {
+        const int end = std::min((*batchEnd)[j], last);
+        NodeBatch<NodeOp>::apply(op, &nodes[j], end-j);
+        j = end;
+    }
+}
+
+// Apply a NodeOp for each of several ensemble members to each node, so that
+// the members are swept through the tree in lock step. Each member uses the
+// same (batched, if available) per-node code as a single State would.
+template <class NodeOp>
+class EnsembleOp {
+public:
+    EnsembleOp(const NodeOp* ops, int n) : ops(ops), n(n) {}
+    void operator()(const RigidBodyNode& node) const 
+    {   for (int k=0; k < n; ++k) ops[k](node); }
+    void batch(const RigidBodyNode* const* nodes, int nNodes) const {
+        for (int k=0; k < n; ++k)
+            NodeBatch<NodeOp>::apply(ops[k], nodes, nNodes);
+    }
+private:
+    const NodeOp*   ops;
+    const int       n;
+};
+
+template <class NodeOp> struct NodeBatch< EnsembleOp<NodeOp> > {
+    static void apply(const EnsembleOp<NodeOp>& op, 
+                      const RigidBodyNode* const* nodes, int n)
+    {   op.batch(nodes, n); }
+};
+
+// Worker-thread task that applies a NodeOp to a contiguous chunk of the nodes
+// in a single level.
+template <class NodeOp>
+class LevelSweepTask : public ParallelExecutor::Task {
+public:
+    LevelSweepTask(const RBNodePtrList& nodes, const Array_<int>* batchEnd,
+                   int chunkSize, const NodeOp& op)
+    :   nodes(nodes), batchEnd(batchEnd), chunkSize(chunkSize), op(op) {}
+
+    void execute(int chunk) {
+        const int first = chunk*chunkSize;
+        const int last  = std::min(first+chunkSize, (int)nodes.size());
+        applyToNodes(nodes, batchEnd, first, last, op);
+    }
+private:
+    const RBNodePtrList&    nodes;
+    const Array_<int>*      batchEnd;
+    const int               chunkSize;
+    const NodeOp&           op;
+};
+
+// Worker-thread task that applies a NodeOp to all the nodes in one bin of
+// branches. The bin lists nodes in base-to-tip order so must be processed
+// backwards for an inward sweep.
+template <class NodeOp>
+class BranchSweepTask : public ParallelExecutor::Task {
+public:
+    BranchSweepTask(const Array_<RBNodePtrList>& bins, bool inward, 
+                    const NodeOp& op)
+    :   bins(bins), inward(inward), op(op) {}
+
+    void execute(int bin) {
+        const RBNodePtrList& nodes = bins[bin];
+        if (inward) {
+            for (int j=(int)nodes.size()-1; j >= 0; --j)
+                op(*nodes[j]);
+        } else {
+            for (int j=0; j < (int)nodes.size(); ++j)
+                op(*nodes[j]);
+        }
+    }
+private:
+    const Array_<RBNodePtrList>&    bins;
+    const bool                      inward;
+    const NodeOp&                   op;
+};
+
+// Assign weighted branches to nBins bins using the "longest processing time
+// first" heuristic: take the branches heaviest first and put each into the 
+// currently lightest bin. Returns the weight of the heaviest bin.
+int assignBranchesToBins(const Array_<int>& weight, int nBins, 
+                         Array_<int>& binOfBranch) 
+{
+    const int nBranches = (int)weight.size();
+    Array_<std::pair<int,int> > byWeight(nBranches);
+    for (int b=0; b < nBranches; ++b)
+        byWeight[b] = std::make_pair(-weight[b], b); // heaviest first
+    std::sort(byWeight.begin(), byWeight.end());
+
+    Array_<int> binWeight(nBins, 0);
+    binOfBranch.resize(nBranches);
+    for (int i=0; i < nBranches; ++i) {
+        const int b = byWeight[i].second;
+        int lightest = 0;
+        for (int k=1; k < nBins; ++k)
+            if (binWeight[k] < binWeight[lightest]) lightest = k;
+        binOfBranch[b] = lightest;
+        binWeight[lightest] += weight[b];
+    }
+    return *std::max_element(binWeight.begin(), binWeight.end());
+}
+}
+
+template <class NodeOp> void SimbodyMatterSubsystemRep::
+applyToLevel(int level, const NodeOp& op) const {
+    const bool batched = useTypeBatchedTreeSweeps;
+    const RBNodePtrList& nodes = batched ? typeSortedNodeLevels[level]
+                                         : rbNodeLevels[level];
+    const Array_<int>* batchEnd = batched ? &nodeBatchEnds[level] : 0;
+    const int nNodes = (int)nodes.size();
+
+    if (!treeSweepExecutor || nNodes < minNodesPerParallelLevel
+        || ParallelExecutor::isWorkerThread()) 
+    {
+        applyToNodes(nodes, batchEnd, 0, nNodes, op);
+        return;
+    }
+
+    // Hand each worker thread a few contiguous chunks so that load imbalance
+    // among node types evens out without making the chunks too small.
+    const int nChunks   = std::min(nNodes, 4*ParallelExecutor::getNumProcessors());
+    const int chunkSize = (nNodes + nChunks - 1) / nChunks;
+    LevelSweepTask<NodeOp> task(nodes, batchEnd, chunkSize, op);
+    treeSweepExecutor->execute(task, (nNodes + chunkSize - 1) / chunkSize);
+}
+
+bool SimbodyMatterSubsystemRep::isUsingBranchParallelTreeSweeps() const {
+    return treeSweepExecutor && !treeSweepBins.empty()
+        && (int)nodeNum2NodeMap.size() >= minNodesPerParallelLevel;
+}
+
+bool SimbodyMatterSubsystemRep::shouldUseBranchParallelSweeps() const {
+    return isUsingBranchParallelTreeSweeps()
+        && !ParallelExecutor::isWorkerThread();
+}
+
+template <class NodeOp> void SimbodyMatterSubsystemRep::
+sweepOutward(const NodeOp& op) const {
+    if (shouldUseBranchParallelSweeps()) {
+        for (int j=0; j < (int)treeSweepTrunk.size(); ++j)
+            op(*treeSweepTrunk[j]);
+        BranchSweepTask<NodeOp> task(treeSweepBins, false, op);
+        treeSweepExecutor->execute(task, (int)treeSweepBins.size());
+        return;
+    }
+
+    for (int i=0; i < (int)rbNodeLevels.size(); ++i)
+        applyToLevel(i, op);
+}
+
+template <class NodeOp> void SimbodyMatterSubsystemRep::
+sweepInward(const NodeOp& op) const {
+    if (shouldUseBranchParallelSweeps()) {
+        BranchSweepTask<NodeOp> task(treeSweepBins, true, op);
+        treeSweepExecutor->execute(task, (int)treeSweepBins.size());
+        for (int j=(int)treeSweepTrunk.size()-1; j >= 0; --j)
+            op(*treeSweepTrunk[j]);
+        return;
+    }
+
+    for (int i=(int)rbNodeLevels.size()-1; i >= 0; --i)
+        applyToLevel(i, op);
+}
+
+namespace {
+// Worker-thread task that sweeps a contiguous chunk of ensemble members
+// outward through the tree using the supplied sweep method. On a worker 
+// thread the sweep itself is serial.
+template <class NodeOp>
+class EnsembleSweepTask : public ParallelExecutor::Task {
+public:
+    typedef void (SimbodyMatterSubsystemRep::*SweepMethod)
+                    (const EnsembleOp<NodeOp>&) const;
+
+    EnsembleSweepTask(const SimbodyMatterSubsystemRep& matter, 
+                      SweepMethod sweep, const Array_<NodeOp>& ops, 
+                      int chunkSize)
+    :   matter(matter), sweep(sweep), ops(ops), chunkSize(chunkSize) {}
+
+    void execute(int chunk) {
+        const int first = chunk*chunkSize;
+        const int last  = std::min(first+chunkSize, (int)ops.size());
+        (matter.*sweep)(EnsembleOp<NodeOp>(&ops[first], last-first));
+    }
+private:
+    const SimbodyMatterSubsystemRep&    matter;
+    const SweepMethod                   sweep;
+    const Array_<NodeOp>&               ops;
+    const int                           chunkSize;
+};
+}
+
+template <class NodeOp> void SimbodyMatterSubsystemRep::
+sweepOutwardEnsemble(const Array_<NodeOp>& ops) const {
+    const int n = (int)ops.size();
+    if (n == 0)
+        return;
+    if (!treeSweepExecutor || n == 1 || ParallelExecutor::isWorkerThread()) {
+        sweepOutward(EnsembleOp<NodeOp>(&ops[0], n));
+        return;
+    }
+
+    const int nChunks   = std::min(n, numTreeSweepThreads);
+    const int chunkSize = (n + nChunks - 1) / nChunks;
+    EnsembleSweepTask<NodeOp> task(*this, 
+        &SimbodyMatterSubsystemRep::sweepOutward< EnsembleOp<NodeOp> >,
+        ops, chunkSize);
+    treeSweepExecutor->execute(task, (n + chunkSize - 1) / chunkSize);
+}
+
+// We estimate the cost of a sweep as the total weight of the trunk, which is
+// done serially, plus the weight of the heaviest bin of branches, where the
+// weight of a body is its number of mobilities (at least 1, since even a Weld
+// has work to do). Starting with the trunk consisting only of Ground, we
+// repeatedly try moving the root of the heaviest branch (and any unbranched
+// chain below it) into the trunk so that its children become separate
+// branches, keeping the change only if the cost goes down. If the resulting
+// cost isn't at most 3/4 of the serial cost we don't bother with branch 
+// parallelism at all.
+void SimbodyMatterSubsystemRep::partitionTreeForParallelSweeps() {
+    treeSweepTrunk.clear();
+    treeSweepBins.clear();
+
+    const int nBins = treeSweepExecutor ? numTreeSweepThreads : 0;
+    const int nb = (int)nodeNum2NodeMap.size();
+    if (nBins < 2 || nb < 3)
+        return;
+
+    // Calculate subtree weights tip to base; children have higher numbers.
+    Array_<int,MobilizedBodyIndex> subtreeWeight(nb);
+    for (int i=nb-1; i >= 0; --i) {
+        const MobilizedBodyIndex mbx(i);
+        const RigidBodyNode& node = getRigidBodyNode(mbx);
+        subtreeWeight[mbx] = std::max(1, node.getDOF());
+        for (int c=0; c < node.getNumChildren(); ++c)
+            subtreeWeight[mbx] += subtreeWeight[node.getChild(c)->getNodeNum()];
+    }
+    const int totalWeight = subtreeWeight[GroundIndex];
+
+    Array_<bool,MobilizedBodyIndex> inTrunk(nb, false);
+    inTrunk[GroundIndex] = true;
+    int trunkWeight = 1;
+
+    Array_<MobilizedBodyIndex> roots;
+    const RigidBodyNode& ground = getRigidBodyNode(GroundIndex);
+    for (int c=0; c < ground.getNumChildren(); ++c)
+        roots.push_back(ground.getChild(c)->getNodeNum());
+
+    Array_<int> weight, binOfBranch;
+    for (unsigned b=0; b < roots.size(); ++b)
+        weight.push_back(subtreeWeight[roots[b]]);
+    int cost = trunkWeight + assignBranchesToBins(weight, nBins, binOfBranch);
+
+    while (true) {
+        // Find the heaviest branch and the first place it splits.
+        const int heaviest = (int)(std::max_element(weight.begin(), 
+                                                     weight.end())
+                                   - weight.begin());
+        Array_<MobilizedBodyIndex> path;
+        const RigidBodyNode* split = &getRigidBodyNode(roots[heaviest]);
+        int pathWeight = 0;
+        while (true) {
+            path.push_back(split->getNodeNum());
+            pathWeight += std::max(1, split->getDOF());
+            if (split->getNumChildren() != 1) break;
+            split = split->getChild(0);
+        }
+        if (split->getNumChildren() == 0)
+            break; // heaviest branch is an unbranched chain
+
+        Array_<MobilizedBodyIndex> newRoots;
+        Array_<int> newWeight, newBinOfBranch;
+        for (int b=0; b < (int)roots.size(); ++b)
+            if (b != heaviest) {
+                newRoots.push_back(roots[b]);
+                newWeight.push_back(weight[b]);
+            }
+        for (int c=0; c < split->getNumChildren(); ++c) {
+            const MobilizedBodyIndex child = split->getChild(c)->getNodeNum();
+            newRoots.push_back(child);
+            newWeight.push_back(subtreeWeight[child]);
+        }
+        const int newCost = trunkWeight + pathWeight
+            + assignBranchesToBins(newWeight, nBins, newBinOfBranch);
+        if (newCost >= cost)
+            break;
+
+        for (unsigned i=0; i < path.size(); ++i)
+            inTrunk[path[i]] = true;
+        trunkWeight += pathWeight;
+        roots.swap(newRoots); weight.swap(newWeight); 
+        binOfBranch.swap(newBinOfBranch);
+        cost = newCost;
+    }
+
+    if (roots.size() < 2 || 4*cost > 3*totalWeight)
+        return; // not worth doing
+
+    // Distribute the nodes; each non-trunk node goes in the same bin as its
+    // parent unless it is a branch root.
+    Array_<int,MobilizedBodyIndex> binOfNode(nb, -1);
+    for (unsigned b=0; b < roots.size(); ++b)
+        binOfNode[roots[b]] = binOfBranch[b];
+    Array_<RBNodePtrList> bins(nBins);
+    for (MobilizedBodyIndex mbx(0); mbx < nb; ++mbx) {
+        const RigidBodyNode& node = getRigidBodyNode(mbx);
+        if (inTrunk[mbx]) {
+            treeSweepTrunk.push_back(&node);
+            continue;
+        }
+        if (binOfNode[mbx] < 0)
+            binOfNode[mbx] = binOfNode[node.getParent()->getNodeNum()];
+        bins[binOfNode[mbx]].push_back(&node);
+    }
+    for (int k=0; k < nBins; ++k)
+        if (!bins[k].empty())
+            treeSweepBins.push_back(bins[k]);
+}
+
+// Copy each level's nodes, sorted so that nodes of the same concrete type are
+// adjacent, and note where each run of same-type nodes ends. Order within a
+// level doesn't otherwise matter; we keep body number order within a run.
+namespace {
+class IsBeforeByNodeType {
+public:
+    bool operator()(const RigidBodyNode* a, const RigidBodyNode* b) const {
+        if (typeid(*a) == typeid(*b))
+            return a->getNodeNum() < b->getNodeNum();
+        return typeid(*a).before(typeid(*b));
+    }
+};
+}
+
+void SimbodyMatterSubsystemRep::groupNodesByTypeForSweeps() {
+    const int nLevels = (int)rbNodeLevels.size();
+    typeSortedNodeLevels.resize(nLevels);
+    nodeBatchEnds.resize(nLevels);
+    for (int i=0; i < nLevels; ++i) {
+        RBNodePtrList& nodes = typeSortedNodeLevels[i];
+        nodes = rbNodeLevels[i];
+        std::sort(nodes.begin(), nodes.end(), IsBeforeByNodeType());
+
+        const int n = (int)nodes.size();
+        Array_<int>& batchEnd = nodeBatchEnds[i];
+        batchEnd.resize(n);
+        for (int j=n-1; j >= 0; --j)
+            batchEnd[j] = j+1 < n && typeid(*nodes[j+1]) == typeid(*nodes[j])
+                          ? batchEnd[j+1] : j+1;
+    }
+}
+
+void SimbodyMatterSubsystemRep::
+setUseParallelTreeSweeps(bool useParallel, int numThreads) {
+    delete treeSweepExecutor;
+    treeSweepExecutor = 0;
+    numTreeSweepThreads = 0;
+    if (useParallel) {
+        if (numThreads <= 0)
+            numThreads = ParallelExecutor::getNumProcessors();
+        treeSweepExecutor = new ParallelExecutor(numThreads);
+        numTreeSweepThreads = numThreads;
+    }
+    if (subsystemTopologyHasBeenRealized())
+        partitionTreeForParallelSweeps();
+}
+
+void SimbodyMatterSubsystemRep::setProjectionReuseTolerance(Real tol) {
+    SimTK_APIARGCHECK1_ALWAYS(0 < tol && tol <= 1,
+        "SimbodyMatterSubsystem", "setProjectionReuseTolerance",
+        "The tolerance must be in (0,1] but was %g.", tol);
+    projectionReuseTolerance = tol;
+}
+
+void SimbodyMatterSubsystemRep::setMinNodesPerParallelLevel(int minNodes) {
+    SimTK_APIARGCHECK1_ALWAYS(minNodes >= 1, "SimbodyMatterSubsystem",
+        "setMinNodesPerParallelLevel",
+        "The minimum number of nodes must be at least 1 but was %d.",
+        minNodes);
+    minNodesPerParallelLevel = minNodes;
+}
+
+// These are the per-node operators used in the tree sweeps below.
+namespace {
+// If needsRealization is supplied, only the nodes it selects are realized.
+class RealizePositionOp {
+public:
+    explicit RealizePositionOp(const SBStateDigest& sbs,
+                               const bool* needsRealization=0)
+    :   sbs(sbs), needsRealization(needsRealization) {}
+    void operator()(const RigidBodyNode& node) const {
+        if (!needsRealization || needsRealization[node.getNodeNum()])
+            node.realizePosition(sbs);
+    }
+    void batch(const RigidBodyNode* const* nodes, int n) const {
+        if (!needsRealization)
+            nodes[0]->realizePositionBatch(nodes, n, sbs);
+        else for (int j=0; j < n; ++j)
+            (*this)(*nodes[j]);
+    }
+private:
+    const SBStateDigest& sbs;
+    const bool*          needsRealization;
+};
+SimTK_NODE_OP_HAS_BATCH(RealizePositionOp)
+
+class RealizeVelocityOp {
+public:
+    explicit RealizeVelocityOp(const SBStateDigest& sbs) : sbs(sbs) {}
+    void operator()(const RigidBodyNode& node) const 
+    {   node.realizeVelocity(sbs); }
+    void batch(const RigidBodyNode* const* nodes, int n) const
+    {   nodes[0]->realizeVelocityBatch(nodes, n, sbs); }
+private:
+    const SBStateDigest& sbs;
+};
+SimTK_NODE_OP_HAS_BATCH(RealizeVelocityOp)
+
+class RealizeDynamicsOp {
+public:
+    RealizeDynamicsOp(const SBArticulatedBodyInertiaCache& abc,
+                      const SBStateDigest& sbs) : abc(abc), sbs(sbs) {}
+    void operator()(const RigidBodyNode& node) const 
+    {   node.realizeDynamics(abc, sbs); }
+    void batch(const RigidBodyNode* const* nodes, int n) const
+    {   nodes[0]->realizeDynamicsBatch(nodes, n, abc, sbs); }
+private:
+    const SBArticulatedBodyInertiaCache&    abc;
+    const SBStateDigest&                    sbs;
+};
+SimTK_NODE_OP_HAS_BATCH(RealizeDynamicsOp)
+
+class RealizeArticulatedBodyInertiasOp {
+public:
+    RealizeArticulatedBodyInertiasOp(const SBInstanceCache&         ic,
+                                     const SBTreePositionCache&     tpc,
+                                     SBArticulatedBodyInertiaCache& abc)
+    :   ic(ic), tpc(tpc), abc(abc) {}
+    void operator()(const RigidBodyNode& node) const 
+    {   node.realizeArticulatedBodyInertiasInward(ic, tpc, abc); }
+    void batch(const RigidBodyNode* const* nodes, int n) const {
+        nodes[0]->realizeArticulatedBodyInertiasInwardBatch(nodes, n, 
+                                                            ic, tpc, abc);
+    }
+private:
+    const SBInstanceCache&          ic;
+    const SBTreePositionCache&      tpc;
+    SBArticulatedBodyInertiaCache&  abc;
+};
+SimTK_NODE_OP_HAS_BATCH(RealizeArticulatedBodyInertiasOp)
+
+class CalcUDotPass1InwardOp {
+public:
+    CalcUDotPass1InwardOp(const SBInstanceCache&                ic,
+                          const SBTreePositionCache&            tpc,
+                          const SBArticulatedBodyInertiaCache&  abc,
+                          const SBDynamicsCache&                dc,
+                          const Real*                           mobilityForces,
+                          const SpatialVec*                     bodyForces,
+                          const Real*                           udot,
+                          SpatialVec*                           z,
+                          SpatialVec*                           zPlus,
+                          Real*                                 hingeForces)
+    :   ic(ic), tpc(tpc), abc(abc), dc(dc), mobilityForces(mobilityForces),
+        bodyForces(bodyForces), udot(udot), z(z), zPlus(zPlus),
+        hingeForces(hingeForces) {}
+    void operator()(const RigidBodyNode& node) const {
+        node.calcUDotPass1Inward(ic,tpc,abc,dc,
+            mobilityForces, bodyForces, udot, z, zPlus, hingeForces);
+    }
+    void batch(const RigidBodyNode* const* nodes, int n) const {
+        nodes[0]->calcUDotPass1InwardBatch(nodes, n, ic,tpc,abc,dc,
+            mobilityForces, bodyForces, udot, z, zPlus, hingeForces);
+    }
+private:
+    const SBInstanceCache&                  ic;
+    const SBTreePositionCache&              tpc;
+    const SBArticulatedBodyInertiaCache&    abc;
+    const SBDynamicsCache&                  dc;
+    const Real*                             mobilityForces;
+    const SpatialVec*                       bodyForces;
+    const Real*                             udot;
+    SpatialVec*                             z;
+    SpatialVec*                             zPlus;
+    Real*                                   hingeForces;
+};
+SimTK_NODE_OP_HAS_BATCH(CalcUDotPass1InwardOp)
+
+class CalcUDotPass2OutwardOp {
+public:
+    CalcUDotPass2OutwardOp(const SBStateDigest&                 sbs,
+                           const SBArticulatedBodyInertiaCache& abc,
+                           const Real*                          hingeForces,
+                           SpatialVec*                          A_GB,
+                           Real*                                udot,
+                           Real*                                qdotdot,
+                           Real*                                tau)
+    :   sbs(sbs), ic(sbs.getInstanceCache()), tpc(sbs.getTreePositionCache()),
+        abc(abc), tvc(sbs.getTreeVelocityCache()), dc(sbs.getDynamicsCache()),
+        hingeForces(hingeForces), A_GB(A_GB), udot(udot), qdotdot(qdotdot),
+        tau(tau) {}
+    void operator()(const RigidBodyNode& node) const {
+        node.calcUDotPass2Outward(ic,tpc,abc,tvc,dc, 
+            hingeForces, A_GB, udot, tau);
+        node.calcQDotDot(sbs, &udot[node.getUIndex()], 
+                         &qdotdot[node.getQIndex()]);
+    }
+    // Each node's qdotdot depends only on its own udots so we can do all
+    // the qdotdots after the batch.
+    void batch(const RigidBodyNode* const* nodes, int n) const {
+        nodes[0]->calcUDotPass2OutwardBatch(nodes, n, ic,tpc,abc,tvc,dc, 
+            hingeForces, A_GB, udot, tau);
+        for (int j=0; j < n; ++j)
+            nodes[j]->calcQDotDot(sbs, &udot[nodes[j]->getUIndex()], 
+                                  &qdotdot[nodes[j]->getQIndex()]);
+    }
+private:
+    const SBStateDigest&                    sbs;
+    const SBInstanceCache&                  ic;
+    const SBTreePositionCache&              tpc;
+    const SBArticulatedBodyInertiaCache&    abc;
+    const SBTreeVelocityCache&              tvc;
+    const SBDynamicsCache&                  dc;
+    const Real*                             hingeForces;
+    SpatialVec*                             A_GB;
+    Real*                                   udot;
+    Real*                                   qdotdot;
+    Real*                                   tau;
+};
+SimTK_NODE_OP_HAS_BATCH(CalcUDotPass2OutwardOp)
+
+class MultiplyByMInvPass1InwardOp {
+public:
+    MultiplyByMInvPass1InwardOp(const SBInstanceCache&                  ic,
+                                const SBTreePositionCache&              tpc,
+                                const SBArticulatedBodyInertiaCache&    abc,
+                                const Real*                             f,
+                                SpatialVec*                             z,
+                                SpatialVec*                             zPlus,
+                                Real*                                   eps)
+    :   ic(ic), tpc(tpc), abc(abc), f(f), z(z), zPlus(zPlus), eps(eps) {}
+    void operator()(const RigidBodyNode& node) const 
+    {   node.multiplyByMInvPass1Inward(ic,tpc,abc, f, z, zPlus, eps); }
+    void batch(const RigidBodyNode* const* nodes, int n) const {
+        nodes[0]->multiplyByMInvPass1InwardBatch(nodes, n, ic,tpc,abc,
+                                                 f, z, zPlus, eps);
+    }
+private:
+    const SBInstanceCache&                  ic;
+    const SBTreePositionCache&              tpc;
+    const SBArticulatedBodyInertiaCache&    abc;
+    const Real*                             f;
+    SpatialVec*                             z;
+    SpatialVec*                             zPlus;
+    Real*                                   eps;
+};
+SimTK_NODE_OP_HAS_BATCH(MultiplyByMInvPass1InwardOp)
+
+class MultiplyByMInvPass2OutwardOp {
+public:
+    MultiplyByMInvPass2OutwardOp(const SBInstanceCache&                 ic,
+                                 const SBTreePositionCache&             tpc,
+                                 const SBArticulatedBodyInertiaCache&   abc,
+                                 const Real*                            eps,
+                                 SpatialVec*                            A_GB,
+                                 Real*                                  MInvf)
+    :   ic(ic), tpc(tpc), abc(abc), eps(eps), A_GB(A_GB), MInvf(MInvf) {}
+    void operator()(const RigidBodyNode& node) const 
+    {   node.multiplyByMInvPass2Outward(ic,tpc,abc, eps, A_GB, MInvf); }
+    void batch(const RigidBodyNode* const* nodes, int n) const {
+        nodes[0]->multiplyByMInvPass2OutwardBatch(nodes, n, ic,tpc,abc,
+                                                  eps, A_GB, MInvf);
+    }
+private:
+    const SBInstanceCache&                  ic;
+    const SBTreePositionCache&              tpc;
+    const SBArticulatedBodyInertiaCache&    abc;
+    const Real*                             eps;
+    SpatialVec*                             A_GB;
+    Real*                                   MInvf;
+};
+SimTK_NODE_OP_HAS_BATCH(MultiplyByMInvPass2OutwardOp)
+}
+//................................ TREE SWEEPS .................................
+
+
 void SimbodyMatterSubsystemRep::clearTopologyState() {
     // Unilateral constraints reference Constraints but not vice versa,
     // so delete the conditional constraints first.
@@ -104,6 +753,10 @@ void SimbodyMatterSubsystemRep::clearTopologyCache() {
     // be deleted when the MobilizedBodyImpl objects are.
     rbNodeLevels.clear();
     nodeNum2NodeMap.clear();
+    treeSweepTrunk.clear();
+    treeSweepBins.clear();
+    typeSortedNodeLevels.clear();
+    nodeBatchEnds.clear();
 
     showDefaultGeometry = true;
 }
@@ -327,6 +980,100 @@ void SimbodyMatterSubsystemRep::endConstruction(State& s) {
         }
         */
     }
+
+    partitionTreeForParallelSweeps();
+    groupNodesByTypeForSweeps();
+}
+
+//==============================================================================
+//                          STATE CHECKPOINT TYPES
+//==============================================================================
+// Our model and instance variables must be saved in a StateCheckpoint since
+// they say which constraints are disabled, which mobilizers are locked, and so
+// on. SBModelVars is plain data. SBInstanceVars is a set of arrays of plain
+// data, written one after another with each length first. Some constraints
+// keep their instance variables in pairs of Vecs, which are plain too.
+namespace {
+template <class T> void appendBytes(const T* p, unsigned n, Array_<char>& out) {
+    const char* c = reinterpret_cast<const char*>(p);
+    out.insert(out.end(), c, c + n*sizeof(T));
+}
+template <class T> bool takeBytes(const char*& data, const char* end,
+                                  T* p, unsigned n) {
+    if (size_t(end-data) / sizeof(T) < n) return false;
+    if (n) std::memcpy(p, data, n*sizeof(T));
+    data += n*sizeof(T);
+    return true;
+}
+
+template <class T, class X>
+void appendArray(const Array_<T,X>& a, Array_<char>& out) {
+    const unsigned n = a.size();
+    appendBytes(&n, 1, out);
+    if (n) appendBytes(a.cbegin(), n, out);
+}
+template <class T, class X>
+bool takeArray(const char*& data, const char* end, Array_<T,X>& a) {
+    unsigned n;
+    if (!takeBytes(data, end, &n, 1) || size_t(end-data)/sizeof(T) < n)
+        return false;
+    a.resize(n);
+    return takeBytes(data, end, a.begin(), n);
+}
+
+void appendVector(const Vector& v, Array_<char>& out) {
+    const unsigned n = v.size();
+    appendBytes(&n, 1, out);
+    for (int i=0; i < v.size(); ++i)
+        appendBytes(&v[i], 1, out);
+}
+bool takeVector(const char*& data, const char* end, Vector& v) {
+    unsigned n;
+    if (!takeBytes(data, end, &n, 1) || size_t(end-data)/sizeof(Real) < n)
+        return false;
+    v.resize(n);
+    for (int i=0; i < v.size(); ++i)
+        if (!takeBytes(data, end, &v[i], 1)) return false;
+    return true;
+}
+
+void writeInstanceVars(const AbstractValue& value, Array_<char>& out) {
+    const SBInstanceVars& iv = Value<SBInstanceVars>::downcast(value).get();
+    appendArray(iv.bodyMassProperties, out);
+    appendArray(iv.outboardMobilizerFrames, out);
+    appendArray(iv.inboardMobilizerFrames, out);
+    appendArray(iv.mobilizerLockLevel, out);
+    appendVector(iv.lockedQs, out);
+    appendVector(iv.lockedUs, out);
+    appendArray(iv.prescribedMotionIsDisabled, out);
+    appendVector(iv.particleMasses, out);
+    appendArray(iv.constraintIsDisabled, out);
+}
+bool readInstanceVars(const char* data, size_t nBytes, AbstractValue& value) {
+    SBInstanceVars& iv = Value<SBInstanceVars>::updDowncast(value).upd();
+    const char* end = data + nBytes;
+    return takeArray(data, end, iv.bodyMassProperties)
+        && takeArray(data, end, iv.outboardMobilizerFrames)
+        && takeArray(data, end, iv.inboardMobilizerFrames)
+        && takeArray(data, end, iv.mobilizerLockLevel)
+        && takeVector(data, end, iv.lockedQs)
+        && takeVector(data, end, iv.lockedUs)
+        && takeArray(data, end, iv.prescribedMotionIsDisabled)
+        && takeVector(data, end, iv.particleMasses)
+        && takeArray(data, end, iv.constraintIsDisabled)
+        && data == end;
+}
+
+bool registerCheckpointTypes() {
+    StateCheckpoint::registerPlainType<SBModelVars>("SBModelVars");
+    StateCheckpoint::registerValueType(typeid(Value<SBInstanceVars>),
+        "SBInstanceVars", &writeInstanceVars, &readInstanceVars);
+    StateCheckpoint::registerPlainType< std::pair<Vec3,Vec3> >
+       ("std::pair<Vec3,Vec3>");
+    StateCheckpoint::registerPlainType< std::pair<Vec3,UnitVec3> >
+       ("std::pair<Vec3,UnitVec3>");
+    return true;
+}
 }
 
 int SimbodyMatterSubsystemRep::realizeSubsystemTopologyImpl(State& s) const {
@@ -342,6 +1089,10 @@ int SimbodyMatterSubsystemRep::realizeSubsystemTopologyImpl(State& s) const {
     if (!subsystemTopologyHasBeenRealized()) 
         mThis->endConstruction(s); // no more bodies after this!
 
+    // Registered once, before any of our States can be checkpointed.
+    static const bool checkpointTypesRegistered = registerCheckpointTypes();
+    (void)checkpointTypesRegistered;
+
     // Fill in the local copy of the topologyCache from the information
     // calculated in endConstruction(). Also ask the State for some room to
     // put Modeling variables & cache and remember the indices in our 
@@ -406,12 +1157,54 @@ int SimbodyMatterSubsystemRep::realizeSubsystemTopologyImpl(State& s) const {
         allocateLazyCacheEntry(s, Stage::Position,
                                new Value<SBCompositeBodyInertiaCache>());
 
+    // Similarly, the mass matrix factorization is calculated only on request.
+    tc.massMatrixFactorizationCacheIndex =
+        allocateLazyCacheEntry(s, Stage::Position,
+                               new Value<SBMassMatrixFactorizationCache>());
+
+    // And the most recently requested operational space inertia.
+    tc.operationalSpaceInertiaCacheIndex =
+        allocateLazyCacheEntry(s, Stage::Position,
+                               new Value<SBOperationalSpaceInertiaCache>());
+
     // Articulated body inertias *can* be calculated any time after Position 
     // stage but we want to put them off until Dynamics stage if possible.
     tc.articulatedBodyInertiaCacheIndex =
-        allocateCacheEntry(s, Stage::Position, Stage::Dynamics, 
+        allocateCacheEntry(s, Stage::Position, Stage::Dynamics,
                            new Value<SBArticulatedBodyInertiaCache>());
 
+    // The factored G*M^-1*~G matrix is calculated when first needed for
+    // multipliers or impulses. Which of the first two entries we use depends
+    // on whether any constraints in use are non-holonomic or acceleration-only.
+    // The third survives changes to q and u so that it can be reused.
+    tc.gMInvGtFactorizationPositionCacheIndex =
+        allocateLazyCacheEntry(s, Stage::Position,
+                               new Value<SBGMInvGtFactorizationCache>());
+    tc.gMInvGtFactorizationVelocityCacheIndex =
+        allocateLazyCacheEntry(s, Stage::Velocity,
+                               new Value<SBGMInvGtFactorizationCache>());
+    tc.reusableGMInvGtFactorizationCacheIndex =
+        allocateLazyCacheEntry(s, Stage::Instance,
+                               new Value<SBGMInvGtFactorizationCache>());
+
+    // Factorizations saved by projectQ() and projectU() for reuse.
+    tc.reusableQProjectionCacheIndex =
+        allocateLazyCacheEntry(s, Stage::Instance,
+                               new Value<SBProjectionFactorizationCache>());
+    tc.reusableUProjectionCacheIndex =
+        allocateLazyCacheEntry(s, Stage::Instance,
+                               new Value<SBProjectionFactorizationCache>());
+
+    // Independent blocks of constraints, if needed.
+    tc.constraintBlockCacheIndex =
+        allocateLazyCacheEntry(s, Stage::Instance,
+                               new Value<SBConstraintBlockCache>());
+
+    // Scratch space for realization and projection; never marked valid.
+    tc.workspaceCacheIndex =
+        allocateLazyCacheEntry(s, Stage::Instance,
+                               new Value<SBWorkspaceCache>());
+
     // Basic tree velocity kinematics can be calculated any time after Position
     // stage and should be filled in first during realizeVelocity() and then
     // marked valid so later computations during the same realization can
@@ -966,6 +1759,8 @@ realizeSubsystemInstanceImpl(const State& s) const {
     updTreePositionCache(s).allocate(topologyCache, mc, ic);
     updConstrainedPositionCache(s).allocate(topologyCache, mc, ic);
     updCompositeBodyInertiaCache(s).allocate(topologyCache, mc, ic);
+    updMassMatrixFactorizationCache(s).allocate(topologyCache, mc, ic);
+    updOperationalSpaceInertiaCache(s).allocate(topologyCache, mc, ic);
     updArticulatedBodyInertiaCache(s).allocate(topologyCache, mc, ic);
     updTreeVelocityCache(s).allocate(topologyCache, mc, ic);
     updConstrainedVelocityCache(s).allocate(topologyCache, mc, ic);
@@ -1042,26 +1837,22 @@ int SimbodyMatterSubsystemRep::realizeSubsystemPositionImpl(const State& s) cons
     const SBStateDigest stateDigest(s, *this, Stage::Position);
     const SBInstanceCache&      ic   = stateDigest.getInstanceCache();
     SBTreePositionCache&        tpc  = stateDigest.updTreePositionCache();
+    Vector&                     qErr = stateDigest.updQErr();
 
     // realize tree positions (kinematics)
     // This includes all local cross-mobilizer kinematics (M in F, B in P)
-    // and all global kinematics relative to Ground (G).
-
-    // Any body which is using quaternions should calculate the quaternion
-    // constraint here and put it in the appropriate slot of qErr.
-    // Set generalized coordinates: sweep from base to tips.
-    for (int i=0 ; i<(int)rbNodeLevels.size() ; i++) 
-        for (int j=0 ; j<(int)rbNodeLevels[i].size() ; j++)
-            rbNodeLevels[i][j]->realizePosition(stateDigest); 
-
-    // Ask the constraints to calculate ancestor-relative kinematics (still 
-    // goes in TreePositionCache).
-    for (ConstraintIndex cx(0); cx < constraints.size(); ++cx)
-        getConstraint(cx).getImpl()
-            .calcConstrainedBodyTransformInAncestor(stateDigest, tpc);
-
-    // Now we're done with the TreePositionCache.
-    markCacheValueRealized(s, topologyCache.treePositionCacheIndex);
+    // and all global kinematics relative to Ground (G). This will already
+    // have been done if the State was realized as part of an ensemble.
+    if (tpc.isRealizedByEnsemble)
+        tpc.isRealizedByEnsemble = false;
+    else {
+        // Any body which is using quaternions should calculate the 
+        // quaternion constraint here and put it in the appropriate slot of
+        // qErr. Set generalized coordinates: sweep from base to tips.
+        const bool* needsRealization = prepareTreePositions(stateDigest);
+        sweepOutward(RealizePositionOp(stateDigest, needsRealization));
+        finishTreePositions(stateDigest);
+    }
 
     // MobilizedBodies
     // This will include writing the prescribed velocities (u's) into
@@ -1070,11 +1861,14 @@ int SimbodyMatterSubsystemRep::realizeSubsystemPositionImpl(const State& s) cons
         getMobilizedBody(mbx).getImpl().realizePosition(stateDigest);
 
 
-    // Put position constraint equation errors in qErr
-    Vector& qErr = stateDigest.updQErr();
+    // Put position constraint equation errors in qErr. Each Constraint is
+    // timed if realize profiling is enabled.
+    const RealizeProfiler& profiler = getSystem().getRealizeProfiler();
     for (ConstraintIndex cx(0); cx < constraints.size(); ++cx) {
         if (isConstraintDisabled(s,cx))
             continue;
+        RealizeProfiler::Scope scope(profiler, getMySubsystemIndex(),
+                                     Stage::Position, "Constraint", cx);
         const SBInstancePerConstraintInfo& 
             cInfo = ic.getConstraintInstanceInfo(cx);
         const Segment& pseg = cInfo.holoErrSegment;
@@ -1096,6 +1890,80 @@ int SimbodyMatterSubsystemRep::realizeSubsystemPositionImpl(const State& s) cons
 
 
 
+// For incremental realization, a body's kinematics must be recalculated if
+// any of its q's have changed since the cache was last calculated, or if its
+// parent's kinematics are being recalculated. The rest are still good. Bodies
+// are numbered so that parents precede children. The quaternion errors are
+// restored here for all bodies, then overwritten for those being recalculated.
+const bool* SimbodyMatterSubsystemRep::
+prepareTreePositions(const SBStateDigest& stateDigest) const {
+    const SBModelCache&         mc   = stateDigest.getModelCache();
+    const SBInstanceCache&      ic   = stateDigest.getInstanceCache();
+    SBTreePositionCache&        tpc  = stateDigest.updTreePositionCache();
+    const Vector&               q    = stateDigest.getQ();
+    Vector&                     qErr = stateDigest.updQErr();
+
+    const int nQuat = mc.totalNQuaternionsInUse;
+    const bool incremental = useIncrementalPositionRealization
+                             && tpc.isQLastRealizedKnown;
+    int nRealized = getNumBodies();
+    if (incremental) {
+        nRealized = 0;
+        for (MobilizedBodyIndex mbx(0); mbx < getNumBodies(); ++mbx) {
+            const RigidBodyNode& node = getRigidBodyNode(mbx);
+            const SBModelPerMobodInfo& mbInfo = mc.getMobodModelInfo(mbx);
+            bool changed = node.getParent() != 0
+                && tpc.bodyNeedsRealization[node.getParent()->getNodeNum()];
+            for (int i=0; i < mbInfo.nQInUse && !changed; ++i) {
+                const int qx = mbInfo.firstQIndex + i;
+                changed = (q[qx] != tpc.qLastRealized[qx]);
+            }
+            tpc.bodyNeedsRealization[mbx] = changed;
+            if (changed) ++nRealized;
+        }
+        for (int i=0; i < nQuat; ++i)
+            qErr[ic.firstQuaternionQErrSlot + i] =
+                tpc.quaternionErrLastRealized[i];
+    }
+    if (nRealized)
+        numBodyPositionRealizations += nRealized;
+
+    // Forget the old q until the sweep is done in case it fails.
+    tpc.isQLastRealizedKnown = false;
+
+    return incremental ? &tpc.bodyNeedsRealization[MobilizedBodyIndex(0)] : 0;
+}
+
+void SimbodyMatterSubsystemRep::
+finishTreePositions(const SBStateDigest& stateDigest) const {
+    const SBModelCache&         mc   = stateDigest.getModelCache();
+    const SBInstanceCache&      ic   = stateDigest.getInstanceCache();
+    SBTreePositionCache&        tpc  = stateDigest.updTreePositionCache();
+    const Vector&               qErr = stateDigest.updQErr();
+
+    if (useIncrementalPositionRealization) {
+        const int nQuat = mc.totalNQuaternionsInUse;
+        tpc.qLastRealized = stateDigest.getQ();
+        tpc.isQLastRealizedKnown = true;
+        tpc.quaternionErrLastRealized.resize(nQuat);
+        for (int i=0; i < nQuat; ++i)
+            tpc.quaternionErrLastRealized[i] =
+                qErr[ic.firstQuaternionQErrSlot + i];
+    }
+
+    // Ask the constraints to calculate ancestor-relative kinematics (still 
+    // goes in TreePositionCache).
+    for (ConstraintIndex cx(0); cx < constraints.size(); ++cx)
+        getConstraint(cx).getImpl()
+            .calcConstrainedBodyTransformInAncestor(stateDigest, tpc);
+
+    // Now we're done with the TreePositionCache.
+    markCacheValueRealized(stateDigest.getState(), 
+                           topologyCache.treePositionCacheIndex);
+}
+
+
+
 //==============================================================================
 //                      REALIZE COMPOSITE BODY INERTIAS
 //==============================================================================
@@ -1124,6 +1992,121 @@ invalidateCompositeBodyInertias(const State& state) const {
 
 
 
+//==============================================================================
+//                    REALIZE MASS MATRIX FACTORIZATION
+//==============================================================================
+// Calculate the sparse LTDL factorization of the free-mobility block of M;
+// see SBMassMatrixFactorizationCache for the storage scheme. First we work 
+// out the sparsity pattern and fill in the lower triangle of M in packed 
+// form using the composite-rigid-body algorithm (see calcM() for details), 
+// then we factor it in place using Featherstone's LTDL algorithm (RBDA 
+// section 6.5). Cost is O(n*d) where d is the depth of the tree in mobilities;
+// no fill-in occurs.
+void SimbodyMatterSubsystemRep::
+realizeMassMatrixFactorization(const State& state) const {
+    const CacheEntryIndex mfx = topologyCache.massMatrixFactorizationCacheIndex;
+
+    if (isCacheValueRealized(state, mfx))
+        return; // already realized
+
+    SimTK_STAGECHECK_GE_ALWAYS(getStage(state), Stage::Position, 
+        "SimbodyMatterSubsystem::realizeMassMatrixFactorization()");
+
+    const SBInstanceCache&      ic  = getInstanceCache(state);
+    const SBTreePositionCache&  tpc = getTreePositionCache(state);
+    const Array_<SpatialInertia,MobilizedBodyIndex>& R = 
+        getCompositeBodyInertias(state);
+    SBMassMatrixFactorizationCache& mfc = updMassMatrixFactorizationCache(state);
+
+    const int nb = getNumBodies();
+    const int nu = getTotalDOF();
+
+    // Find each free mobility's parent: the previous free mobility of the 
+    // same body, or else the last free mobility of the nearest ancestor that 
+    // has one. Ancestors have lower u indices so we can count the number of
+    // entries in each row of L as we go.
+    Array_<int,MobilizedBodyIndex> lastFreeU(nb, -1);
+    mfc.firstL[0] = 0;
+    for (MobilizedBodyIndex mbx(1); mbx < nb; ++mbx) {
+        const RigidBodyNode& node = getRigidBodyNode(mbx);
+        const bool isPrescribed = node.isUDotKnown(ic);
+        int last = lastFreeU[node.getParent()->getNodeNum()];
+        for (int k=0; k < node.getDOF(); ++k) {
+            const int u = node.getUIndex() + k;
+            mfc.isPrescribed[u] = isPrescribed;
+            mfc.parentU[u] = isPrescribed ? -1 : last;
+            const int nInRow = 
+                (isPrescribed || last < 0) ? 0
+                : mfc.firstL[last+1] - mfc.firstL[last] + 1;
+            mfc.firstL[u+1] = mfc.firstL[u] + nInRow;
+            if (!isPrescribed) last = u;
+        }
+        lastFreeU[mbx] = last;
+    }
+    mfc.L.resize(mfc.firstL[nu]);
+
+    // Fill in D and L with the elements of M, which we get a column at a time
+    // (equivalently, a row of the lower triangle) by applying the composite
+    // body inertia to a column of H and projecting the resulting force onto
+    // the inboard mobilities. The inboard mobilities are visited in exactly
+    // the parent, grandparent, ... order used for the rows of L.
+    for (MobilizedBodyIndex mbx(1); mbx < nb; ++mbx) {
+        const RigidBodyNode& node = getRigidBodyNode(mbx);
+        if (node.isUDotKnown(ic))
+            continue;
+        for (int k=0; k < node.getDOF(); ++k) {
+            const int u = node.getUIndex() + k;
+            Real* Lu = mfc.L.begin() + mfc.firstL[u];
+            SpatialVec F = R[mbx] * node.getHCol(tpc,k);
+            mfc.D[u] = ~node.getHCol(tpc,k) * F;
+            for (int j=k-1; j >= 0; --j)
+                *Lu++ = ~node.getHCol(tpc,j) * F;
+            for (const RigidBodyNode* body = &node; 
+                 body->getParent()->getNodeNum() != GroundIndex; 
+                 body = body->getParent())
+            {
+                F = body->getPhi(tpc) * F; // shift to parent
+                const RigidBodyNode& parent = *body->getParent();
+                if (parent.isUDotKnown(ic))
+                    continue;
+                for (int j=parent.getDOF()-1; j >= 0; --j)
+                    *Lu++ = ~parent.getHCol(tpc,j) * F;
+            }
+            assert(Lu == mfc.L.begin() + mfc.firstL[u+1]);
+        }
+    }
+
+    // Factor in place, tip to base. For each mobility k, eliminate it from
+    // all its ancestors i. Row i of L contains entries for the ancestors of i,
+    // which are exactly the ancestors of k that follow i in k's row.
+    for (int k=nu-1; k >= 0; --k) {
+        if (mfc.isPrescribed[k])
+            continue;
+        Real* Lk = mfc.L.begin() + mfc.firstL[k];
+        const int nk = mfc.firstL[k+1] - mfc.firstL[k];
+        int i = mfc.parentU[k];
+        for (int m=0; m < nk; ++m, i = mfc.parentU[i]) {
+            const Real a = Lk[m] / mfc.D[k];
+            mfc.D[i] -= a*Lk[m];
+            Real* Li = mfc.L.begin() + mfc.firstL[i];
+            for (int p=m+1; p < nk; ++p)
+                Li[p-m-1] -= a*Lk[p];
+            Lk[m] = a;
+        }
+    }
+
+    markCacheValueRealized(state, mfx);
+}
+
+void SimbodyMatterSubsystemRep::
+invalidateMassMatrixFactorization(const State& state) const {
+    const CacheEntryIndex mfx = 
+        topologyCache.massMatrixFactorizationCacheIndex;
+    markCacheValueNotRealized(state, mfx);
+}
+
+
+
 //==============================================================================
 //                     REALIZE ARTICULATED BODY INERTIAS
 //==============================================================================
@@ -1143,9 +2126,7 @@ realizeArticulatedBodyInertias(const State& state) const {
     SBArticulatedBodyInertiaCache&  abc = updArticulatedBodyInertiaCache(state);
 
     // tip-to-base sweep
-    for (int i=rbNodeLevels.size()-1 ; i>=0 ; --i) 
-        for (int j=0 ; j<(int)rbNodeLevels[i].size() ; ++j)
-            rbNodeLevels[i][j]->realizeArticulatedBodyInertiasInward(ic,tpc,abc);
+    sweepInward(RealizeArticulatedBodyInertiasOp(ic,tpc,abc));
 
     markCacheValueRealized(state, abx);
 }
@@ -1194,21 +2175,15 @@ int SimbodyMatterSubsystemRep::realizeSubsystemVelocityImpl(const State& s) cons
 
     // realize tree velocity kinematics
     // This includes all local cross-mobilizer velocities (M in F, B in P)
-    // and all global velocities relative to Ground (G).
-
-    // Set generalized speeds: sweep from base to tips.
-    for (int i=0 ; i<(int)rbNodeLevels.size() ; ++i) 
-        for (int j=0 ; j<(int)rbNodeLevels[i].size() ; ++j)
-            rbNodeLevels[i][j]->realizeVelocity(stateDigest); 
-
-    // Ask the constraints to calculate ancestor-relative velocity kinematics 
-    // (still goes in TreePositionCache).
-    for (ConstraintIndex cx(0); cx < constraints.size(); ++cx)
-        getConstraint(cx).getImpl()
-            .calcConstrainedBodyVelocityInAncestor(stateDigest, tvc);
-
-    // Now we're done with the TreeVelocityCache.
-    markCacheValueRealized(s, topologyCache.treeVelocityCacheIndex);
+    // and all global velocities relative to Ground (G). This will already
+    // have been done if the State was realized as part of an ensemble.
+    if (tvc.isRealizedByEnsemble)
+        tvc.isRealizedByEnsemble = false;
+    else {
+        // Set generalized speeds: sweep from base to tips.
+        sweepOutward(RealizeVelocityOp(stateDigest));
+        finishTreeVelocities(stateDigest);
+    }
 
     // MobilizedBodies
     // probably not much to do here
@@ -1216,11 +2191,15 @@ int SimbodyMatterSubsystemRep::realizeSubsystemVelocityImpl(const State& s) cons
         getMobilizedBody(mbx).getImpl().realizeVelocity(stateDigest);
 
 
-    // Put velocity constraint equation errors in uErr
+    // Put velocity constraint equation errors in uErr, timing each
+    // Constraint if realize profiling is enabled.
     Vector& uErr = stateDigest.updUErr();
+    const RealizeProfiler& profiler = getSystem().getRealizeProfiler();
     for (ConstraintIndex cx(0); cx < constraints.size(); ++cx) {
         if (isConstraintDisabled(s,cx))
             continue;
+        RealizeProfiler::Scope scope(profiler, getMySubsystemIndex(),
+                                     Stage::Velocity, "Constraint", cx);
         const SBInstancePerConstraintInfo& 
             cInfo = ic.getConstraintInstanceInfo(cx);
 
@@ -1251,6 +2230,81 @@ int SimbodyMatterSubsystemRep::realizeSubsystemVelocityImpl(const State& s) cons
 
 
 
+void SimbodyMatterSubsystemRep::
+finishTreeVelocities(const SBStateDigest& stateDigest) const {
+    SBTreeVelocityCache& tvc = stateDigest.updTreeVelocityCache();
+
+    // Ask the constraints to calculate ancestor-relative velocity kinematics 
+    // (still goes in TreePositionCache).
+    for (ConstraintIndex cx(0); cx < constraints.size(); ++cx)
+        getConstraint(cx).getImpl()
+            .calcConstrainedBodyVelocityInAncestor(stateDigest, tvc);
+
+    // Now we're done with the TreeVelocityCache.
+    markCacheValueRealized(stateDigest.getState(), 
+                           topologyCache.treeVelocityCacheIndex);
+}
+
+
+
+//==============================================================================
+//                            REALIZE TREE ENSEMBLE
+//==============================================================================
+// Each State gets its own StateDigest and per-node operator, exactly as it
+// would if it were realized alone, and the operators are then applied together
+// in one outward sweep. The work before and after the sweep is done serially
+// for each State. Each State is marked so that realizing stage g next doesn't
+// repeat the sweep; see SBTreePositionCache::isRealizedByEnsemble. The marks
+// are made only after every State is finished, so if anything throws none of
+// them is marked and a later realize() does the sweep as usual.
+void SimbodyMatterSubsystemRep::
+realizeTreeEnsemble(const Array_<const State*>& states, Stage g) const {
+    SimTK_APIARGCHECK1_ALWAYS(g==Stage::Position || g==Stage::Velocity,
+        "SimbodyMatterSubsystem", "realizeTreeEnsemble",
+        "Only Position and Velocity stages can be realized this way, not %s.",
+        g.getName().c_str());
+
+    const int n = (int)states.size();
+    Array_<SBStateDigest> digests; digests.reserve(n);
+    for (int k=0; k < n; ++k) {
+        SimTK_STAGECHECK_EQ_ALWAYS(getStage(*states[k]), g.prev(),
+            "SimbodyMatterSubsystem::realizeTreeEnsemble()");
+        digests.push_back(SBStateDigest(*states[k], *this, g));
+    }
+
+    if (g == Stage::Position) {
+        Array_<RealizePositionOp> ops; ops.reserve(n);
+        for (int k=0; k < n; ++k)
+            ops.push_back(RealizePositionOp(digests[k], 
+                                            prepareTreePositions(digests[k])));
+        sweepOutwardEnsemble(ops);
+        for (int k=0; k < n; ++k)
+            finishTreePositions(digests[k]);
+        for (int k=0; k < n; ++k)
+            digests[k].updTreePositionCache().isRealizedByEnsemble = true;
+    } else {
+        Array_<RealizeVelocityOp> ops; ops.reserve(n);
+        for (int k=0; k < n; ++k)
+            ops.push_back(RealizeVelocityOp(digests[k]));
+        sweepOutwardEnsemble(ops);
+        for (int k=0; k < n; ++k)
+            finishTreeVelocities(digests[k]);
+        for (int k=0; k < n; ++k)
+            digests[k].updTreeVelocityCache().isRealizedByEnsemble = true;
+    }
+}
+
+void SimbodyMatterSubsystemRep::
+cancelTreeEnsemble(const State& s, Stage g) const {
+    const SBStateDigest stateDigest(s, *this, g);
+    if (g == Stage::Position)
+        stateDigest.updTreePositionCache().isRealizedByEnsemble = false;
+    else
+        stateDigest.updTreeVelocityCache().isRealizedByEnsemble = false;
+}
+
+
+
 //==============================================================================
 //                               REALIZE DYNAMICS
 //==============================================================================
@@ -1273,9 +2327,7 @@ int SimbodyMatterSubsystemRep::realizeSubsystemDynamicsImpl(const State& s)  con
 
     // Realize velocity-dependent articulated body quantities needed for 
     // dynamics: base-to-tip.
-    for (int i=0; i < (int)rbNodeLevels.size(); ++i)
-        for (int j=0; j < (int)rbNodeLevels[i].size(); ++j)
-            rbNodeLevels[i][j]->realizeDynamics(abc, stateDigest);
+    sweepOutward(RealizeDynamicsOp(abc, stateDigest));
 
     // MobilizedBodies
     // This will include writing the prescribed accelerations into
@@ -2005,6 +3057,25 @@ calcConstraintForcesFromMultipliers
     Vector&              mobilityForces,
     Array_<SpatialVec>&  consBodyForcesInG,
     Array_<Real>&        consMobilityForces) const
+{
+    Array_<Real> lambdap, lambdav, lambdaa;
+    calcConstraintForcesFromMultipliers(s, lambda, bodyForcesInG, 
+        mobilityForces, consBodyForcesInG, consMobilityForces,
+        lambdap, lambdav, lambdaa);
+}
+
+// Same, with caller-supplied arrays to hold one Constraint's multipliers.
+void SimbodyMatterSubsystemRep::
+calcConstraintForcesFromMultipliers
+   (const State&         s, 
+    const Vector&        lambda,
+    Vector_<SpatialVec>& bodyForcesInG,
+    Vector&              mobilityForces,
+    Array_<SpatialVec>&  consBodyForcesInG,
+    Array_<Real>&        consMobilityForces,
+    Array_<Real>&        lambdap,
+    Array_<Real>&        lambdav,
+    Array_<Real>&        lambdaa) const
 {
     const SBInstanceCache& ic = getInstanceCache(s);
 
@@ -2022,8 +3093,7 @@ calcConstraintForcesFromMultipliers
     bodyForcesInG.resize(getNumBodies()); bodyForcesInG.setToZero();
     mobilityForces.resize(getNU(s));      mobilityForces.setToZero();
 
-    // These Arrays are for one constraint at a time.
-    Array_<Real> lambdap, lambdav, lambdaa; // multipliers
+    // The lambda Arrays are for one constraint at a time.
 
     // Loop over all enabled constraints, ask them to generate forces, and
     // accumulate the results in the global problem return vectors.
@@ -2134,12 +3204,13 @@ calcConstraintForcesFromMultipliers
 // All of the Vector arguments must use contiguous storage.
 // Complexity is O(m+n).
 void SimbodyMatterSubsystemRep::
-multiplyByPVATranspose( const State&     s,
-                        bool             includeP,
-                        bool             includeV,
-                        bool             includeA,
-                        const Vector&    lambda,
-                        Vector&          allfuVector) const
+multiplyByPVATranspose( const State&             s,
+                        bool                     includeP,
+                        bool                     includeV,
+                        bool                     includeA,
+                        const Vector&            lambda,
+                        Vector&                  allfuVector,
+                        SBPVATransposeWorkspace& ws) const
 {
     const SBInstanceCache& ic = getInstanceCache(s);
 
@@ -2163,11 +3234,12 @@ multiplyByPVATranspose( const State&     s,
     if (nu==0) return;
     if (m==0) {allfuVector.setToZero(); return;}
 
-    // Allocate a temporary body forces vector here. We'll map these to 
-    // generalized forces as the penultimate step, then add those into 
-    // the output argument allfuVector which will have already accumulated 
-    // all directly-generated mobility forces.
-    Vector_<SpatialVec> allF_GVector(nb);
+    // A temporary body forces vector. We'll map these to generalized forces
+    // as the penultimate step, then add those into the output argument 
+    // allfuVector which will have already accumulated all directly-generated
+    // mobility forces.
+    Vector_<SpatialVec>& allF_GVector = ws.allF_G;
+    allF_GVector.resize(nb);
 
     // We'll be accumulating constraint forces into these Vectors so zero 
     // them now. Multiple constraints may contribute to forces on the same 
@@ -2190,13 +3262,12 @@ multiplyByPVATranspose( const State&     s,
     // These Arrays are for one constraint at a time. We need separate 
     // memory for these because constrained bodies and constrained u's are
     // not ordered the same as the global ones, nor are they necessarily
-    // contiguous in the global arrays. We're declaring these arrays
-    // outside the loop to avoid heap allocation -- they will grow to the
-    // max size needed by any constraint, then get resized as needed without
-    // further heap allocation.
-    Array_<SpatialVec,ConstrainedBodyIndex> oneF_G; // body spatial forces
-    Array_<Real,      ConstrainedUIndex>    onefu;  // u-space generalized forces     
-    Array_<Real,      ConstrainedQIndex>    onefq;  // q-space generalized forces     
+    // contiguous in the global arrays. They live in the workspace to avoid 
+    // heap allocation -- they will grow to the max size needed by any 
+    // constraint, then get resized as needed without further heap allocation.
+    Array_<SpatialVec,ConstrainedBodyIndex>& oneF_G = ws.oneF_G; // body forces
+    Array_<Real,      ConstrainedUIndex>&    onefu  = ws.onefu;  // u-space
+    Array_<Real,      ConstrainedQIndex>&    onefq  = ws.onefq;  // q-space
 
     // Loop over all enabled constraints, ask them to generate forces, and
     // accumulate the results in the global problem arrays (allF_G,allfu).
@@ -2270,8 +3341,8 @@ multiplyByPVATranspose( const State&     s,
 
     // Map the body forces into u-space generalized forces.
     // 12*nu + 18*nb flops.
-    Vector ftmp(nu);
-    multiplyBySystemJacobianTranspose(s, allF_GVector, ftmp);
+    Vector& ftmp = ws.ftmp;
+    multiplyBySystemJacobianTranspose(s, allF_GVector, ftmp, ws.zTemp);
     allfuVector += ftmp;
 }
 
@@ -2328,6 +3399,211 @@ calcPVATranspose(   const State&     s,
 
 
 
+//==============================================================================
+//                               CALC PVA SPARSE
+//==============================================================================
+// Each row of G=[P;V;A] belongs to a single Constraint, and can have nonzero
+// elements only for that Constraint's participating mobilities: its
+// constrained mobilities and the mobilities on the paths from its constrained
+// bodies in to (but not including) its Ancestor. We generate the rows as for
+// calcPVATranspose(), using the Constraint's force method with a single unit
+// multiplier, but rather than mapping the resulting body forces to
+// generalized forces for the whole system we walk inward from each
+// constrained body to the Ancestor, so each row costs time proportional to
+// the size of the Constraint's subtree rather than n.
+void SimbodyMatterSubsystemRep::
+calcPVASparse(  const State&     s,
+                bool             includeP,
+                bool             includeV,
+                bool             includeA,
+                Array_<int>&     rowStart,
+                Array_<int>&     colIndex,
+                Array_<Real>&    values) const
+{
+    const SBInstanceCache&     ic  = getInstanceCache(s);
+    const SBTreePositionCache& tpc = getTreePositionCache(s);
+
+    // Global problem dimensions.
+    const int mHolo    = includeP ?
+        ic.totalNHolonomicConstraintEquationsInUse : 0;
+    const int mNonholo = includeV ?
+        ic.totalNNonholonomicConstraintEquationsInUse : 0;
+    const int mAccOnly = includeA ?
+        ic.totalNAccelerationOnlyConstraintEquationsInUse : 0;
+    const int m = mHolo+mNonholo+mAccOnly;
+
+    const int nu = getNU(s);
+
+    // First pass: the sparsity pattern. Every row generated by a Constraint
+    // has the same length, the number of its participating mobilities.
+    rowStart.resize(m+1);
+    rowStart[0] = 0;
+    for (ConstraintIndex cx(0); cx < constraints.size(); ++cx) {
+        if (isConstraintDisabled(s,cx))
+            continue;
+        const SBInstancePerConstraintInfo&
+                              cInfo = ic.getConstraintInstanceInfo(cx);
+        const int npu = cInfo.getNumParticipatingU();
+        if (includeP)
+            for (int i=0; i < cInfo.holoErrSegment.length; ++i)
+                rowStart[cInfo.holoErrSegment.offset + i + 1] = npu;
+        if (includeV)
+            for (int i=0; i < cInfo.nonholoErrSegment.length; ++i)
+                rowStart[mHolo + cInfo.nonholoErrSegment.offset + i + 1] = npu;
+        if (includeA)
+            for (int i=0; i < cInfo.accOnlyErrSegment.length; ++i)
+                rowStart[mHolo + mNonholo
+                         + cInfo.accOnlyErrSegment.offset + i + 1] = npu;
+    }
+    for (int i=0; i < m; ++i)
+        rowStart[i+1] += rowStart[i];
+
+    const int nnz = rowStart[m];
+    colIndex.resize(nnz);
+    values.resize(nnz);
+    if (nnz == 0)
+        return;
+
+    // Second pass: the values. We accumulate each row into a dense u-space
+    // workspace, then gather its participating entries and clear them.
+    Array_<Real> fu(nu, Real(0));
+
+    // Per-constraint temporaries; see multiplyByPVATranspose().
+    Array_<SpatialVec,ConstrainedBodyIndex> oneF_G;
+    Array_<Real,      ConstrainedUIndex>    onefu;
+    Array_<Real,      ConstrainedQIndex>    onefq;
+    Array_<Real>                            lambda;
+
+    for (ConstraintIndex cx(0); cx < constraints.size(); ++cx) {
+        if (isConstraintDisabled(s,cx))
+            continue;
+
+        const ConstraintImpl& crep = constraints[cx]->getImpl();
+        const SBInstancePerConstraintInfo&
+                              cInfo = ic.getConstraintInstanceInfo(cx);
+        const int ncb = crep.getNumConstrainedBodies();
+        const int ncq = cInfo.getNumConstrainedQ();
+        const int ncu = cInfo.getNumConstrainedU();
+        const int npu = cInfo.getNumParticipatingU();
+        // A Constraint that acts only on mobilities has no constrained
+        // bodies and hence no Ancestor.
+        const MobilizedBodyIndex ancestor = ncb
+            ? crep.getAncestorMobilizedBody().getMobilizedBodyIndex()
+            : GroundIndex;
+        const Rotation R_GA = ncb && crep.isAncestorDifferentFromGround()
+            ? crep.getAncestorMobilizedBody().getBodyRotation(s)
+            : Rotation();
+
+        // Process each of this constraint's included equations in turn;
+        // level 0,1,2 is holonomic, nonholonomic, acceleration-only.
+        for (int level=0; level < 3; ++level) {
+            const Segment& seg = level==0 ? cInfo.holoErrSegment
+                               : level==1 ? cInfo.nonholoErrSegment
+                               :            cInfo.accOnlyErrSegment;
+            const bool include = level==0 ? includeP
+                               : level==1 ? includeV : includeA;
+            const int firstRow = level==0 ? seg.offset
+                               : level==1 ? mHolo + seg.offset
+                               :            mHolo + mNonholo + seg.offset;
+            if (!include || seg.length == 0)
+                continue;
+
+            lambda.resize(seg.length); lambda.fill(Real(0));
+            for (int i=0; i < seg.length; ++i) {
+                oneF_G.resize(ncb); oneF_G.fill(SpatialVec(Vec3(0)));
+                onefu.resize(ncu);  onefu.fill(Real(0));
+
+                lambda[i] = 1;
+                if (level == 0) {
+                    onefq.resize(ncq); onefq.fill(Real(0));
+                    crep.addInPositionConstraintForces(s, lambda, oneF_G, onefq);
+                    crep.convertQForcesToUForces(s, onefq, onefu);
+                } else if (level == 1)
+                    crep.addInVelocityConstraintForces(s, lambda, oneF_G, onefu);
+                else
+                    crep.addInAccelerationConstraintForces(s, lambda, oneF_G,
+                                                           onefu);
+                lambda[i] = 0;
+
+                // Map each body force (in A) to the mobilities between its
+                // body and the Ancestor. Body forces are applied at the body
+                // origin; Phi shifts them to the parent's origin.
+                for (ConstrainedBodyIndex cbx(0); cbx < ncb; ++cbx) {
+                    SpatialVec F_G = crep.isAncestorDifferentFromGround()
+                                     ? R_GA*oneF_G[cbx] : oneF_G[cbx];
+                    for (const RigidBodyNode* node = &getRigidBodyNode
+                            (crep.getMobilizedBodyIndexOfConstrainedBody(cbx));
+                         node->getNodeNum() != ancestor;
+                         node = node->getParent())
+                    {
+                        for (int j=0; j < node->getDOF(); ++j)
+                            fu[node->getUIndex()+j] +=
+                                ~node->getHCol(tpc,j) * F_G;
+                        F_G = node->getPhi(tpc) * F_G;
+                    }
+                }
+                for (ConstrainedUIndex cux(0); cux < ncu; ++cux)
+                    fu[cInfo.getUIndexFromConstrainedU(cux)] += onefu[cux];
+
+                // Gather and clear the participating entries.
+                const int start = rowStart[firstRow + i];
+                for (ParticipatingUIndex pux(0); pux < npu; ++pux) {
+                    const UIndex ux = cInfo.getUIndexFromParticipatingU(pux);
+                    colIndex[start+pux] = ux;
+                    values[start+pux]   = fu[ux];
+                    fu[ux] = 0;
+                }
+            }
+        }
+    }
+}
+
+
+
+//==============================================================================
+//                          CALC PVA TRANSPOSE SPARSE
+//==============================================================================
+// Form the CSR representation of [P;V;A] and then transpose it by counting
+// the number of elements in each column. Because rows are visited in order,
+// row indices within each column come out sorted. The transpose is O(nnz).
+void SimbodyMatterSubsystemRep::
+calcPVATransposeSparse( const State&     s,
+                        bool             includeP,
+                        bool             includeV,
+                        bool             includeA,
+                        Array_<int>&     colStart,
+                        Array_<int>&     rowIndex,
+                        Array_<Real>&    values) const
+{
+    Array_<int> rowStart, colIndex;
+    Array_<Real> rowValues;
+    calcPVASparse(s, includeP, includeV, includeA,
+                  rowStart, colIndex, rowValues);
+
+    const int m   = (int)rowStart.size() - 1;
+    const int nu  = getNU(s);
+    const int nnz = (int)colIndex.size();
+
+    colStart.resize(nu+1);
+    colStart.fill(0);
+    for (int k=0; k < nnz; ++k)
+        ++colStart[colIndex[k]+1];
+    for (int j=0; j < nu; ++j)
+        colStart[j+1] += colStart[j];
+
+    rowIndex.resize(nnz);
+    values.resize(nnz);
+    Array_<int> next(colStart.begin(), colStart.end()-1); // next slot per col
+    for (int i=0; i < m; ++i)
+        for (int k=rowStart[i]; k < rowStart[i+1]; ++k) {
+            const int dest = next[colIndex[k]]++;
+            rowIndex[dest] = i;
+            values[dest]   = rowValues[k];
+        }
+}
+
+
+
 //==============================================================================
 //                          MULTIPLY BY Pq TRANSPOSE
 //==============================================================================
@@ -2389,33 +3665,33 @@ calcPqTranspose(const State& s, Matrix& Pqt) const {
 
 
 //==============================================================================
-//                         CALC WEIGHTED Pq_r TRANSPOSE
+//                              CALC WEIGHTED Pq_r
 //==============================================================================
 // The full Pq matrix is mp X nq. We want the mp X nfq submatrix that retains 
 // only the columns that correspond to free (not prescribed) q's; call that 
 // Pq_r. Also, we want the rows scaled by 1/constraint tolerances and retained 
-// columns scaled by 1/q weights; call that Pqw_r. And we're actually going to 
-// compute the nfq X mp transpose ~Pqw_r, which we'll call Pqw_rt.
+// columns scaled by 1/q weights; call that Pqw_r.
 //
 //   Pq = P N^+
 //   Pqw = Tp Pq     Wq^+ 
 //       = Tp Pq (N Wu^-1 N^+)
 //       = (Tp P Wu^-1) N^+          (because N^+ N = I)
 //       =     Pw       N^+
-//   Pqwt = ~Pqw = ~N^+ Wu^-1 ~P Tp  (weights are symmetric)
-//       (= ~N^+ ~Pw)
-//
-//   Pqw_rt = Pqwt submatrix with rows removed if they correspond to q_p.
+//   ~Pqw = ~N^+ Wu^-1 ~P Tp         (weights are symmetric)
 //
-// We calculate one column at a time to avoid any matrix ops. We can do the
-// column scaling of ~P by Tp for free, but the row scaling requires nq*mp flops.
-// Return matrix Pqw_rt must have contiguous-data columns.
+// We calculate one row of Pqw_r at a time as a column of ~Pqw to avoid any 
+// matrix ops. We can do the column scaling of ~P by Tp for free, but the row
+// scaling requires nq*mp flops. The rows are copied into Pqw_r element by
+// element; that is cheap compared to the operators and avoids making 
+// transposed or column views, which would allocate. Temporaries are kept in
+// the workspace.
 void SimbodyMatterSubsystemRep::
-calcWeightedPqrTranspose( 
-        const State&     s,
-        const Vector&    Tp,   // 1/perr tols (mp)
-        const Vector&    ooWu, // 1/u weights (nu)
-        Matrix&          Pqw_rt) const // nfq X mp
+calcWeightedPqr( 
+        const State&        s,
+        const Vector&       Tp,   // 1/perr tols (mp)
+        const Vector&       ooWu, // 1/u weights (nu)
+        Matrix&             Pqw_r, // mp X nfq
+        SBWorkspaceCache&   ws) const
 {
     const SBInstanceCache& ic = getInstanceCache(s);
 
@@ -2426,61 +3702,64 @@ calcWeightedPqrTranspose(
     const int nfq = ic.getTotalNumFreeQ();
     assert(nfq <= nq);
     const bool mustPack = (nfq != nq);
+    const Array_<QIndex>& freeQX = getFreeQIndex(s);
 
     assert(Tp.size() == mp);
     assert(ooWu.size() == nu);
 
-    Pqw_rt.resize(nfq, mp);
+    Pqw_r.resize(mp, nfq);
     if (mp==0 || nfq==0)
         return;
 
-    assert(Pqw_rt(0).hasContiguousData());
-
-    Vector Ptcol(nu), PNInvtcol;
-    Vector lambdap(mp, Real(0));
+    Vector& Ptcol = ws.projCol;         // nu
+    Vector& PNInvtcol = ws.projQCol;    // nq
+    Vector& lambdap = ws.projLambda;
+    lambdap.resize(mp); lambdap.setToZero();
 
     for (int j=0; j < mp; ++j) {
         lambdap[j] = Tp[j]; // this gives column j of ~P scaled by Tp[j]
-        multiplyByPVATranspose(s, true, false, false, lambdap, Ptcol);
+        multiplyByPVATranspose(s, true, false, false, lambdap, Ptcol,
+                               ws.pvaTranspose);
         lambdap[j] = 0;
         Ptcol.rowScaleInPlace(ooWu); // now (Wu^-1 ~P Tp)_i
         // Calculate (~Pqw)(j) = ~(N^+) * (~Pw)(j)
+        multiplyByNInv(s, true/*transpose*/,Ptcol,PNInvtcol);
         if (mustPack) {
-            multiplyByNInv(s, true/*transpose*/,Ptcol,PNInvtcol);
-            packFreeQ(s, PNInvtcol, Pqw_rt(j));
-        } else
-            multiplyByNInv(s, true/*transpose*/,Ptcol,Pqw_rt(j));
+            for (int k=0; k < nfq; ++k)
+                Pqw_r(j,k) = PNInvtcol[freeQX[k]];
+        } else {
+            for (int k=0; k < nq; ++k)
+                Pqw_r(j,k) = PNInvtcol[k];
+        }
     }
 }
 
 
 
 //==============================================================================
-//                        CALC WEIGHTED PV_r TRANSPOSE
+//                              CALC WEIGHTED PV_r
 //==============================================================================
 // The full P;V matrix is mpv X nu, where mpv=(mp+mv). Here we want the 
 // mpv X nfu submatrix 
 // that retains only the columns that correspond to free (not prescribed) u's;
 // call that PV_r. Also, we want the rows scaled by 1/constraint tolerances and 
-// retained columns scaled by 1/u weights; call that PVw_r. And we're actually 
-// going to compute the nfu X mpv transpose ~PVw_r, which we'll call PVw_rt.
+// retained columns scaled by 1/u weights; call that PVw_r.
 //
 //   PV   = [P]
 //          [V]
 //   PVw  = Tpv PV Wu^-1 
-//   PVwt = ~PVw = Wu^-1 ~PV Tpv  (weights are symmetric)
-//
-//   PVw_rt = PVwt submatrix with rows removed if they correspond to u_p.
+//   ~PVw = Wu^-1 ~PV Tpv  (weights are symmetric)
 //
-// We calculate one column at a time to avoid any matrix ops. We can do the
-// column scaling of ~PV by Tpv for free, but the row scaling requires nu*mpv 
-// flops. Return matrix PVw_rt must have contiguous-data columns.
+// As for calcWeightedPqr() we calculate one row at a time as a column of
+// ~PVw and copy it into PVw_r element by element. We can do the column 
+// scaling of ~PV by Tpv for free, but the row scaling requires nu*mpv flops.
 void SimbodyMatterSubsystemRep::
-calcWeightedPVrTranspose(
-    const State&     s,
-    const Vector&    Tpv,    // 1/verr tols (mp+mv)
-    const Vector&    ooWu, // 1/u weights (nu)
-    Matrix&          PVw_rt) const
+calcWeightedPVr(
+    const State&        s,
+    const Vector&       Tpv,    // 1/verr tols (mp+mv)
+    const Vector&       ooWu, // 1/u weights (nu)
+    Matrix&             PVw_r,  // mpv X nfu
+    SBWorkspaceCache&   ws) const
 {
     const SBInstanceCache& ic = getInstanceCache(s);
 
@@ -2493,33 +3772,32 @@ calcWeightedPVrTranspose(
     const int nfu = ic.getTotalNumFreeU();
     assert(nfu <= nu);
     const bool mustPack = (nfu != nu);
+    const Array_<UIndex>& freeUX = getFreeUIndex(s);
 
     assert(Tpv.size() == mpv);
     assert(ooWu.size() == nu);
 
-    PVw_rt.resize(nfu,mpv);
+    PVw_r.resize(mpv,nfu);
     if (mpv==0 || nfu==0)
         return;
 
-    assert(PVw_rt.hasContiguousData());
-
-    Vector lambdapv(mpv, Real(0));
-    if (mustPack) {
-        Vector PVtcol(nu);
-        for (int j=0; j < mpv; ++j) {
-            lambdapv[j] = Tpv[j]; // this gives column j of ~PV scaled by Tpv[i]
-            multiplyByPVATranspose(s, true, true, false, lambdapv, PVtcol);
-            lambdapv[j] = 0;
-            PVtcol.rowScaleInPlace(ooWu); // now (Wu^-1 ~PV Tpv)_j
-            packFreeU(s, PVtcol, PVw_rt(j));
-        }
-    } else { // No prescribed motion so we can work in place.
-        for (int j=0; j < mpv; ++j) {
-            VectorView PVw_rt_j = PVw_rt(j);
-            lambdapv[j] = Tpv[j]; // this gives column j of ~PV scaled by Tpv[i]
-            multiplyByPVATranspose(s, true, true, false, lambdapv, PVw_rt_j);
-            lambdapv[j] = 0;
-            PVw_rt_j.rowScaleInPlace(ooWu); // now (Wu^-1 ~PV Tpv)_j
+    Vector& PVtcol = ws.projCol; // nu
+    Vector& lambdapv = ws.projLambda;
+    lambdapv.resize(mpv); lambdapv.setToZero();
+
+    for (int j=0; j < mpv; ++j) {
+        lambdapv[j] = Tpv[j]; // this gives column j of ~PV scaled by Tpv[i]
+        multiplyByPVATranspose(s, true, true, false, lambdapv, PVtcol,
+                               ws.pvaTranspose);
+        lambdapv[j] = 0;
+        if (mustPack) {
+            for (int k=0; k < nfu; ++k) {
+                const UIndex ux = freeUX[k];
+                PVw_r(j,k) = ooWu[ux]*PVtcol[ux]; // (Wu^-1 ~PV Tpv)_j
+            }
+        } else {
+            for (int k=0; k < nu; ++k)
+                PVw_r(j,k) = ooWu[k]*PVtcol[k];
         }
     }
 }
@@ -2556,11 +3834,12 @@ calcWeightedPVrTranspose(
 // The output vector must use contiguous storage.
 // Complexity is O(m).
 void SimbodyMatterSubsystemRep::
-calcBiasForMultiplyByPVA(const State& s,
-                         bool         includeP,
-                         bool         includeV,
-                         bool         includeA,
-                         Vector&      bias) const
+calcBiasForMultiplyByPVA(const State&        s,
+                         bool                includeP,
+                         bool                includeV,
+                         bool                includeA,
+                         Vector&             bias,
+                         SBPVABiasWorkspace& ws) const
 {
     const SBInstanceCache& ic = getInstanceCache(s);
 
@@ -2596,19 +3875,19 @@ calcBiasForMultiplyByPVA(const State& s,
 
     // This array will be resized and filled with the Ancestor-relative
     // coriolis accelerations for the constrained bodies of each velocity
-    // or acceleration-only Constraint in turn; we're declaring it outside the 
-    // loop to minimize heap allocation (resizing down doesn't normally free 
+    // or acceleration-only Constraint in turn; it is kept in the workspace
+    // to minimize heap allocation (resizing down doesn't normally free 
     // heap space). This won't be used if we have only holonomic constraints.
-    Array_<SpatialVec,ConstrainedBodyIndex> AC_AB;
+    Array_<SpatialVec,ConstrainedBodyIndex>& AC_AB = ws.AC_AB;
 
     // Subarrays of these all-zero arrays will be used to supply zero body
     // velocities and qdots (holonomic) or zero udots (nonholonomic and
-    // acceleration-only) for each Constraint in turn; we're declaring 
-    // them outside the loop to minimize heap allocation. They'll grow until 
-    // they hit the maximum size needed by any Constraint.
-    Array_<SpatialVec,ConstrainedBodyIndex> zeroV_AB;
-    Array_<Real,      ConstrainedQIndex>    zeroQDot;
-    Array_<Real,      ConstrainedUIndex>    zeroUDot;
+    // acceleration-only) for each Constraint in turn; they are kept in the
+    // workspace to minimize heap allocation. They'll grow until they hit the
+    // maximum size needed by any Constraint, and are never written to.
+    Array_<SpatialVec,ConstrainedBodyIndex>& zeroV_AB = ws.zeroV_AB;
+    Array_<Real,      ConstrainedQIndex>&    zeroQDot = ws.zeroQDot;
+    Array_<Real,      ConstrainedUIndex>&    zeroUDot = ws.zeroUDot;
 
     // Loop over all enabled constraints, ask them to generate constraint
     // errors, and collect those in the output bias vector.
@@ -2858,10 +4137,11 @@ calcBiasForAccelerationConstraints(const State& s,
 // All vectors must be using contiguous storage.
 // Complexity is O(mp + n).
 void SimbodyMatterSubsystemRep::
-multiplyByPq(const State&   s,
-             const Vector&  bias_p,
-             const Vector&  qlike,
-             Vector&        PqXqlike) const
+multiplyByPq(const State&    s,
+             const Vector&   bias_p,
+             const Vector&   qlike,
+             Vector&         PqXqlike,
+             SBPVAWorkspace& ws) const
 {
     const SBInstanceCache& ic = getInstanceCache(s);
 
@@ -2888,8 +4168,9 @@ multiplyByPq(const State&   s,
 
     // Generate a u-like Vector via ulike = N^-1 * qlike. Then use that to
     // calculate spatial velocities V_GB = J * ulike.
-    Vector ulike(nu);
-    Vector_<SpatialVec> V_GB(nb);
+    Vector&              ulike = ws.qOrU;
+    Vector_<SpatialVec>& V_GB  = ws.Jv;
+    ulike.resize(nu);
     multiplyByNInv(s, false, qlike, ulike);   // cheap
     multiplyBySystemJacobian(s, ulike, V_GB); // 12*(nu+nb) flops
 
@@ -2903,11 +4184,11 @@ multiplyByPq(const State&   s,
 
     // This array will be resized and filled with the Ancestor-relative
     // velocities for the constrained bodies of each Constraint in turn; 
-    // we're declaring it outside the loop to minimize heap allocation 
+    // it is kept in the workspace to minimize heap allocation 
     // (resizing down doesn't normally free heap space).
-    Array_<SpatialVec,ConstrainedBodyIndex> V_AB;
+    Array_<SpatialVec,ConstrainedBodyIndex>& V_AB = ws.V_AB;
     // Same, but for each constraint's qdot subset.
-    Array_<Real,ConstrainedQIndex> qdot;
+    Array_<Real,ConstrainedQIndex>& qdot = ws.qdot;
 
     // Loop over all enabled constraints, ask them to generate constraint
     // errors, and collect those in the output vector, subtracting off the bias
@@ -3024,7 +4305,8 @@ multiplyByPVA(  const State&     s,
                 bool             includeA,
                 const Vector&    bias,
                 const Vector&    ulike,
-                Vector&          PVAu) const
+                Vector&          PVAu,
+                SBPVAWorkspace&  ws) const
 {
     const SBInstanceCache& ic = getInstanceCache(s);
 
@@ -3059,7 +4341,7 @@ multiplyByPVA(  const State&     s,
     // body spatial accelerations A=J*udot + Jdot*u, depending on how we're
     // interpreting the ulike argument (as a u for holonomic constraints,
     // and as udot for everything else).
-    Vector_<SpatialVec> Julike(nb);
+    Vector_<SpatialVec>& Julike = ws.Jv;
     multiplyBySystemJacobian(s, ulike, Julike); // 12*(nu+nb) flops
 
     // Julike serves as V_GB when we're interpreting ulike as u.
@@ -3068,7 +4350,7 @@ multiplyByPVA(  const State&     s,
 
     // If we're doing any nonholonomic or acceleration-only constraints, we'll 
     // finish calculating body spatial accelerations and put them here.
-    Array_<SpatialVec,MobilizedBodyIndex> allA_GB;
+    Array_<SpatialVec,MobilizedBodyIndex>& allA_GB = ws.allA_GB;
     if (mNonholo || mAccOnly) {
         allA_GB.resize(nb);
         const Array_<SpatialVec>& 
@@ -3080,7 +4362,8 @@ multiplyByPVA(  const State&     s,
     // If we're going to be dealing with holonomic (position) constraints,
     // generate a q-like Vector via qlike = N * ulike since the position
     // error derivative routine wants qdots.
-    Vector qlike(nq);
+    Vector& qlike = ws.qOrU;
+    qlike.resize(nq);
     if (mHolo)
         multiplyByN(s, false, ulike, qlike);   // cheap
 
@@ -3093,20 +4376,20 @@ multiplyByPVA(  const State&     s,
 
     // This array will be resized and filled with the Ancestor-relative
     // velocities for the constrained bodies of each holonomic Constraint in 
-    // turn; we're declaring it outside the loop to minimize heap allocation 
+    // turn; it is kept in the workspace to minimize heap allocation 
     // (resizing down doesn't normally free heap space). This won't be used 
     // if we aren't processing holonomic constraints.
-    Array_<SpatialVec,ConstrainedBodyIndex> V_AB;
+    Array_<SpatialVec,ConstrainedBodyIndex>& V_AB = ws.V_AB;
     // Same, but for each holonomic constraint's qdot subset.
-    Array_<Real,ConstrainedQIndex> qdot;
+    Array_<Real,ConstrainedQIndex>& qdot = ws.qdot;
 
     // This array will be resized and filled with the Ancestor-relative
     // accelerations for the constrained bodies of each velocity
     // or acceleration-only Constraint in turn. This won't be used if we have 
     // only holonomic constraints.
-    Array_<SpatialVec,ConstrainedBodyIndex> A_AB;
+    Array_<SpatialVec,ConstrainedBodyIndex>& A_AB = ws.A_AB;
     // Same, but for each nonholonomic/acconly constraint's udot subset.
-    Array_<Real,ConstrainedUIndex> udot;
+    Array_<Real,ConstrainedUIndex>& udot = ws.udot;
 
     // Loop over all enabled constraints, ask them to generate constraint
     // errors, and collect those in the output argument PVAu. Remove bias
@@ -3269,12 +4552,11 @@ calcPVA(const State&     s,
 // removing the Gp columns of G in the final operation. Note: the resulting
 // matrix is *not* a submatrix of G*M^-1*~G!
 //
-// Note that we do not require contiguous storage for GMInvGt's columns, 
-// although we'll take advantage of it if they are. If not, we'll work in
-// a contiguous temp and then copy back. This is because we want to allow
-// any matrix at the Simbody API level and we don't want to force the API
-// method to have to allocate a whole new mXm matrix when all we need for
-// a temporary here is an m-length temporary.
+// We do not require contiguous storage for GMInvGt's columns. Column views
+// of a Matrix require heap allocation, so we work with contiguous single 
+// columns from the workspace and copy elements in and out of the matrices 
+// instead. That costs O(m*n) flops, no more than the operators do, and lets
+// us form and factor GMInvGt while realizing without touching the heap.
 //
 // Complexity is O(m^2 + m*n) = O(m*n).
 //
@@ -3284,73 +4566,418 @@ calcPVA(const State&     s,
 // result in the force transmission matrix != G (this occurs for example for
 // some kinds of "working" constraints like sliding friction).
 void SimbodyMatterSubsystemRep::
-calcGMInvGt(const State&   s,
-            Matrix&        GMInvGt) const
+calcGMInvGt(const State&        s,
+            Matrix&             GMInvGt,
+            SBGMInvGtWorkspace& ws) const
+{
+    const SBInstanceCache& ic = getInstanceCache(s);
+
+    // Global problem dimensions.
+    const int mHolo    = ic.totalNHolonomicConstraintEquationsInUse;
+    const int mNonholo = ic.totalNNonholonomicConstraintEquationsInUse;
+    const int mAccOnly = ic.totalNAccelerationOnlyConstraintEquationsInUse;
+    const int m        = mHolo+mNonholo+mAccOnly;  
+    const int nu       = getNU(s);
+
+    GMInvGt.resize(m,m);
+    if (m==0) return;
+
+    // Gt holds all the columns of ~G, which are then replaced in place by
+    // the columns of M^-1 * ~G in a single pair of sweeps.
+    Matrix& Gt         = ws.Gt;
+    Vector& Gtcol      = ws.Gtcol;      // nu
+    Vector& GMInvGtcol = ws.GMInvGtcol; // m
+    Gt.resize(nu, m);
+
+    // Precalculate bias so we can perform multiplication by G efficiently.
+    Vector& bias = ws.bias;
+    calcBiasForMultiplyByPVA(s,true,true,true,bias,ws.pvaBias);
+   
+    // Lambda is used to pluck out one column at a time of Gt. Exactly one
+    // element at a time of lambda will be 1, the rest are 0.
+    Vector& lambda = ws.lambda;
+    lambda.resize(m); lambda.setToZero();
+
+    for (int j=0; j < m; ++j) {
+        lambda[j] = 1;
+        multiplyByPVATranspose(s, true, true, true, lambda, Gtcol, 
+                               ws.pvaTranspose);
+        lambda[j] = 0;
+        for (int i=0; i < nu; ++i)
+            Gt(i,j) = Gtcol[i];
+    }
+
+    Matrix& MInvGt = Gt;
+    multiplyByMInvWithBodyAccelerations(s, Gt, MInvGt, ws.A_GB);
+
+    for (int j=0; j < m; ++j) {
+        for (int i=0; i < nu; ++i)
+            Gtcol[i] = MInvGt(i,j);
+        multiplyByPVA(s, true, true, true, bias, Gtcol, GMInvGtcol, ws.pva);
+        for (int i=0; i < m; ++i)
+            GMInvGt(i,j) = GMInvGtcol[i];
+    }
+} 
+
+
+
+// =============================================================================
+//                            CALC G MInv G^T BLOCKS
+// =============================================================================
+// Like calcGMInvGt() above, but working one block of constraint equations at
+// a time and keeping only the rows of each column that belong to the block.
+// Each column still costs O(n) so this is O(m*n) overall, but the only
+// temporaries are n X mb and an m-vector.
+void SimbodyMatterSubsystemRep::
+calcGMInvGtBlocks(const State&                  s,
+                  const Array_< Array_<int> >&  rows,
+                  Array_<Matrix>&               blocks) const
+{
+    const SBInstanceCache& ic = getInstanceCache(s);
+    const int m = ic.totalNHolonomicConstraintEquationsInUse
+                + ic.totalNNonholonomicConstraintEquationsInUse
+                + ic.totalNAccelerationOnlyConstraintEquationsInUse;
+    const int nu = getNU(s);
+
+    blocks.resize(rows.size());
+    if (m==0) return;
+
+    Vector bias(m);
+    calcBiasForMultiplyByPVA(s,true,true,true,bias);
+    Vector lambda(m, Real(0)), GMInvGt_j(m);
+    Matrix MInvGt;
+
+    for (unsigned k=0; k < rows.size(); ++k) {
+        const Array_<int>& r = rows[k];
+        const int mb = (int)r.size();
+        Matrix& block = blocks[k];
+        block.resize(mb, mb);
+        if (mb == 0) continue;
+
+        MInvGt.resize(nu, mb);
+        for (int j=0; j < mb; ++j) {
+            lambda[r[j]] = 1;
+            VectorView Gtcol = MInvGt(j); // contiguous
+            multiplyByPVATranspose(s, true, true, true, lambda, Gtcol);
+            lambda[r[j]] = 0;
+        }
+        multiplyByMInv(s, MInvGt, MInvGt);
+
+        for (int j=0; j < mb; ++j) {
+            multiplyByPVA(s, true, true, true, bias, MInvGt(j), GMInvGt_j);
+            for (int i=0; i < mb; ++i)
+                block(i,j) = GMInvGt_j[r[i]];
+        }
+    }
+}
+
+
+
+// =============================================================================
+//                    REALIZE G MInv G^T FACTORIZATION
+// =============================================================================
+// Calculate GMInvGt in O(m*n) time and factor it in O(m^3) time, unless that
+// has already been done for the current state.
+const ConstraintFactorization& SimbodyMatterSubsystemRep::
+realizeGMInvGtFactorization(const State& s) const {
+    const CacheEntryIndex fx = getGMInvGtFactorizationCacheIndex(s);
+    SBGMInvGtFactorizationCache& fc = updGMInvGtFactorizationCache(s);
+    if (isCacheValueRealized(s, fx))
+        return fc.factorization;
+
+    const int m = getNumHolonomicConstraintEquationsInUse(s)
+                + getNumNonholonomicConstraintEquationsInUse(s)
+                + getNumAccelerationOnlyConstraintEquationsInUse(s);
+    assert(m > 0);
+
+    // Conditioning tolerance. This determines when we'll drop a
+    // constraint.
+    // TODO: this is probably too tight; should depend on constraint tolerance
+    // and should be consistent with position and velocity projection ranks.
+    // Tricky here because conditioning depends on mass matrix as well as
+    // constraints.
+    const Real conditioningTol = m
+        //* SignificantReal;
+        * SqrtEps*std::sqrt(SqrtEps); // Eps^(3/4)
+
+    // specify 1/cond at which we declare rank deficiency
+    if (useBlockConstraintSolver) {
+        // Everything outside the diagonal blocks is zero, so we never form
+        // the full matrix.
+        const SBConstraintBlockCache& bc = realizeConstraintBlocks(s);
+        Array_<Matrix> blocks;
+        calcGMInvGtBlocks(s, bc.rows, blocks);
+        fc.factorization.factorBlocks(m, m, blocks, bc.rows, bc.rows, true,
+                                      conditioningTol);
+    } else {
+        SBWorkspaceCache& ws = updWorkspaceCache(s);
+        calcGMInvGt(s, ws.GMInvGt, ws.gMInvGt);
+        fc.factorization.factor(ws.GMInvGt, conditioningTol);
+    }
+    fc.m = m;
+    ++numMultiplierFactorizations;
+
+    //printf("fwdDynamics: m=%d condTol=%g rank=%d\n",
+    //    GMInvGt.nrow(), conditioningTol, fc.factorization.getRank());
+
+    markCacheValueRealized(s, fx);
+    return fc.factorization;
+}
+
+
+
+int SimbodyMatterSubsystemRep::
+getNumRankDeficientConstraintBlocks(const State& s) const {
+    if (!useBlockConstraintSolver
+        || getNumHolonomicConstraintEquationsInUse(s)
+         + getNumNonholonomicConstraintEquationsInUse(s)
+         + getNumAccelerationOnlyConstraintEquationsInUse(s) == 0)
+        return 0;
+    return realizeGMInvGtFactorization(s).getNumRankDeficientBlocks();
+}
+
+
+
+// =============================================================================
+//                         REALIZE CONSTRAINT BLOCKS
+// =============================================================================
+// Find the branch (child of Ground) containing each mobility, then merge
+// branches that are connected by a constraint using a union-find forest over
+// the branch base bodies. Each resulting set with any constraints in it is a
+// block. A constraint that has no participating mobilities at all gets a
+// block of its own.
+const SBConstraintBlockCache& SimbodyMatterSubsystemRep::
+realizeConstraintBlocks(const State& s) const {
+    const CacheEntryIndex bx = topologyCache.constraintBlockCacheIndex;
+    SBConstraintBlockCache& bc = Value<SBConstraintBlockCache>::updDowncast
+                                                        (updCacheEntry(s,bx));
+    if (isCacheValueRealized(s, bx))
+        return bc;
+
+    const SBInstanceCache& ic = getInstanceCache(s);
+    const int nb = getNumBodies();
+    const int mHolo    = ic.totalNHolonomicConstraintEquationsInUse;
+    const int mNonholo = ic.totalNNonholonomicConstraintEquationsInUse;
+
+    // base[b] is the child of Ground at the root of body b's branch; later it
+    // is the union-find parent link.
+    Array_<int> base(nb, 0), link(nb);
+    for (MobilizedBodyIndex mbx(1); mbx < nb; ++mbx) {
+        const int parent = getRigidBodyNode(mbx).getParent()->getNodeNum();
+        base[mbx] = parent == 0 ? (int)mbx : base[parent];
+    }
+    for (int b=0; b < nb; ++b) link[b] = b;
+
+    Array_<int> uBase(getNU(s)), qBase(getNQ(s));
+    for (MobilizedBodyIndex mbx(1); mbx < nb; ++mbx) {
+        const MobilizedBody& mobod = getMobilizedBody(mbx);
+        const int nu = mobod.getNumU(s), nq = mobod.getNumQ(s);
+        for (int i=0; i < nu; ++i) uBase[mobod.getFirstUIndex(s)+i] = base[mbx];
+        for (int i=0; i < nq; ++i) qBase[mobod.getFirstQIndex(s)+i] = base[mbx];
+    }
+
+    struct Find { // with path halving
+        static int root(Array_<int>& link, int b) {
+            while (link[b] != b) b = link[b] = link[link[b]];
+            return b;
+        }
+    };
+
+    // Merge the branches of each constraint's participating mobilities.
+    for (ConstraintIndex cx(0); cx < constraints.size(); ++cx) {
+        if (isConstraintDisabled(s,cx))
+            continue;
+        const SBInstancePerConstraintInfo& cInfo = 
+            ic.getConstraintInstanceInfo(cx);
+        const int npu = cInfo.getNumParticipatingU();
+        if (npu == 0) continue;
+        const int first = Find::root(link, 
+            uBase[cInfo.getUIndexFromParticipatingU(ParticipatingUIndex(0))]);
+        for (ParticipatingUIndex pux(1); pux < npu; ++pux)
+            link[Find::root(link, 
+                 uBase[cInfo.getUIndexFromParticipatingU(pux)])] = first;
+    }
+
+    // Assign block numbers to roots as we encounter them in constraints.
+    Array_<int> blockOfRoot(nb, -1);
+    bc.rows.clear(); bc.freeQ.clear(); bc.freeU.clear();
+    for (ConstraintIndex cx(0); cx < constraints.size(); ++cx) {
+        if (isConstraintDisabled(s,cx))
+            continue;
+        const SBInstancePerConstraintInfo& cInfo = 
+            ic.getConstraintInstanceInfo(cx);
+        int block;
+        if (cInfo.getNumParticipatingU() == 0) {
+            block = (int)bc.rows.size();
+            bc.rows.push_back();
+        } else {
+            const int root = Find::root(link, 
+                uBase[cInfo.getUIndexFromParticipatingU(ParticipatingUIndex(0))]);
+            if (blockOfRoot[root] < 0) {
+                blockOfRoot[root] = (int)bc.rows.size();
+                bc.rows.push_back();
+            }
+            block = blockOfRoot[root];
+        }
+        Array_<int>& rows = bc.rows[block];
+        for (int i=0; i < cInfo.holoErrSegment.length; ++i)
+            rows.push_back(cInfo.holoErrSegment.offset + i);
+        for (int i=0; i < cInfo.nonholoErrSegment.length; ++i)
+            rows.push_back(mHolo + cInfo.nonholoErrSegment.offset + i);
+        for (int i=0; i < cInfo.accOnlyErrSegment.length; ++i)
+            rows.push_back(mHolo + mNonholo + cInfo.accOnlyErrSegment.offset + i);
+    }
+    for (unsigned k=0; k < bc.rows.size(); ++k)
+        std::sort(bc.rows[k].begin(), bc.rows[k].end());
+
+    // Distribute the free mobilities of constrained branches; they come out
+    // in order.
+    bc.freeQ.resize(bc.rows.size()); bc.freeU.resize(bc.rows.size());
+    const Array_<QIndex>& freeQ = getFreeQIndex(s);
+    for (int j=0; j < (int)freeQ.size(); ++j) {
+        const int block = blockOfRoot[Find::root(link, qBase[freeQ[j]])];
+        if (block >= 0) bc.freeQ[block].push_back(j);
+    }
+    const Array_<UIndex>& freeU = getFreeUIndex(s);
+    for (int j=0; j < (int)freeU.size(); ++j) {
+        const int block = blockOfRoot[Find::root(link, uBase[freeU[j]])];
+        if (block >= 0) bc.freeU[block].push_back(j);
+    }
+
+    markCacheValueRealized(s, bx);
+    return bc;
+}
+
+
+
+// =============================================================================
+//                         FACTOR CONSTRAINT MATRIX
+// =============================================================================
+void SimbodyMatterSubsystemRep::
+factorConstraintMatrix(const State&                s,
+                       const Matrix&               A,
+                       ConstraintMatrixColumns     columnKind,
+                       Real                        rcondTol,
+                       ConstraintFactorization&    factorization) const
 {
-    const SBInstanceCache& ic = getInstanceCache(s);
+    if (!useBlockConstraintSolver) {
+        factorization.factor(A, rcondTol);
+        return;
+    }
 
-    // Global problem dimensions.
-    const int mHolo    = ic.totalNHolonomicConstraintEquationsInUse;
-    const int mNonholo = ic.totalNNonholonomicConstraintEquationsInUse;
-    const int mAccOnly = ic.totalNAccelerationOnlyConstraintEquationsInUse;
-    const int m        = mHolo+mNonholo+mAccOnly;  
-    const int nu       = getNU(s);
+    // Rows of A are a leading subset of the rows of [P;V;A].
+    const SBConstraintBlockCache& bc = realizeConstraintBlocks(s);
+    const int m = A.nrow();
+    Array_< Array_<int> > rows(bc.rows.size());
+    for (unsigned k=0; k < bc.rows.size(); ++k)
+        for (unsigned i=0; i < bc.rows[k].size() && bc.rows[k][i] < m; ++i)
+            rows[k].push_back(bc.rows[k][i]);
+
+    switch (columnKind) {
+    case ColumnsAreFreeQ:
+        factorization.factorBlocks(A, rows, bc.freeQ, false, rcondTol);
+        break;
+    case ColumnsAreFreeU:
+        factorization.factorBlocks(A, rows, bc.freeU, false, rcondTol);
+        break;
+    }
+}
 
-    GMInvGt.resize(m,m);
-    if (m==0) return;
 
-    // If the output matrix doesn't have columns in contiguous memory, we'll
-    // allocate a contiguous-memory temp that we can use to hold one column
-    // at a time as we compute them.
-    const bool columnsAreContiguous = GMInvGt(0).hasContiguousData();
-    Vector GMInvGt_j(columnsAreContiguous ? 0 : m);
 
-    // These two temporaries are always needed to hold one column of Gt,
-    // then one column of M^-1 * Gt.
-    Vector Gtcol(nu), MInvGtcol(nu);
+// =============================================================================
+//                          SOLVE FOR MULTIPLIERS
+// =============================================================================
+// In modified Newton mode we use the most recent factorization of GMInvGt,
+// Wold, even if it was computed at a different q and u, and correct the
+// resulting multipliers by iterating
+//      r = aerr - W*lambda,  lambda += Wold^-1 r
+// until the residual r is negligible. W*lambda is formed in O(m+n) time using
+// operators so each iteration is much cheaper than forming and factoring W.
+// The iteration converges linearly, at a rate that depends on how far W has
+// drifted from Wold. If it doesn't converge in a few iterations, or converges
+// too slowly to be worth continuing, we factor W at the current state and
+// save that factorization for next time.
+void SimbodyMatterSubsystemRep::
+solveForMultipliers(const State&     s,
+                    const Vector&    udotErr,
+                    Vector&          multipliers) const
+{
+    const int m = udotErr.size();
+    assert(m > 0);
 
-    // Precalculate bias so we can perform multiplication by G efficiently.
-    Vector bias(m);
-    calcBiasForMultiplyByPVA(s,true,true,true,bias);
-   
-    // Lambda is used to pluck out one column at a time of Gt. Exactly one
-    // element at a time of lambda will be 1, the rest are 0.
-    Vector lambda(m, Real(0));
+    if (!useModifiedNewtonForMultipliers) {
+        realizeGMInvGtFactorization(s).solve(udotErr, multipliers);
+        return;
+    }
 
-    for (int j=0; j < m; ++j) {
-        lambda[j] = 1;
-        multiplyByPVATranspose(s, true, true, true, lambda, Gtcol);
-        lambda[j] = 0;
-        multiplyByMInv(s, Gtcol, MInvGtcol);
-        if (columnsAreContiguous)
-            multiplyByPVA(s, true, true, true, bias, MInvGtcol, GMInvGt(j));
-        else {
-            multiplyByPVA(s, true, true, true, bias, MInvGtcol, GMInvGt_j);
-            GMInvGt(j) = GMInvGt_j;
+    // Near the saved configuration one or two corrections are enough; we
+    // give up if an iteration doesn't reduce the residual by at least 4X.
+    const int  MaxIterations = 6;
+    const Real MinRate = 0.25;
+    const Real tol = m * SqrtEps*std::sqrt(SqrtEps) // Eps^(3/4)
+                       * std::max(Real(1), udotErr.normInf());
+
+    // The reusable factorization is valid only if it was saved since
+    // Instance stage was last realized, since the set of constraints in use
+    // may have changed. It need not match the current q and u; that's the
+    // point.
+    const CacheEntryIndex rx = 
+        topologyCache.reusableGMInvGtFactorizationCacheIndex;
+    SBGMInvGtFactorizationCache& reuse =
+        updReusableGMInvGtFactorizationCache(s);
+
+    if (isCacheValueRealized(s, rx) && reuse.m == m) {
+        Vector bias(m), fu, MInvfu, r(m), dlambda;
+        calcBiasForMultiplyByPVA(s, true, true, true, bias);
+        reuse.factorization.solve(udotErr, multipliers);
+        Real prevNorm = Infinity;
+        for (int iter=0; iter < MaxIterations; ++iter) {
+            multiplyByPVATranspose(s, true, true, true, multipliers, fu);
+            multiplyByMInv(s, fu, MInvfu);
+            multiplyByPVA(s, true, true, true, bias, MInvfu, r);
+            r = udotErr - r;
+            const Real rNorm = r.normInf();
+            if (rNorm <= tol) {
+                ++numMultiplierReuses;
+                return;
+            }
+            if (rNorm > MinRate*prevNorm)
+                break;
+            prevNorm = rNorm;
+            reuse.factorization.solve(r, dlambda);
+            multipliers += dlambda;
         }
     }
-} 
+
+    // Nothing to reuse or it didn't work; start over with a new factorization.
+    const ConstraintFactorization& fact = realizeGMInvGtFactorization(s);
+    fact.solve(udotErr, multipliers);
+    reuse.factorization = fact;
+    reuse.m = m;
+    markCacheValueRealized(s, rx);
+}
 
 
 
 // =============================================================================
 //                     SOLVE FOR CONSTRAINT IMPULSES
 // =============================================================================
-// Current implementation computes G*M^-1*~G, factors it, and does a single
-// solve all at great expense.
-// TODO: should realize factored matrix if needed and reuse if possible.
+// This uses the same factorization of G*M^-1*~G as forward dynamics,
+// calculating it first if necessary.
 void SimbodyMatterSubsystemRep::
 solveForConstraintImpulses(const State&     state,
                            const Vector&    deltaV,
                            Vector&          impulse) const
 {
-    Matrix GMInvGt;
-    calcGMInvGt(state, GMInvGt);
-    // MUST DUPLICATE SIMBODY'S METHOD HERE:
-    const Real conditioningTol = GMInvGt.nrow() 
-                                    * SqrtEps*std::sqrt(SqrtEps); // Eps^(3/4)
-    FactorQTZ qtz(GMInvGt, conditioningTol); 
-    qtz.solve(deltaV, impulse);
+    const int m = getNumHolonomicConstraintEquationsInUse(state)
+                + getNumNonholonomicConstraintEquationsInUse(state)
+                + getNumAccelerationOnlyConstraintEquationsInUse(state);
+    if (m == 0) {
+        impulse.resize(0);
+        return;
+    }
+    realizeGMInvGtFactorization(state).solve(deltaV, impulse);
 }
 
 
@@ -3421,11 +5048,12 @@ calcBodyAccelerationFromUDot(const State&           s,
 // to m=mp+mv+ma.  Complexity is O(m+n).
 void SimbodyMatterSubsystemRep::
 calcConstraintAccelerationErrors
-       (const State&                s,
-        const Vector_<SpatialVec>&  A_GB,
-        const Vector_<Real>&        udot,
-        const Vector_<Real>&        qdotdot,
-        Vector&                     pvaerr) const
+       (const State&                 s,
+        const Vector_<SpatialVec>&   A_GB,
+        const Vector_<Real>&         udot,
+        const Vector_<Real>&         qdotdot,
+        Vector&                      pvaerr,
+        SBConstraintErrorsWorkspace& ws) const
 {
     const SBInstanceCache&     ic  = getInstanceCache(s);
 
@@ -3463,11 +5091,11 @@ calcConstraintAccelerationErrors
     ArrayView_<Real>                    allAerr (&pvaerr[0],  &pvaerr[0]  + m );
 
     // These arrays will be resized and filled with the input needs of each 
-    // Constraint in turn. We're declaring them outside the loop to minimize 
-    // heap allocation (resizing down doesn't normally free heap space). 
-    Array_<SpatialVec,ConstrainedBodyIndex> A_AB;
-    Array_<Real,ConstrainedQIndex> qdd; // holonomic only
-    Array_<Real,ConstrainedUIndex> ud;  // nonholonomic or acc-only
+    // Constraint in turn. They are kept in the workspace to minimize heap 
+    // allocation (resizing down doesn't normally free heap space). 
+    Array_<SpatialVec,ConstrainedBodyIndex>& A_AB = ws.A_AB;
+    Array_<Real,ConstrainedQIndex>& qdd = ws.cq; // holonomic only
+    Array_<Real,ConstrainedUIndex>& ud  = ws.cu; // nonholonomic or acc-only
 
     // Loop over all enabled constraints, ask them to generate constraint
     // errors, and collect those in the output argument pvaerr.
@@ -3708,7 +5336,7 @@ void SimbodyMatterSubsystemRep::enforcePositionConstraints
 
     if (normAchievedTRMS > consAccuracyToTryFor) {
         Vector saveQ = getQ(s);
-        Matrix Pqwrt(nfq,mHolo);
+        Matrix Pqwr(mHolo,nfq);
         Vector dfq_WLS(nfq), du(nu), dq(nq); // = Wq^+ dq_WLS
         Vector udfq_WLS(hasPrescribedMotion ? nq : 0); // unpacked if needed
         udfq_WLS.setToZero(); // must initialize unwritten elements
@@ -3716,10 +5344,11 @@ void SimbodyMatterSubsystemRep::enforcePositionConstraints
         Real prevNormAchievedTRMS = normAchievedTRMS; // watch for divergence
         const int MaxIterations  = 20;
         do {
-            calcWeightedPqrTranspose(s, ooPTols, ooUWeights, Pqwrt);//nfq X mp
+            calcWeightedPqr(s, ooPTols, ooUWeights, Pqwr,   // mp X nfq
+                            updWorkspaceCache(s));
 
             // This factorization acts like a pseudoinverse.
-            Pqwr_qtz.factor<Real>(~Pqwrt, conditioningTol); 
+            Pqwr_qtz.factor<Real>(Pqwr, conditioningTol); 
 
             //printf("enforcePositionConstraints %d: condTol=%g rank=%d rcond=%g\n",
             //    nItsUsed, conditioningTol, Pqwr_qtz.getRank(),
@@ -3867,6 +5496,49 @@ void SimbodyMatterSubsystemRep::enforcePositionConstraints
 //   multiplying these matrices by columns, but not for producing Wq so we 
 //   just create it operationally as we go.
 
+// Used to check that weights haven't changed since a saved projection
+// factorization was calculated.
+static bool isSameVector(const Vector& a, const Vector& b) {
+    if (a.size() != b.size()) return false;
+    for (int i=0; i < a.size(); ++i)
+        if (a[i] != b[i]) return false;
+    return true;
+}
+
+// Return the RMS or infinity norm of v(start,n), with each element scaled
+// by the corresponding element of w if w is given, and the index within the
+// segment of the largest one (-1 if n==0). This is the same as a norm of a 
+// row-scaled view but doesn't allocate anything, so is cheap enough to check
+// constraint errors every step.
+static Real calcSegmentNorm(const Vector& v, int start, int n, 
+                            const Vector* w, bool useNormInf, int& worst) {
+    worst = n ? 0 : -1;
+    Real sumsq = 0, maxabs = 0;
+    for (int i=0; i < n; ++i) {
+        const Real x = std::abs(w ? (*w)[start+i]*v[start+i] : v[start+i]);
+        if (x > maxabs) maxabs = x, worst = i;
+        sumsq += x*x;
+    }
+    if (n == 0) return 0;
+    return useNormInf ? maxabs : std::sqrt(sumsq/n);
+}
+
+// Copy v(start,n) into out, or scale it elementwise by w(start,n) on the
+// way. These are the same as assigning a view or a row-scaled view but don't
+// allocate anything once out is big enough.
+static void copySegment(const Vector& v, int start, int n, Vector& out) {
+    out.resize(n);
+    for (int i=0; i < n; ++i)
+        out[i] = v[start+i];
+}
+
+static void scaleSegment(const Vector& v, int start, int n, const Vector& w,
+                         Vector& out) {
+    out.resize(n);
+    for (int i=0; i < n; ++i)
+        out[i] = w[start+i]*v[start+i];
+}
+
 int SimbodyMatterSubsystemRep::projectQ
    (State&                  s, 
     Vector&                 qErrest, // q error estimate or empty 
@@ -3889,21 +5561,19 @@ int SimbodyMatterSubsystemRep::projectQ
     const int mHolo  = getNumHolonomicConstraintEquationsInUse(s);
     const int mQuats = getNumQuaternionsInUse(s);
 
-    // This is a const view into the State; the contents it refers to will 
-    // change though.
-    const VectorView pErrs = getQErr(s)(0,mHolo); // just leave off quaternions
-    const VectorView quatErrs = getQErr(s)(mHolo,mQuats); // quaternions
-
-    // We don't weight the quaternion errors.
-    const VectorView perrWeights = getQErrWeights(s)(0,mHolo); // 1/unit error (Tp)
+    // The first mHolo qErrs are position errors, and the rest are for
+    // quaternions. We don't weight the quaternion errors.
+    const Vector& qErrs = getQErr(s);
+    const Vector& qErrWeights = getQErrWeights(s); // 1/unit error (Tp)
 
-    // Determine norms on entry.
+    // Determine norms on entry. This is done without making views of the
+    // errors so that we don't allocate anything in the common case that
+    // there is nothing to do.
     int worstPerr, worstQuatErr;
-    Vector scaledPerrs = pErrs.rowScale(perrWeights);
-    const Real perrNormOnEntry = useNormInf ? scaledPerrs.normInf(&worstPerr)
-                                            : scaledPerrs.normRMS(&worstPerr);
-    const Real quatNormOnEntry = useNormInf ? quatErrs.normInf(&worstQuatErr)
-                                            : quatErrs.normRMS(&worstQuatErr);
+    const Real perrNormOnEntry = calcSegmentNorm(qErrs, 0, mHolo, &qErrWeights,
+                                                 useNormInf, worstPerr);
+    const Real quatNormOnEntry = calcSegmentNorm(qErrs, mHolo, mQuats, 0,
+                                                 useNormInf, worstQuatErr);
     
     Real normOnEntry;
     if (perrNormOnEntry >= quatNormOnEntry) {
@@ -3934,8 +5604,8 @@ int SimbodyMatterSubsystemRep::projectQ
         if (quatNormOnEntry > consAccuracy || forceOneIter) {
             const bool anyQuatChange = normalizeQuaternions(s,qErrest);
             results.setAnyChangeMade(anyQuatChange);
-            const Real quatNorm = useNormInf ? quatErrs.normInf(&worstQuatErr)
-                                             : quatErrs.normRMS(&worstQuatErr);
+            const Real quatNorm = calcSegmentNorm(qErrs, mHolo, mQuats, 0,
+                                                  useNormInf, worstQuatErr);
             results.setNormOnExit(quatNorm);
             if (quatNorm > consAccuracy) {
                 results.setExitStatus(ProjectResults::FailedToAchieveAccuracy);
@@ -3960,6 +5630,18 @@ int SimbodyMatterSubsystemRep::projectQ
 
     // We're going to have to project constraints. Get the remaining options.
 
+    // These are const views into the State; the contents they refer to will 
+    // change though.
+    // Temporaries are kept in the State's workspace so that projecting 
+    // while integrating doesn't allocate. For the same reason we work with
+    // segments of the error Vector by index rather than through views. The
+    // perr weights are copied since a reusable factorization is checked 
+    // against them.
+    SBWorkspaceCache& ws = updWorkspaceCache(s);
+    Vector& perrWeights = ws.errWeights;
+    copySegment(qErrWeights, 0, mHolo, perrWeights);
+    Vector& scaledPerrs = ws.scaledErrs;
+    scaleSegment(qErrs, 0, mHolo, qErrWeights, scaledPerrs); // Tp * pErrs
 
     // This is the factor by which we try to achieve a tighter accuracy
     // than requested. E.g. if overshootFactor=0.1 then we attempt 10X 
@@ -3975,9 +5657,12 @@ int SimbodyMatterSubsystemRep::projectQ
     // initialization.
     const bool localOnly = opts.isOptionSet(ProjectOptions::LocalOnly);
     // We are permitted to use an out-of-date Jacobian for projection unless
-    // this is set. TODO: always using full Newton at the moment.
+    // this is set. We use full Newton anyway unless modified Newton has
+    // been enabled with setUseModifiedNewtonForProjection().
     const bool forceFullNewton =
         opts.isOptionSet(ProjectOptions::ForceFullNewton);
+    const bool reuseFactorization = 
+        useModifiedNewtonForProjection && !forceFullNewton;
 
     // Get problem dimensions.
     const SBInstanceCache& ic = getInstanceCache(s);
@@ -4003,11 +5688,14 @@ int SimbodyMatterSubsystemRep::projectQ
     // (diagonal weights are symmetric). We only retain rows that 
     // correspond to free (non prescribed) q's.
     //
-    // This is a nonlinear least squares problem. Below is a full Newton 
-    // iteration since we recalculate the iteration matrix each time around the
-    // loop. TODO: a solution could be found using the same iteration matrix, 
-    // since we are projecting from (presumably) not too far away. Q1: will it
-    // be the same solution? Q2: if not, does it matter?
+    // This is a nonlinear least squares problem. Normally below is a full
+    // Newton iteration since we recalculate the iteration matrix each time
+    // around the loop. In modified Newton mode we instead keep using the
+    // last factorization, possibly from an earlier projection, as long as
+    // each iteration reduces the error norm by at least a factor of
+    // projectionReuseTolerance. That finds a solution to the same accuracy
+    // but not necessarily the same one, since the correction is a least
+    // squares solution for a nearby iteration matrix.
 
     // These will be updated as we go.
     Real perrNormAchieved = perrNormOnEntry;
@@ -4016,7 +5704,10 @@ int SimbodyMatterSubsystemRep::projectQ
     // We always use absolute scaling for q's, derived from the absolute
     // scaling of u's.
     const Vector& uWeights = getUWeights(s);    // 1/unit change (Wu)
-    const Vector uAbsScale = uWeights.elementwiseInvert(); // Wu^-1
+    Vector& uAbsScale = ws.uScale; // Wu^-1
+    uAbsScale.resize(nu);
+    for (int i=0; i < nu; ++i)
+        uAbsScale[i] = 1/uWeights[i];
 
     Real lastChangeMadeWRMS = 0; // size of last change in weighted dq
     int nItsUsed = 0;
@@ -4033,27 +5724,53 @@ int SimbodyMatterSubsystemRep::projectQ
 
     // Keep the starting q in case we have to restore it, which we'll do
     // if the attempts here make the constraint norm worse.
-    const Vector saveQ = getQ(s);
-
-    Matrix Pqwrt(nfq,mHolo);
-    Vector dfq_WLS(nfq), du(nu), dq(nq); // = Wq^+ dq_WLS
-    Vector udfq_WLS(hasPrescribedMotion ? nq : 0); // unpacked if needed
+    Vector& saveQ = ws.saveQorU;
+    saveQ = getQ(s);
+
+    Matrix& Pqwr     = ws.Pqwr;
+    Vector& dfq_WLS  = ws.df_WLS;   dfq_WLS.resize(nfq);
+    Vector& du       = ws.du;       du.resize(nu);
+    Vector& dq       = ws.dq;       dq.resize(nq); // = Wq^+ dq_WLS
+    Vector& udfq_WLS = ws.udf_WLS;  // unpacked if needed
+    udfq_WLS.resize(hasPrescribedMotion ? nq : 0);
     udfq_WLS.setToZero(); // must initialize unwritten elements
-    FactorQTZ Pqwr_qtz;
+
+    // In modified Newton mode the factorization lives in the State cache so
+    // we can start with whatever was there if it is still applicable.
+    SBProjectionFactorizationCache* reuse = 
+        reuseFactorization ? &updReusableQProjectionCache(s) : 0;
+    ConstraintFactorization& Pqwr_fact = 
+        reuse ? reuse->factorization : ws.qProjectionFactorization;
+    bool haveFactorization = reuse && reuse->m == mHolo && reuse->nf == nfq
+        && isSameVector(reuse->rowWeights, perrWeights)
+        && isSameVector(reuse->colScale, uAbsScale);
+
     Real prevPerrNormAchieved = perrNormAchieved; // watch for divergence
     bool diverged = false;
     const int MaxIterations  = 20;
     do {
-        calcWeightedPqrTranspose(s, perrWeights, uAbsScale, Pqwrt);//nfq X mp
+        bool freshFactorization = false;
+        if (!haveFactorization) {
+            calcWeightedPqr(s, perrWeights, uAbsScale, Pqwr, ws); // mp X nfq
 
-        // This factorization acts like a pseudoinverse.
-        Pqwr_qtz.factor<Real>(~Pqwrt, conditioningTol); 
+            // This factorization acts like a pseudoinverse.
+            factorConstraintMatrix(s, Pqwr, ColumnsAreFreeQ, conditioningTol,
+                                   Pqwr_fact);
+            ++numProjectQFactorizations;
+            if (reuse) {
+                reuse->m = mHolo; reuse->nf = nfq;
+                reuse->rowWeights = perrWeights; reuse->colScale = uAbsScale;
+            }
+            // Full Newton refactors every time.
+            haveFactorization = reuseFactorization;
+            freshFactorization = true;
+        } else
+            ++numProjectQReuses;
 
-        //printf("projectQ %d: m=%d condTol=%g rank=%d rcond=%g\n",
-        //    nItsUsed, Pqwrt.ncol(), conditioningTol, Pqwr_qtz.getRank(),
-        //    Pqwr_qtz.getRCondEstimate());
+        //printf("projectQ %d: m=%d condTol=%g rank=%d\n",
+        //    nItsUsed, Pqwr.nrow(), conditioningTol, Pqwr_fact.getRank());
 
-        Pqwr_qtz.solve(scaledPerrs, dfq_WLS); // this is weighted dq_WLS=Wq*dq
+        Pqwr_fact.solve(scaledPerrs, dfq_WLS); // this is weighted dq_WLS=Wq*dq
         lastChangeMadeWRMS = dfq_WLS.normRMS(); // change in weighted norm
 
         // switch back to unweighted dq=Wq^+*dq_WLS
@@ -4077,17 +5794,30 @@ int SimbodyMatterSubsystemRep::projectQ
         // Now recalculate the position constraint errors at the new q.
         realizeSubsystemPosition(s); // pErrs changes here
 
-        scaledPerrs = pErrs.rowScale(perrWeights); // Tp * pErrs
+        scaleSegment(qErrs, 0, mHolo, qErrWeights, scaledPerrs); // Tp*pErrs
         perrNormAchieved = useNormInf ? scaledPerrs.normInf()
                                       : scaledPerrs.normRMS();
         ++nItsUsed;
 
-        if (localOnly && nItsUsed >= 2 
+        if (!freshFactorization && perrNormAchieved 
+                > projectionReuseTolerance*prevPerrNormAchieved) {
+            // An out-of-date factorization isn't working well enough. If 
+            // it actually made things worse, undo the last step. Then
+            // refactor at the current q and try again.
+            if (perrNormAchieved > prevPerrNormAchieved) {
+                updQ(s) += dq;
+                realizeSubsystemPosition(s); // pErrs changes here
+                scaleSegment(qErrs, 0, mHolo, qErrWeights, scaledPerrs);
+                perrNormAchieved = useNormInf ? scaledPerrs.normInf()
+                                              : scaledPerrs.normRMS();
+            }
+            haveFactorization = false;
+        } else if (localOnly && nItsUsed >= 2 
             && perrNormAchieved > prevPerrNormAchieved) {
             // perr norm got worse; restore to end of previous iteration
             updQ(s) += dq;
             realizeSubsystemPosition(s); // pErrs changes here
-            scaledPerrs = pErrs.rowScale(perrWeights);
+            scaleSegment(qErrs, 0, mHolo, qErrWeights, scaledPerrs);
             perrNormAchieved = useNormInf ? scaledPerrs.normInf()
                                           : scaledPerrs.normRMS();
             diverged = true;
@@ -4158,23 +5888,26 @@ int SimbodyMatterSubsystemRep::projectQ
     // N^+*N.)
     if (qErrest.size()) {
         // Work in Wq-norm
-        Vector Tp_Pq_qErrest, bias_p;
-        calcBiasForMultiplyByPq(s, bias_p);
+        Vector& Tp_Pq_qErrest = ws.errestRHS;
+        Vector& bias_p = ws.errestBias;
+        calcBiasForMultiplyByPVA(s, true, false, false, bias_p, ws.pvaBias);
 
         // Switch back to unweighted dq = Wq^+ * dq_WLS
         // = N * Wu^-1 * N^+ * dq_WLS
         if (hasPrescribedMotion) {
-            Vector qErrest_0(qErrest);
+            Vector& qErrest_0 = ws.errest0;
+            qErrest_0 = qErrest;
             zeroKnownQ(s, qErrest_0); // zero out prescribed entries
-            multiplyByPq(s, bias_p, qErrest_0, Tp_Pq_qErrest); // (Pq*qErrest)_r
+            multiplyByPq(s, bias_p, qErrest_0, Tp_Pq_qErrest, // (Pq*qErrest)_r
+                         ws.pva);
             Tp_Pq_qErrest.rowScaleInPlace(perrWeights); // now Tp*(Pq*qErrest)_r
-            Pqwr_qtz.solve(Tp_Pq_qErrest, dfq_WLS); // weighted
+            Pqwr_fact.solve(Tp_Pq_qErrest, dfq_WLS); // weighted
             unpackFreeQ(s, dfq_WLS, udfq_WLS); // zeroes in q_p slots
             multiplyByNInv(s,false,udfq_WLS,du);
         } else {
-            multiplyByPq(s, bias_p, qErrest, Tp_Pq_qErrest); // Pq*qErrest
+            multiplyByPq(s, bias_p, qErrest, Tp_Pq_qErrest, ws.pva); // Pq*qErr
             Tp_Pq_qErrest.rowScaleInPlace(perrWeights); // now Tp*Pq*qErrest
-            Pqwr_qtz.solve(Tp_Pq_qErrest, dfq_WLS); // weighted
+            Pqwr_fact.solve(Tp_Pq_qErrest, dfq_WLS); // weighted
             multiplyByNInv(s,false,dfq_WLS,du);
         }
         // Here du = du_WLS = N^+ * dq_WLS
@@ -4195,8 +5928,8 @@ int SimbodyMatterSubsystemRep::projectQ
     if (mQuats) {
         const bool anyQuatChange = normalizeQuaternions(s,qErrest);
         if (anyQuatChange) results.setAnyChangeMade(true);
-        quatNormAchieved = useNormInf ? quatErrs.normInf(&worstQuatErr)
-                                      : quatErrs.normRMS(&worstQuatErr);
+        quatNormAchieved = calcSegmentNorm(qErrs, mHolo, mQuats, 0,
+                                           useNormInf, worstQuatErr);
         if (quatNormAchieved > consAccuracy) {
             results.setNormOnExit(quatNormAchieved);
             results.setExitStatus(ProjectResults::FailedToAchieveAccuracy);
@@ -4333,18 +6066,18 @@ void SimbodyMatterSubsystemRep::enforceVelocityConstraints
 
     if (normAchievedTRMS > consAccuracyToTryFor) {
         const Vector saveU = getU(s);
-        Matrix PVwrt(nfu, mHolo+mNonholo);
+        Matrix PVwr(mHolo+mNonholo, nfu);
         Vector dfu_WLS(nfu);
         Vector du(nu); // unpacked into here if necessary
         if (hasPrescribedMotion)
             du.setToZero(); // must initialize unwritten elements
 
-        calcWeightedPVrTranspose(s, ooPVTols, ooUWeights, PVwrt);
-        // PVwrt is now Wu^-1 (Pt Vt) Tpv
+        calcWeightedPVr(s, ooPVTols, ooUWeights, PVwr, updWorkspaceCache(s));
+        // PVwr is now Tpv [P;V] Wu^-1
 
         // Calculate pseudoinverse (just once)
         FactorQTZ PVwr_qtz;
-        PVwr_qtz.factor<Real>(~PVwrt, conditioningTol);
+        PVwr_qtz.factor<Real>(PVwr, conditioningTol);
 
         Real prevNormAchievedTRMS = normAchievedTRMS; // watch for divergence
         const int MaxIterations  = 7;
@@ -4468,11 +6201,11 @@ int SimbodyMatterSubsystemRep::projectU
     const Vector& pvErrs = getUErr(s); // mHolo+mNonholo of these
     const Vector& pverrWeights = getUErrWeights(s); // 1/unit err (Tpv)
 
-    // Determine norm on entry.
+    // Determine norm on entry, without allocating anything.
     int worstPVerr;
-    Vector scaledPVerrs = pvErrs.rowScale(pverrWeights);
-    const Real pverrNormOnEntry = useNormInf ? scaledPVerrs.normInf(&worstPVerr)
-                                             : scaledPVerrs.normRMS(&worstPVerr);
+    const Real pverrNormOnEntry = calcSegmentNorm(pvErrs, 0, pvErrs.size(),
+                                                  &pverrWeights, useNormInf,
+                                                  worstPVerr);
     
     results.setNormOnEntrance(pverrNormOnEntry, worstPVerr);
 
@@ -4502,6 +6235,12 @@ int SimbodyMatterSubsystemRep::projectU
         return 0;
     }
 
+    // Temporaries are kept in the State's workspace so that projecting 
+    // while integrating doesn't allocate.
+    SBWorkspaceCache& ws = updWorkspaceCache(s);
+    Vector& scaledPVerrs = ws.scaledErrs;
+    scaleSegment(pvErrs, 0, pvErrs.size(), pverrWeights, scaledPVerrs);
+
     // We're going to have to project constraints. Get the remaining options.
 
     // This is the factor by which we try to achieve a tighter accuracy
@@ -4518,9 +6257,14 @@ int SimbodyMatterSubsystemRep::projectU
     // initialization.
     const bool localOnly = opts.isOptionSet(ProjectOptions::LocalOnly);
     // We are permitted to use an out-of-date Jacobian for projection unless
-    // this is set. TODO: always using modified Newton at the moment.
+    // this is set. We always use modified Newton within a single projection
+    // (see below); this determines whether we can also reuse a factorization
+    // from an earlier projection, if that has been enabled with
+    // setUseModifiedNewtonForProjection().
     const bool forceFullNewton =
         opts.isOptionSet(ProjectOptions::ForceFullNewton);
+    const bool reuseFactorization = 
+        useModifiedNewtonForProjection && !forceFullNewton;
 
     // Get problem dimensions.
     const SBInstanceCache& ic = getInstanceCache(s);
@@ -4550,7 +6294,8 @@ int SimbodyMatterSubsystemRep::projectU
     // Calculate relative scaling for changes to u.
     const Vector& u = getU(s);
     const Vector& uWeights = getUWeights(s); // 1/unit change (Wu)
-    Vector uRelScale(nu);
+    Vector& uRelScale = ws.uScale;
+    uRelScale.resize(nu);
     for (int i=0; i<nu; ++i) {
         const Real ui = std::abs(u[i]);
         const Real wi = uWeights[i];
@@ -4570,30 +6315,53 @@ int SimbodyMatterSubsystemRep::projectU
 
     // Keep the starting u in case we have to restore it, which we'll do
     // if the attempts here make the constraint norm worse.
-    const Vector saveU = getU(s);
+    Vector& saveU = ws.saveQorU;
+    saveU = getU(s);
 
-    Matrix PVwrt(nfu, mHolo+mNonholo);
-    Vector dfu_WLS(nfu);
-    Vector du(nu); // unpacked into here if necessary
+    Matrix& PVwr    = ws.PVwr;
+    Vector& dfu_WLS = ws.df_WLS;    dfu_WLS.resize(nfu);
+    Vector& du      = ws.du;        du.resize(nu); // unpacked if necessary
     if (hasPrescribedMotion)
         du.setToZero(); // must initialize unwritten elements
 
-    calcWeightedPVrTranspose(s, pverrWeights, uRelScale, PVwrt);
-    // PVwrt is now Eu^-1 (Pt Vt) Tpv
-
-    // Calculate pseudoinverse (just once)
-    FactorQTZ PVwr_qtz;
-    PVwr_qtz.factor<Real>(~PVwrt, conditioningTol);
-
-    //printf("projectU m=%d condTol=%g rank=%d rcond=%g\n",
-    //    PVwrt.ncol(), conditioningTol, PVwr_qtz.getRank(),
-    //    PVwr_qtz.getRCondEstimate());
+    // If we're allowed to reuse a factorization from an earlier projection
+    // we have to use the same u scaling it was calculated with. Since that
+    // depends on u it will usually differ a little from the current one;
+    // that's fine since any reasonable scaling will do.
+    SBProjectionFactorizationCache* reuse = 
+        reuseFactorization ? &updReusableUProjectionCache(s) : 0;
+    ConstraintFactorization& PVwr_fact = 
+        reuse ? reuse->factorization : ws.uProjectionFactorization;
+    bool haveFactorization = reuse && reuse->m == mHolo+mNonholo 
+        && reuse->nf == nfu && isSameVector(reuse->rowWeights, pverrWeights);
+    if (haveFactorization)
+        uRelScale = reuse->colScale;
+    bool freshFactorization = false;
 
     Real prevPVerrNormAchieved = pverrNormAchieved; // watch for divergence
     bool diverged = false;
     const int MaxIterations  = 7;
     do {
-        PVwr_qtz.solve(scaledPVerrs, dfu_WLS);
+        if (!haveFactorization) {
+            calcWeightedPVr(s, pverrWeights, uRelScale, PVwr, ws);
+            // PVwr is now Tpv [P;V] Eu^-1
+
+            // Calculate pseudoinverse (just once)
+            factorConstraintMatrix(s, PVwr, ColumnsAreFreeU, conditioningTol,
+                                   PVwr_fact);
+            ++numProjectUFactorizations;
+            if (reuse) {
+                reuse->m = mHolo+mNonholo; reuse->nf = nfu;
+                reuse->rowWeights = pverrWeights; reuse->colScale = uRelScale;
+            }
+            haveFactorization = freshFactorization = true;
+
+            //printf("projectU m=%d condTol=%g rank=%d\n",
+            //    PVwr.nrow(), conditioningTol, PVwr_fact.getRank());
+        } else if (!freshFactorization)
+            ++numProjectUReuses;
+
+        PVwr_fact.solve(scaledPVerrs, dfu_WLS);
         lastChangeMadeWRMS = dfu_WLS.normRMS(); // change in weighted norm
 
         // switch back to unweighted du=Eu^-1*du_WLS
@@ -4601,24 +6369,41 @@ int SimbodyMatterSubsystemRep::projectU
             unpackFreeU(s, dfu_WLS, du);    // zeroes in u_p slots
             du.rowScaleInPlace(uRelScale); // du=Eu^-1*unpack(dfu_WLS)
         } else {
-            du = dfu_WLS.rowScale(uRelScale); // unscale: du=Eu^-1*du_WLS
+            for (int i=0; i < nu; ++i) // unscale: du=Eu^-1*du_WLS
+                du[i] = uRelScale[i]*dfu_WLS[i];
         }
         updU(s) -= du;
         results.setAnyChangeMade(true);
 
         // Recalculate the constraint errors for the new u's.
         realizeSubsystemVelocity(s);
-        scaledPVerrs = pvErrs.rowScale(pverrWeights); // Tpv * pvErrs
+        scaleSegment(pvErrs, 0, pvErrs.size(), pverrWeights, // Tpv * pvErrs
+                     scaledPVerrs);
         pverrNormAchieved = useNormInf ? scaledPVerrs.normInf()
                                        : scaledPVerrs.normRMS();
         ++nItsUsed;
 
-        if (localOnly && nItsUsed >= 2 
+        if (!freshFactorization && pverrNormAchieved 
+                > projectionReuseTolerance*prevPVerrNormAchieved) {
+            // A factorization from an earlier projection isn't working well
+            // enough here. Undo the last step if it made things worse, then
+            // refactor at the current q and try again.
+            if (pverrNormAchieved > prevPVerrNormAchieved) {
+                updU(s) += du;
+                realizeSubsystemVelocity(s); // pvErrs changes here
+                scaleSegment(pvErrs, 0, pvErrs.size(), pverrWeights,
+                             scaledPVerrs);
+                pverrNormAchieved = useNormInf ? scaledPVerrs.normInf()
+                                               : scaledPVerrs.normRMS();
+            }
+            haveFactorization = false;
+        } else if (localOnly && nItsUsed >= 2 
             && pverrNormAchieved > prevPVerrNormAchieved) {
             // Velocity norm worse -- restore to end of previous iteration.
             updU(s) += du;
             realizeSubsystemVelocity(s); // pvErrs changes here
-            scaledPVerrs = pvErrs.rowScale(pverrWeights);
+            scaleSegment(pvErrs, 0, pvErrs.size(), pverrWeights,
+                         scaledPVerrs);
             pverrNormAchieved = useNormInf ? scaledPVerrs.normInf()
                                            : scaledPVerrs.normRMS();
             diverged = true;
@@ -4686,21 +6471,24 @@ int SimbodyMatterSubsystemRep::projectU
 
     if (uErrest.size()) {
         // Work in Wu-norm
-        Vector Tpv_PV_uErrest(mHolo+mNonholo);
-        Vector bias_pv(mHolo+mNonholo);
-        calcBiasForMultiplyByPVA(s,true,true,false,bias_pv); // just P,V
+        Vector& Tpv_PV_uErrest = ws.errestRHS;
+        Vector& bias_pv = ws.errestBias;
+        calcBiasForMultiplyByPVA(s,true,true,false,bias_pv, // just P,V
+                                 ws.pvaBias);
         if (hasPrescribedMotion) {
-            Vector uErrest_0(uErrest);
+            Vector& uErrest_0 = ws.errest0;
+            uErrest_0 = uErrest;
             zeroKnownU(s, uErrest_0); // zero out prescribed entries
             multiplyByPVA(s,true,true,false,bias_pv,
-                            uErrest_0,Tpv_PV_uErrest);
+                            uErrest_0,Tpv_PV_uErrest,ws.pva);
             Tpv_PV_uErrest.rowScaleInPlace(pverrWeights); // = Tpv*PV*uErrest_0
-            PVwr_qtz.solve(Tpv_PV_uErrest, dfu_WLS);
+            PVwr_fact.solve(Tpv_PV_uErrest, dfu_WLS);
             unpackFreeU(s, dfu_WLS, du); // still weighted
         } else {
-            multiplyByPVA(s,true,true,false,bias_pv,uErrest,Tpv_PV_uErrest);
+            multiplyByPVA(s,true,true,false,bias_pv,uErrest,Tpv_PV_uErrest,
+                          ws.pva);
             Tpv_PV_uErrest.rowScaleInPlace(pverrWeights); // = Tpv PV uErrEst
-            PVwr_qtz.solve(Tpv_PV_uErrest, du);
+            PVwr_fact.solve(Tpv_PV_uErrest, du);
         }
         du.rowScaleInPlace(uRelScale); // now du=Eu^-1*unpack(dfu_WLS)
         uErrest -= du; // this is unweighted now
@@ -4735,6 +6523,19 @@ int SimbodyMatterSubsystemRep::projectU
 // with internal forces generated by constraints. Note that the extra forces 
 // here are treated with opposite sign from the applied forces, as is 
 // appropriate for constraint forces.
+// Return f if there are no extra forces, otherwise total=f-extra. This is
+// done elementwise so nothing is allocated once total has been sized.
+template <class T> static const Vector_<T>&
+subtractExtraForces(const Vector_<T>& f, const Vector_<T>* extra, 
+                    Vector_<T>& total) {
+    if (!extra) return f;
+    assert(extra->size() == f.size());
+    total.resize(f.size());
+    for (int i=0; i < f.size(); ++i)
+        total[i] = f[i] - (*extra)[i];
+    return total;
+}
+
 void SimbodyMatterSubsystemRep::calcTreeForwardDynamicsOperator(
     const State&                    s,
     const Vector&                   mobilityForces,
@@ -4745,8 +6546,36 @@ void SimbodyMatterSubsystemRep::calcTreeForwardDynamicsOperator(
     SBTreeAccelerationCache&        tac,  // accels, prescribed forces go here
     Vector&                         udot, // in/out (in for prescribed udot)
     Vector&                         qdotdot,
-    Vector&                         udotErr) const
+    Vector&                         udotErr,
+    SBWorkspaceCache*               ws) const
 {
+    // If there are extra forces, combine them with the input forces and 
+    // start over. We don't want to construct the temporaries otherwise since
+    // even an empty Vector requires a heap allocation.
+    if ((extraMobilityForces || extraBodyForces) && ws) {
+        calcTreeForwardDynamicsOperator
+           (s, subtractExtraForces(mobilityForces, extraMobilityForces,
+                                   ws->totalMobilityForces),
+            particleForces, 
+            subtractExtraForces(bodyForces, extraBodyForces,
+                                ws->totalBodyForces),
+            0, 0, tac, udot, qdotdot, udotErr, ws);
+        return;
+    }
+    if (extraMobilityForces || extraBodyForces) {
+        Vector              totalMobilityForces;
+        Vector_<SpatialVec> totalBodyForces;
+        if (extraMobilityForces)
+            totalMobilityForces = mobilityForces - *extraMobilityForces; // note sign
+        if (extraBodyForces)
+            totalBodyForces = bodyForces - *extraBodyForces;    // note sign
+        calcTreeForwardDynamicsOperator
+           (s, extraMobilityForces ? totalMobilityForces : mobilityForces,
+            particleForces, extraBodyForces ? totalBodyForces : bodyForces,
+            0, 0, tac, udot, qdotdot, udotErr, 0);
+        return;
+    }
+
     SBStateDigest sbs(s, *this, Stage::Acceleration);
 
     const SBModelCache&         mc  = sbs.getModelCache();
@@ -4760,25 +6589,6 @@ void SimbodyMatterSubsystemRep::calcTreeForwardDynamicsOperator(
     udot.resize(topologyCache.nDOFs);
     qdotdot.resize(topologyCache.maxNQs);
 
-    Vector              totalMobilityForces;
-    Vector_<SpatialVec> totalBodyForces;
-
-    // inputs
-
-    // First assume we'll use the input forces as-is.
-    const Vector*              mobilityForcesToUse  = &mobilityForces;
-    const Vector_<SpatialVec>* bodyForcesToUse      = &bodyForces;
-
-    if (extraMobilityForces) {
-        totalMobilityForces = mobilityForces - *extraMobilityForces; // note sign
-        mobilityForcesToUse = &totalMobilityForces;
-    }
-
-    if (extraBodyForces) {
-        totalBodyForces = bodyForces - *extraBodyForces;    // note sign
-        bodyForcesToUse = &totalBodyForces;
-    }
-
     // outputs
     Vector&              netHingeForces = tac.epsilon;
     Array_<SpatialVec,MobilizedBodyIndex>&
@@ -4792,13 +6602,17 @@ void SimbodyMatterSubsystemRep::calcTreeForwardDynamicsOperator(
     // body accelerations A_GB, u-space generalized accelerations udot,
     // and q-space generalized accelerations qdotdot.
     calcTreeAccelerations
-       (s, *mobilityForcesToUse, *bodyForcesToUse, dc.presUDotPool,
+       (s, mobilityForces, bodyForces, dc.presUDotPool,
         netHingeForces, abForcesZ, abForcesZPlus,
         A_GB, udot, qdotdot, tau);
 
     // Feed the accelerations into the constraint error methods to determine
     // the acceleration constraint errors they generate.
-    calcConstraintAccelerationErrors(s, A_GB, udot, qdotdot, udotErr);
+    if (ws)
+        calcConstraintAccelerationErrors(s, A_GB, udot, qdotdot, udotErr,
+                                         ws->constraintErrors);
+    else
+        calcConstraintAccelerationErrors(s, A_GB, udot, qdotdot, udotErr);
 }
 //......................CALC TREE FORWARD DYNAMICS OPERATOR ....................
 
@@ -4828,7 +6642,7 @@ void SimbodyMatterSubsystemRep::realizeTreeForwardDynamics(
     calcTreeForwardDynamicsOperator
        (s, mobilityForces, particleForces, bodyForces,
         extraMobilityForces, extraBodyForces,
-        tac, udot, qdotdot, udotErr);
+        tac, udot, qdotdot, udotErr, &updWorkspaceCache(s));
 
     // Since we're realizing, mark the resulting cache entry valid.
     markCacheValueRealized(s, topologyCache.treeAccelerationCacheIndex);
@@ -4857,7 +6671,8 @@ void SimbodyMatterSubsystemRep::calcLoopForwardDynamicsOperator
     Vector&                         udot,
     Vector&                         qdotdot,
     Vector&                         multipliers,
-    Vector&                         udotErr) const
+    Vector&                         udotErr,
+    SBWorkspaceCache*               ws) const
 {
     assert(getStage(s) >= Stage::Acceleration-1);
 
@@ -4865,7 +6680,7 @@ void SimbodyMatterSubsystemRep::calcLoopForwardDynamicsOperator
     // them calculate the resulting constraint errors.
     calcTreeForwardDynamicsOperator
        (s, mobilityForces, particleForces, bodyForces,
-        0, 0, tac, udot, qdotdot, udotErr);
+        0, 0, tac, udot, qdotdot, udotErr, ws);
 
     // Next, determine how many acceleration-level constraint equations 
     // need to be obeyed.
@@ -4881,48 +6696,38 @@ void SimbodyMatterSubsystemRep::calcLoopForwardDynamicsOperator
     if (m==0) return;
     if (nu==0) {multipliers.setToZero(); return;}
 
-    // Conditioning tolerance. This determines when we'll drop a 
-    // constraint. 
-    // TODO: this is probably too tight; should depend on constraint tolerance
-    // and should be consistent with position and velocity projection ranks.
-    // Tricky here because conditioning depends on mass matrix as well as
-    // constraints.
-    const Real conditioningTol = m 
-        //* SignificantReal;
-        * SqrtEps*std::sqrt(SqrtEps); // Eps^(3/4)
-
     // Calculate multipliers lambda as
     //     (G M^-1 ~G) lambda = aerr
-    // The method here calculates the mXm matrix G*M^-1*G^T as fast as 
-    // I know how to do, O(m*n) with O(n) temporary memory, using a series
-    // of O(n) operators. Then we'll factor it here in O(m^3) time. 
-    Matrix GMInvGt(m,m);
-    calcGMInvGt(s, GMInvGt);
-    
-    // specify 1/cond at which we declare rank deficiency
-    FactorQTZ qtz(GMInvGt, conditioningTol); 
-
-    //printf("fwdDynamics: m=%d condTol=%g rank=%d rcond=%g\n",
-    //    GMInvGt.nrow(), conditioningTol, qtz.getRank(),
-    //    qtz.getRCondEstimate());
-
-    qtz.solve(udotErr, multipliers);
-
-    // We have the multipliers, now turn them into forces.
+    // The mXm matrix G*M^-1*G^T is calculated in O(m*n) time using a series
+    // of O(n) operators and factored in O(m^3) time, but only once for a
+    // given q (and u if needed); see realizeGMInvGtFactorization().
+    solveForMultipliers(s, udotErr, multipliers);
+
+    // We have the multipliers, now turn them into forces. Note that 
+    // constraint forces have the opposite sign from applied forces so must be
+    // subtracted to calculate the total forces. Then recalculate the 
+    // accelerations applying the constraint forces in addition to the applied
+    // forces that were passed in. The constraint errors calculated now should
+    // be within numerical noise of zero.
+    if (ws) {
+        calcConstraintForcesFromMultipliers(s, multipliers,
+            ws->constraintBodyForces, ws->constraintMobilityForces,
+            cac.constrainedBodyForcesInG, cac.constraintMobilityForces,
+            ws->lambdap, ws->lambdav, ws->lambdaa);
+        calcTreeForwardDynamicsOperator
+           (s, mobilityForces, particleForces, bodyForces,
+            &ws->constraintMobilityForces, &ws->constraintBodyForces, 
+            tac, udot, qdotdot, udotErr, ws);
+        return;
+    }
 
     Vector_<SpatialVec> bodyForcesInG;
     Vector              mobilityF;
     calcConstraintForcesFromMultipliers(s,multipliers,bodyForcesInG,mobilityF,
         cac.constrainedBodyForcesInG, cac.constraintMobilityForces);
-    // Note that constraint forces have the opposite sign from applied forces
-    // so must be subtracted to calculate the total forces.
-
-    // Recalculate the accelerations applying the constraint forces in addition
-    // to the applied forces that were passed in. The constraint errors 
-    // calculated now should be within numerical noise of zero.
     calcTreeForwardDynamicsOperator
        (s, mobilityForces, particleForces, bodyForces,
-        &mobilityF, &bodyForcesInG, tac, udot, qdotdot, udotErr);
+        &mobilityF, &bodyForcesInG, tac, udot, qdotdot, udotErr, 0);
 }
 //................... CALC LOOP FORWARD DYNAMICS OPERATOR ......................
 
@@ -4949,7 +6754,7 @@ void SimbodyMatterSubsystemRep::realizeLoopForwardDynamics(const State& s,
 
     calcLoopForwardDynamicsOperator
        (s, mobilityForces, particleForces, bodyForces,
-        tac, cac, udot, qdotdot, multipliers, udotErr);
+        tac, cac, udot, qdotdot, multipliers, udotErr, &updWorkspaceCache(s));
 
     // Since we're realizing, note that we're done with these cache entries.
     markCacheValueRealized(s, topologyCache.treeAccelerationCacheIndex);
@@ -5045,7 +6850,6 @@ void SimbodyMatterSubsystemRep::calcTreeAccelerations(const State& s,
 
     const SBInstanceCache&      ic  = sbs.getInstanceCache();
     const SBTreePositionCache&  tpc = sbs.getTreePositionCache();
-    const SBTreeVelocityCache&  tvc = sbs.getTreeVelocityCache();
     const SBDynamicsCache&      dc  = sbs.getDynamicsCache();
 
     assert(mobilityForces.size() == getTotalDOF());
@@ -5088,22 +6892,12 @@ void SimbodyMatterSubsystemRep::calcTreeAccelerations(const State& s,
     for (int i=0; i < (int)ic.zeroUDot.size(); ++i)
         udotPtr[ic.zeroUDot[i]] = 0;
 
-    for (int i=rbNodeLevels.size()-1 ; i>=0 ; i--) 
-        for (int j=0 ; j<(int)rbNodeLevels[i].size() ; j++) {
-            const RigidBodyNode& node = *rbNodeLevels[i][j];
-            node.calcUDotPass1Inward(ic,tpc,abc,dc,
-                mobilityForcePtr, bodyForcePtr, udotPtr, zPtr, zPlusPtr,
-                hingeForcePtr);
-        }
+    sweepInward(CalcUDotPass1InwardOp(ic,tpc,abc,dc,
+        mobilityForcePtr, bodyForcePtr, udotPtr, zPtr, zPlusPtr,
+        hingeForcePtr));
 
-    for (int i=0 ; i<(int)rbNodeLevels.size() ; i++)
-        for (int j=0 ; j<(int)rbNodeLevels[i].size() ; j++) {
-            const RigidBodyNode& node = *rbNodeLevels[i][j];
-            node.calcUDotPass2Outward(ic,tpc,abc,tvc,dc, 
-                hingeForcePtr, aPtr, udotPtr, tauPtr);
-            node.calcQDotDot(sbs, &udotPtr[node.getUIndex()], 
-                             &qdotdotPtr[node.getQIndex()]);
-        }
+    sweepOutward(CalcUDotPass2OutwardOp(sbs, abc,
+        hingeForcePtr, aPtr, udotPtr, qdotdotPtr, tauPtr));
 }
 //......................... CALC TREE ACCELERATIONS ............................
 
@@ -5147,19 +6941,10 @@ void SimbodyMatterSubsystemRep::multiplyByMInv(const State& s,
     const Real* fPtr     = &f[0];       
     Real*       MInvfPtr = &MInvf[0];
 
-    for (int i=rbNodeLevels.size()-1 ; i>=0 ; i--) 
-        for (int j=0 ; j<(int)rbNodeLevels[i].size() ; j++) {
-            const RigidBodyNode& node = *rbNodeLevels[i][j];
-            node.multiplyByMInvPass1Inward(ic,tpc,abc,
-                fPtr, z.begin(), zPlus.begin(), eps.begin());
-        }
-
-    for (int i=0 ; i<(int)rbNodeLevels.size() ; i++)
-        for (int j=0 ; j<(int)rbNodeLevels[i].size() ; j++) {
-            const RigidBodyNode& node = *rbNodeLevels[i][j];
-            node.multiplyByMInvPass2Outward(ic,tpc,abc, 
-                eps.cbegin(), A_GB.begin(), MInvfPtr);
-        }
+    sweepInward(MultiplyByMInvPass1InwardOp(ic,tpc,abc,
+        fPtr, z.begin(), zPlus.begin(), eps.begin()));
+    sweepOutward(MultiplyByMInvPass2OutwardOp(ic,tpc,abc,
+        eps.cbegin(), A_GB.begin(), MInvfPtr));
 }
 //............................. CALC M INVERSE F ...............................
 
@@ -5211,36 +6996,328 @@ void SimbodyMatterSubsystemRep::multiplyByM(const State&    s,
 
 
 
+//==============================================================================
+//                    MULTIPLY BY M and M INV (MULTIPLE COLUMNS)
+//==============================================================================
+// Calculate M*A or M^-1*F for all the columns of a matrix with one pair of
+// sweeps, rather than a pair of sweeps per column. Each node processes all the
+// columns together, fetching its geometry and articulated inertias once. The
+// temporaries are stored by node so that each node's columns are adjacent. 
+// Both matrices must have contiguous storage by columns; they may be the same
+// matrix.
+namespace {
+class MultiplyByMInvMultiPass1InwardOp {
+public:
+    MultiplyByMInvMultiPass1InwardOp(const SBInstanceCache& ic, 
+        const SBTreePositionCache& tpc, const SBArticulatedBodyInertiaCache& abc,
+        int nu, int ncol, const Real* F, SpatialVec* zPlus, Real* MInvF)
+    :   ic(ic), tpc(tpc), abc(abc), nu(nu), ncol(ncol), F(F), zPlus(zPlus), 
+        MInvF(MInvF) {}
+    void operator()(const RigidBodyNode& node) const
+    {   node.multiplyByMInvMultiPass1Inward(ic,tpc,abc,nu,ncol,F,zPlus,MInvF); }
+private:
+    const SBInstanceCache&                  ic;
+    const SBTreePositionCache&              tpc;
+    const SBArticulatedBodyInertiaCache&    abc;
+    int nu; int ncol; const Real* F; SpatialVec* zPlus; Real* MInvF;
+};
+
+class MultiplyByMInvMultiPass2OutwardOp {
+public:
+    MultiplyByMInvMultiPass2OutwardOp(const SBInstanceCache& ic, 
+        const SBTreePositionCache& tpc, const SBArticulatedBodyInertiaCache& abc,
+        int nu, int ncol, SpatialVec* A_GB, Real* MInvF)
+    :   ic(ic), tpc(tpc), abc(abc), nu(nu), ncol(ncol), A_GB(A_GB), 
+        MInvF(MInvF) {}
+    void operator()(const RigidBodyNode& node) const
+    {   node.multiplyByMInvMultiPass2Outward(ic,tpc,abc,nu,ncol,A_GB,MInvF); }
+private:
+    const SBInstanceCache&                  ic;
+    const SBTreePositionCache&              tpc;
+    const SBArticulatedBodyInertiaCache&    abc;
+    int nu; int ncol; SpatialVec* A_GB; Real* MInvF;
+};
+
+class MultiplyByMMultiPass1OutwardOp {
+public:
+    MultiplyByMMultiPass1OutwardOp(const SBTreePositionCache& tpc, 
+        int nu, int ncol, const Real* A, SpatialVec* A_GB)
+    :   tpc(tpc), nu(nu), ncol(ncol), A(A), A_GB(A_GB) {}
+    void operator()(const RigidBodyNode& node) const
+    {   node.multiplyByMMultiPass1Outward(tpc,nu,ncol,A,A_GB); }
+private:
+    const SBTreePositionCache& tpc;
+    int nu; int ncol; const Real* A; SpatialVec* A_GB;
+};
+
+class MultiplyByMMultiPass2InwardOp {
+public:
+    MultiplyByMMultiPass2InwardOp(const SBTreePositionCache& tpc, 
+        int nu, int ncol, const SpatialVec* A_GB, SpatialVec* F, Real* MA)
+    :   tpc(tpc), nu(nu), ncol(ncol), A_GB(A_GB), F(F), MA(MA) {}
+    void operator()(const RigidBodyNode& node) const
+    {   node.multiplyByMMultiPass2Inward(tpc,nu,ncol,A_GB,F,MA); }
+private:
+    const SBTreePositionCache& tpc;
+    int nu; int ncol; const SpatialVec* A_GB; SpatialVec* F; Real* MA;
+};
+}
+
+void SimbodyMatterSubsystemRep::multiplyByMInv(const State& s,
+    const Matrix&                                           F,
+    Matrix&                                                 MInvF) const 
+{
+    const int nb   = getNumBodies();
+    const int nu   = getNU(s);
+    const int ncol = F.ncol();
+
+    assert(F.nrow() == nu);
+
+    MInvF.resize(nu, ncol);
+    if (nu==0 || ncol==0)
+        return;
+
+    assert(F.hasContiguousData() && (nu==1 || &F(1,0) == &F(0,0)+1));
+    assert(MInvF.hasContiguousData() && (nu==1 || &MInvF(1,0) == &MInvF(0,0)+1));
+
+    // Temporary used for zPlus on the way in and A_GB on the way out.
+    Array_<SpatialVec> zPlusOrA_GB(nb*ncol);
+    calcMInvFAndBodyAccelerations(s, F, MInvF, zPlusOrA_GB);
+}
+
+void SimbodyMatterSubsystemRep::multiplyByMInvWithBodyAccelerations
+   (const State& s, const Matrix& F, Matrix& MInvF, 
+    Array_<SpatialVec>& A_GB) const
+{
+    const int nb   = getNumBodies();
+    const int nu   = getNU(s);
+    const int ncol = F.ncol();
+
+    assert(F.nrow() == nu);
+
+    MInvF.resize(nu, ncol);
+    A_GB.resize(nb*ncol);
+    if (ncol==0)
+        return;
+    if (nu==0) {
+        A_GB.fill(SpatialVec(Vec3(0), Vec3(0)));
+        return;
+    }
+
+    assert(F.hasContiguousData() && (nu==1 || &F(1,0) == &F(0,0)+1));
+    assert(MInvF.hasContiguousData() && (nu==1 || &MInvF(1,0) == &MInvF(0,0)+1));
+
+    calcMInvFAndBodyAccelerations(s, F, MInvF, A_GB);
+}
+
+// This is the common implementation of the above two methods. Arguments have
+// already been checked and sized. zPlusOrA_GB is used as a temporary on the
+// way in and holds the body accelerations on return.
+void SimbodyMatterSubsystemRep::calcMInvFAndBodyAccelerations
+   (const State& s, const Matrix& F, Matrix& MInvF, 
+    Array_<SpatialVec>& zPlusOrA_GB) const
+{
+    const SBInstanceCache&                  ic  = getInstanceCache(s);
+    const SBTreePositionCache&              tpc = getTreePositionCache(s);
+
+    realizeArticulatedBodyInertias(s); // (may already have been realized)
+    const SBArticulatedBodyInertiaCache&    abc = getArticulatedBodyInertiaCache(s);
+
+    const int nu   = getNU(s);
+    const int ncol = F.ncol();
+
+    const Real* FPtr     = &F(0,0);
+    Real*       MInvFPtr = &MInvF(0,0);
+
+    sweepInward(MultiplyByMInvMultiPass1InwardOp(ic,tpc,abc,nu,ncol,
+        FPtr, zPlusOrA_GB.begin(), MInvFPtr));
+    sweepOutward(MultiplyByMInvMultiPass2OutwardOp(ic,tpc,abc,nu,ncol,
+        zPlusOrA_GB.begin(), MInvFPtr));
+}
+
+
+
+//==============================================================================
+//                CALC OPERATIONAL SPACE INERTIA INVERSE
+//==============================================================================
+// Calculate the inverse operational space inertia Lambda^-1 = J*M^-1*~J for
+// a set of nt station or frame tasks, where J is the task Jacobian. This takes
+// O(n*nt) time and never forms J or M^-1. Column j of ~J is the set of 
+// mobility forces produced by a unit force (or moment) in one task direction; 
+// we get each with an O(n) inward sweep. Then a single pair of M^-1 sweeps 
+// for all the columns yields the body accelerations produced by each unit 
+// task force, from which we pick out the task accelerations to get column j 
+// of J*M^-1*~J. The result is saved in the State cache along with the task 
+// list.
+void SimbodyMatterSubsystemRep::calcOperationalSpaceInertiaInverse
+   (const State&                        s,
+    bool                                isFrameTask,
+    const Array_<MobilizedBodyIndex>&   onBodyB,
+    const Array_<Vec3>&                 pointInB,
+    Matrix&                             LambdaInv) const
+{
+    const CacheEntryIndex osx = topologyCache.operationalSpaceInertiaCacheIndex;
+    SBOperationalSpaceInertiaCache& osc = updOperationalSpaceInertiaCache(s);
+
+    if (isCacheValueRealized(s, osx) && osc.isFrameTask == isFrameTask
+        && osc.onBodyB == onBodyB && osc.pointInB == pointInB) {
+        LambdaInv = osc.LambdaInv; // same tasks; reuse
+        return;
+    }
+
+    SimTK_STAGECHECK_GE_ALWAYS(getStage(s), Stage::Position, 
+        "SimbodyMatterSubsystem::calcOperationalSpaceInertiaInverse()");
+
+    const int nb = getNumBodies();
+    const int nu = getNU(s);
+    const int nt = (int)onBodyB.size();
+    const int k  = isFrameTask ? 6 : 3; // rows per task
+    const int m  = k*nt;
+    assert((int)pointInB.size() == nt);
+
+    // Task points, measured from their body origins but expressed in Ground.
+    Array_<Vec3> p_BP_G(nt);
+    for (int t=0; t < nt; ++t)
+        p_BP_G[t] = getBodyTransform(s, onBodyB[t]).R() * pointInB[t];
+
+    // Form ~J a column at a time by applying a unit force (or moment) to one
+    // task. Frame tasks have moments first, then forces.
+    Matrix Jt(nu, m);
+    Vector_<SpatialVec> F_G(nb); F_G.setToZero();
+    for (int t=0; t < nt; ++t) {
+        SpatialVec& F_GB = F_G[onBodyB[t]];
+        for (int d=0; d < k; ++d) {
+            if (d < k-3) {
+                F_GB[0][d] = 1; // unit moment
+            } else {
+                Vec3 f(0); f[d-(k-3)] = 1; // unit force at P
+                F_GB = SpatialVec(p_BP_G[t] % f, f);
+            }
+            VectorView Jtcol = Jt(k*t + d); // contiguous
+            multiplyBySystemJacobianTranspose(s, F_G, Jtcol);
+            F_GB = SpatialVec(Vec3(0), Vec3(0));
+        }
+    }
+
+    // M^-1*~J, keeping the body accelerations for every column.
+    Matrix MInvJt;
+    Array_<SpatialVec> A_GB;
+    multiplyByMInvWithBodyAccelerations(s, Jt, MInvJt, A_GB);
+
+    // Now pick the task accelerations out of the body accelerations.
+    osc.LambdaInv.resize(m, m);
+    for (int c=0; c < m; ++c)
+        for (int t=0; t < nt; ++t) {
+            const SpatialVec& A = A_GB[onBodyB[t]*m + c];
+            const Vec3 a_GP = A[1] + A[0] % p_BP_G[t];
+            if (isFrameTask)
+                for (int i=0; i < 3; ++i) {
+                    osc.LambdaInv(6*t+i,   c) = A[0][i];
+                    osc.LambdaInv(6*t+3+i, c) = a_GP[i];
+                }
+            else
+                for (int i=0; i < 3; ++i)
+                    osc.LambdaInv(3*t+i, c) = a_GP[i];
+        }
+
+    osc.isFrameTask = isFrameTask;
+    osc.onBodyB     = onBodyB;
+    osc.pointInB    = pointInB;
+    markCacheValueRealized(s, osx);
+
+    LambdaInv = osc.LambdaInv;
+}
+
+void SimbodyMatterSubsystemRep::multiplyByM(const State&    s,
+                                            const Matrix&   A,
+                                            Matrix&         MA) const 
+{
+    const SBTreePositionCache& tpc = getTreePositionCache(s);
+    const int nb   = getNumBodies();
+    const int nu   = getNU(s);
+    const int ncol = A.ncol();
+
+    assert(A.nrow() == nu);
+    MA.resize(nu, ncol);
+    if (nu==0 || ncol==0)
+        return;
+
+    assert(A.hasContiguousData() && (nu==1 || &A(1,0) == &A(0,0)+1));
+    assert(MA.hasContiguousData() && (nu==1 || &MA(1,0) == &MA(0,0)+1));
+
+    Array_<SpatialVec> A_GB(nb*ncol), FTmp(nb*ncol);
+
+    sweepOutward(MultiplyByMMultiPass1OutwardOp(tpc,nu,ncol,
+        &A(0,0), A_GB.begin()));
+    sweepInward(MultiplyByMMultiPass2InwardOp(tpc,nu,ncol,
+        A_GB.cbegin(), FTmp.begin(), &MA(0,0)));
+}
+
+
+
 //==============================================================================
 //                                  CALC M
 //==============================================================================
-// Calculate the mass matrix M in O(n^2) time. This Subsystem must already have
-// been realized to Position stage.
+// Calculate the mass matrix M in O(n*d) time, where d is the depth of the
+// tree, using the composite-rigid-body algorithm. This Subsystem must already
+// have been realized to Position stage; composite body inertias will be 
+// realized if necessary.
+//
+// Column c of M, where c is one of the u's of body B, is the set of 
+// generalized forces needed to produce a unit udot_c with all the other 
+// udots zero. That rigidly accelerates the composite body outboard of B's 
+// mobilizer, so takes body force F=R_B*H_B(c) at B, and ~H*F at each
+// mobilizer from B inward to Ground, with F shifted along the way. Bodies 
+// that aren't ancestors of B don't feel any force so their entries are 
+// zero. Those entries are at or above the diagonal since ancestors have lower
+// u indices than their descendants, so we calculate only that triangle and 
+// then copy it to the other one.
+//
 // It is OK if M's data is not contiguous.
 void SimbodyMatterSubsystemRep::calcM(const State& s, Matrix& M) const {
     const int nu = getTotalDOF();
     M.resize(nu,nu);
     if (nu==0) return;
 
-    // This could be calculated much faster by doing it directly and calculating
-    // only half of it. As a placeholder, however, we're doing this with 
-    // repeated O(n) calls to multiplyByM() to get M one column at a time.
+    // If M is contiguous we can work directly in it; it is symmetric so we 
+    // don't care whether it is stored by rows or columns.
+    const bool isContiguous = M.hasContiguousData();
+    Matrix contigM(isContiguous ? 0 : nu, isContiguous ? 0 : nu);
+    Real* Mptr = isContiguous ? &M(0,0) : &contigM(0,0);
+    for (int i=0; i < nu*nu; ++i) Mptr[i] = 0;
 
-    // If M's columns are contiguous we can avoid copying.
-    const bool isContiguous = M(0).hasContiguousData();
-    Vector contig_col(isContiguous ? 0 : nu);
-
-    Vector v(nu); v.setToZero();
-    for (int i=0; i < nu; ++i) {
-        v[i] = 1;
-        if (isContiguous) {
-            multiplyByM(s, v, M(i));
-        } else {
-            multiplyByM(s, v, contig_col);
-            M(i) = contig_col;
+    const SBTreePositionCache& tpc = getTreePositionCache(s);
+    const Array_<SpatialInertia,MobilizedBodyIndex>& R = 
+        getCompositeBodyInertias(s);
+
+    for (MobilizedBodyIndex mbx(1); mbx < getNumBodies(); ++mbx) {
+        const RigidBodyNode& node = getRigidBodyNode(mbx);
+        const int firstCol = node.getUIndex();
+        for (int k=0; k < node.getDOF(); ++k) {
+            Real* col = &Mptr[(firstCol+k)*nu];
+            SpatialVec F = R[mbx] * node.getHCol(tpc,k);
+            for (int j=0; j <= k; ++j)
+                col[firstCol+j] = ~node.getHCol(tpc,j) * F;
+            for (const RigidBodyNode* body = &node; 
+                 body->getParent()->getNodeNum() != GroundIndex; 
+                 body = body->getParent())
+            {
+                F = body->getPhi(tpc) * F; // shift to parent
+                const RigidBodyNode& parent = *body->getParent();
+                const int parentFirstRow = parent.getUIndex();
+                for (int j=0; j < parent.getDOF(); ++j)
+                    col[parentFirstRow+j] = ~parent.getHCol(tpc,j) * F;
+            }
         }
-        v[i] = 0;
     }
+
+    // Fill in the lower triangle.
+    for (int c=0; c < nu; ++c)
+        for (int r=c+1; r < nu; ++r)
+            Mptr[c*nu + r] = Mptr[r*nu + c];
+
+    if (!isContiguous)
+        M = contigM;
 }
 
 
@@ -5249,31 +7326,181 @@ void SimbodyMatterSubsystemRep::calcM(const State& s, Matrix& M) const {
 //                                CALC MInv
 //==============================================================================
 // Calculate the mass matrix inverse MInv(=M^-1) in O(n^2) time. This Subsystem
-// must already have been realized to Position stage.
+// must already have been realized to Position stage; articulated body 
+// inertias will be realized if necessary. As for multiplyByMInv(), rows and
+// columns corresponding to prescribed mobilities are zero.
+//
+// This applies the passes of multiplyByMInv() to blocks of columns of the
+// identity matrix at once, but each body deals only with the columns from its
+// first u onwards (the others being known by symmetry), and on the inward
+// pass only with columns belonging to its subtree (the others being zero). See
+// RigidBodyNode::calcMInvPass1Inward(). Doing a fixed-size block of columns
+// per pair of sweeps keeps the workspace at O(n) rather than O(n^2) while
+// still amortizing the cost of visiting each node.
+//
 // It is OK if MInv's data is not contiguous.
+namespace {
+// Number of columns of M^-1 calculated per pair of sweeps.
+const int MInvColumnBlockSize = 16;
+
+class CalcMInvPass1InwardOp {
+public:
+    CalcMInvPass1InwardOp(const SBInstanceCache& ic, 
+        const SBTreePositionCache& tpc, const SBArticulatedBodyInertiaCache& abc,
+        int nu, int col0, int col1, int* colEnd, SpatialVec* zPlus, 
+        Real* MInv)
+    :   ic(ic), tpc(tpc), abc(abc), nu(nu), col0(col0), col1(col1), 
+        colEnd(colEnd), zPlus(zPlus), MInv(MInv) {}
+    void operator()(const RigidBodyNode& node) const
+    {   node.calcMInvPass1Inward(ic,tpc,abc,nu,col0,col1,colEnd,zPlus,MInv); }
+private:
+    const SBInstanceCache&                  ic;
+    const SBTreePositionCache&              tpc;
+    const SBArticulatedBodyInertiaCache&    abc;
+    int nu, col0, col1; int* colEnd; SpatialVec* zPlus; Real* MInv;
+};
+
+class CalcMInvPass2OutwardOp {
+public:
+    CalcMInvPass2OutwardOp(const SBInstanceCache& ic, 
+        const SBTreePositionCache& tpc, const SBArticulatedBodyInertiaCache& abc,
+        int nu, int col0, int col1, const int* colEnd, SpatialVec* A_GB, 
+        Real* MInv)
+    :   ic(ic), tpc(tpc), abc(abc), nu(nu), col0(col0), col1(col1), 
+        colEnd(colEnd), A_GB(A_GB), MInv(MInv) {}
+    void operator()(const RigidBodyNode& node) const
+    {   node.calcMInvPass2Outward(ic,tpc,abc,nu,col0,col1,colEnd,A_GB,MInv); }
+private:
+    const SBInstanceCache&                  ic;
+    const SBTreePositionCache&              tpc;
+    const SBArticulatedBodyInertiaCache&    abc;
+    int nu, col0, col1; const int* colEnd; SpatialVec* A_GB; Real* MInv;
+};
+}
+
 void SimbodyMatterSubsystemRep::calcMInv(const State& s, Matrix& MInv) const {
     const int nu = getTotalDOF();
     MInv.resize(nu,nu);
     if (nu==0) return;
 
-    // This could probably be calculated faster by doing it directly and
-    // filling in only half. For now we're doing it with repeated calls to
-    // the O(n) operator multiplyByMInv().
+    const SBInstanceCache&      ic  = getInstanceCache(s);
+    const SBTreePositionCache&  tpc = getTreePositionCache(s);
+    realizeArticulatedBodyInertias(s); // (may already have been realized)
+    const SBArticulatedBodyInertiaCache& abc = getArticulatedBodyInertiaCache(s);
 
-    // If M's columns are contiguous we can avoid copying.
-    const bool isContiguous = MInv(0).hasContiguousData();
-    Vector contig_col(isContiguous ? 0 : nu);
+    // If MInv is contiguous we can work directly in it; it is symmetric so
+    // we don't care whether it is stored by rows or columns.
+    const bool isContiguous = MInv.hasContiguousData();
+    Matrix contigMInv(isContiguous ? 0 : nu, isContiguous ? 0 : nu);
+    Real* MInvPtr = isContiguous ? &MInv(0,0) : &contigMInv(0,0);
 
-    Vector f(nu); f.setToZero();
-    for (int i=0; i < nu; ++i) {
-        f[i] = 1;
-        if (isContiguous) {
-            multiplyByMInv(s, f, MInv(i));
-        } else {
-            multiplyByMInv(s, f, contig_col);
-            MInv(i) = contig_col;
-        }
-        f[i] = 0;
+    // Temporaries, O(n). The zPlus values from pass 1 aren't needed in pass
+    // 2 so the A_GB values can reuse their space.
+    const int nb = getNumBodies();
+    const int blockSize = std::min(nu, MInvColumnBlockSize);
+    Array_<int>         colEnd(nb);
+    Array_<SpatialVec>  zPlusOrA_GB(nb*blockSize);
+
+    for (int col0=0; col0 < nu; col0 += blockSize) {
+        const int col1 = std::min(col0 + blockSize, nu);
+        sweepInward(CalcMInvPass1InwardOp(ic,tpc,abc,nu,col0,col1,
+            colEnd.begin(), zPlusOrA_GB.begin(), MInvPtr));
+        sweepOutward(CalcMInvPass2OutwardOp(ic,tpc,abc,nu,col0,col1,
+            colEnd.cbegin(), zPlusOrA_GB.begin(), MInvPtr));
+    }
+
+    // Fill in the lower triangle.
+    for (int c=0; c < nu; ++c)
+        for (int r=c+1; r < nu; ++r)
+            MInvPtr[c*nu + r] = MInvPtr[r*nu + c];
+
+    if (!isContiguous)
+        MInv = contigMInv;
+}
+
+
+
+//==============================================================================
+//                   SOLVE USING MASS MATRIX FACTORIZATION
+//==============================================================================
+// Given the factorization Mrr = ~L*D*L, solve Mrr*x=f in place for one 
+// contiguous right-hand side of length nu. Prescribed entries of f are 
+// ignored and set to zero in x. Cost is O(n*d).
+namespace {
+void solveInPlaceUsingLTDL(const SBMassMatrixFactorizationCache& mfc, Real* x) {
+    const int nu = mfc.D.size();
+
+    // x = L^-T x, tip to base: once x_k is final, remove its contribution
+    // from each of its ancestors.
+    for (int k=nu-1; k >= 0; --k) {
+        if (mfc.isPrescribed[k]) {x[k] = 0; continue;}
+        const Real* Lk = mfc.L.cbegin() + mfc.firstL[k];
+        const int nk = mfc.firstL[k+1] - mfc.firstL[k];
+        const Real xk = x[k];
+        int i = mfc.parentU[k];
+        for (int m=0; m < nk; ++m, i = mfc.parentU[i])
+            x[i] -= Lk[m]*xk;
+    }
+
+    // x = D^-1 x, then x = L^-1 x base to tip.
+    for (int k=0; k < nu; ++k) {
+        if (mfc.isPrescribed[k]) continue;
+        const Real* Lk = mfc.L.cbegin() + mfc.firstL[k];
+        const int nk = mfc.firstL[k+1] - mfc.firstL[k];
+        Real xk = x[k] / mfc.D[k];
+        int i = mfc.parentU[k];
+        for (int m=0; m < nk; ++m, i = mfc.parentU[i])
+            xk -= Lk[m]*x[i]; // x[i] already final since i < k
+        x[k] = xk;
+    }
+}
+}
+
+void SimbodyMatterSubsystemRep::solveUsingMassMatrixFactorization
+   (const State& s, const Matrix& F, Matrix& MInvF) const
+{
+    const int nu = getTotalDOF();
+    const int nrhs = F.ncol();
+    assert(F.nrow() == nu);
+
+    MInvF.resize(nu, nrhs);
+    if (nu == 0 || nrhs == 0)
+        return;
+
+    realizeMassMatrixFactorization(s);
+    const SBMassMatrixFactorizationCache& mfc = 
+        getMassMatrixFactorizationCache(s);
+
+    // Work one column at a time in contiguous temporary storage.
+    Vector x(nu);
+    for (int j=0; j < nrhs; ++j) {
+        x = F(j);
+        solveInPlaceUsingLTDL(mfc, &x[0]);
+        MInvF(j) = x;
+    }
+}
+
+void SimbodyMatterSubsystemRep::solveUsingMassMatrixFactorization
+   (const State& s, const Vector& f, Vector& MInvf) const
+{
+    const int nu = getTotalDOF();
+    assert(f.size() == nu);
+
+    MInvf.resize(nu);
+    if (nu == 0)
+        return;
+
+    realizeMassMatrixFactorization(s);
+    const SBMassMatrixFactorizationCache& mfc = 
+        getMassMatrixFactorizationCache(s);
+
+    if (MInvf.hasContiguousData()) {
+        MInvf = f;
+        solveInPlaceUsingLTDL(mfc, &MInvf[0]);
+    } else {
+        Vector x(f);
+        solveInPlaceUsingLTDL(mfc, &x[0]);
+        MInvf = x;
     }
 }
 
@@ -6090,6 +8317,17 @@ void SimbodyMatterSubsystemRep::multiplyBySystemJacobianTranspose
    (const State&                s, 
     const Vector_<SpatialVec>&  X,
     Vector&                     JtX) const
+{
+    Vector_<SpatialVec> zTemp(getNumBodies());
+    multiplyBySystemJacobianTranspose(s, X, JtX, zTemp);
+}
+
+// Same, with caller-supplied workspace which will be resized to nb.
+void SimbodyMatterSubsystemRep::multiplyBySystemJacobianTranspose
+   (const State&                s, 
+    const Vector_<SpatialVec>&  X,
+    Vector&                     JtX,
+    Vector_<SpatialVec>&        zTemp) const
 {
     assert(X.size() == getNumBodies());
     JtX.resize(getNU(s));
@@ -6098,7 +8336,7 @@ void SimbodyMatterSubsystemRep::multiplyBySystemJacobianTranspose
 
     const SBTreePositionCache& tpc = getTreePositionCache(s);
 
-    Vector_<SpatialVec> zTemp(getNumBodies()); zTemp.setToZero();
+    zTemp.resize(getNumBodies()); zTemp.setToZero();
     const SpatialVec* xPtr = X.size() ? &X[0] : NULL;
     Real* jtxPtr = JtX.size() ? &JtX[0] : NULL;
     SpatialVec* zPtr = zTemp.size() ? &zTemp[0] : NULL;
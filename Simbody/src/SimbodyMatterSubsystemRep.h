@@ -141,7 +141,13 @@ private:
 class SimbodyMatterSubsystemRep : public SimTK::Subsystem::Guts {
 public:
     SimbodyMatterSubsystemRep() 
-      : Subsystem::Guts("SimbodyMatterSubsystem", "0.7.1")
+      : Subsystem::Guts("SimbodyMatterSubsystem", "0.7.1"),
+        treeSweepExecutor(0), numTreeSweepThreads(0),
+        minNodesPerParallelLevel(32), useTypeBatchedTreeSweeps(false),
+        useIncrementalPositionRealization(false),
+        useModifiedNewtonForMultipliers(false),
+        useBlockConstraintSolver(false),
+        useModifiedNewtonForProjection(false), projectionReuseTolerance(0.25)
     { 
         clearTopologyCache();
     }
@@ -157,6 +163,7 @@ public:
         invalidateSubsystemTopologyCache();
         clearTopologyCache(); // should do cache before state
         clearTopologyState();
+        delete treeSweepExecutor;
     }
 
     SimbodyMatterSubsystemRep* cloneImpl() const {
@@ -462,9 +469,14 @@ public:
     // Call at Position Stage or later.
     void realizeArticulatedBodyInertias(const State&) const;
 
+    // Call at Position Stage or later. Composite body inertias will be 
+    // realized first if necessary.
+    void realizeMassMatrixFactorization(const State&) const;
+
     // These are just used in timing tests.
     void invalidateCompositeBodyInertias(const State&) const;
     void invalidateArticulatedBodyInertias(const State&) const;
+    void invalidateMassMatrixFactorization(const State&) const;
 
         // OPERATORS //
 
@@ -501,6 +513,11 @@ public:
     void multiplyBySystemJacobianTranspose(const State&, 
         const Vector_<SpatialVec>& X, 
         Vector&                    JtX) const;
+    // Same, using zTemp as workspace.
+    void multiplyBySystemJacobianTranspose(const State&, 
+        const Vector_<SpatialVec>& X, 
+        Vector&                    JtX,
+        Vector_<SpatialVec>&       zTemp) const;
 
     // Given a set of body forces, return the equivalent set of mobilizer torques 
     // IGNORING CONSTRAINTS.
@@ -535,19 +552,64 @@ public:
         const Vector&                   f,
         Vector&                         MInvf) const; 
 
-    // Calculate the mass matrix in O(n^2) time. State must have already
+    // Multiple right-hand side versions of the above, in a single pair of
+    // sweeps for all the columns. Matrices must be stored contiguously by
+    // columns; the output may be the same matrix as the input.
+    void multiplyByM(const State&   s,
+        const Matrix&               A,
+        Matrix&                     MA) const;
+    void multiplyByMInv(const State& s,
+        const Matrix&               F,
+        Matrix&                     MInvF) const;
+
+    // Same as the multiple-column multiplyByMInv() but also returns the 
+    // resulting body accelerations A_GB=J*M^-1*F for every column, stored by
+    // body with element (mbx,c) at A_GB[mbx*ncol+c].
+    void multiplyByMInvWithBodyAccelerations(const State& s,
+        const Matrix&               F,
+        Matrix&                     MInvF,
+        Array_<SpatialVec>&         A_GB) const;
+
+    // Calculate the inverse operational space inertia J*M^-1*~J for a set of
+    // station or frame tasks in O(n*nt) time without forming J, reusing the
+    // previous result if the same tasks were requested since q last changed.
+    void calcOperationalSpaceInertiaInverse(const State&    s,
+        bool                                isFrameTask,
+        const Array_<MobilizedBodyIndex>&   onBodyB,
+        const Array_<Vec3>&                 pointInB,
+        Matrix&                             LambdaInv) const;
+
+    // Implementation of multiplyByMInv() for multiple columns. Arguments must
+    // already have been checked and sized; A_GB has nb*ncol elements.
+    void calcMInvFAndBodyAccelerations(const State& s,
+        const Matrix&               F,
+        Matrix&                     MInvF,
+        Array_<SpatialVec>&         A_GB) const;
+
+    // Calculate the mass matrix in O(n*d) time, where d is the depth of the
+    // tree in mobilities (so O(n^2) at worst), using the composite body
+    // inertias, which will be realized if necessary. State must have already
     // been realized to Position stage. M must be resizeable or already the
     // right size (nXn). The result is symmetric but the entire matrix is
     // filled in.
     void calcM(const State& s, Matrix& M) const;
 
-    // Calculate the mass matrix inverse in O(n^2) time. State must have already
-    // been realized to Position stage. MInv must be resizeable or already the
-    // right size (nXn). The result is symmetric but the entire matrix is
-    // filled in. Only the non-prescribed block Mrr is inverted; other elements
-    // are not written.
+    // Calculate the mass matrix inverse in O(n^2) time, using O(n) workspace.
+    // State must have already been realized to Position stage. MInv must be
+    // resizeable or already the right size (nXn). The result is symmetric but
+    // the entire matrix is filled in. Only the non-prescribed block Mrr is inverted; rows and
+    // columns corresponding to prescribed mobilities are set to zero.
     void calcMInv(const State& s, Matrix& MInv) const;
 
+    // Solve M*X=F for the free mobilities using the cached factorization of
+    // M, realizing it first if necessary. F and MInvF may be non-contiguous.
+    void solveUsingMassMatrixFactorization(const State&    s,
+                                           const Matrix&   F,
+                                           Matrix&         MInvF) const;
+    void solveUsingMassMatrixFactorization(const State&    s,
+                                           const Vector&   f,
+                                           Vector&         MInvf) const;
+
     void calcTreeResidualForces(const State&,
         const Vector&               appliedMobilityForces,
         const Vector_<SpatialVec>&  appliedBodyForces,
@@ -732,6 +794,18 @@ public:
        Array_<SpatialVec>&  constrainedBodyForcesInG,
        Array_<Real>&        contraintMobilityForces) const;
 
+    // Same, with caller-supplied arrays for one Constraint's multipliers.
+    void calcConstraintForcesFromMultipliers
+      (const State&         state, 
+       const Vector&        lambda,
+       Vector_<SpatialVec>& bodyForcesInG,
+       Vector&              mobilityForces,
+       Array_<SpatialVec>&  constrainedBodyForcesInG,
+       Array_<Real>&        contraintMobilityForces,
+       Array_<Real>&        lambdap,
+       Array_<Real>&        lambdav,
+       Array_<Real>&        lambdaa) const;
+
     // Call this signature if you don't care about the individual constraint
     // contributions.
     void calcConstraintForcesFromMultipliers
@@ -758,7 +832,19 @@ public:
                                 bool             includeV,
                                 bool             includeA,
                                 const Vector&    lambda,
-                                Vector&          fu) const;
+                                Vector&          fu) const
+    {   SBPVATransposeWorkspace ws;
+        multiplyByPVATranspose(state,includeP,includeV,includeA,lambda,fu,ws); }
+
+    // Same, but with caller-supplied temporaries so that repeated calls 
+    // don't allocate.
+    void multiplyByPVATranspose(const State&             state,
+                                bool                     includeP,
+                                bool                     includeV,
+                                bool                     includeA,
+                                const Vector&            lambda,
+                                Vector&                  fu,
+                                SBPVATransposeWorkspace& ws) const;
 
     // Explicitly form the u-space constraint Jacobian transpose 
     // ~G=[~P ~V ~A] or selected submatrices of it. Performance is best if the 
@@ -773,6 +859,32 @@ public:
                             bool             includeA,
                             Matrix&          PVAt) const;
 
+    // Form [P;V;A] or selected submatrices of it in compressed sparse row
+    // (CSR) format, using the constraint force methods as for
+    // calcPVATranspose(). Only the participating mobilities of each Constraint
+    // are stored; column indices are increasing within each row. On return
+    // rowStart has length m+1 and row i occupies elements
+    // [rowStart[i],rowStart[i+1]) of colIndex and values. Cost is proportional
+    // to the number of stored elements rather than m*n.
+    void calcPVASparse( const State&     state,
+                        bool             includeP,
+                        bool             includeV,
+                        bool             includeA,
+                        Array_<int>&     rowStart,
+                        Array_<int>&     colIndex,
+                        Array_<Real>&    values) const;
+
+    // Same as calcPVASparse() but returns the transpose [~P ~V ~A] in CSR
+    // format, which is the same as [P;V;A] in compressed sparse column (CSC)
+    // format. Row indices are increasing within each column.
+    void calcPVATransposeSparse(const State&     state,
+                                bool             includeP,
+                                bool             includeV,
+                                bool             includeA,
+                                Array_<int>&     colStart,
+                                Array_<int>&     rowIndex,
+                                Array_<Real>&    values) const;
+
     // Form the product 
     //    fq = [ ~Pq ] * lambdap
     // The multiplier-like vector must have length m=mp always.
@@ -799,7 +911,17 @@ public:
                                   bool         includeP,
                                   bool         includeV,
                                   bool         includeA,
-                                  Vector&      bias) const;
+                                  Vector&      bias) const
+    {   SBPVABiasWorkspace ws;
+        calcBiasForMultiplyByPVA(state,includeP,includeV,includeA,bias,ws); }
+
+    // Same, with caller-supplied temporaries.
+    void calcBiasForMultiplyByPVA(const State&        state,
+                                  bool                includeP,
+                                  bool                includeV,
+                                  bool                includeA,
+                                  Vector&             bias,
+                                  SBPVABiasWorkspace& ws) const;
 
     // Calculate the bias vector from the acceleration constraint error
     // equations used. Here bias is what you would get from paerr, vaerr,
@@ -830,7 +952,19 @@ public:
                        bool             includeA,
                        const Vector&    bias,
                        const Vector&    ulike,
-                       Vector&          PVAu) const;
+                       Vector&          PVAu) const
+    {   SBPVAWorkspace ws;
+        multiplyByPVA(state,includeP,includeV,includeA,bias,ulike,PVAu,ws); }
+
+    // Same, with caller-supplied temporaries.
+    void multiplyByPVA(const State&     state,
+                       bool             includeP,
+                       bool             includeV,
+                       bool             includeA,
+                       const Vector&    bias,
+                       const Vector&    ulike,
+                       Vector&          PVAu,
+                       SBPVAWorkspace&  ws) const;
 
     // Explicitly form the u-space constraint Jacobian G=[P;V;A] or 
     // selected submatrices of it. Performance is best if the output matrix 
@@ -853,7 +987,15 @@ public:
     void multiplyByPq(  const State&   state,
                         const Vector&  bias_p,
                         const Vector&  qlike,
-                        Vector&        PqXqlike) const;
+                        Vector&        PqXqlike) const
+    {   SBPVAWorkspace ws; multiplyByPq(state,bias_p,qlike,PqXqlike,ws); }
+
+    // Same, with caller-supplied temporaries.
+    void multiplyByPq(  const State&    state,
+                        const Vector&   bias_p,
+                        const Vector&   qlike,
+                        Vector&         PqXqlike,
+                        SBPVAWorkspace& ws) const;
 
     // Explicitly form the q-space holonomic constraint Jacobian Pq (= P*N^-1).
     // Performance is best if the output matrix has columns stored contiguously
@@ -870,12 +1012,23 @@ public:
     // are holonomic in which case Position will do. This matrix is used
     // when solving for Lagrange multipliers: (G M^-1 G^T) lambda = aerr
     // gives values for lambda that elimnate aerr.
-    // Performance is best if the output matrix has columns stored 
-    // contiguously in memory, but this method will work anyway, in that case
-    // using a contiguous temporary for column calculations and then copying
-    // out into the result.
+    // The output matrix need not have contiguous columns.
     void calcGMInvGt(const State&   state,
-                     Matrix&        GMInvGt) const;
+                     Matrix&        GMInvGt) const
+    {   SBGMInvGtWorkspace ws; calcGMInvGt(state, GMInvGt, ws); }
+
+    // Same, with caller-supplied temporaries.
+    void calcGMInvGt(const State&        state,
+                     Matrix&             GMInvGt,
+                     SBGMInvGtWorkspace& ws) const;
+
+    // Calculate only the diagonal blocks GMInvGt(rows[k],rows[k]) of the
+    // mXm matrix G M^-1 ~G, without forming the whole thing. This takes the
+    // same m multiplications by ~G, M^-1, and G that calcGMInvGt() does but
+    // needs only an n X (largest block size) temporary.
+    void calcGMInvGtBlocks(const State&                 state,
+                           const Array_< Array_<int> >& rows,
+                           Array_<Matrix>&              blocks) const;
 
     // Use factored GMInvGt to solve GMinvGt*impulse=deltaV. The main benefit
     // of this method is that it promises to use the same method Simbody does
@@ -884,6 +1037,45 @@ public:
                                     const Vector&    deltaV,
                                     Vector&          impulse) const;
 
+    // Return the factored GMInvGt for the current state, calculating it if
+    // necessary. The factorization is saved in the State cache until q
+    // changes, or until q or u changes if there are any nonholonomic or
+    // acceleration-only constraints in use. Must have at least one
+    // constraint equation in use.
+    const ConstraintFactorization& 
+    realizeGMInvGtFactorization(const State&) const;
+
+    // Return the partition of the constraint equations into independent
+    // blocks, calculating it if necessary. Requires Instance stage.
+    const SBConstraintBlockCache& realizeConstraintBlocks(const State&) const;
+
+    // What the columns of a constraint-space matrix represent; see
+    // factorConstraintMatrix().
+    enum ConstraintMatrixColumns {
+        ColumnsAreFreeQ,        // like Pq restricted to free q's
+        ColumnsAreFreeU         // like [P;V] restricted to free u's
+    };
+
+    // Factor a matrix whose rows correspond to the first A.nrow() rows of
+    // [P;V;A] and whose columns are as described by columnKind. This uses
+    // a single FactorQTZ normally, or independent blocks if the block
+    // constraint solver has been requested with setUseBlockConstraintSolver().
+    void factorConstraintMatrix(const State&                s,
+                                const Matrix&               A,
+                                ConstraintMatrixColumns     columnKind,
+                                Real                        rcondTol,
+                                ConstraintFactorization&    factorization) const;
+
+    // Solve GMInvGt*multipliers=udotErr for the constraint multipliers as
+    // for forward dynamics. Normally this uses the factorization returned by
+    // realizeGMInvGtFactorization(). If modified Newton mode is enabled,
+    // we first try iterating with the last factorization we computed,
+    // possibly at a different configuration, and refactor only if that
+    // doesn't converge quickly.
+    void solveForMultipliers(const State&     state,
+                             const Vector&    udotErr,
+                             Vector&          multipliers) const;
+
     // Given an array of nu udots, return nb body accelerations in G (including
     // Ground as the 0th body with A_GB[0]=0). The returned accelerations are
     // A = J*udot + Jdot*u, with the Jdot*u (coriolis acceleration) term
@@ -908,7 +1100,18 @@ public:
         const Vector_<SpatialVec>&  A_GB,
         const Vector_<Real>&        udot,
         const Vector_<Real>&        qdotdot,
-        Vector&                     pvaerr) const;
+        Vector&                     pvaerr) const
+    {   SBConstraintErrorsWorkspace ws;
+        calcConstraintAccelerationErrors(state,A_GB,udot,qdotdot,pvaerr,ws); }
+
+    // Same, with caller-supplied temporaries.
+    void calcConstraintAccelerationErrors
+       (const State&                 state,
+        const Vector_<SpatialVec>&   A_GB,
+        const Vector_<Real>&         udot,
+        const Vector_<Real>&         qdotdot,
+        Vector&                      pvaerr,
+        SBConstraintErrorsWorkspace& ws) const;
 
     // This is a solver which generates internal velocities from spatial ones.
     void velFromCartesian(const Vector& pos, Vector& vel) {assert(false);/*TODO*/}
@@ -1008,6 +1211,55 @@ public:
             (updCacheEntry(s,topologyCache.compositeBodyInertiaCacheIndex));
     }
 
+    const SBMassMatrixFactorizationCache& getMassMatrixFactorizationCache(const State& s) const {
+        return Value<SBMassMatrixFactorizationCache>::downcast
+            (getCacheEntry(s,topologyCache.massMatrixFactorizationCacheIndex));
+    }
+    SBMassMatrixFactorizationCache& updMassMatrixFactorizationCache(const State& s) const { //mutable
+        return Value<SBMassMatrixFactorizationCache>::updDowncast
+            (updCacheEntry(s,topologyCache.massMatrixFactorizationCacheIndex));
+    }
+
+    SBOperationalSpaceInertiaCache& updOperationalSpaceInertiaCache(const State& s) const { //mutable
+        return Value<SBOperationalSpaceInertiaCache>::updDowncast
+            (updCacheEntry(s,topologyCache.operationalSpaceInertiaCacheIndex));
+    }
+
+    // This is a lazy Position or Velocity stage cache entry depending on
+    // whether all the constraints in use are holonomic.
+    CacheEntryIndex getGMInvGtFactorizationCacheIndex(const State& s) const {
+        return getNumNonholonomicConstraintEquationsInUse(s) == 0
+            && getNumAccelerationOnlyConstraintEquationsInUse(s) == 0
+            ? topologyCache.gMInvGtFactorizationPositionCacheIndex
+            : topologyCache.gMInvGtFactorizationVelocityCacheIndex;
+    }
+    SBGMInvGtFactorizationCache& updGMInvGtFactorizationCache(const State& s) const { //mutable
+        return Value<SBGMInvGtFactorizationCache>::updDowncast
+            (updCacheEntry(s,getGMInvGtFactorizationCacheIndex(s)));
+    }
+    // This one depends only on Instance stage so is always accessed for
+    // update, even just to read it.
+    SBGMInvGtFactorizationCache& updReusableGMInvGtFactorizationCache(const State& s) const { //mutable
+        return Value<SBGMInvGtFactorizationCache>::updDowncast
+            (updCacheEntry(s,topologyCache.reusableGMInvGtFactorizationCacheIndex));
+    }
+    // These are used by projectQ() and projectU() and also depend only on
+    // Instance stage.
+    SBProjectionFactorizationCache& updReusableQProjectionCache(const State& s) const { //mutable
+        return Value<SBProjectionFactorizationCache>::updDowncast
+            (updCacheEntry(s,topologyCache.reusableQProjectionCacheIndex));
+    }
+    SBProjectionFactorizationCache& updReusableUProjectionCache(const State& s) const { //mutable
+        return Value<SBProjectionFactorizationCache>::updDowncast
+            (updCacheEntry(s,topologyCache.reusableUProjectionCacheIndex));
+    }
+    // Scratch space for methods that realize or project the State; see
+    // SBWorkspaceCache for who may use it.
+    SBWorkspaceCache& updWorkspaceCache(const State& s) const { //mutable
+        return Value<SBWorkspaceCache>::updDowncast
+            (updCacheEntry(s,topologyCache.workspaceCacheIndex));
+    }
+
     const SBArticulatedBodyInertiaCache& getArticulatedBodyInertiaCache(const State& s) const {
         return Value<SBArticulatedBodyInertiaCache>::downcast
             (getCacheEntry(s,topologyCache.articulatedBodyInertiaCacheIndex));
@@ -1135,6 +1387,75 @@ public:
     bool getShowDefaultGeometry() const;
     void setShowDefaultGeometry(bool show);
 
+    void setUseParallelTreeSweeps(bool useParallel, int numThreads);
+    bool getUseParallelTreeSweeps() const {return treeSweepExecutor != 0;}
+    void setMinNodesPerParallelLevel(int minNodes);
+    int getMinNodesPerParallelLevel() const {return minNodesPerParallelLevel;}
+    bool isUsingBranchParallelTreeSweeps() const;
+    int getNumTreeSweepBranchBins() const {return (int)treeSweepBins.size();}
+
+    void setUseTypeBatchedTreeSweeps(bool batched)
+    {   useTypeBatchedTreeSweeps = batched; }
+    bool getUseTypeBatchedTreeSweeps() const {return useTypeBatchedTreeSweeps;}
+
+    void setUseIncrementalPositionRealization(bool incremental)
+    {   useIncrementalPositionRealization = incremental; }
+    bool getUseIncrementalPositionRealization() const
+    {   return useIncrementalPositionRealization; }
+    int getNumBodyPositionRealizations() const
+    {   return numBodyPositionRealizations; }
+    void resetPositionRealizationStatistics()
+    {   numBodyPositionRealizations = 0; }
+
+    // Calculate the tree kinematics that are normally computed at the start
+    // of realizing stage g (Position or Velocity) for a collection of States
+    // of this system, which must all be at stage g-1. The States are swept
+    // through the tree together; see MultibodySystem::realizeEnsemble().
+    // Realizing stage g must follow immediately and won't repeat the sweep;
+    // if that isn't going to happen call cancelTreeEnsemble().
+    void realizeTreeEnsemble(const Array_<const State*>& states, 
+                             Stage g) const;
+    void cancelTreeEnsemble(const State& state, Stage g) const;
+
+    void setUseModifiedNewtonForMultipliers(bool useModifiedNewton)
+    {   useModifiedNewtonForMultipliers = useModifiedNewton; }
+    bool getUseModifiedNewtonForMultipliers() const
+    {   return useModifiedNewtonForMultipliers; }
+    int getNumMultiplierFactorizations() const
+    {   return numMultiplierFactorizations; }
+    int getNumMultiplierReuses() const {return numMultiplierReuses;}
+    void resetMultiplierStatistics()
+    {   numMultiplierFactorizations = 0; numMultiplierReuses = 0; }
+
+    void setUseBlockConstraintSolver(bool useBlocks)
+    {   useBlockConstraintSolver = useBlocks; }
+    bool getUseBlockConstraintSolver() const
+    {   return useBlockConstraintSolver; }
+    int getNumConstraintBlocks(const State& s) const
+    {   return useBlockConstraintSolver 
+            ? (int)realizeConstraintBlocks(s).rows.size() : 0; }
+    int getNumRankDeficientConstraintBlocks(const State& s) const;
+
+    void setUseModifiedNewtonForProjection(bool useModifiedNewton)
+    {   useModifiedNewtonForProjection = useModifiedNewton; }
+    bool getUseModifiedNewtonForProjection() const
+    {   return useModifiedNewtonForProjection; }
+    void setProjectionReuseTolerance(Real tol);
+    Real getProjectionReuseTolerance() const
+    {   return projectionReuseTolerance; }
+
+    int getNumProjectQFactorizations() const {return numProjectQFactorizations;}
+    int getNumProjectQReuses() const {return numProjectQReuses;}
+    int getNumProjectUFactorizations() const {return numProjectUFactorizations;}
+    int getNumProjectUReuses() const {return numProjectUReuses;}
+    void resetProjectionStatistics() {
+        numProjectQFactorizations = 0; numProjectQReuses = 0;
+        numProjectUFactorizations = 0; numProjectUReuses = 0;
+    }
+
+    // The last argument of these two operators is scratch space to use
+    // instead of local temporaries; pass the State's workspace cache only
+    // when realizing, or zero otherwise.
     void calcTreeForwardDynamicsOperator(const State&,
         const Vector&                   mobilityForces,
         const Vector_<Vec3>&            particleForces,
@@ -1144,7 +1465,8 @@ public:
         SBTreeAccelerationCache&        tac,    // kinematics & prescribed forces into here
         Vector&                         udot,   // in/out (in for prescribed udot)
         Vector&                         qdotdot,
-        Vector&                         udotErr) const;
+        Vector&                         udotErr,
+        SBWorkspaceCache*               ws) const;
 
     void calcLoopForwardDynamicsOperator(const State&, 
         const Vector&                   mobilityForces,
@@ -1155,7 +1477,8 @@ public:
         Vector&                         udot,   // in/out (in for prescribed udot)
         Vector&                         qdotdot,
         Vector&                         multipliers,
-        Vector&                         udotErr) const;
+        Vector&                         udotErr,
+        SBWorkspaceCache*               ws) const;
 
     // Given a set of forces, calculate accelerations ignoring
     // constraints, and leave the results in the state cache. 
@@ -1179,20 +1502,22 @@ public:
         const Vector_<Vec3>&       particleForces,
         const Vector_<SpatialVec>& bodyForces) const;
 
-    // calc ~(Tp Pq Wq^-1)_r (nfq X mp)
-    void calcWeightedPqrTranspose(   
-        const State&     state,
-        const Vector&    Tp,    // 1/perr tols
-        const Vector&    Wqinv, // 1/q weights
-        Matrix&          Pqrt) const;
-
-    // calc ~(Tp P Wu^-1)
-    //       (Tv V Wu^-1)_r (nfu X (mp+mv))
-    void calcWeightedPVrTranspose(
-        const State&     s,
-        const Vector&    Tpv,   // 1/verr tols
-        const Vector&    Wuinv, // 1/u weights
-        Matrix&          PVrt) const;
+    // calc (Tp Pq Wq^-1)_r (mp X nfq), using the workspace for temporaries
+    void calcWeightedPqr(   
+        const State&        state,
+        const Vector&       Tp,    // 1/perr tols
+        const Vector&       Wuinv, // 1/u weights
+        Matrix&             Pqr,
+        SBWorkspaceCache&   ws) const;
+
+    // calc (Tp P Wu^-1)
+    //      (Tv V Wu^-1)_r ((mp+mv) X nfu), using the workspace for temporaries
+    void calcWeightedPVr(
+        const State&        s,
+        const Vector&       Tpv,   // 1/verr tols
+        const Vector&       Wuinv, // 1/u weights
+        Matrix&             PVr,
+        SBWorkspaceCache&   ws) const;
 
     const Array_<QIndex>& getFreeQIndex(const State& state) const;
     const Array_<QIndex>& getPresQIndex(const State& state) const;
@@ -1289,6 +1614,42 @@ private:
     // Map nodeNum (a.k.a. MobilizedBodyIndex) to (level,offset).
     Array_<RigidBodyNodeIndex,MobilizedBodyIndex> nodeNum2NodeMap;
 
+    // Apply a per-node operator to every node in a level, or to every node
+    // in base-to-tip (outward) or tip-to-base (inward) order. NodeOp must
+    // provide operator()(const RigidBodyNode&) const, and may also provide a
+    // type-batched version (see NodeBatch). When parallel tree sweeps are
+    // enabled the sweeps are done branch-by-branch or level-by-level on
+    // worker threads; see setUseParallelTreeSweeps().
+    // Defined in SimbodyMatterSubsystemRep.cpp.
+    template <class NodeOp> void applyToLevel(int level, const NodeOp&) const;
+    template <class NodeOp> void sweepOutward(const NodeOp&) const;
+    template <class NodeOp> void sweepInward(const NodeOp&) const;
+    bool shouldUseBranchParallelSweeps() const;
+
+    // Apply one NodeOp per ensemble member in a single outward sweep; each
+    // node is processed for all the members before moving on. With parallel
+    // tree sweeps the members are divided among the worker threads instead.
+    template <class NodeOp> 
+    void sweepOutwardEnsemble(const Array_<NodeOp>& ops) const;
+
+    // The work done before and after the outward kinematic sweeps in 
+    // realizeSubsystemPosition() and realizeSubsystemVelocity(), shared with
+    // realizeTreeEnsemble(). prepareTreePositions() returns the nodes that 
+    // need recalculating if that's not all of them (see 
+    // setUseIncrementalPositionRealization()), otherwise null.
+    const bool* prepareTreePositions(const SBStateDigest&) const;
+    void finishTreePositions(const SBStateDigest&) const;
+    void finishTreeVelocities(const SBStateDigest&) const;
+
+    // Divide the tree into a serial trunk and independent branches assigned
+    // to treeSweepBins for branch-parallel sweeps. This depends on the
+    // topology and the number of threads so must be redone if either changes.
+    void partitionTreeForParallelSweeps();
+
+    // Fill in typeSortedNodeLevels and nodeBatchEnds; done once the tree is
+    // complete.
+    void groupNodesByTypeForSweeps();
+
         // Constraints
 
     // Here we sort the above constraints by branch (ancestor's base body), then by
@@ -1361,6 +1722,68 @@ private:
     
     // Specifies whether default decorative geometry should be shown.
     bool showDefaultGeometry;
+
+        // MULTITHREADING
+
+    // These are not part of the topology; they can be changed at any time
+    // and have no effect on results. The executor is null unless parallel
+    // tree sweeps have been requested; we own it.
+    ParallelExecutor*   treeSweepExecutor;
+    int                 numTreeSweepThreads;
+    int                 minNodesPerParallelLevel;
+
+    // Partition of the tree for branch-parallel sweeps. The trunk includes
+    // Ground and is processed serially; each bin is processed by one thread.
+    // All these lists are in base-to-tip order. These are empty if
+    // branch-parallel sweeps would not pay off for this tree.
+    RBNodePtrList           treeSweepTrunk;
+    Array_<RBNodePtrList>   treeSweepBins;
+
+    // The same nodes as in rbNodeLevels, but sorted by concrete type within
+    // each level. nodeBatchEnds[i][j] is one past the last node in level i
+    // that has the same type as node j there. These are used by level sweeps
+    // when useTypeBatchedTreeSweeps is set (the default).
+    Array_<RBNodePtrList>   typeSortedNodeLevels;
+    Array_< Array_<int> >   nodeBatchEnds;
+    bool                    useTypeBatchedTreeSweeps;
+
+    // If set, realizePosition() recalculates kinematics only for bodies whose
+    // q's have changed since the State's tree position cache was last
+    // calculated, and their descendents. Not part of the topology; results
+    // are the same either way.
+    bool                    useIncrementalPositionRealization;
+
+        // CONSTRAINT MULTIPLIERS
+
+    // If set, forward dynamics tries to reuse a GMInvGt factorization from a
+    // previous configuration; see solveForMultipliers(). Not part of the
+    // topology; results agree to within a tight tolerance either way.
+    bool                    useModifiedNewtonForMultipliers;
+
+    // Statistics; these are updated by const solves, possibly for different
+    // States on different threads, so must be atomic.
+    mutable AtomicInteger   numMultiplierFactorizations, numMultiplierReuses;
+
+    // If set, constraint-space matrices are factored by independent blocks
+    // rather than as a whole; see factorConstraintMatrix().
+    bool                    useBlockConstraintSolver;
+
+        // CONSTRAINT PROJECTION
+
+    // If set, projectQ() and projectU() start with the factorization from the
+    // last projection and keep using it as long as each iteration reduces
+    // the error norm by at least the reuse tolerance factor.
+    bool                    useModifiedNewtonForProjection;
+    Real                    projectionReuseTolerance;
+
+    // Statistics; these are updated by const projection methods, possibly
+    // from several threads projecting different States at once.
+    mutable AtomicInteger   numProjectQFactorizations, numProjectQReuses;
+    mutable AtomicInteger   numProjectUFactorizations, numProjectUReuses;
+
+    // Statistics; the number of bodies whose kinematics have been calculated
+    // by realizePosition(), which may be running on several threads.
+    mutable AtomicInteger   numBodyPositionRealizations;
 };
 
 std::ostream& operator<<(std::ostream&, const SimbodyMatterSubsystemRep&);
@@ -63,9 +63,12 @@ receive a state evaluated to stage Whatever-1 equipped with values for stage
 Whatever so that it can calculate results and put them in the cache (which is 
 allocated if necessary), and then advance to stage Whatever. */
 
+#include "SimTKmath.h"
 #include "simbody/internal/common.h"
 #include "simbody/internal/Motion.h"
 
+#include "ConstraintFactorization.h"
+
 #include <cassert>
 #include <iostream>
 using std::cout; using std::endl;
@@ -86,7 +89,13 @@ class SBTimeCache;
 class SBTreePositionCache;
 class SBConstrainedPositionCache;
 class SBCompositeBodyInertiaCache;
+class SBMassMatrixFactorizationCache;
+class SBOperationalSpaceInertiaCache;
 class SBArticulatedBodyInertiaCache;
+class SBGMInvGtFactorizationCache;
+class SBProjectionFactorizationCache;
+class SBConstraintBlockCache;
+class SBWorkspaceCache;
 class SBTreeVelocityCache;
 class SBConstrainedVelocityCache;
 class SBDynamicsCache;
@@ -151,7 +160,16 @@ public:
     CacheEntryIndex       modelingCacheIndex,instanceCacheIndex, timeCacheIndex, 
                           treePositionCacheIndex, constrainedPositionCacheIndex,
                           compositeBodyInertiaCacheIndex, 
+                          massMatrixFactorizationCacheIndex,
+                          operationalSpaceInertiaCacheIndex,
                           articulatedBodyInertiaCacheIndex,
+                          gMInvGtFactorizationPositionCacheIndex,
+                          gMInvGtFactorizationVelocityCacheIndex,
+                          reusableGMInvGtFactorizationCacheIndex,
+                          reusableQProjectionCacheIndex,
+                          reusableUProjectionCacheIndex,
+                          constraintBlockCacheIndex,
+                          workspaceCacheIndex,
                           treeVelocityCacheIndex, constrainedVelocityCacheIndex,
                           dynamicsCacheIndex, 
                           treeAccelerationCacheIndex, 
@@ -646,6 +664,31 @@ public:
 
 class SBTreePositionCache {
 public:
+    SBTreePositionCache() 
+    :   isQLastRealizedKnown(false), isRealizedByEnsemble(false) {}
+    // Everything is copied except isRealizedByEnsemble, which applies only
+    // to the State in which it was set.
+    SBTreePositionCache(const SBTreePositionCache& src) {*this = src;}
+    SBTreePositionCache& operator=(const SBTreePositionCache& src) {
+        if (&src == this) return *this;
+        mobilizerQCache = src.mobilizerQCache;
+        storageForH_FM  = src.storageForH_FM;
+        storageForH     = src.storageForH;
+        bodyJointInParentJointFrame = src.bodyJointInParentJointFrame;
+        bodyConfigInParent          = src.bodyConfigInParent;
+        bodyConfigInGround          = src.bodyConfigInGround;
+        bodyToParentShift           = src.bodyToParentShift;
+        bodySpatialInertiaInGround  = src.bodySpatialInertiaInGround;
+        bodyCOMInGround             = src.bodyCOMInGround;
+        constrainedBodyConfigInAncestor = src.constrainedBodyConfigInAncestor;
+        isQLastRealizedKnown            = src.isQLastRealizedKnown;
+        qLastRealized                   = src.qLastRealized;
+        quaternionErrLastRealized       = src.quaternionErrLastRealized;
+        bodyNeedsRealization            = src.bodyNeedsRealization;
+        isRealizedByEnsemble            = false; // never copied
+        return *this;
+    }
+
     const Transform& getX_FM(MobilizedBodyIndex mbx) const {return bodyJointInParentJointFrame[mbx];}
     Transform&       updX_FM(MobilizedBodyIndex mbx)       {return bodyJointInParentJointFrame[mbx];}
     const Transform& getX_PB(MobilizedBodyIndex mbx) const {return bodyConfigInParent[mbx];}
@@ -699,6 +742,28 @@ public:
     // the Ancestor frame rather than Ground.
     Array_<Transform> constrainedBodyConfigInAncestor;   // nacb (X_AB)
 
+        // Incremental realization
+
+    // When incremental position realization is enabled, this is the q from
+    // which the per-body quantities above were last calculated, and the
+    // quaternion normalization errors that were calculated then (since qErr
+    // is not preserved when a State is copied). These are meaningless unless
+    // isQLastRealizedKnown is set; it isn't after allocation or after a
+    // realization that did not complete.
+    bool   isQLastRealizedKnown;
+    Vector qLastRealized;                               // nq
+    Vector quaternionErrLastRealized;                   // nquat
+
+    // Scratch: which bodies need their kinematics recalculated during the
+    // current incremental realization.
+    Array_<bool,MobilizedBodyIndex> bodyNeedsRealization; // nb
+
+    // Set when this State's tree kinematics were calculated along with other
+    // States by realizeTreeEnsemble(), which is immediately followed by the
+    // realizePosition() that clears it. This can't be determined from the 
+    // cache entry's validity since that depends only on Time stage.
+    bool isRealizedByEnsemble;
+
 public:
     void allocate(const SBTopologyCache& tree,
                   const SBModelCache&    model,
@@ -739,6 +804,10 @@ public:
         bodyCOMInGround[GroundIndex] = Vec3(0);
 
         constrainedBodyConfigInAncestor.resize(nacb);
+
+        isQLastRealizedKnown = false;
+        bodyNeedsRealization.resize(nBodies);
+        isRealizedByEnsemble = false;
     }
 };
 //.......................... TREE POSITION CACHE ...............................
@@ -821,6 +890,75 @@ public:
 
 
 
+// =============================================================================
+//                       MASS MATRIX FACTORIZATION CACHE
+// =============================================================================
+// This is a sparse factorization M = ~L*D*L of the part of the mass matrix 
+// corresponding to free (non-prescribed) mobilities, where L is unit lower
+// triangular and D is diagonal (Featherstone's LTDL factorization). Because
+// M is the mass matrix of a tree, element M(i,j) (i>j) can be nonzero only if
+// mobility j is on the path from mobility i to Ground, and L has exactly the
+// same sparsity, so we store only those elements. Each free mobility has a 
+// "parent" mobility: the next free mobility inward from it, or -1 if there 
+// isn't one. Row i of L holds i's elements for its parent, grandparent, and
+// so on, in that order, starting at L[firstL[i]]. Prescribed mobilities have
+// no rows and appear in no other mobility's row.
+//
+// This is lazily evaluated at Position stage, after composite body inertias.
+class SBMassMatrixFactorizationCache {
+public:
+    Array_<bool> isPrescribed;  // nu
+    Array_<int>  parentU;       // nu; -1 if none
+    Array_<int>  firstL;        // nu+1; row i of L is [firstL[i],firstL[i+1])
+    Array_<Real> L;             // packed strictly lower triangle by rows
+    Array_<Real> D;             // nu
+
+public:
+    void allocate(const SBTopologyCache& tree,
+                  const SBModelCache&    model,
+                  const SBInstanceCache& instance) 
+    {
+        const int nu = tree.nDOFs;
+        isPrescribed.resize(nu);
+        parentU.resize(nu);
+        firstL.resize(nu+1);
+        D.resize(nu);
+        L.clear(); // size depends on prescribed motion; set when calculated
+    }
+};
+//..................... MASS MATRIX FACTORIZATION CACHE ........................
+
+
+
+// =============================================================================
+//                     OPERATIONAL SPACE INERTIA CACHE
+// =============================================================================
+// This holds the most recently requested inverse operational space inertia
+// Lambda^-1 = J*M^-1*~J along with the list of tasks that J represents, so 
+// that repeated requests for the same tasks at the same configuration are 
+// free. This is lazily evaluated at Position stage.
+class SBOperationalSpaceInertiaCache {
+public:
+    bool                        isFrameTask;    // else station task
+    Array_<MobilizedBodyIndex>  onBodyB;        // nt
+    Array_<Vec3>                pointInB;       // nt
+    Matrix                      LambdaInv;      // 3nt X 3nt or 6nt X 6nt
+
+public:
+    void allocate(const SBTopologyCache& tree,
+                  const SBModelCache&    model,
+                  const SBInstanceCache& instance) 
+    {
+        isFrameTask = false;
+        onBodyB.clear();
+        pointInB.clear();
+        LambdaInv.clear();
+    }
+};
+//................... OPERATIONAL SPACE INERTIA CACHE ..........................
+
+
+
 // =============================================================================
 //                       ARTICULATED BODY INERTIA CACHE
 // =============================================================================
@@ -895,6 +1033,176 @@ public:
 
 
 
+// =============================================================================
+//                        G M^-1 ~G FACTORIZATION CACHE
+// =============================================================================
+// The factored mXm matrix W=G*M^-1*~G used to solve for constraint multipliers
+// (W*lambda=aerr) and impulses. W depends only on t and q if all the
+// constraints in use are holonomic; otherwise it may also depend on u. We
+// keep a lazily-evaluated copy at each of those stages and use whichever one
+// applies. A third copy, depending only on Instance stage, is used for
+// "modified Newton" solves which reuse an old factorization across changes
+// in q and u; see SimbodyMatterSubsystemRep::solveForMultipliers().
+class SBGMInvGtFactorizationCache {
+public:
+    SBGMInvGtFactorizationCache() : m(-1) {}
+
+    ConstraintFactorization factorization;  // factored W
+    int m;  // dimension of W when factored; -1 if never factored
+};
+//...................... G M^-1 ~G FACTORIZATION CACHE .........................
+
+
+
+// =============================================================================
+//                      PROJECTION FACTORIZATION CACHE
+// =============================================================================
+// projectQ() and projectU() solve for least squares corrections using a
+// factorization of a weighted, transposed constraint matrix: Pq for q, [P;V]
+// for u. If reuse is enabled we keep the most recent factorization here,
+// depending only on Instance stage, so that it survives changes to q and u
+// and can be used again by later projections while they still converge well
+// with it. The weights it was calculated with are saved too since they
+// can change without invalidating anything but Report stage.
+class SBProjectionFactorizationCache {
+public:
+    SBProjectionFactorizationCache() : m(-1), nf(-1) {}
+
+    // Factored (row weights)*matrix*(column scale).
+    ConstraintFactorization factorization;
+    int         m, nf;      // dimensions when factored; -1 if never factored
+    Vector      rowWeights; // m of these
+    Vector      colScale;   // n of these (all mobilities, not just free)
+};
+//...................... PROJECTION FACTORIZATION CACHE ........................
+
+
+
+// =============================================================================
+//                          CONSTRAINT BLOCK CACHE
+// =============================================================================
+// Bodies in different branches of the multibody tree (that is, descended
+// from different children of Ground) don't interact through the mass matrix.
+// So constraints that don't share any branches, directly or through other 
+// constraints, have independent rows in G M^-1 ~G and in the constraint
+// matrices used for projection. This is the resulting partition into blocks 
+// of the constraint equations in use, numbered as the rows of [P;V;A], with
+// the free q's and free u's (numbered as packed by packFreeQ() and 
+// packFreeU()) of the branches each block affects. Mobilities in branches
+// with no constraints don't appear. This is a lazy Instance-stage entry,
+// calculated only if block factorization has been requested.
+class SBConstraintBlockCache {
+public:
+    Array_< Array_<int> > rows;     // sorted constraint equation numbers
+    Array_< Array_<int> > freeQ;    // sorted packed free q numbers
+    Array_< Array_<int> > freeU;    // sorted packed free u numbers
+};
+//........................... CONSTRAINT BLOCK CACHE ...........................
+
+
+
+// =============================================================================
+//                              WORKSPACE CACHE
+// =============================================================================
+// Temporaries for the constraint operators and for the calculations that call
+// them repeatedly while realizing and projecting a State: forming and
+// factoring G M^-1 ~G, loop forward dynamics, constraint errors, and the
+// projectQ()/projectU() iterations. Those calculations write into the State
+// anyway, so keeping their scratch space here lets them run without heap
+// allocation once it has grown to size. The public operators can be called
+// concurrently on the same State (from Forces, say) so they don't use this;
+// instead they make local workspaces of the types below. This is a lazy
+// Instance-stage entry that is never marked valid; it is used only for its
+// storage so State copies don't copy its contents.
+
+// Used by multiplyByPVA() and multiplyByPq(). Jv is J*u for a u-like vector;
+// qOrU is the q-like (PVA) or u-like (Pq) partner of the operand.
+class SBPVAWorkspace {
+public:
+    Vector_<SpatialVec>                     Jv;         // nb
+    Vector                                  qOrU;       // nq or nu
+    Array_<SpatialVec,MobilizedBodyIndex>   allA_GB;    // nb
+    Array_<SpatialVec,ConstrainedBodyIndex> V_AB, A_AB; // one constraint
+    Array_<Real,ConstrainedQIndex>          qdot;
+    Array_<Real,ConstrainedUIndex>          udot;
+};
+
+// Used by multiplyByPVATranspose().
+class SBPVATransposeWorkspace {
+public:
+    Vector_<SpatialVec>                     allF_G;     // nb
+    Vector_<SpatialVec>                     zTemp;      // nb, for ~J
+    Vector                                  ftmp;       // nu
+    Array_<SpatialVec,ConstrainedBodyIndex> oneF_G;     // one constraint
+    Array_<Real,ConstrainedUIndex>          onefu;
+    Array_<Real,ConstrainedQIndex>          onefq;
+};
+
+// Used by calcBiasForMultiplyByPVA().
+class SBPVABiasWorkspace {
+public:
+    Array_<SpatialVec,ConstrainedBodyIndex> AC_AB, zeroV_AB;
+    Array_<Real,ConstrainedQIndex>          zeroQDot;
+    Array_<Real,ConstrainedUIndex>          zeroUDot;
+};
+
+// Operands for one Constraint at a time when calculating its errors at
+// any level from the State or from given accelerations.
+class SBConstraintErrorsWorkspace {
+public:
+    Array_<Transform,ConstrainedBodyIndex>  X_AB;
+    Array_<SpatialVec,ConstrainedBodyIndex> V_AB, A_AB;
+    Array_<Real,ConstrainedQIndex>          cq;   // q, qdot, or qdotdot
+    Array_<Real,ConstrainedUIndex>          cu;   // u or udot
+};
+
+// Used by calcGMInvGt(): ~G (replaced by M^-1 ~G), the bias for G, and
+// contiguous single columns, plus what the operators it calls need.
+class SBGMInvGtWorkspace {
+public:
+    Matrix                      Gt;             // nu X m
+    Vector                      bias, lambda;   // m
+    Vector                      Gtcol;          // nu
+    Vector                      GMInvGtcol;     // m
+    Array_<SpatialVec>          A_GB;           // nb*m
+    SBPVAWorkspace              pva;
+    SBPVATransposeWorkspace     pvaTranspose;
+    SBPVABiasWorkspace          pvaBias;
+};
+
+class SBWorkspaceCache {
+public:
+    SBPVAWorkspace              pva;
+    SBPVATransposeWorkspace     pvaTranspose;
+    SBPVABiasWorkspace          pvaBias;
+    SBConstraintErrorsWorkspace constraintErrors;
+
+    // G M^-1 ~G and the temporaries used to form it.
+    Matrix                      GMInvGt;
+    SBGMInvGtWorkspace          gMInvGt;
+
+    // Loop forward dynamics: constraint forces and the totals they're
+    // subtracted into, and one constraint's multipliers.
+    Vector_<SpatialVec>         constraintBodyForces, totalBodyForces;
+    Vector                      constraintMobilityForces, totalMobilityForces;
+    Array_<Real>                lambdap, lambdav, lambdaa;
+
+    // projectQ() and projectU(): weighted constraint matrices and the
+    // columns of their transposes, the iteration vectors (df_WLS holds free
+    // q's or u's), and factorizations used when the reusable ones in 
+    // SBProjectionFactorizationCache are not.
+    Matrix                      Pqwr, PVwr;
+    Vector                      projCol, projQCol, projLambda;
+    Vector                      errWeights, scaledErrs, saveQorU, uScale;
+    Vector                      df_WLS, udf_WLS, du, dq;
+    Vector                      errestBias, errestRHS, errest0;
+    ConstraintFactorization     qProjectionFactorization,
+                                uProjectionFactorization;
+};
+//............................. WORKSPACE CACHE ................................
+
+
+
 // =============================================================================
 //                              TREE VELOCITY CACHE
 // =============================================================================
@@ -917,6 +1225,27 @@ public:
 
 class SBTreeVelocityCache {
 public:
+    SBTreeVelocityCache() : isRealizedByEnsemble(false) {}
+    // See SBTreePositionCache for why we need these.
+    SBTreeVelocityCache(const SBTreeVelocityCache& src) {*this = src;}
+    SBTreeVelocityCache& operator=(const SBTreeVelocityCache& src) {
+        if (&src == this) return *this;
+        storageForHDot_FM = src.storageForHDot_FM;
+        storageForHDot    = src.storageForHDot;
+        mobilizerRelativeVelocity   = src.mobilizerRelativeVelocity;
+        bodyVelocityInParent        = src.bodyVelocityInParent;
+        bodyVelocityInGround        = src.bodyVelocityInGround;
+        bodyVelocityInParentDerivRemainder
+                                    = src.bodyVelocityInParentDerivRemainder;
+        gyroscopicForces            = src.gyroscopicForces;
+        mobilizerCoriolisAcceleration = src.mobilizerCoriolisAcceleration;
+        totalCoriolisAcceleration   = src.totalCoriolisAcceleration;
+        constrainedBodyVelocityInAncestor
+                                    = src.constrainedBodyVelocityInAncestor;
+        isRealizedByEnsemble        = false; // never copied
+        return *this;
+    }
+
     const SpatialVec& getV_FM(MobilizedBodyIndex mbx) const {return mobilizerRelativeVelocity[mbx];}
     SpatialVec&       updV_FM(MobilizedBodyIndex mbx)       {return mobilizerRelativeVelocity[mbx];}
     const SpatialVec& getV_PB(MobilizedBodyIndex mbx) const {return bodyVelocityInParent[mbx];}
@@ -956,6 +1285,9 @@ public:
     // Ancestor frame rather than Ground.
     Array_<SpatialVec> constrainedBodyVelocityInAncestor; // nacb (V_AB)
 
+    // See SBTreePositionCache.
+    bool isRealizedByEnsemble;
+
 public:
     void allocate(const SBTopologyCache& tree,
                   const SBModelCache&    model,
@@ -992,6 +1324,8 @@ public:
         totalCoriolisAcceleration[GroundIndex] = SpatialVec(Vec3(0),Vec3(0));
 
         constrainedBodyVelocityInAncestor.resize(nacb);
+
+        isRealizedByEnsemble = false;
     }
 };
 //............................ TREE VELOCITY CACHE .............................
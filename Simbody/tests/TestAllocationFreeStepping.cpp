@@ -0,0 +1,118 @@
+/* -------------------------------------------------------------------------- *
+ *                               Simbody(tm)                                  *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+// Check that once an integrator has warmed up, further calls to stepTo() on
+// a system whose topology doesn't change make no heap allocations. We count
+// allocations by replacing the global operator new.
+
+#include "SimTKsimbody.h"
+#include "SimTKcommon/Testing.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+using namespace SimTK;
+using std::cout; using std::endl;
+
+static bool countAllocations = false;
+static int  numAllocations = 0;
+
+static void* countedAlloc(std::size_t size) {
+    if (countAllocations)
+        ++numAllocations;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size) {return countedAlloc(size);}
+void* operator new[](std::size_t size) {return countedAlloc(size);}
+void operator delete(void* p) throw() {std::free(p);}
+void operator delete[](void* p) throw() {std::free(p);}
+
+// Return the number of heap allocations made while stepping the integrator
+// through n more reporting intervals of length dt.
+static int countStepAllocations(Integrator& integ, int n, Real dt) {
+    numAllocations = 0;
+    countAllocations = true;
+    for (int i=1; i <= n; ++i)
+        integ.stepTo(integ.getTime() + dt);
+    countAllocations = false;
+    return numAllocations;
+}
+
+// An unconstrained system: a Pin-Ball pendulum with a damped elbow, and a
+// free box (with quaternions) bouncing on a spring, all under gravity.
+static void buildSystem(MultibodySystem& system, SimbodyMatterSubsystem& matter,
+                        GeneralForceSubsystem& forces) {
+    const Body::Rigid link(MassProperties(1, Vec3(0,-.5,0),
+        UnitInertia::cylinderAlongY(.05,.5).shiftFromCentroid(Vec3(0,-.5,0))));
+    const Body::Rigid box(MassProperties(3, Vec3(0),
+                          UnitInertia::brick(.2,.1,.3)));
+    Force::Gravity(forces, matter, -YAxis, 9.8);
+    MobilizedBody::Pin upper(matter.updGround(), Vec3(0), link, Vec3(0));
+    MobilizedBody::Ball lower(upper, Vec3(0,-1,0), link, Vec3(0));
+    Force::MobilityLinearDamper(forces, upper, MobilizerUIndex(0), .1);
+    MobilizedBody::Free free(matter.updGround(), Vec3(2,0,0), box, Vec3(0));
+    Force::TwoPointLinearSpring(forces, matter.updGround(), Vec3(2,0,0),
+                                free, Vec3(.1,.1,0), 20, 1);
+}
+
+template <class INTEG> void testIntegrator(const char* name) {
+    MultibodySystem system;
+    SimbodyMatterSubsystem matter(system);
+    GeneralForceSubsystem forces(system);
+    buildSystem(system, matter, forces);
+    State state = system.realizeTopology();
+    state.updQ() = .1; state.updU() = .2;
+
+    INTEG integ(system);
+    integ.setAccuracy(1e-4);
+    integ.initialize(state);
+
+    // Warm up: the first steps size the workspaces.
+    countStepAllocations(integ, 50, .01);
+    const int n = countStepAllocations(integ, 50, .01);
+    cout << name << ": " << n << " allocations in 50 reporting intervals, "
+         << integ.getNumStepsTaken() << " steps so far" << endl;
+    SimTK_TEST(n == 0);
+}
+
+void testRungeKuttaMerson()
+{   testIntegrator<RungeKuttaMersonIntegrator>("RungeKuttaMerson"); }
+void testRungeKutta3()
+{   testIntegrator<RungeKutta3Integrator>("RungeKutta3"); }
+void testRungeKutta2()
+{   testIntegrator<RungeKutta2Integrator>("RungeKutta2"); }
+void testRungeKuttaFeldberg()
+{   testIntegrator<RungeKuttaFeldbergIntegrator>("RungeKuttaFeldberg"); }
+
+int main() {
+    SimTK_START_TEST("TestAllocationFreeStepping");
+        SimTK_SUBTEST(testRungeKuttaMerson);
+        SimTK_SUBTEST(testRungeKutta3);
+        SimTK_SUBTEST(testRungeKutta2);
+        SimTK_SUBTEST(testRungeKuttaFeldberg);
+    SimTK_END_TEST();
+}
@@ -360,6 +360,407 @@ void testWeldConstraintWithPreAssembly() {
     delete &system;
 }
 
+// Check the compressed sparse forms of G against the dense matrix. This uses
+// the same system as testConstraintMatrices(), which includes a Constraint
+// whose Ancestor is not Ground, mobility-only constraints, and all three
+// kinds of constraint equations.
+void testSparseConstraintMatrices() {
+    State state;
+    MultibodySystem& system = createSystem();
+    SimbodyMatterSubsystem& matter = system.updMatterSubsystem();
+    MobilizedBody& first = matter.updMobilizedBody(MobilizedBodyIndex(1));
+    MobilizedBody& second = matter.updMobilizedBody(MobilizedBodyIndex(2));
+    MobilizedBody& fifth = matter.updMobilizedBody(MobilizedBodyIndex(5));
+    MobilizedBody& last = matter.updMobilizedBody(MobilizedBodyIndex(NUM_BODIES));
+
+    MobilizedBody::Free extra(fifth, Transform(),
+        MassProperties(1, Vec3(.01,.02,.03), Inertia(1,1.1,1.2)), Transform());
+    Constraint::Weld weld(extra, fifth);
+    Constraint::Ball ball(first, last);
+    Constraint::ConstantAcceleration accel2(second, MobilizerUIndex(1), .01);
+    Constraint::ConstantSpeed speed5(fifth, MobilizerUIndex(1), .1);
+    createState(system, state);
+
+    const int nu = matter.getNU(state);
+    Matrix G;
+    matter.calcG(state, G);
+    const int m = G.nrow();
+
+    Array_<int> rowStart, colIndex;
+    Array_<Real> values;
+    matter.calcGSparse(state, rowStart, colIndex, values);
+    SimTK_TEST(rowStart.size() == m+1);
+    SimTK_TEST(colIndex.size() == rowStart[m]);
+    SimTK_TEST(values.size() == rowStart[m]);
+    SimTK_TEST(rowStart[m] < m*nu); // must actually be sparse
+
+    // Expand to a dense matrix; every element we didn't store must be zero.
+    Matrix Gx(m, nu, Real(0));
+    for (int i=0; i < m; ++i)
+        for (int k=rowStart[i]; k < rowStart[i+1]; ++k) {
+            if (k > rowStart[i])
+                SimTK_TEST(colIndex[k-1] < colIndex[k]);
+            Gx(i, colIndex[k]) = values[k];
+        }
+    SimTK_TEST_EQ(Gx, G);
+
+    // The weld can't involve any mobilities inboard of its Ancestor.
+    for (int k=0; k < rowStart[m]; ++k)
+        SimTK_TEST(colIndex[k] >= (int)fifth.getFirstUIndex(state)
+                   || colIndex[k] < (int)extra.getFirstUIndex(state));
+
+    Array_<int> colStart, rowIndex;
+    Array_<Real> tvalues;
+    matter.calcGTransposeSparse(state, colStart, rowIndex, tvalues);
+    SimTK_TEST(colStart.size() == nu+1);
+    SimTK_TEST(colStart[nu] == rowStart[m]);
+    Matrix Gtx(nu, m, Real(0));
+    for (int j=0; j < nu; ++j)
+        for (int k=colStart[j]; k < colStart[j+1]; ++k) {
+            if (k > colStart[j])
+                SimTK_TEST(rowIndex[k-1] < rowIndex[k]);
+            Gtx(j, rowIndex[k]) = tvalues[k];
+        }
+    SimTK_TEST_EQ(Gtx, ~G);
+
+    // Disabling a constraint removes its rows.
+    ball.disable(state);
+    system.realize(state, Stage::Velocity);
+    matter.calcG(state, G);
+    matter.calcGSparse(state, rowStart, colIndex, values);
+    SimTK_TEST(rowStart.size() == G.nrow()+1);
+    Gx.resize(G.nrow(), nu); Gx = 0;
+    for (int i=0; i < G.nrow(); ++i)
+        for (int k=rowStart[i]; k < rowStart[i+1]; ++k)
+            Gx(i, colIndex[k]) = values[k];
+    SimTK_TEST_EQ(Gx, G);
+
+    delete &system;
+}
+
+// Forward dynamics and impulse calculations share a cached factorization of
+// G*M^-1*~G. Check that they agree with explicit calculation, that the cache
+// is updated when q or u changes, and that modified Newton mode gives the
+// same answers as refactoring every time.
+void testMultiplierFactorizationReuse() {
+    State state;
+    MultibodySystem& system = createSystem();
+    SimbodyMatterSubsystem& matter = system.updMatterSubsystem();
+    MobilizedBody& first = matter.updMobilizedBody(MobilizedBodyIndex(1));
+    MobilizedBody& second = matter.updMobilizedBody(MobilizedBodyIndex(2));
+    MobilizedBody& fifth = matter.updMobilizedBody(MobilizedBodyIndex(5));
+    MobilizedBody& last = matter.updMobilizedBody(MobilizedBodyIndex(NUM_BODIES));
+    Constraint::Ball ball(first, last);
+    Constraint::ConstantSpeed speed5(fifth, MobilizerUIndex(1), .1);
+    Constraint::ConstantAcceleration accel2(second, MobilizerUIndex(1), .01);
+    createState(system, state);
+    SimTK_TEST(!matter.getUseModifiedNewtonForMultipliers());
+
+    const int m = state.getNUDotErr();
+    Matrix W;
+    matter.calcProjectedMInv(state, W);
+    FactorQTZ qtz(W, m*SqrtEps*std::sqrt(SqrtEps));
+
+    // Impulses use the cached factorization; repeat to use it again.
+    matter.resetMultiplierStatistics();
+    Vector deltaV = Test::randVector(m), impulse, expected;
+    qtz.solve(deltaV, expected);
+    for (int i=0; i < 2; ++i) {
+        matter.solveForConstraintImpulses(state, deltaV, impulse);
+        SimTK_TEST_EQ_TOL(impulse, expected, 1e-10);
+    }
+    SimTK_TEST(matter.getNumMultiplierFactorizations() <= 1);
+    SimTK_TEST(matter.getNumMultiplierReuses() == 0);
+
+    // Acceleration errors must be satisfied after a change to u, which
+    // invalidates the factorization since there are nonholonomic and
+    // acceleration-only constraints here.
+    state.updU() += 0.1;
+    system.realize(state, Stage::Acceleration);
+    SimTK_TEST_EQ_TOL(state.getUDotErr(), Vector(m, Real(0)), 1e-10);
+    const Vector udot0 = state.getUDot();
+    const Vector mult0 = state.getMultipliers();
+
+    // Modified Newton: the first solve factors W here and the next one, at a
+    // nearby configuration, should reuse that and still get the answer.
+    matter.setUseModifiedNewtonForMultipliers(true);
+    SimTK_TEST(matter.getUseModifiedNewtonForMultipliers());
+    state.invalidateAllCacheAtOrAbove(Stage::Position);
+    matter.resetMultiplierStatistics();
+    system.realize(state, Stage::Acceleration);
+    SimTK_TEST_EQ_TOL(state.getUDot(), udot0, 1e-10);
+    SimTK_TEST_EQ_TOL(state.getMultipliers(), mult0, 1e-10);
+    SimTK_TEST(matter.getNumMultiplierFactorizations() == 1);
+    SimTK_TEST(matter.getNumMultiplierReuses() == 0);
+
+    State nearby = state;
+    nearby.updQ() += 1e-3;
+    nearby.updU() += 1e-3;
+    system.realize(nearby, Stage::Acceleration);
+    const Vector udotMN = nearby.getUDot();
+    const Vector multMN = nearby.getMultipliers();
+    SimTK_TEST_EQ_TOL(nearby.getUDotErr(), Vector(m, Real(0)), 1e-10);
+    // That must have been done with the old factorization.
+    SimTK_TEST(matter.getNumMultiplierFactorizations() == 1);
+    SimTK_TEST(matter.getNumMultiplierReuses() == 1);
+
+    matter.setUseModifiedNewtonForMultipliers(false);
+    nearby.invalidateAllCacheAtOrAbove(Stage::Position);
+    system.realize(nearby, Stage::Acceleration);
+    SimTK_TEST_EQ_TOL(udotMN, nearby.getUDot(), 1e-8);
+    SimTK_TEST_EQ_TOL(multMN, nearby.getMultipliers(), 1e-8);
+
+    // A big change should fall back to refactoring and still work.
+    matter.setUseModifiedNewtonForMultipliers(true);
+    matter.resetMultiplierStatistics();
+    nearby.updQ() += 0.5;
+    system.realize(nearby, Stage::Acceleration);
+    SimTK_TEST_EQ_TOL(nearby.getUDotErr(), Vector(m, Real(0)), 1e-10);
+    SimTK_TEST(matter.getNumMultiplierFactorizations() == 1);
+    SimTK_TEST(matter.getNumMultiplierReuses() == 0);
+
+    // A reusable factorization saved before an Instance-stage change (here
+    // disabling a constraint and reenabling it) is not used.
+    speed5.disable(nearby);
+    speed5.enable(nearby);
+    matter.resetMultiplierStatistics();
+    system.realize(nearby, Stage::Acceleration);
+    SimTK_TEST(matter.getNumMultiplierFactorizations() == 1);
+    SimTK_TEST(matter.getNumMultiplierReuses() == 0);
+
+    // Modified Newton must not disturb a simulation.
+    State simState = state;
+    RungeKuttaMersonIntegrator integ(system);
+    integ.setAccuracy(1e-6);
+    integ.setConstraintTolerance(1e-6);
+    TimeStepper ts(system, integ);
+    ts.initialize(simState);
+    matter.resetMultiplierStatistics();
+    ts.stepTo(0.2);
+    SimTK_TEST(ts.getState().getTime() == 0.2);
+    SimTK_TEST_EQ_TOL(ts.getState().getUDotErr(), Vector(m, Real(0)), 1e-8);
+    // Most integrator stages should have reused an earlier factorization.
+    SimTK_TEST(matter.getNumMultiplierReuses() 
+               > matter.getNumMultiplierFactorizations());
+
+    delete &system;
+}
+
+// Position and velocity projection can reuse the factorization from an
+// earlier projection. Check that the constraints still get satisfied, that
+// reuse actually happens, and that ForceFullNewton prevents it.
+void testProjectionFactorizationReuse() {
+    State state;
+    MultibodySystem& system = createSystem();
+    SimbodyMatterSubsystem& matter = system.updMatterSubsystem();
+    MobilizedBody& first = matter.updMobilizedBody(MobilizedBodyIndex(1));
+    MobilizedBody& fifth = matter.updMobilizedBody(MobilizedBodyIndex(5));
+    MobilizedBody& last = matter.updMobilizedBody(MobilizedBodyIndex(NUM_BODIES));
+    Constraint::Ball ball(first, last);
+    Constraint::ConstantSpeed speed5(fifth, MobilizerUIndex(1), .1);
+    createState(system, state);
+    SimTK_TEST(!matter.getUseModifiedNewtonForProjection());
+    SimTK_TEST(matter.getProjectionReuseTolerance() == 0.25);
+    SimTK_TEST_MUST_THROW(matter.setProjectionReuseTolerance(0));
+
+    const Real tol = 1e-10;
+    ProjectOptions opts(tol);
+    ProjectResults results;
+    Vector noErrest;
+
+    // Without reuse every position projection iteration factors.
+    matter.resetProjectionStatistics();
+    State perturbed = state;
+    perturbed.updQ() += 1e-3;
+    system.realize(perturbed, Stage::Position);
+    system.projectQ(perturbed, noErrest, opts, results);
+    SimTK_TEST(results.getExitStatus() == ProjectResults::Succeeded);
+    SimTK_TEST(   matter.getNumProjectQFactorizations() 
+               == results.getNumIterations());
+    SimTK_TEST(matter.getNumProjectQReuses() == 0);
+    const Vector qFullNewton = perturbed.getQ();
+
+    // The first projection has nothing to reuse, but later iterations
+    // reuse its factorization. We should get nearly the same answer.
+    matter.setUseModifiedNewtonForProjection(true);
+    matter.resetProjectionStatistics();
+    perturbed = state;
+    perturbed.updQ() += 1e-3;
+    system.realize(perturbed, Stage::Position);
+    system.projectQ(perturbed, noErrest, opts, results);
+    SimTK_TEST(results.getExitStatus() == ProjectResults::Succeeded);
+    SimTK_TEST(results.getNormOnExit() <= tol);
+    SimTK_TEST(matter.getNumProjectQFactorizations() == 1);
+    SimTK_TEST_EQ_TOL(perturbed.getQ(), qFullNewton, 1e-5);
+
+    // A projection from somewhere nearby should need no new factorization.
+    // The factorization is kept in the State, so start from a copy of the
+    // one we just projected.
+    State nearby = perturbed;
+    nearby.updQ() -= 1e-3;
+    system.realize(nearby, Stage::Position);
+    system.projectQ(nearby, noErrest, opts, results);
+    SimTK_TEST(results.getExitStatus() == ProjectResults::Succeeded);
+    SimTK_TEST(results.getNormOnExit() <= tol);
+    SimTK_TEST(matter.getNumProjectQFactorizations() == 1);
+    SimTK_TEST(matter.getNumProjectQReuses() >= results.getNumIterations());
+
+    // Unless we insist.
+    const int nReusesBefore = matter.getNumProjectQReuses();
+    nearby = state;
+    nearby.updQ() -= 2e-3;
+    system.realize(nearby, Stage::Position);
+    system.projectQ(nearby, noErrest, 
+                    ProjectOptions(opts).setOption(ProjectOptions::ForceFullNewton),
+                    results);
+    SimTK_TEST(results.getExitStatus() == ProjectResults::Succeeded);
+    SimTK_TEST(   matter.getNumProjectQFactorizations() 
+               == 1 + results.getNumIterations());
+    SimTK_TEST(matter.getNumProjectQReuses() == nReusesBefore);
+
+    // Velocity projection factors once per projection normally; with reuse
+    // the second projection shouldn't need to.
+    system.realize(nearby, Stage::Velocity);
+    State vstate = nearby;
+    for (int i=0; i < 2; ++i) {
+        vstate.updU() += (i+1)*1e-2;
+        system.realize(vstate, Stage::Velocity);
+        system.projectU(vstate, noErrest, opts, results);
+        SimTK_TEST(results.getExitStatus() == ProjectResults::Succeeded);
+        SimTK_TEST(results.getNormOnExit() <= tol);
+        SimTK_TEST(matter.getNumProjectUFactorizations() == 1);
+        SimTK_TEST(matter.getNumProjectUReuses() == (i==0 ? 0 : 
+                                                results.getNumIterations()));
+    }
+
+    // A simulation with reuse should keep the constraints satisfied.
+    matter.resetProjectionStatistics();
+    RungeKuttaMersonIntegrator integ(system);
+    integ.setAccuracy(1e-6);
+    integ.setConstraintTolerance(1e-6);
+    TimeStepper ts(system, integ);
+    ts.initialize(state);
+    ts.stepTo(0.2);
+    SimTK_TEST(ts.getState().getTime() == 0.2);
+    SimTK_TEST(ts.getState().getQErr().normInf() <= 1e-5);
+    SimTK_TEST(ts.getState().getUErr().normInf() <= 1e-5);
+
+    delete &system;
+}
+
+// With the block constraint solver, independent groups of constraints are
+// factored separately. Here there are four chains hanging from Ground. The 
+// first two are tied to Ground and to each other, the third is tied to
+// Ground by two redundant Ball constraints, and the last is unconstrained.
+// The chains are bent at q=0 so that the constraints aren't singular there.
+// Results must match the dense solver.
+void testBlockConstraintSolver() {
+    MultibodySystem system;
+    SimbodyMatterSubsystem matter(system);
+    GeneralForceSubsystem forces(system);
+    Force::UniformGravity(forces, matter, Vec3(0,-9.8,0));
+    const Real mass = 1.3;
+    Body::Rigid body(MassProperties(mass, Vec3(.1,.2,-.03), 
+                     mass*UnitInertia(1.1, 1.2, 1.3, .01, -.02, .07)));
+
+    Array_<MobilizedBodyIndex> ends;
+    for (int c=0; c < 4; ++c) {
+        MobilizedBodyIndex parent = GroundIndex;
+        for (int i=0; i < 4; ++i) {
+            const Transform X_PF(Rotation(i==0 ? 0 : .4, ZAxis),
+                Vec3(i==0 ? Real(c) : Real(0), i==0 ? 0 : -.5, 0));
+            MobilizedBody::Gimbal link(matter.updMobilizedBody(parent), X_PF,
+                                       body, Vec3(0,.5,0));
+            parent = link.getMobilizedBodyIndex();
+        }
+        ends.push_back(parent);
+    }
+    MobilizedBody& end0 = matter.updMobilizedBody(ends[0]);
+    MobilizedBody& end1 = matter.updMobilizedBody(ends[1]);
+    MobilizedBody& end2 = matter.updMobilizedBody(ends[2]);
+
+    // Tie the ends to where they are when q=0.
+    system.realizeTopology();
+    State state = system.getDefaultState();
+    system.realize(state, Stage::Position);
+    const Vec3 p0 = end0.getBodyOriginLocation(state);
+    const Vec3 p1 = end1.getBodyOriginLocation(state);
+    const Vec3 p2 = end2.getBodyOriginLocation(state);
+    Constraint::Ball ball0(matter.Ground(), p0, end0, Vec3(0));
+    Constraint::Ball ball1(matter.Ground(), p1, end1, Vec3(0));
+    Constraint::Rod rod01(end0, Vec3(0,.5,0), end1, Vec3(0,.5,0), 
+                          (p1-p0).norm());
+    Constraint::ConstantSpeed speed1(matter.updMobilizedBody
+                                        (MobilizedBodyIndex(ends[1]-2)),
+                                     MobilizerUIndex(0), 0);
+    Constraint::Ball ball2a(matter.Ground(), p2, end2, Vec3(0));
+    Constraint::Ball ball2b(matter.Ground(), p2, end2, Vec3(0));
+
+    state = system.realizeTopology();
+    SimTK_TEST(!matter.getUseBlockConstraintSolver());
+    Random::Uniform random(-.01, .01);
+    random.setSeed(17);
+    for (int i=0; i < state.getNY(); ++i)
+        state.updY()[i] = random.getValue();
+    system.realize(state, Stage::Velocity);
+    system.project(state, 1e-10);
+
+    // Forward dynamics and impulses.
+    system.realize(state, Stage::Acceleration);
+    const Vector udot = state.getUDot(), mults = state.getMultipliers();
+    const Vector deltaV = Test::randVector(state.getNMultipliers());
+    Vector impulse, blockImpulse;
+    matter.solveForConstraintImpulses(state, deltaV, impulse);
+
+    SimTK_TEST(matter.getNumConstraintBlocks(state) == 0);
+    matter.setUseBlockConstraintSolver(true);
+    SimTK_TEST(matter.getUseBlockConstraintSolver());
+    state.invalidateAllCacheAtOrAbove(Stage::Position);
+    system.realize(state, Stage::Acceleration);
+    SimTK_TEST_EQ_TOL(state.getUDot(), udot, 1e-10);
+    SimTK_TEST_EQ_TOL(state.getMultipliers(), mults, 1e-8);
+    matter.solveForConstraintImpulses(state, deltaV, blockImpulse);
+    SimTK_TEST_EQ_TOL(blockImpulse, impulse, 1e-8);
+
+    // Chains 0 and 1 make one block and chain 2 another. The redundant Balls
+    // on chain 2 make its block singular, so Cholesky must have given up on
+    // it in favor of QTZ.
+    SimTK_TEST(matter.getNumConstraintBlocks(state) == 2);
+    SimTK_TEST(matter.getNumRankDeficientConstraintBlocks(state) == 1);
+
+    // Without the redundancy every block is Cholesky factored, and the
+    // answers still agree with the dense solver.
+    State nonredundant = state;
+    ball2b.disable(nonredundant);
+    system.realize(nonredundant, Stage::Acceleration);
+    SimTK_TEST(matter.getNumConstraintBlocks(nonredundant) == 2);
+    SimTK_TEST(matter.getNumRankDeficientConstraintBlocks(nonredundant) == 0);
+    const Vector blockUDot = nonredundant.getUDot();
+    matter.setUseBlockConstraintSolver(false);
+    nonredundant.invalidateAllCacheAtOrAbove(Stage::Position);
+    system.realize(nonredundant, Stage::Acceleration);
+    SimTK_TEST_EQ_TOL(nonredundant.getUDot(), blockUDot, 1e-10);
+    matter.setUseBlockConstraintSolver(true);
+
+    // Position and velocity projection.
+    Random::Uniform perturb(-1e-3, 1e-3);
+    perturb.setSeed(18);
+    State dense = state;
+    for (int i=0; i < dense.getNY(); ++i)
+        dense.updY()[i] += perturb.getValue();
+    system.realize(dense, Stage::Velocity);
+    State block = dense;
+
+    matter.setUseBlockConstraintSolver(false);
+    system.project(dense, 1e-10);
+    matter.setUseBlockConstraintSolver(true);
+    system.project(block, 1e-10);
+    SimTK_TEST_EQ_TOL(block.getQ(), dense.getQ(), 1e-8);
+    SimTK_TEST_EQ_TOL(block.getU(), dense.getU(), 1e-8);
+    SimTK_TEST(block.getQErr().normInf() <= 1e-10);
+    SimTK_TEST(block.getUErr().normInf() <= 1e-10);
+}
+
 void testDisablingConstraints() {
     
     State state;
@@ -596,6 +997,10 @@ int main() {
         SimTK_SUBTEST(testWeldConstraintWithPreAssembly);
         SimTK_SUBTEST(testConstraintForces);
         SimTK_SUBTEST(testConstraintMatrices);
+        SimTK_SUBTEST(testSparseConstraintMatrices);
+        SimTK_SUBTEST(testMultiplierFactorizationReuse);
         SimTK_SUBTEST(testDisablingConstraints);
+        SimTK_SUBTEST(testProjectionFactorizationReuse);
+        SimTK_SUBTEST(testBlockConstraintSolver);
     SimTK_END_TEST();
 }
@@ -0,0 +1,229 @@
+/* -------------------------------------------------------------------------- *
+ *                               Simbody(tm)                                  *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+// Check that realizing a collection of States together with
+// MultibodySystem::realizeEnsemble() gives exactly the same results as 
+// realizing each of them separately.
+
+#include "SimTKsimbody.h"
+#include "SimTKcommon/Testing.h"
+
+#include <iostream>
+
+using namespace SimTK;
+using std::cout; using std::endl;
+
+// A row of double pendulums (a Pin, then a Universal) hanging from Ground,
+// and a free ball held at a fixed distance from the end of the first one.
+static void buildSystem(MultibodySystem& system,
+                        SimbodyMatterSubsystem& matter) {
+    const Body::Rigid link(MassProperties(1, Vec3(0,-.25,0),
+        UnitInertia::cylinderAlongY(.03,.25).shiftFromCentroid(Vec3(0,-.25,0))));
+    const Body::Rigid ball(MassProperties(2, Vec3(0), UnitInertia::sphere(.1)));
+
+    MobilizedBody firstTip;
+    for (int i=0; i < 6; ++i) {
+        MobilizedBody::Pin upper(matter.updGround(), Vec3(i,0,0),
+                                 link, Vec3(0));
+        MobilizedBody::Universal lower(upper, Vec3(0,-.5,0), link, Vec3(0));
+        if (i == 0) firstTip = lower;
+    }
+    MobilizedBody::Free free(matter.updGround(), Vec3(0,-1.5,0),
+                             ball, Vec3(0));
+    Constraint::Rod(firstTip, Vec3(0,-.5,0), free, Vec3(0), .5);
+}
+
+// Make n States with different random q's and u's.
+static Array_<State> makeStates(const MultibodySystem& system, int n) {
+    Random::Uniform random(-1, 1);
+    random.setSeed(23);
+    Array_<State> states(n, system.getDefaultState());
+    for (int k=0; k < n; ++k) {
+        State& state = states[k];
+        for (int i=0; i < state.getNQ(); ++i) 
+            state.updQ()[i] = random.getValue();
+        for (int i=0; i < state.getNU(); ++i) 
+            state.updU()[i] = random.getValue();
+    }
+    return states;
+}
+
+// Both States must be realized through Acceleration stage. The answers
+// should be bitwise identical.
+static void compareResults(const SimbodyMatterSubsystem& matter,
+                           const State& s1, const State& s2) {
+    SimTK_TEST(s1.getSystemStage() == s2.getSystemStage());
+    for (MobilizedBodyIndex mbx(0); mbx < matter.getNumBodies(); ++mbx) {
+        const MobilizedBody& mobod = matter.getMobilizedBody(mbx);
+        const Transform& X1 = mobod.getBodyTransform(s1);
+        const Transform& X2 = mobod.getBodyTransform(s2);
+        SimTK_TEST(X1.p() == X2.p());
+        SimTK_TEST(X1.R().asMat33() == X2.R().asMat33());
+        SimTK_TEST(mobod.getBodyVelocity(s1) == mobod.getBodyVelocity(s2));
+    }
+    for (int i=0; i < s1.getQErr().size(); ++i)
+        SimTK_TEST(s1.getQErr()[i] == s2.getQErr()[i]);
+    for (int i=0; i < s1.getUErr().size(); ++i)
+        SimTK_TEST(s1.getUErr()[i] == s2.getUErr()[i]);
+    for (int i=0; i < s1.getUDot().size(); ++i)
+        SimTK_TEST(s1.getUDot()[i] == s2.getUDot()[i]);
+}
+
+static void checkEnsembleMatchesSeparate(const MultibodySystem& system) {
+    const SimbodyMatterSubsystem& matter = system.getMatterSubsystem();
+    Array_<State> states = makeStates(system, 25);
+    Array_<State> ref = states;
+
+    // Start from a mix of stages.
+    for (int k=0; k < (int)states.size(); k += 3)
+        system.realize(states[k], Stage::Position);
+    for (int k=1; k < (int)states.size(); k += 3)
+        system.realize(states[k], Stage::Model);
+
+    system.realizeEnsemble(states, Stage::Acceleration);
+    for (int k=0; k < (int)states.size(); ++k) {
+        system.realize(ref[k], Stage::Acceleration);
+        compareResults(matter, states[k], ref[k]);
+    }
+
+    // Again after changing some q's and u's.
+    for (int k=0; k < (int)states.size(); k += 2) {
+        states[k].updQ()[k % states[k].getNQ()] += .01;
+        states[k].updU()[k % states[k].getNU()] -= .01;
+        ref[k].updQ() = states[k].getQ();
+        ref[k].updU() = states[k].getU();
+    }
+    system.realizeEnsemble(states, Stage::Acceleration);
+    for (int k=0; k < (int)states.size(); ++k) {
+        system.realize(ref[k], Stage::Acceleration);
+        compareResults(matter, states[k], ref[k]);
+    }
+
+    // Stopping short of Velocity stage.
+    Array_<State> partial = makeStates(system, 5);
+    system.realizeEnsemble(partial, Stage::Position);
+    for (int k=0; k < (int)partial.size(); ++k)
+        SimTK_TEST(partial[k].getSystemStage() == Stage::Position);
+
+    // An empty ensemble is fine.
+    system.realizeEnsemble(Array_<State>());
+}
+
+void testSerial() {
+    MultibodySystem system;
+    SimbodyMatterSubsystem matter(system);
+    GeneralForceSubsystem forces(system);
+    Force::Gravity gravity(forces, matter, -YAxis, 9.8);
+    buildSystem(system, matter);
+    system.realizeTopology();
+    checkEnsembleMatchesSeparate(system);
+}
+
+void testParallel() {
+    MultibodySystem system;
+    SimbodyMatterSubsystem matter(system);
+    GeneralForceSubsystem forces(system);
+    Force::Gravity gravity(forces, matter, -YAxis, 9.8);
+    buildSystem(system, matter);
+    matter.setUseParallelTreeSweeps(true, 3);
+    system.realizeTopology();
+    checkEnsembleMatchesSeparate(system);
+}
+
+void testIncremental() {
+    MultibodySystem system;
+    SimbodyMatterSubsystem matter(system);
+    GeneralForceSubsystem forces(system);
+    Force::Gravity gravity(forces, matter, -YAxis, 9.8);
+    buildSystem(system, matter);
+    matter.setUseIncrementalPositionRealization(true);
+    system.realizeTopology();
+    checkEnsembleMatchesSeparate(system);
+}
+
+// A force that does nothing, except throw when asked to realize the
+// designated stage for a State whose time is 1.
+class ThrowingForce : public Force::Custom::Implementation {
+public:
+    explicit ThrowingForce(Stage stage) : stage(stage) {}
+    void calcForce(const State&, Vector_<SpatialVec>&, Vector_<Vec3>&,
+                   Vector&) const override {}
+    Real calcPotentialEnergy(const State&) const override { return 0; }
+    void realizePosition(const State& s) const override
+    {   check(s, Stage::Position); }
+    void realizeVelocity(const State& s) const override
+    {   check(s, Stage::Velocity); }
+private:
+    void check(const State& s, Stage g) const {
+        if (g == stage && s.getTime() == 1)
+            SimTK_THROW1(Exception::Cant, "realize this State");
+    }
+    Stage stage;
+};
+
+// If one State of an ensemble fails to realize, none of the others may be
+// left thinking its kinematics are already done. Otherwise after the q's or
+// u's change a later realize() would skip the tree sweep and return stale
+// results.
+static void checkThrowMidEnsemble(Stage stage) {
+    MultibodySystem system;
+    SimbodyMatterSubsystem matter(system);
+    GeneralForceSubsystem forces(system);
+    Force::Gravity gravity(forces, matter, -YAxis, 9.8);
+    Force::Custom thrower(forces, new ThrowingForce(stage));
+    buildSystem(system, matter);
+    system.realizeTopology();
+
+    Array_<State> states = makeStates(system, 9);
+    states[4].setTime(1);
+    SimTK_TEST_MUST_THROW(system.realizeEnsemble(states, Stage::Acceleration));
+    for (int k=0; k < (int)states.size(); ++k)
+        SimTK_TEST(states[k].getSystemStage() < Stage::Acceleration);
+
+    // Change every State, then realize each one alone.
+    states[4].setTime(0);
+    for (int k=0; k < (int)states.size(); ++k) {
+        states[k].updQ() *= .5;
+        states[k].updU() *= .5;
+    }
+    Array_<State> ref = states;
+    for (int k=0; k < (int)states.size(); ++k) {
+        system.realize(states[k], Stage::Acceleration);
+        system.realize(ref[k], Stage::Acceleration);
+        compareResults(matter, states[k], ref[k]);
+    }
+}
+
+void testThrowMidEnsemble() {
+    checkThrowMidEnsemble(Stage::Position);
+    checkThrowMidEnsemble(Stage::Velocity);
+}
+
+int main() {
+    SimTK_START_TEST("TestEnsembleRealization");
+        SimTK_SUBTEST(testSerial);
+        SimTK_SUBTEST(testParallel);
+        SimTK_SUBTEST(testIncremental);
+        SimTK_SUBTEST(testThrowMidEnsemble);
+    SimTK_END_TEST();
+}
@@ -0,0 +1,237 @@
+/* -------------------------------------------------------------------------- *
+ *                       Simbody(tm): SimTKsimbody                            *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+// Check that GeneralForceSubsystem keeps a separate cached force sum for the
+// force elements that depend only on time, on positions, or on velocities,
+// and recalculates only the classes whose dependency stage was invalidated.
+
+#include "SimTKsimbody.h"
+#include "SimTKcommon/Testing.h"
+
+#include <iostream>
+
+using namespace SimTK;
+using std::cout; using std::endl;
+
+// A force on one body that depends only on the given stage's results, and
+// counts how many times it has been evaluated.
+class StageForce : public Force::Custom::Implementation {
+public:
+    StageForce(const MobilizedBody& body, Stage dependsOn, bool footprint)
+    :   body(body), dependsOn(dependsOn), footprint(footprint), numCalls(0) {}
+    void calcForce(const State& state, Vector_<SpatialVec>& bodyForces,
+                   Vector_<Vec3>& particleForces, Vector& mobilityForces)
+                   const override {
+        ++numCalls;
+        Vec3 f(1 + state.getTime(), 0, 0);
+        if (dependsOn >= Stage::Position)
+            f[1] = body.getBodyOriginLocation(state)[0];
+        if (dependsOn >= Stage::Velocity)
+            f[2] = -body.getBodyOriginVelocity(state)[1];
+        bodyForces[body.getMobilizedBodyIndex()][1] += f;
+        mobilityForces[body.getFirstUIndex(state)] += f[0];
+    }
+    Real calcPotentialEnergy(const State& state) const override {return 0;}
+    Stage getDependencyStage() const override {return dependsOn;}
+    bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                           Array_<MobilizedBodyIndex>& mobilizers)
+                           const override {
+        if (!footprint) return false;
+        bodies.push_back(body.getMobilizedBodyIndex());
+        mobilizers.push_back(body.getMobilizedBodyIndex());
+        return true;
+    }
+
+    const MobilizedBody body;
+    const Stage         dependsOn;
+    const bool          footprint;
+    mutable int         numCalls;
+};
+
+// A few pendulum links with one StageForce of each dependency class on each,
+// plus a DiscreteForces element whose Dynamics-stage discrete variables we
+// can change.
+class TestSystem {
+public:
+    explicit TestSystem(bool footprints)
+    :   matter(system), forces(system), discrete(forces, matter) {
+        const Body::Rigid body(MassProperties(1, Vec3(0,-.5,0),
+                               UnitInertia::ellipsoid(.1,.5,.1)
+                                   .shiftFromCentroid(Vec3(0,-.5,0))));
+        MobilizedBody parent = matter.updGround();
+        for (int i=0; i < 4; ++i) {
+            MobilizedBody::Gimbal link(parent, Vec3(0,-1,0), body, Vec3(0));
+            links.push_back(link);
+            parent = link;
+        }
+        const Stage stages[] = {Stage::Time, Stage::Position,
+                                Stage::Velocity, Stage::Dynamics};
+        for (int k=0; k < 4; ++k) {
+            for (int i=0; i < (int)links.size(); ++i) {
+                StageForce* f = new StageForce(links[i], stages[k], footprints);
+                Force::Custom(forces, f);
+                stageForces[k].push_back(f);
+            }
+        }
+        // This one has the default dependency and must not be cached.
+        damper = Force::MobilityLinearDamper(forces, links[1],
+                                             MobilizerUIndex(0), 2);
+        system.realizeTopology();
+
+        state = system.getDefaultState();
+        for (int i=0; i < state.getNQ(); ++i)
+            state.updQ()[i] = .1*(i+1);
+        for (int i=0; i < state.getNU(); ++i)
+            state.updU()[i] = .2*(i-3);
+        state.updTime() = .5;
+    }
+
+    void resetCounts() {
+        for (int k=0; k < 4; ++k)
+            for (unsigned i=0; i < stageForces[k].size(); ++i)
+                stageForces[k][i]->numCalls = 0;
+    }
+
+    // Each force element in a class was evaluated either once or not at all.
+    void checkCounts(bool t, bool p, bool v, bool d) {
+        const bool expect[] = {t, p, v, d};
+        for (int k=0; k < 4; ++k)
+            for (unsigned i=0; i < stageForces[k].size(); ++i)
+                SimTK_TEST(stageForces[k][i]->numCalls == (expect[k] ? 1:0));
+        resetCounts();
+    }
+
+    // Sum the forces element by element, bypassing the subsystem's caches.
+    void checkForces() {
+        system.realize(state, Stage::Velocity);
+        Vector_<SpatialVec> bodyForces(matter.getNumBodies());
+        Vector mobForces(state.getNU());
+        bodyForces.setToZero(); mobForces.setToZero();
+        Vector_<SpatialVec> F; Vector_<Vec3> P; Vector f;
+        for (int i=0; i < forces.getNumForces(); ++i) {
+            if (forces.isForceDisabled(state, ForceIndex(i))) continue;
+            forces.getForce(ForceIndex(i)).calcForceContribution(state,F,P,f);
+            bodyForces += F;
+            mobForces += f;
+        }
+        resetCounts();
+        system.realize(state, Stage::Dynamics);
+        SimTK_TEST_EQ(system.getRigidBodyForces(state, Stage::Dynamics),
+                      bodyForces);
+        SimTK_TEST_EQ(system.getMobilityForces(state, Stage::Dynamics),
+                      mobForces);
+    }
+
+    MultibodySystem             system;
+    SimbodyMatterSubsystem      matter;
+    GeneralForceSubsystem       forces;
+    Force::DiscreteForces       discrete;
+    Force::MobilityLinearDamper damper;
+    Array_<MobilizedBody>       links;
+    Array_<StageForce*>         stageForces[4]; // owned by the forces
+    State                       state;
+};
+
+void testSelectiveRecalculation(bool footprints) {
+    TestSystem test(footprints);
+    test.system.realize(test.state, Stage::Dynamics);
+    test.checkCounts(true, true, true, true);
+
+    // Nothing changed; nothing is recalculated.
+    test.system.realize(test.state, Stage::Dynamics);
+    test.checkCounts(false, false, false, false);
+
+    // Changing a discrete input that invalidates only Dynamics stage
+    // recalculates just the uncached forces.
+    test.discrete.setOneMobilityForce(test.state, test.links[2],
+                                      MobilizerUIndex(1), 3.);
+    test.system.realize(test.state, Stage::Dynamics);
+    test.checkCounts(false, false, false, true);
+    test.checkForces();
+
+    test.state.updU()[4] += .3;
+    test.system.realize(test.state, Stage::Dynamics);
+    test.checkCounts(false, false, true, true);
+    test.checkForces();
+
+    test.state.updQ()[1] += .1;
+    test.system.realize(test.state, Stage::Dynamics);
+    test.checkCounts(false, true, true, true);
+    test.checkForces();
+
+    test.state.updTime() += .25;
+    test.system.realize(test.state, Stage::Dynamics);
+    test.checkCounts(true, true, true, true);
+    test.checkForces();
+
+    // Disabling a velocity-class element invalidates only that class.
+    test.system.realize(test.state, Stage::Dynamics);
+    test.forces.setForceIsDisabled(test.state, ForceIndex(1+2*4), true);
+    test.system.realize(test.state, Stage::Dynamics);
+    test.checkForces();
+}
+
+void testWithFootprints()    {testSelectiveRecalculation(true);}
+void testWithoutFootprints() {testSelectiveRecalculation(false);}
+
+// Built-in velocity-dependent elements now declare that, so a change to
+// Dynamics-stage inputs doesn't recalculate them, but the result is the
+// same as before.
+void testBuiltInClasses() {
+    MultibodySystem system;
+    SimbodyMatterSubsystem matter(system);
+    GeneralForceSubsystem forces(system);
+    Force::DiscreteForces discrete(forces, matter);
+    const Body::Rigid body(MassProperties(1, Vec3(0), UnitInertia(1)));
+    MobilizedBody::Free a(matter.updGround(), Vec3(0), body, Vec3(0));
+    MobilizedBody::Free b(a, Vec3(1,0,0), body, Vec3(0));
+    Force::TwoPointLinearSpring(forces, a, Vec3(0), b, Vec3(0), 10, .5);
+    Force::TwoPointLinearDamper(forces, a, Vec3(0,.1,0), b, Vec3(0), 3);
+    Force::GlobalDamper(forces, matter, .5);
+    Force::LinearBushing(forces, a, Transform(), b, Transform(),
+                         Vec6(1,2,3,4,5,6), Vec6(.1,.2,.3,.4,.5,.6));
+    system.realizeTopology();
+    State state = system.getDefaultState();
+    for (int i=0; i < state.getNQ(); ++i) state.updQ()[i] = .05*i;
+    for (int i=0; i < state.getNU(); ++i) state.updU()[i] = .1*(i-5);
+    system.realize(state, Stage::Dynamics);
+    const Vector_<SpatialVec> before =
+        system.getRigidBodyForces(state, Stage::Dynamics);
+
+    const SpatialVec extra(Vec3(1,2,3), Vec3(4,5,6));
+    discrete.setOneBodyForce(state, b, extra);
+    system.realize(state, Stage::Dynamics);
+    Vector_<SpatialVec> expected = before;
+    expected[b.getMobilizedBodyIndex()] += extra;
+    SimTK_TEST_EQ(system.getRigidBodyForces(state, Stage::Dynamics),
+                  expected);
+
+}
+
+int main() {
+    SimTK_START_TEST("TestForceDependencyCache");
+        SimTK_SUBTEST(testWithFootprints);
+        SimTK_SUBTEST(testWithoutFootprints);
+        SimTK_SUBTEST(testBuiltInClasses);
+    SimTK_END_TEST();
+}
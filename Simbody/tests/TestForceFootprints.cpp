@@ -0,0 +1,204 @@
+/* -------------------------------------------------------------------------- *
+ *                       Simbody(tm): SimTKsimbody                            *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+// Check that force elements that declare which bodies and mobilizers they
+// affect still produce the same total forces when GeneralForceSubsystem uses
+// those footprints to skip untouched entries and to evaluate them in
+// parallel without private force arrays.
+
+#include "SimTKsimbody.h"
+#include "SimTKcommon/Testing.h"
+
+#include <iostream>
+
+using namespace SimTK;
+using std::cout; using std::endl;
+
+// A position-dependent force pulling a body's origin toward a fixed point,
+// with a declared footprint.
+class Tether : public Force::Custom::Implementation {
+public:
+    Tether(const MobilizedBody& body, const Vec3& anchor, Real k)
+    :   body(body), anchor(anchor), k(k) {}
+    void calcForce(const State& state, Vector_<SpatialVec>& bodyForces,
+                   Vector_<Vec3>& particleForces, Vector& mobilityForces)
+                   const override {
+        const Vec3 p = body.getBodyOriginLocation(state);
+        bodyForces[body.getMobilizedBodyIndex()][1] += k*(anchor - p);
+    }
+    Real calcPotentialEnergy(const State& state) const override {
+        return k*(anchor - body.getBodyOriginLocation(state)).normSqr()/2;
+    }
+    bool dependsOnlyOnPositions() const override {return true;}
+    bool getForceFootprint(Array_<MobilizedBodyIndex>& bodies,
+                           Array_<MobilizedBodyIndex>& mobilizers)
+                           const override {
+        bodies.push_back(body.getMobilizedBodyIndex());
+        return true;
+    }
+private:
+    const MobilizedBody body;
+    const Vec3          anchor;
+    const Real          k;
+};
+
+// A chain of pin-jointed pairs of free bodies, with springs between
+// neighbors, mobility springs and dampers on the pins, tethers, and
+// (optionally) gravity, which has no footprint.
+class TestSystem {
+public:
+    TestSystem(int nBodies, bool withGravity) : matter(system), forces(system) {
+        const Body::Rigid box(MassProperties(2, Vec3(0),
+                              UnitInertia::brick(.2,.1,.2)));
+        const Body::Rigid arm(MassProperties(.5, Vec3(0,-.5,0),
+            UnitInertia::cylinderAlongY(.05,.5).shiftFromCentroid(Vec3(0,-.5,0))));
+        for (int i=0; i < nBodies; ++i) {
+            MobilizedBody::Free free(matter.updGround(),
+                Vec3(i % 10, 0, i / 10), box, Vec3(0));
+            MobilizedBody::Pin pin(free, Vec3(0,-.1,0), arm, Vec3(0));
+            bodies.push_back(free);
+            pins.push_back(pin);
+        }
+        for (int i=0; i+1 < nBodies; ++i) {
+            Force::TwoPointLinearSpring(forces, bodies[i], Vec3(.1,0,0),
+                                        bodies[i+1], Vec3(0,.1,0), 10, .5);
+            Force::TwoPointLinearDamper(forces, pins[i], Vec3(0,0,.1),
+                                        pins[i+1], Vec3(.1,0,0), 2);
+        }
+        for (int i=0; i < nBodies; ++i) {
+            Force::MobilityLinearSpring(forces, pins[i], MobilizerQIndex(0),
+                                        3, .2);
+            Force::MobilityLinearDamper(forces, pins[i], MobilizerUIndex(0),
+                                        .5);
+            Force::Custom(forces, new Tether(pins[i], Vec3(i,-2,0), 4));
+        }
+        if (withGravity)
+            Force::Gravity(forces, matter, -YAxis, 9.8);
+        system.realizeTopology();
+
+        state = system.getDefaultState();
+        Random::Uniform random(-1, 1);
+        random.setSeed(7);
+        for (int i=0; i < state.getNQ(); ++i)
+            state.updQ()[i] += random.getValue();
+        for (int i=0; i < state.getNU(); ++i)
+            state.updU()[i] = random.getValue();
+        system.realize(state, Stage::Position);
+        matter.normalizeQuaternions(state);
+    }
+
+    // Sum the forces element by element using Force::calcForceContribution()
+    // which knows nothing about footprints.
+    void calcExpected(Vector_<SpatialVec>& bodyForces, Vector& mobForces) {
+        system.realize(state, Stage::Velocity);
+        bodyForces.resize(matter.getNumBodies());
+        bodyForces.setToZero();
+        mobForces.resize(state.getNU());
+        mobForces.setToZero();
+        Vector_<SpatialVec> F; Vector_<Vec3> P; Vector f;
+        for (int i=0; i < forces.getNumForces(); ++i) {
+            forces.getForce(ForceIndex(i))
+                  .calcForceContribution(state, F, P, f);
+            bodyForces += F;
+            mobForces += f;
+        }
+    }
+
+    void checkForces() {
+        Vector_<SpatialVec> bodyForces; Vector mobForces;
+        calcExpected(bodyForces, mobForces);
+        system.realize(state, Stage::Dynamics);
+        SimTK_TEST_EQ(system.getRigidBodyForces(state, Stage::Dynamics),
+                      bodyForces);
+        SimTK_TEST_EQ(system.getMobilityForces(state, Stage::Dynamics),
+                      mobForces);
+    }
+
+    MultibodySystem             system;
+    SimbodyMatterSubsystem      matter;
+    GeneralForceSubsystem       forces;
+    Array_<MobilizedBody>       bodies, pins;
+    State                       state;
+};
+
+// With footprints on all the position-only forces the cached position-only
+// forces are zeroed and added only where they can be nonzero.
+void testSparseCache() {
+    TestSystem test(20, false);
+    test.checkForces();
+
+    // Now the cache is reused when only velocities change ...
+    test.state.updU()[3] += .2;
+    test.checkForces();
+
+    // ... and recomputed (sparsely) when positions change.
+    test.state.updQ()[5] += .1;
+    test.checkForces();
+
+    // Disabling some of the cached elements must leave their entries zero.
+    for (int i=0; i < 10; ++i)
+        test.forces.updForce(ForceIndex(i)).disable(test.state);
+    test.checkForces();
+}
+
+// Gravity has no footprint, so the full arrays are used for the cache.
+void testWithoutFootprint() {
+    TestSystem test(10, true);
+    test.checkForces();
+    test.state.updQ()[2] += .1;
+    test.checkForces();
+}
+
+// In parallel, elements with footprints are evaluated a color at a time
+// directly into the System's arrays; the rest still use private arrays.
+// Results must match serial evaluation to roundoff and be repeatable.
+void testParallel() {
+    for (int withGravity=0; withGravity <= 1; ++withGravity) {
+        TestSystem test(50, withGravity != 0);
+        test.forces.setUseParallelForceEvaluation(true, 4);
+        test.forces.setMinForcesForParallelEvaluation(1);
+        test.checkForces();
+
+        const Vector_<SpatialVec> F4 =
+            test.system.getRigidBodyForces(test.state, Stage::Dynamics);
+        for (int trial=0; trial < 3; ++trial) {
+            test.state.invalidateAllCacheAtOrAbove(Stage::Position);
+            test.system.realize(test.state, Stage::Dynamics);
+            const Vector_<SpatialVec>& again =
+                test.system.getRigidBodyForces(test.state, Stage::Dynamics);
+            for (int i=0; i < again.size(); ++i)
+                SimTK_TEST(again[i] == F4[i]);
+        }
+
+        test.state.updU()[1] += .3;
+        test.checkForces();
+    }
+}
+
+int main() {
+    SimTK_START_TEST("TestForceFootprints");
+        SimTK_SUBTEST(testSparseCache);
+        SimTK_SUBTEST(testWithoutFootprint);
+        SimTK_SUBTEST(testParallel);
+    SimTK_END_TEST();
+}
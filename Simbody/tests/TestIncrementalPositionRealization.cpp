@@ -0,0 +1,313 @@
+/* -------------------------------------------------------------------------- *
+ *                               Simbody(tm)                                  *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+// Check that incremental position realization, which recalculates kinematics
+// only for bodies whose q's have changed and their descendents, gives exactly
+// the same results as recalculating everything.
+
+#include "SimTKsimbody.h"
+#include "SimTKcommon/Testing.h"
+
+#include <iostream>
+
+using namespace SimTK;
+using std::cout; using std::endl;
+
+// A free-floating torso with two three-link arms, whose hands are tied
+// together by a rod so there are position errors besides the quaternion ones,
+// and a separate two-link leg on Ground that the arms don't affect. Bodies 2
+// and 6 are the left shoulder and the right elbow.
+static void buildSystem(MultibodySystem& system,
+                        SimbodyMatterSubsystem& matter) {
+    const Body::Rigid torso(MassProperties(10, Vec3(0),
+                                           UnitInertia::brick(.2,.3,.1)));
+    const Body::Rigid link(MassProperties(1, Vec3(0,-.25,0),
+        UnitInertia::cylinderAlongY(.03,.25).shiftFromCentroid(Vec3(0,-.25,0))));
+
+    MobilizedBody::Free chest(matter.updGround(), Vec3(0,2,0),
+                              torso, Vec3(0));
+    MobilizedBody hand[2];
+    for (int side=0; side < 2; ++side) {
+        const Real x = side == 0 ? -.25 : .25;
+        MobilizedBody::Ball shoulder(chest, Vec3(x,.25,0), link, Vec3(0));
+        MobilizedBody::Pin  elbow(shoulder, Vec3(0,-.5,0), link, Vec3(0));
+        hand[side] = MobilizedBody::Pin(elbow, Vec3(0,-.5,0), link, Vec3(0));
+    }
+    Constraint::Rod(hand[0], Vec3(0,-.2,0), hand[1], Vec3(0,-.2,0), .3);
+
+    MobilizedBody::Pin thigh(matter.updGround(), Vec3(1,1,0), link, Vec3(0));
+    MobilizedBody::Slider(thigh, Vec3(0,-.5,0), link, Vec3(0));
+}
+
+static void setRandomState(State& state) {
+    Random::Uniform random(-1, 1);
+    random.setSeed(11);
+    for (int i=0; i < state.getNQ(); ++i) state.updQ()[i] = random.getValue();
+    for (int i=0; i < state.getNU(); ++i) state.updU()[i] = random.getValue();
+}
+
+// Realize with incremental realization turned off.
+static void realizeFully(SimbodyMatterSubsystem& matter, const State& state,
+                         Stage g) {
+    const bool incremental = matter.getUseIncrementalPositionRealization();
+    matter.setUseIncrementalPositionRealization(false);
+    matter.getSystem().realize(state, g);
+    matter.setUseIncrementalPositionRealization(incremental);
+}
+
+// Both States must be realized through Acceleration stage. The answers
+// should be bitwise identical.
+static void compareResults(const SimbodyMatterSubsystem& matter,
+                           const State& s1, const State& s2) {
+    for (MobilizedBodyIndex mbx(0); mbx < matter.getNumBodies(); ++mbx) {
+        const MobilizedBody& mobod = matter.getMobilizedBody(mbx);
+        const Transform& X1 = mobod.getBodyTransform(s1);
+        const Transform& X2 = mobod.getBodyTransform(s2);
+        SimTK_TEST(X1.p() == X2.p());
+        SimTK_TEST(X1.R().asMat33() == X2.R().asMat33());
+        SimTK_TEST(mobod.getBodyOriginLocation(s1)
+                   == mobod.getBodyOriginLocation(s2));
+    }
+    SimTK_TEST(s1.getQErr().size() == s2.getQErr().size());
+    for (int i=0; i < s1.getQErr().size(); ++i)
+        SimTK_TEST(s1.getQErr()[i] == s2.getQErr()[i]);
+    for (int i=0; i < s1.getUDot().size(); ++i)
+        SimTK_TEST(s1.getUDot()[i] == s2.getUDot()[i]);
+}
+
+// Count the mobilized bodies that are mbx or outboard of it.
+static int countSubtree(const SimbodyMatterSubsystem& matter,
+                        MobilizedBodyIndex mbx) {
+    int n = 0;
+    for (MobilizedBodyIndex b(0); b < matter.getNumBodies(); ++b) {
+        MobilizedBodyIndex a = b;
+        while (a != mbx && a != GroundIndex)
+            a = matter.getMobilizedBody(a).getParentMobilizedBody()
+                      .getMobilizedBodyIndex();
+        if (a == mbx) ++n;
+    }
+    return n;
+}
+
+static MobilizedBodyIndex findBodyOfQ(const SimbodyMatterSubsystem& matter,
+                                      const State& state, int qx) {
+    for (MobilizedBodyIndex mbx(1); mbx < matter.getNumBodies(); ++mbx) {
+        const MobilizedBody& mobod = matter.getMobilizedBody(mbx);
+        const int first = mobod.getFirstQIndex(state);
+        if (first <= qx && qx < first + mobod.getNumQ(state))
+            return mbx;
+    }
+    return MobilizedBodyIndex();
+}
+
+// Perturb one q at a time as for a finite difference Jacobian. Only the
+// affected subtree should be recalculated each time.
+void testPerturbingOneQ() {
+    MultibodySystem system;
+    SimbodyMatterSubsystem matter(system);
+    GeneralForceSubsystem forces(system);
+    Force::Gravity gravity(forces, matter, -YAxis, 9.8);
+    buildSystem(system, matter);
+    const int nb = matter.getNumBodies();
+
+    SimTK_TEST(!matter.getUseIncrementalPositionRealization());
+    matter.setUseIncrementalPositionRealization(true);
+    SimTK_TEST(matter.getUseIncrementalPositionRealization());
+
+    State state = system.realizeTopology();
+    setRandomState(state);
+    State ref = state;
+
+    // Nothing is known the first time.
+    matter.resetPositionRealizationStatistics();
+    system.realize(state, Stage::Acceleration);
+    SimTK_TEST(matter.getNumBodyPositionRealizations() == nb);
+    realizeFully(matter, ref, Stage::Acceleration);
+    SimTK_TEST(matter.getNumBodyPositionRealizations() == 2*nb);
+    compareResults(matter, state, ref);
+
+    // Invalidating the position stage without changing any q's costs
+    // nothing.
+    matter.resetPositionRealizationStatistics();
+    state.invalidateAllCacheAtOrAbove(Stage::Position);
+    system.realize(state, Stage::Acceleration);
+    SimTK_TEST(matter.getNumBodyPositionRealizations() == 0);
+    compareResults(matter, state, ref);
+
+    const Vector q0 = state.getQ();
+    int nIncremental = 0;
+    for (int i=0; i < state.getNQ(); ++i) {
+        const MobilizedBodyIndex mbx = findBodyOfQ(matter, state, i);
+        state.updQ()[i] = q0[i] + 1e-3;
+        ref.updQ()[i]   = q0[i] + 1e-3;
+
+        matter.resetPositionRealizationStatistics();
+        system.realize(state, Stage::Acceleration);
+        SimTK_TEST(matter.getNumBodyPositionRealizations()
+                   == countSubtree(matter, mbx));
+        nIncremental += matter.getNumBodyPositionRealizations();
+
+        realizeFully(matter, ref, Stage::Acceleration);
+        compareResults(matter, state, ref);
+
+        // Put it back; that recalculates the same subtree again.
+        state.updQ()[i] = q0[i];
+        ref.updQ()[i]   = q0[i];
+        matter.resetPositionRealizationStatistics();
+        system.realize(state, Stage::Position);
+        SimTK_TEST(matter.getNumBodyPositionRealizations()
+                   == countSubtree(matter, mbx));
+    }
+    // Most q's move only a few bodies, so we should have saved a lot.
+    SimTK_TEST(nIncremental < state.getNQ()*nb/2);
+
+    // Changing several q's at once works too.
+    state.updQ()[0] += .1; state.updQ()[state.getNQ()-1] -= .1;
+    ref.updQ() = state.getQ();
+    system.realize(state, Stage::Acceleration);
+    realizeFully(matter, ref, Stage::Acceleration);
+    compareResults(matter, state, ref);
+}
+
+// Copies of a State carry along the kinematics from which they were copied.
+void testCopiedStates() {
+    MultibodySystem system;
+    SimbodyMatterSubsystem matter(system);
+    GeneralForceSubsystem forces(system);
+    Force::Gravity gravity(forces, matter, -YAxis, 9.8);
+    buildSystem(system, matter);
+    matter.setUseIncrementalPositionRealization(true);
+
+    State state = system.realizeTopology();
+    setRandomState(state);
+    system.realize(state, Stage::Acceleration);
+
+    // Copies only go through Instance stage, but the q's haven't changed so
+    // nothing needs recalculating. The quaternion errors must come back even
+    // though they weren't copied.
+    State copy(state);
+    matter.resetPositionRealizationStatistics();
+    system.realize(copy, Stage::Acceleration);
+    SimTK_TEST(matter.getNumBodyPositionRealizations() == 0);
+    compareResults(matter, copy, state);
+
+    // Changing the copy doesn't affect the original. Bending the right elbow
+    // moves the right hand.
+    const MobilizedBody& elbow = matter.getMobilizedBody(MobilizedBodyIndex(6));
+    const MobilizedBody& hand = matter.getMobilizedBody(MobilizedBodyIndex(7));
+    const Transform X_GB = hand.getBodyTransform(state);
+    copy.updQ()[elbow.getFirstQIndex(copy)] += .2;
+    system.realize(copy, Stage::Acceleration);
+    SimTK_TEST(hand.getBodyTransform(copy).p() != X_GB.p());
+    SimTK_TEST(hand.getBodyTransform(state).p() == X_GB.p());
+
+    State ref = copy;
+    realizeFully(matter, ref, Stage::Acceleration);
+    compareResults(matter, copy, ref);
+
+    // Assignment over a State with different kinematics.
+    copy = state;
+    system.realize(copy, Stage::Acceleration);
+    compareResults(matter, copy, state);
+
+    // Simulate a little to exercise the State copies made by the integrator,
+    // and compare with doing the same thing without incremental realization.
+    // The random configuration doesn't satisfy the constraint so assemble
+    // it first.
+    State init = state;
+    Assembler(system).assemble(init);
+    RungeKuttaMersonIntegrator integ(system);
+    integ.setAccuracy(1e-6);
+    TimeStepper ts(system, integ);
+    ts.initialize(init);
+    ts.stepTo(0.1);
+
+    matter.setUseIncrementalPositionRealization(false);
+    RungeKuttaMersonIntegrator integ2(system);
+    integ2.setAccuracy(1e-6);
+    TimeStepper ts2(system, integ2);
+    ts2.initialize(init);
+    ts2.stepTo(0.1);
+
+    const State& s1 = ts.getState();
+    const State& s2 = ts2.getState();
+    SimTK_TEST(s1.getTime() == s2.getTime());
+    for (int i=0; i < s1.getNY(); ++i)
+        SimTK_TEST(s1.getY()[i] == s2.getY()[i]);
+}
+
+// Changes at Instance stage or earlier must cause everything to be
+// recalculated.
+void testInstanceChanges() {
+    MultibodySystem system;
+    SimbodyMatterSubsystem matter(system);
+    GeneralForceSubsystem forces(system);
+    Force::Gravity gravity(forces, matter, -YAxis, 9.8);
+    buildSystem(system, matter);
+    matter.setUseIncrementalPositionRealization(true);
+    const int nb = matter.getNumBodies();
+
+    State state = system.realizeTopology();
+    setRandomState(state);
+    system.realize(state, Stage::Acceleration);
+
+    // Lock a mobilizer (an Instance-stage change).
+    const MobilizedBody& body = matter.getMobilizedBody(MobilizedBodyIndex(2));
+    body.lock(state);
+    matter.resetPositionRealizationStatistics();
+    system.realize(state, Stage::Acceleration);
+    SimTK_TEST(matter.getNumBodyPositionRealizations() == nb);
+    State ref = state;
+    realizeFully(matter, ref, Stage::Acceleration);
+    compareResults(matter, state, ref);
+    body.unlock(state);
+
+    // Switch to Euler angles (a Model-stage change), which changes the
+    // number of q's.
+    matter.setUseEulerAngles(state, true);
+    system.realizeModel(state);
+    setRandomState(state);
+    matter.resetPositionRealizationStatistics();
+    system.realize(state, Stage::Acceleration);
+    SimTK_TEST(matter.getNumBodyPositionRealizations() == nb);
+    ref = state;
+    realizeFully(matter, ref, Stage::Acceleration);
+    compareResults(matter, state, ref);
+
+    state.updQ()[0] += .1;
+    matter.resetPositionRealizationStatistics();
+    system.realize(state, Stage::Acceleration);
+    SimTK_TEST(matter.getNumBodyPositionRealizations()
+               == countSubtree(matter, findBodyOfQ(matter, state, 0)));
+    ref.updQ()[0] = state.getQ()[0];
+    realizeFully(matter, ref, Stage::Acceleration);
+    compareResults(matter, state, ref);
+}
+
+int main() {
+    SimTK_START_TEST("TestIncrementalPositionRealization");
+        SimTK_SUBTEST(testPerturbingOneQ);
+        SimTK_SUBTEST(testCopiedStates);
+        SimTK_SUBTEST(testInstanceChanges);
+    SimTK_END_TEST();
+}
@@ -1037,6 +1037,278 @@ void testCompositeInertia() {
     //cout << "udots=" << state.getUDot() << endl;
 }
 
+// calcM() and calcMInv() compute the whole matrices directly rather than a
+// column at a time. Check them against multiplyByM() and multiplyByMInv() on
+// a branched tree that includes a weld, lone particles, and prescribed 
+// mobilizers (whose rows and columns of M^-1 must be zero).
+void testDirectMassMatrix() {
+    MultibodySystem         mbs;
+    SimbodyMatterSubsystem  matter(mbs);
+    Body::Rigid body(MassProperties(1.3, Vec3(.1,.2,-.3), 
+                                    UnitInertia(1.2,1.1,1.3,.01,-.02,.03)));
+
+    MobilizedBody::Free base(matter.Ground(), Vec3(0,1,0), body, Vec3(0,-.2,0));
+    MobilizedBody::Pin arm1(base, Vec3(.5,0,0), body, Vec3(0,.5,0));
+    MobilizedBody::Ball arm2(arm1, Vec3(0,-.5,0), body, Vec3(0,.5,0));
+    MobilizedBody::Weld hand(arm2, Vec3(0,-.5,0), body, Vec3(0,.2,0));
+    MobilizedBody::Slider finger(hand, Vec3(.1,0,0), body, Vec3(0));
+    MobilizedBody::Gimbal leg1(base, Vec3(-.5,0,0), body, Vec3(0,.5,0));
+    MobilizedBody::Pin leg2(leg1, Vec3(0,-.5,0), body, Vec3(0,.5,0));
+    MobilizedBody::Ball foot(leg2, Vec3(0,-.5,0), body, Vec3(0,.1,0));
+    Motion::Sinusoid(leg2, Motion::Position, .5, 2, .1);
+    MobilizedBody::Universal other(matter.Ground(), Vec3(3,0,0), 
+                                   body, Vec3(0,1,0));
+    MobilizedBody::Translation particle1(matter.Ground(), body);
+    MobilizedBody::Translation particle2(matter.Ground(), body);
+    Motion::Sinusoid(particle2, Motion::Position, .5, 2, .1);
+
+    State state = mbs.realizeTopology();
+    state.updQ() = Test::randVector(state.getNQ());
+    mbs.realize(state, Stage::Position);
+    const int nu = state.getNU();
+    // calcMInv() works on blocks of 16 columns; make sure there is more than
+    // one and that a block boundary falls within a body's mobilities.
+    SimTK_TEST(nu > 16);
+    SimTK_TEST(foot.getFirstUIndex(state) < 16
+               && 16 < foot.getFirstUIndex(state) + foot.getNumU(state));
+
+    Matrix M(nu,nu), MInv(nu,nu);
+    Vector v(nu, Real(0));
+    for (int j=0; j < nu; ++j) {
+        v[j] = 1;
+        matter.multiplyByM(state, v, M(j));
+        matter.multiplyByMInv(state, v, MInv(j));
+        v[j] = 0;
+    }
+
+    Matrix MM, MMInv;
+    matter.calcM(state, MM); matter.calcMInv(state, MMInv);
+    SimTK_TEST_EQ_SIZE(MM, M, nu);
+    SimTK_TEST_EQ_SIZE(MMInv, MInv, nu);
+
+    // These should be exactly symmetric.
+    for (int i=0; i < nu; ++i)
+        for (int j=0; j < i; ++j) {
+            SimTK_TEST(MM(i,j) == MM(j,i));
+            SimTK_TEST(MMInv(i,j) == MMInv(j,i));
+        }
+
+    // Prescribed mobilities have zero rows and columns in M^-1.
+    const UIndex prescribed[] = {leg2.getFirstUIndex(state),
+                                 particle2.getFirstUIndex(state)};
+    for (int p=0; p < 2; ++p)
+        for (int i=0; i < nu; ++i) {
+            SimTK_TEST(MMInv(prescribed[p],i) == 0);
+            SimTK_TEST(MMInv(i,prescribed[p]) == 0);
+        }
+
+    // Mobilities on unrelated branches are exactly uncoupled in M.
+    for (int i=0; i < 6; ++i)
+        SimTK_TEST(MM(base.getFirstUIndex(state)+i, 
+                      other.getFirstUIndex(state)) == 0);
+    SimTK_TEST(MM(foot.getFirstUIndex(state), 
+                  finger.getFirstUIndex(state)) == 0);
+
+    // Output into a non-contiguous block of a larger matrix should work too.
+    Matrix big(nu+2, nu+2, Real(-1));
+    MatrixView block = big.updBlock(1,1,nu,nu);
+    matter.calcM(state, block);
+    SimTK_TEST_EQ(big.block(1,1,nu,nu), MM);
+    matter.calcMInv(state, block);
+    SimTK_TEST_EQ(big.block(1,1,nu,nu), MMInv);
+    SimTK_TEST(big(0,0) == -1 && big(nu+1,nu+1) == -1);
+}
+
+// Check solves using the sparse factorization of M against M^-1, including
+// multiple right-hand sides, locked mobilizers, and non-contiguous arguments.
+void testMassMatrixFactorization() {
+    MultibodySystem system;
+    MyForceImpl* frcp;
+    makeSystem(false, system, frcp);
+    const SimbodyMatterSubsystem& matter = system.getMatterSubsystem();
+
+    State state = system.realizeTopology();
+    system.realizeModel(state);
+    const MobilizedBody& locked = matter.getMobilizedBody(MobilizedBodyIndex(3));
+    locked.lock(state);
+    state.updQ() = Test::randVector(state.getNQ());
+    system.realize(state, Stage::Position);
+    const int nu = state.getNU();
+
+    Matrix MInv;
+    matter.calcMInv(state, MInv);
+
+    const int nrhs = 5;
+    Matrix F(nu, nrhs);
+    for (int j=0; j < nrhs; ++j) F(j) = Test::randVector(nu);
+
+    Matrix X;
+    matter.solveUsingMassMatrixFactorization(state, F, X);
+    SimTK_TEST(X.nrow() == nu && X.ncol() == nrhs);
+    SimTK_TEST_EQ_SIZE(X, MInv*F, nu);
+
+    // Locked mobilities are prescribed so their results must be zero.
+    for (int i=0; i < locked.getNumU(state); ++i)
+        for (int j=0; j < nrhs; ++j)
+            SimTK_TEST(X(locked.getFirstUIndex(state)+i, j) == 0);
+
+    // Single right-hand side should agree with the O(n) operator.
+    Vector x, MInvf;
+    matter.solveUsingMassMatrixFactorization(state, F(0), x);
+    matter.multiplyByMInv(state, F(0), MInvf);
+    SimTK_TEST_EQ_SIZE(x, MInvf, nu);
+
+    // Non-contiguous arguments, solving in place.
+    Matrix big(nu+2, nrhs, Real(-1));
+    MatrixView block = big.updBlock(1,0,nu,nrhs);
+    block = F;
+    matter.solveUsingMassMatrixFactorization(state, block, block);
+    SimTK_TEST_EQ(big.block(1,0,nu,nrhs), X);
+    SimTK_TEST(big(0,0) == -1 && big(nu+1,nrhs-1) == -1);
+
+    SimTK_TEST_MUST_THROW(
+        matter.solveUsingMassMatrixFactorization(state, Matrix(nu+1,2), X));
+
+    // A new configuration requires a new factorization.
+    state.updQ() = Test::randVector(state.getNQ());
+    system.realize(state, Stage::Position);
+    matter.calcMInv(state, MInv);
+    matter.solveUsingMassMatrixFactorization(state, F, X);
+    SimTK_TEST_EQ_SIZE(X, MInv*F, nu);
+
+    matter.invalidateMassMatrixFactorization(state);
+    matter.realizeMassMatrixFactorization(state);
+    matter.solveUsingMassMatrixFactorization(state, F, X);
+    SimTK_TEST_EQ_SIZE(X, MInv*F, nu);
+}
+
+// The matrix versions of multiplyByM() and multiplyByMInv() must give the
+// same answers as the vector versions applied column by column.
+void testMultipleColumns() {
+    MultibodySystem system;
+    MyForceImpl* frcp;
+    makeSystem(false, system, frcp);
+    SimbodyMatterSubsystem& matter = system.updMatterSubsystem();
+    MobilizedBody::Translation particle(matter.updGround(), Vec3(1,2,3),
+        Body::Rigid(MassProperties(2.5, Vec3(0), UnitInertia(0))), Vec3(0));
+
+    State state = system.realizeTopology();
+    system.realizeModel(state);
+    const MobilizedBody& locked = matter.getMobilizedBody(MobilizedBodyIndex(4));
+    locked.lock(state);
+    state.updQ() = Test::randVector(state.getNQ());
+    system.realize(state, Stage::Position);
+    const int nu = state.getNU();
+
+    const int ncol = 7;
+    Matrix F(nu, ncol);
+    for (int j=0; j < ncol; ++j) F(j) = Test::randVector(nu);
+
+    Matrix MF, MInvF;
+    matter.multiplyByM(state, F, MF);
+    matter.multiplyByMInv(state, F, MInvF);
+    SimTK_TEST(MF.nrow() == nu && MF.ncol() == ncol);
+    SimTK_TEST(MInvF.nrow() == nu && MInvF.ncol() == ncol);
+    for (int j=0; j < ncol; ++j) {
+        Vector Mf, MInvf;
+        matter.multiplyByM(state, F(j), Mf);
+        matter.multiplyByMInv(state, F(j), MInvf);
+        SimTK_TEST_EQ(MF(j), Mf);
+        SimTK_TEST_EQ(MInvF(j), MInvf);
+    }
+
+    // Non-contiguous and transposed arguments, and in-place operation.
+    const Matrix Ft = ~F;
+    Matrix big(nu+3, ncol, Real(-1));
+    MatrixView block = big.updBlock(2,0,nu,ncol);
+    matter.multiplyByMInv(state, ~Ft, block);
+    SimTK_TEST_EQ(block, MInvF);
+    matter.multiplyByM(state, block, block);
+    SimTK_TEST(big(0,0) == -1 && big(nu+2,ncol-1) == -1);
+    Matrix MMInvF(F);
+    matter.multiplyByMInv(state, MMInvF, MMInvF);
+    matter.multiplyByM(state, MMInvF, MMInvF);
+    SimTK_TEST_EQ(block, MMInvF);
+
+    // Locked mobilities have zero rows in M^-1*F. Otherwise M*M^-1 is the
+    // identity.
+    for (int i=0; i < nu; ++i) {
+        const bool isLocked = locked.getFirstUIndex(state) <= i 
+            && i < locked.getFirstUIndex(state) + locked.getNumU(state);
+        for (int j=0; j < ncol; ++j) {
+            if (isLocked) {SimTK_TEST(MInvF(i,j) == 0);}
+            else {SimTK_TEST_EQ_TOL(MMInvF(i,j), F(i,j), 1e-10);}
+        }
+    }
+
+    // Empty matrices are fine; wrong sizes aren't.
+    matter.multiplyByMInv(state, Matrix(nu,0), MInvF);
+    SimTK_TEST(MInvF.nrow() == nu && MInvF.ncol() == 0);
+    SimTK_TEST_MUST_THROW(matter.multiplyByM(state, Matrix(nu-1,2), MF));
+}
+
+// Compare the directly-computed inverse operational space inertias with ones
+// formed explicitly from the task Jacobians and M^-1.
+void testOperationalSpaceInertia() {
+    MultibodySystem system;
+    MyForceImpl* frcp;
+    makeSystem(false, system, frcp);
+    const SimbodyMatterSubsystem& matter = system.getMatterSubsystem();
+
+    State state = system.realizeTopology();
+    system.realizeModel(state);
+    matter.getMobilizedBody(MobilizedBodyIndex(2)).lock(state);
+    state.updQ() = Test::randVector(state.getNQ());
+    system.realize(state, Stage::Position);
+
+    // Include a repeated body and a station on Ground.
+    Array_<MobilizedBodyIndex> onBodyB;
+    Array_<Vec3> pointInB;
+    onBodyB.push_back(MobilizedBodyIndex(5)); pointInB.push_back(Vec3(1,2,3));
+    onBodyB.push_back(MobilizedBodyIndex(3)); pointInB.push_back(Vec3(-1,0,0));
+    onBodyB.push_back(MobilizedBodyIndex(5)); pointInB.push_back(Vec3(0,.5,0));
+    onBodyB.push_back(GroundIndex);           pointInB.push_back(Vec3(1,1,1));
+    onBodyB.push_back(MobilizedBodyIndex(9)); pointInB.push_back(Vec3(0));
+
+    Matrix MInv, JS, JF;
+    matter.calcMInv(state, MInv);
+    matter.calcStationJacobian(state, onBodyB, pointInB, JS);
+    matter.calcFrameJacobian(state, onBodyB, pointInB, JF);
+
+    Matrix LambdaInvS, LambdaInvF;
+    matter.calcStationOperationalSpaceInertiaInverse
+       (state, onBodyB, pointInB, LambdaInvS);
+    SimTK_TEST(LambdaInvS.nrow() == 15 && LambdaInvS.ncol() == 15);
+    SimTK_TEST_EQ_SIZE(LambdaInvS, JS*MInv*~JS, state.getNU());
+
+    matter.calcFrameOperationalSpaceInertiaInverse
+       (state, onBodyB, pointInB, LambdaInvF);
+    SimTK_TEST(LambdaInvF.nrow() == 30 && LambdaInvF.ncol() == 30);
+    SimTK_TEST_EQ_SIZE(LambdaInvF, JF*MInv*~JF, state.getNU());
+
+    // Asking again for the same tasks gives the same answer.
+    Matrix again;
+    matter.calcFrameOperationalSpaceInertiaInverse
+       (state, onBodyB, pointInB, again);
+    SimTK_TEST_EQ(again, LambdaInvF);
+    matter.calcStationOperationalSpaceInertiaInverse
+       (state, onBodyB, pointInB, again);
+    SimTK_TEST_EQ(again, LambdaInvS);
+
+    // A different configuration needs a new calculation.
+    state.updQ() = Test::randVector(state.getNQ());
+    system.realize(state, Stage::Position);
+    matter.calcMInv(state, MInv);
+    matter.calcStationJacobian(state, onBodyB, pointInB, JS);
+    matter.calcStationOperationalSpaceInertiaInverse
+       (state, onBodyB, pointInB, LambdaInvS);
+    SimTK_TEST_EQ_SIZE(LambdaInvS, JS*MInv*~JS, state.getNU());
+
+    pointInB.pop_back();
+    SimTK_TEST_MUST_THROW(matter.calcStationOperationalSpaceInertiaInverse
+       (state, onBodyB, pointInB, LambdaInvS));
+}
+
 void testTaskJacobians() {
     MultibodySystem system;
     MyForceImpl* frcp;
@@ -1240,6 +1512,10 @@ int main() {
         SimTK_SUBTEST(testRel2Cart);
         SimTK_SUBTEST(testJacobianBiasTerms);
         SimTK_SUBTEST(testCompositeInertia);
+        SimTK_SUBTEST(testDirectMassMatrix);
+        SimTK_SUBTEST(testMassMatrixFactorization);
+        SimTK_SUBTEST(testMultipleColumns);
+        SimTK_SUBTEST(testOperationalSpaceInertia);
         SimTK_SUBTEST(testUnconstrainedSystem);
         SimTK_SUBTEST(testConstrainedSystem);
         SimTK_SUBTEST(testTaskJacobians);
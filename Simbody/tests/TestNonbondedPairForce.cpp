@@ -0,0 +1,250 @@
+/* -------------------------------------------------------------------------- *
+ *                       Simbody(tm): SimTKsimbody                            *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+// Check that Force::NonbondedPairForce gets the same forces and energy as
+// summing over all pairs, that its neighbor list is reused and rebuilt when
+// it should be, and that parallel evaluation agrees with serial.
+
+#include "SimTKsimbody.h"
+#include "SimTKcommon/Testing.h"
+
+#include <iostream>
+
+using namespace SimTK;
+using std::cout; using std::endl;
+
+typedef Force::NonbondedPairForce::SiteProperties SiteProperties;
+
+const Real Cutoff = 1.2, Skin = .3;
+
+// Free bodies scattered through a box, each with one or two sites, and all
+// three built-in potentials.
+class TestSystem {
+public:
+    explicit TestSystem(int nBodies)
+    :   matter(system), forces(system) {
+        pairs = Force::NonbondedPairForce(forces, matter, Cutoff, Skin);
+        pairs.adoptPotential(new Force::NonbondedPairForce::LennardJones());
+        pairs.adoptPotential(new Force::NonbondedPairForce::SoftSphere(50));
+        pairs.adoptPotential
+           (new Force::NonbondedPairForce::CoulombCutoff(1.5));
+
+        const Body::Rigid ball(MassProperties(1, Vec3(0), UnitInertia(1)));
+        Random::Uniform random(0, 1);
+        random.setSeed(17);
+        const Real side = std::cbrt(Real(nBodies)) * .9;
+        for (int b=0; b < nBodies; ++b) {
+            MobilizedBody::Free mobod(matter.updGround(), ball);
+            mobod.setDefaultTranslation(side*Vec3(random.getValue(),
+                                                  random.getValue(),
+                                                  random.getValue()));
+            const int nSites = b % 3 == 0 ? 2 : 1;
+            for (int k=0; k < nSites; ++k) {
+                const SiteProperties props(random.getValue()-.5,
+                                           .2 + .1*random.getValue(),
+                                           .5 + random.getValue());
+                const Vec3 site = k == 0 ? Vec3(0) : Vec3(.1,-.05,.08);
+                pairs.addSite(mobod, site, props);
+                body.push_back(mobod.getMobilizedBodyIndex());
+                station.push_back(site);
+            }
+        }
+        system.realizeTopology();
+        state = system.getDefaultState();
+        Random::Uniform perturb(-.3, .3);
+        perturb.setSeed(5);
+        for (int i=0; i < state.getNQ(); ++i)
+            state.updQ()[i] += perturb.getValue();
+        system.realize(state, Stage::Position);
+        matter.normalizeQuaternions(state);
+    }
+
+    Vector_<SpatialVec> calcBodyForces() {
+        system.realize(state, Stage::Dynamics);
+        return system.getRigidBodyForces(state, Stage::Dynamics);
+    }
+
+    // Sum over all pairs of sites on different bodies.
+    Real calcBruteForce(Vector_<SpatialVec>& bodyForces) {
+        system.realize(state, Stage::Position);
+        const int n = pairs.getNumSites();
+        Array_<Vec3> p(n), s(n);
+        for (int i=0; i < n; ++i) {
+            const Transform& X_GB =
+                matter.getMobilizedBody(body[i]).getBodyTransform(state);
+            s[i] = X_GB.R()*station[i];
+            p[i] = X_GB.p() + s[i];
+        }
+        const Force::NonbondedPairForce::LennardJones lj;
+        const Force::NonbondedPairForce::SoftSphere   soft(50);
+        const Force::NonbondedPairForce::CoulombCutoff coulomb(1.5);
+        bodyForces.resize(matter.getNumBodies());
+        bodyForces = SpatialVec(Vec3(0), Vec3(0));
+        Real pe = 0;
+        for (int i=0; i < n; ++i)
+            for (int j=i+1; j < n; ++j) {
+                if (body[i] == body[j]) continue;
+                const Vec3 r = p[j] - p[i];
+                const Real d = r.norm();
+                if (d >= Cutoff) continue;
+                const SiteProperties& pi = pairs.getSiteProperties(i);
+                const SiteProperties& pj = pairs.getSiteProperties(j);
+                Real dEdr, dEdrSum = 0;
+                pe += lj.calcEnergy(d, Cutoff, pi, pj, dEdr); dEdrSum += dEdr;
+                pe += soft.calcEnergy(d, Cutoff, pi, pj, dEdr); dEdrSum += dEdr;
+                pe += coulomb.calcEnergy(d, Cutoff, pi, pj, dEdr);
+                dEdrSum += dEdr;
+                const Vec3 f = (dEdrSum/d)*r;
+                bodyForces[body[i]] += SpatialVec(s[i] % f, f);
+                bodyForces[body[j]] -= SpatialVec(s[j] % f, f);
+            }
+        return pe;
+    }
+
+    MultibodySystem             system;
+    SimbodyMatterSubsystem      matter;
+    GeneralForceSubsystem       forces;
+    Force::NonbondedPairForce   pairs;
+    Array_<MobilizedBodyIndex>  body;
+    Array_<Vec3>                station;
+    State                       state;
+};
+
+void testMatchesBruteForce() {
+    TestSystem test(300);
+    SimTK_TEST(test.pairs.getNumSites() > 300);
+    SimTK_TEST(test.pairs.getNumPotentials() == 3);
+
+    Vector_<SpatialVec> expected;
+    const Real expectedPE = test.calcBruteForce(expected);
+    SimTK_TEST_EQ_TOL(test.calcBodyForces(), expected, 1e-10);
+    SimTK_TEST_EQ_TOL(test.system.calcPotentialEnergy(test.state), expectedPE,
+                      1e-10);
+    // A cell list shouldn't need anything like all the pairs.
+    const int n = test.pairs.getNumSites();
+    SimTK_TEST(test.pairs.getNumNeighborPairs(test.state) > 0);
+    SimTK_TEST(test.pairs.getNumNeighborPairs(test.state) < n*(n-1)/4);
+}
+
+// Small motions reuse the list and still give the right answer; a large one
+// forces a rebuild.
+void testNeighborListReuse() {
+    TestSystem test(200);
+    test.calcBodyForces();
+    SimTK_TEST(test.pairs.getNumNeighborListBuilds(test.state) == 1);
+
+    // Free mobilizer q's are quaternion then translation; move body 1 a
+    // little less than half the skin.
+    const int firstTrans = 4;
+    test.state.updQ()[firstTrans] += .4*Skin;
+    Vector_<SpatialVec> expected;
+    Real expectedPE = test.calcBruteForce(expected);
+    SimTK_TEST_EQ_TOL(test.calcBodyForces(), expected, 1e-10);
+    SimTK_TEST(test.pairs.getNumNeighborListBuilds(test.state) == 1);
+
+    test.state.updQ()[firstTrans] += .4*Skin;
+    expectedPE = test.calcBruteForce(expected);
+    SimTK_TEST_EQ_TOL(test.calcBodyForces(), expected, 1e-10);
+    SimTK_TEST_EQ_TOL(test.system.calcPotentialEnergy(test.state), expectedPE,
+                      1e-10);
+    SimTK_TEST(test.pairs.getNumNeighborListBuilds(test.state) == 2);
+}
+
+void testParallel() {
+    TestSystem test(400);
+    const Vector_<SpatialVec> serial = test.calcBodyForces();
+
+    test.pairs.setUseParallelEvaluation(true, 4);
+    SimTK_TEST(test.pairs.getUseParallelEvaluation());
+    test.state.invalidateAllCacheAtOrAbove(Stage::Position);
+    const Vector_<SpatialVec> parallel = test.calcBodyForces();
+    SimTK_TEST_EQ_TOL(parallel, serial, 1e-12);
+
+    // Repeated evaluation gives bitwise-identical results.
+    for (int k=0; k < 5; ++k) {
+        test.state.invalidateAllCacheAtOrAbove(Stage::Position);
+        const Vector_<SpatialVec> again = test.calcBodyForces();
+        for (int b=0; b < again.size(); ++b)
+            SimTK_TEST(again[b] == parallel[b]);
+    }
+
+    test.pairs.setUseParallelEvaluation(false);
+    SimTK_TEST(!test.pairs.getUseParallelEvaluation());
+}
+
+// The potentials' derivatives agree with their energies, and they are zero
+// at the cutoff.
+void testPotentials() {
+    const SiteProperties s1(.4, .3, 1.2), s2(-.7, .25, .8);
+    const Force::NonbondedPairForce::LennardJones lj;
+    const Force::NonbondedPairForce::SoftSphere   soft(20);
+    const Force::NonbondedPairForce::CoulombCutoff coulomb(2);
+    const Force::NonbondedPairForce::PairPotential* pots[] =
+        {&lj, &soft, &coulomb};
+    const Real h = 1e-6;
+    for (auto pot : pots) {
+        Real dEdr, ignore;
+        SimTK_TEST_EQ_TOL(pot->calcEnergy(Cutoff, Cutoff, s1, s2, dEdr), 0,
+                          1e-14);
+        for (Real r = .35; r < Cutoff; r += .1) {
+            pot->calcEnergy(r, Cutoff, s1, s2, dEdr);
+            const Real numeric =
+                (  pot->calcEnergy(r+h, Cutoff, s1, s2, ignore)
+                 - pot->calcEnergy(r-h, Cutoff, s1, s2, ignore)) / (2*h);
+            SimTK_TEST_EQ_TOL(dEdr, numeric, 1e-5*std::max(Real(1),
+                                                           std::abs(dEdr)));
+        }
+    }
+    // Lennard-Jones minimum is at the sum of the radii.
+    Real dEdr;
+    lj.calcEnergy(.55, Cutoff, s1, s2, dEdr);
+    SimTK_TEST_EQ(dEdr, 0);
+    SimTK_TEST(soft.calcEnergy(.6, Cutoff, s1, s2, dEdr) == 0 && dEdr == 0);
+}
+
+void testErrors() {
+    MultibodySystem system;
+    SimbodyMatterSubsystem matter(system);
+    GeneralForceSubsystem forces(system);
+    SimTK_TEST_MUST_THROW(Force::NonbondedPairForce(forces, matter, 0, .1));
+    SimTK_TEST_MUST_THROW(Force::NonbondedPairForce(forces, matter, 1, -.1));
+    Force::NonbondedPairForce pairs(forces, matter, 1, .1);
+    SimTK_TEST_MUST_THROW(pairs.getSiteProperties(0));
+    SimTK_TEST_MUST_THROW(pairs.adoptPotential(0));
+
+    // No sites is fine.
+    system.realizeTopology();
+    State state = system.getDefaultState();
+    system.realize(state, Stage::Dynamics);
+    SimTK_TEST(pairs.getNumNeighborPairs(state) == 0);
+}
+
+int main() {
+    SimTK_START_TEST("TestNonbondedPairForce");
+        SimTK_SUBTEST(testMatchesBruteForce);
+        SimTK_SUBTEST(testNeighborListReuse);
+        SimTK_SUBTEST(testParallel);
+        SimTK_SUBTEST(testPotentials);
+        SimTK_SUBTEST(testErrors);
+    SimTK_END_TEST();
+}
@@ -0,0 +1,195 @@
+/* -------------------------------------------------------------------------- *
+ *                       Simbody(tm): SimTKsimbody                            *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+// Check that evaluating force elements on multiple threads gives the same
+// forces as serial evaluation (to roundoff, since the sums are grouped
+// differently) and that repeated parallel evaluations are bitwise identical.
+
+#include "SimTKsimbody.h"
+#include "SimTKcommon/Testing.h"
+
+#include <iostream>
+
+using namespace SimTK;
+using std::cout; using std::endl;
+
+// A force element that isn't safe to evaluate concurrently since it counts
+// its calls in an unprotected member. It applies a small constant torque.
+class CountingTorque : public Force::Custom::Implementation {
+public:
+    CountingTorque(const MobilizedBody& body)
+    :   body(body), numCalls(0) {}
+    void calcForce(const State& state, Vector_<SpatialVec>& bodyForces,
+                   Vector_<Vec3>& particleForces, Vector& mobilityForces)
+                   const override {
+        ++numCalls;
+        bodyForces[body.getMobilizedBodyIndex()][0] += Vec3(.1,.2,.3);
+    }
+    Real calcPotentialEnergy(const State& state) const override {return 0;}
+
+    const MobilizedBody body;
+    mutable int         numCalls;
+};
+
+// Many free bodies connected by springs and dampers, plus gravity and the
+// torque element above. The springs depend only on positions so are cached.
+class TestSystem {
+public:
+    explicit TestSystem(int nBodies) : matter(system), forces(system) {
+        const Body::Rigid body(MassProperties(.5, Vec3(0),
+                                              UnitInertia::sphere(.1)));
+        for (int i=0; i < nBodies; ++i)
+            bodies.push_back(MobilizedBody::Free(matter.updGround(),
+                Vec3(i % 10, 0, i / 10), body, Vec3(0)));
+        for (int i=0; i+1 < nBodies; ++i) {
+            Force::TwoPointLinearSpring(forces, bodies[i], Vec3(.1,0,0),
+                                        bodies[i+1], Vec3(0,.1,0), 10, .5);
+            Force::TwoPointLinearDamper(forces, bodies[i], Vec3(0,0,.1),
+                                        bodies[i+1], Vec3(.1,0,0), 2);
+        }
+        Force::Gravity(forces, matter, -YAxis, 9.8);
+        torque = new CountingTorque(bodies[0]);
+        counter = Force::Custom(forces, torque);
+        counter.setParallelEvaluationAllowed(false);
+        system.realizeTopology();
+
+        state = system.getDefaultState();
+        Random::Uniform random(-1, 1);
+        random.setSeed(42);
+        for (int i=0; i < state.getNQ(); ++i)
+            state.updQ()[i] += random.getValue();
+        for (int i=0; i < state.getNU(); ++i)
+            state.updU()[i] = random.getValue();
+        system.realize(state, Stage::Position);
+        matter.normalizeQuaternions(state);
+    }
+
+    // Realize Dynamics stage from scratch and return the total body forces.
+    Vector_<SpatialVec> calcBodyForces() {
+        state.invalidateAllCacheAtOrAbove(Stage::Position);
+        system.realize(state, Stage::Dynamics);
+        return system.getRigidBodyForces(state, Stage::Dynamics);
+    }
+
+    MultibodySystem             system;
+    SimbodyMatterSubsystem      matter;
+    GeneralForceSubsystem       forces;
+    Array_<MobilizedBody>       bodies;
+    Force::Custom               counter;
+    CountingTorque*             torque;  // owned by counter
+    State                       state;
+};
+
+void testParallelMatchesSerial() {
+    TestSystem test(100);
+    SimTK_TEST(!test.forces.getUseParallelForceEvaluation());
+    SimTK_TEST(test.forces.getMinForcesForParallelEvaluation() == 32);
+    SimTK_TEST(!test.counter.isParallelEvaluationAllowed());
+    const Vector_<SpatialVec> serial = test.calcBodyForces();
+    const Real energy = test.system.calcPotentialEnergy(test.state);
+
+    // Use more threads than we have processors so that we really do run in
+    // parallel here.
+    test.forces.setUseParallelForceEvaluation(true, 4);
+    SimTK_TEST(test.forces.getUseParallelForceEvaluation());
+    const Vector_<SpatialVec> parallel = test.calcBodyForces();
+    SimTK_TEST_EQ(parallel, serial);
+    SimTK_TEST_EQ(test.system.calcPotentialEnergy(test.state), energy);
+
+    // Repeated parallel evaluations must be bitwise identical regardless of
+    // how the threads were scheduled.
+    for (int trial=0; trial < 5; ++trial) {
+        const Vector_<SpatialVec> again = test.calcBodyForces();
+        for (int i=0; i < again.size(); ++i)
+            SimTK_TEST(again[i] == parallel[i]);
+    }
+
+    // Re-realizing Dynamics without changing positions uses the cached
+    // spring forces and evaluates only the others.
+    test.state.updU()[0] += .1;
+    test.forces.setUseParallelForceEvaluation(false);
+    test.system.realize(test.state, Stage::Dynamics);
+    const Vector_<SpatialVec> serialU =
+        test.system.getRigidBodyForces(test.state, Stage::Dynamics);
+    test.state.invalidateAllCacheAtOrAbove(Stage::Dynamics);
+    test.forces.setUseParallelForceEvaluation(true, 3);
+    test.system.realize(test.state, Stage::Dynamics);
+    SimTK_TEST_EQ(test.system.getRigidBodyForces(test.state, Stage::Dynamics),
+                  serialU);
+
+    // Disabled forces stay out of it.
+    for (int i=0; i < 20; ++i)
+        test.forces.updForce(ForceIndex(i)).disable(test.state);
+    const Vector_<SpatialVec> fewer = test.calcBodyForces();
+    test.forces.setUseParallelForceEvaluation(false);
+    SimTK_TEST_EQ(test.calcBodyForces(), fewer);
+}
+
+void testOptOutAndThreshold() {
+    TestSystem test(10);
+    test.forces.setUseParallelForceEvaluation(true, 4);
+
+    // The torque element isn't thread safe but has opted out so is always
+    // evaluated once, on this thread.
+    test.torque->numCalls = 0;
+    test.forces.setMinForcesForParallelEvaluation(1);
+    SimTK_TEST(test.forces.getMinForcesForParallelEvaluation() == 1);
+    const Vector_<SpatialVec> parallel = test.calcBodyForces();
+    SimTK_TEST(test.torque->numCalls == 1);
+
+    // With too few eligible force elements we just evaluate serially.
+    test.forces.setMinForcesForParallelEvaluation(1000);
+    SimTK_TEST_EQ(test.calcBodyForces(), parallel);
+    SimTK_TEST(test.torque->numCalls == 2);
+
+    SimTK_TEST_MUST_THROW(test.forces.setMinForcesForParallelEvaluation(0));
+}
+
+void testSimulation() {
+    // Integrating with parallel force evaluation should track the serial
+    // trajectory closely.
+    TestSystem serial(40), parallel(40);
+    parallel.forces.setUseParallelForceEvaluation(true, 4);
+    parallel.forces.setMinForcesForParallelEvaluation(1);
+
+    RungeKuttaMersonIntegrator serialInteg(serial.system);
+    RungeKuttaMersonIntegrator parallelInteg(parallel.system);
+    serialInteg.setAccuracy(1e-6);
+    parallelInteg.setAccuracy(1e-6);
+    TimeStepper serialTs(serial.system, serialInteg);
+    TimeStepper parallelTs(parallel.system, parallelInteg);
+    serialTs.initialize(serial.state);
+    parallelTs.initialize(parallel.state);
+    serialTs.stepTo(0.5);
+    parallelTs.stepTo(0.5);
+    SimTK_TEST_EQ_TOL(parallelInteg.getState().getQ(),
+                      serialInteg.getState().getQ(), 1e-4);
+}
+
+int main() {
+    SimTK_START_TEST("TestParallelForces");
+        SimTK_SUBTEST(testParallelMatchesSerial);
+        SimTK_SUBTEST(testOptOutAndThreshold);
+        SimTK_SUBTEST(testSimulation);
+    SimTK_END_TEST();
+}
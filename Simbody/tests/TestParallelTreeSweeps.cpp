@@ -0,0 +1,275 @@
+/* -------------------------------------------------------------------------- *
+ *                               Simbody(tm)                                  *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+// Check that multithreaded sweeps over the multibody tree produce exactly the
+// same results as the normal serial sweeps. Every node performs the same
+// arithmetic either way, so we expect bitwise-identical answers.
+
+#include "SimTKsimbody.h"
+#include "SimTKcommon/Testing.h"
+
+#include <iostream>
+
+using namespace SimTK;
+using std::cout; using std::endl;
+
+// All the trees below are made of this body, which has no symmetries so that
+// every term of the tree sweeps matters.
+static Body::Rigid makeBody() {
+    return Body::Rigid(MassProperties(1.5, Vec3(.1,.2,.3),
+                                      UnitInertia(1.1,1.2,1.3,.01,.02,.03)));
+}
+
+// Build a wide, shallow tree: many short chains hanging from Ground, with a
+// mix of mobilizer types so that the levels are not homogeneous.
+static void buildWideTree(SimbodyMatterSubsystem& matter, int nChains) {
+    const Body::Rigid body = makeBody();
+    for (int i=0; i < nChains; ++i) {
+        const Vec3 loc(i % 10, 0, i / 10);
+        MobilizedBody parent = matter.updGround();
+        MobilizedBody::Ball b1(parent, Transform(loc), body, Vec3(0,1,0));
+        MobilizedBody::Pin  b2(b1, Vec3(0,-1,0), body, Vec3(0,1,0));
+        MobilizedBody::Slider b3(b2, Vec3(0,-1,0), body, Vec3(0,1,0));
+        if (i % 3 == 0)
+            MobilizedBody::Free b4(b3, Vec3(0,-1,0), body, Vec3(0,1,0));
+    }
+}
+
+// Realize the given state through Acceleration stage and return the
+// resulting state derivatives and some other quantities computed by
+// tree sweeps.
+static void calcResults(const MultibodySystem& system, State& state,
+                        Vector& ydot, Vector& MInvf, Vector& Ma) {
+    const SimbodyMatterSubsystem& matter = system.getMatterSubsystem();
+    state.invalidateAllCacheAtOrAbove(Stage::Position);
+    system.realize(state, Stage::Acceleration);
+    ydot = state.getYDot();
+
+    Vector f(state.getNU());
+    for (int i=0; i < f.size(); ++i) f[i] = std::sin(Real(i));
+    matter.multiplyByMInv(state, f, MInvf);
+    matter.multiplyByM(state, f, Ma);
+}
+
+// A binary tree like the one in TestMultibodyPerformance: two base bodies
+// whose subtrees are of similar size. This should be done branch-by-branch.
+static void buildBinaryTree(SimbodyMatterSubsystem& matter, int nBodies) {
+    const Body::Rigid body = makeBody();
+    for (int i=0; i < nBodies; ++i) {
+        MobilizedBody& parent = matter.updMobilizedBody(MobilizedBodyIndex(i/2));
+        if (i % 2)
+            MobilizedBody::Pin next(parent, Vec3(0,-1,0), body, Vec3(0,1,0));
+        else
+            MobilizedBody::Ball next(parent, Vec3(0,-1,0), body, Vec3(0,1,0));
+    }
+}
+
+// One long chain plus a few short ones. No split of this tree into branches
+// is balanced, so this should fall back to level parallelism.
+static void buildLopsidedTree(SimbodyMatterSubsystem& matter, int nLinks) {
+    const Body::Rigid body = makeBody();
+    MobilizedBody parent = matter.updGround();
+    for (int i=0; i < nLinks; ++i) {
+        MobilizedBody::Pin link(parent, Vec3(0,-1,0), body, Vec3(0,1,0));
+        parent = link;
+    }
+    for (int i=0; i < 3; ++i) {
+        MobilizedBody::Slider s1(matter.updGround(), Vec3(i+1,0,0), 
+                                 body, Vec3(0));
+        MobilizedBody::Slider s2(s1, Vec3(0,-1,0), body, Vec3(0,1,0));
+    }
+}
+
+// Compare serial and parallel results for a system that has already had its
+// topology realized, and check that the expected parallel strategy was chosen.
+static void checkParallelMatchesSerial(MultibodySystem& system,
+                                       bool expectBranchParallel) {
+    SimbodyMatterSubsystem& matter = system.updMatterSubsystem();
+    State state = system.getDefaultState();
+    Random::Uniform random(-1, 1);
+    random.setSeed(42);
+    for (int i=0; i < state.getNQ(); ++i) state.updQ()[i] = random.getValue();
+    for (int i=0; i < state.getNU(); ++i) state.updU()[i] = random.getValue();
+    system.realize(state, Stage::Position);
+    matter.normalizeQuaternions(state);
+
+    SimTK_TEST(!matter.getUseParallelTreeSweeps());
+    SimTK_TEST(!matter.isUsingBranchParallelTreeSweeps());
+    Vector ydotSerial, MInvfSerial, MaSerial;
+    calcResults(system, state, ydotSerial, MInvfSerial, MaSerial);
+
+    // Use more threads than we have processors, and make every level
+    // eligible, so that we really do run in parallel here.
+    matter.setUseParallelTreeSweeps(true, 4);
+    matter.setMinNodesPerParallelLevel(1);
+    SimTK_TEST(matter.getUseParallelTreeSweeps());
+    SimTK_TEST(matter.getMinNodesPerParallelLevel() == 1);
+    SimTK_TEST(matter.isUsingBranchParallelTreeSweeps()
+               == expectBranchParallel);
+    if (expectBranchParallel) {
+        SimTK_TEST(matter.getNumParallelTreeSweepBranchGroups() >= 2);
+        SimTK_TEST(matter.getNumParallelTreeSweepBranchGroups() <= 4);
+    } else
+        SimTK_TEST(matter.getNumParallelTreeSweepBranchGroups() == 0);
+
+    Vector ydotParallel, MInvfParallel, MaParallel;
+    for (int trial=0; trial < 5; ++trial) {
+        calcResults(system, state, ydotParallel, MInvfParallel, MaParallel);
+        SimTK_TEST(ydotParallel.size() == ydotSerial.size());
+        for (int i=0; i < ydotSerial.size(); ++i)
+            SimTK_TEST(ydotParallel[i] == ydotSerial[i]);
+        for (int i=0; i < MInvfSerial.size(); ++i)
+            SimTK_TEST(MInvfParallel[i] == MInvfSerial[i]);
+        for (int i=0; i < MaSerial.size(); ++i)
+            SimTK_TEST(MaParallel[i] == MaSerial[i]);
+    }
+
+    // Turning it back off should still work.
+    matter.setUseParallelTreeSweeps(false);
+    matter.setMinNodesPerParallelLevel(32);
+    SimTK_TEST(!matter.getUseParallelTreeSweeps());
+    SimTK_TEST(!matter.isUsingBranchParallelTreeSweeps());
+    calcResults(system, state, ydotParallel, MInvfParallel, MaParallel);
+    SimTK_TEST_EQ(ydotParallel, ydotSerial);
+}
+
+void testWideTree() {
+    MultibodySystem system;
+    SimbodyMatterSubsystem matter(system);
+    GeneralForceSubsystem forces(system);
+    Force::Gravity gravity(forces, matter, -YAxis, 9.8);
+    buildWideTree(matter, 60);
+    system.realizeTopology();
+    // Sixty similar chains on Ground balance easily among the threads.
+    checkParallelMatchesSerial(system, true);
+
+    SimTK_TEST_MUST_THROW(matter.setMinNodesPerParallelLevel(0));
+}
+
+void testBinaryTree() {
+    MultibodySystem system;
+    SimbodyMatterSubsystem matter(system);
+    GeneralForceSubsystem forces(system);
+    Force::Gravity gravity(forces, matter, -YAxis, 9.8);
+    buildBinaryTree(matter, 100);
+    system.realizeTopology();
+    checkParallelMatchesSerial(system, true);
+}
+
+void testLopsidedTree() {
+    MultibodySystem system;
+    SimbodyMatterSubsystem matter(system);
+    GeneralForceSubsystem forces(system);
+    Force::Gravity gravity(forces, matter, -YAxis, 9.8);
+    buildLopsidedTree(matter, 30);
+    system.realizeTopology();
+    checkParallelMatchesSerial(system, false);
+}
+
+// Make sure a parallel-enabled system can be integrated.
+void testParallelSimulation() {
+    MultibodySystem system;
+    SimbodyMatterSubsystem matter(system);
+    GeneralForceSubsystem forces(system);
+    Force::Gravity gravity(forces, matter, -YAxis, 9.8);
+    buildWideTree(matter, 20);
+
+    matter.setUseParallelTreeSweeps(true, 3);
+    matter.setMinNodesPerParallelLevel(2);
+    State state = system.realizeTopology();
+    state.updU() = 0.1;
+
+    RungeKuttaMersonIntegrator integ(system);
+    integ.setAccuracy(1e-6);
+    TimeStepper ts(system, integ);
+    ts.initialize(state);
+    const Real E0 = system.calcEnergy(ts.getState());
+    ts.stepTo(0.5);
+    const Real E1 = system.calcEnergy(ts.getState());
+    SimTK_TEST_EQ_TOL(E0, E1, 1e-4*std::abs(E0));
+}
+
+// Type-batched level sweeps visit the nodes of a level in a different order
+// but do the same arithmetic for each node, so results must be identical
+// with or without batching, serial or parallel.
+void testTypeBatchedSweeps() {
+    MultibodySystem system;
+    SimbodyMatterSubsystem matter(system);
+    GeneralForceSubsystem forces(system);
+    Force::Gravity gravity(forces, matter, -YAxis, 9.8);
+    buildWideTree(matter, 40);
+    // Plus a rope of identical pins, so there are long runs of the same type.
+    const Body::Rigid body(MassProperties(1, Vec3(0,-.5,0), UnitInertia(.1)));
+    MobilizedBody parent = matter.updGround();
+    for (int i=0; i < 30; ++i) {
+        MobilizedBody::Pin link(parent, Vec3(0,-1,0), body, Vec3(0));
+        parent = link;
+    }
+    system.realizeTopology();
+
+    State state = system.getDefaultState();
+    Random::Uniform random(-1, 1);
+    random.setSeed(99);
+    for (int i=0; i < state.getNQ(); ++i) state.updQ()[i] = random.getValue();
+    for (int i=0; i < state.getNU(); ++i) state.updU()[i] = random.getValue();
+    system.realize(state, Stage::Position);
+    matter.normalizeQuaternions(state);
+
+    SimTK_TEST(!matter.getUseTypeBatchedTreeSweeps()); // the default
+    matter.setUseTypeBatchedTreeSweeps(true);
+    SimTK_TEST(matter.getUseTypeBatchedTreeSweeps());
+    Vector ydotBatched, MInvfBatched, MaBatched;
+    calcResults(system, state, ydotBatched, MInvfBatched, MaBatched);
+
+    matter.setUseTypeBatchedTreeSweeps(false);
+    SimTK_TEST(!matter.getUseTypeBatchedTreeSweeps());
+    Vector ydot, MInvf, Ma;
+    calcResults(system, state, ydot, MInvf, Ma);
+    SimTK_TEST(ydot.size() == ydotBatched.size());
+    for (int i=0; i < ydot.size(); ++i)
+        SimTK_TEST(ydot[i] == ydotBatched[i]);
+    for (int i=0; i < MInvf.size(); ++i)
+        SimTK_TEST(MInvf[i] == MInvfBatched[i]);
+    for (int i=0; i < Ma.size(); ++i)
+        SimTK_TEST(Ma[i] == MaBatched[i]);
+
+    // Batched level-parallel sweeps.
+    matter.setUseTypeBatchedTreeSweeps(true);
+    matter.setUseParallelTreeSweeps(true, 3);
+    matter.setMinNodesPerParallelLevel(1);
+    calcResults(system, state, ydot, MInvf, Ma);
+    for (int i=0; i < ydot.size(); ++i)
+        SimTK_TEST(ydot[i] == ydotBatched[i]);
+    for (int i=0; i < MInvf.size(); ++i)
+        SimTK_TEST(MInvf[i] == MInvfBatched[i]);
+}
+
+int main() {
+    SimTK_START_TEST("TestParallelTreeSweeps");
+        SimTK_SUBTEST(testWideTree);
+        SimTK_SUBTEST(testBinaryTree);
+        SimTK_SUBTEST(testLopsidedTree);
+        SimTK_SUBTEST(testParallelSimulation);
+        SimTK_SUBTEST(testTypeBatchedSweeps);
+    SimTK_END_TEST();
+}
@@ -0,0 +1,179 @@
+/* -------------------------------------------------------------------------- *
+ *                       Simbody(tm): SimTKsimbody                            *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+// Check the timings collected by the System's RealizeProfiler.
+
+#include "SimTKsimbody.h"
+#include "SimTKcommon/Testing.h"
+
+#include <iostream>
+#include <sstream>
+
+using namespace SimTK;
+using std::cout; using std::endl;
+
+// A planar double pendulum whose tip is held at a fixed distance from a
+// point on Ground, with two force elements.
+class TestSystem {
+public:
+    TestSystem() : matter(system), forces(system) {
+        const Body::Rigid link(MassProperties(1, Vec3(0,-.5,0),
+            UnitInertia::cylinderAlongY(.05,.5).shiftFromCentroid(Vec3(0,-.5,0))));
+        MobilizedBody::Pin upper(matter.updGround(), Vec3(0), link, Vec3(0));
+        MobilizedBody::Pin lower(upper, Vec3(0,-1,0), link, Vec3(0));
+        Constraint::Rod(matter.updGround(), Vec3(1,0,0),
+                        lower, Vec3(0,-1,0), 1.5);
+        Force::Gravity(forces, matter, -YAxis, 9.8);
+        Force::MobilityLinearSpring(forces, lower, MobilizerQIndex(0), 5, 0);
+        system.realizeTopology();
+    }
+
+    MultibodySystem         system;
+    SimbodyMatterSubsystem  matter;
+    GeneralForceSubsystem   forces;
+};
+
+void testDisabled() {
+    TestSystem test;
+    const RealizeProfiler& profiler = test.system.getRealizeProfiler();
+    SimTK_TEST(!test.system.isRealizeProfilingEnabled());
+
+    State state = test.system.getDefaultState();
+    test.system.realize(state, Stage::Acceleration);
+    SimTK_TEST(profiler.getSystemTiming(Stage::Position).numCalls == 0);
+    SimTK_TEST(profiler.getSubsystemTiming(test.matter.getMySubsystemIndex(),
+                                           Stage::Position).numCalls == 0);
+    SimTK_TEST(profiler.getNumElements() == 0);
+}
+
+void testTimings() {
+    TestSystem test;
+    test.system.setRealizeProfilingEnabled(true);
+    SimTK_TEST(test.system.isRealizeProfilingEnabled());
+    const RealizeProfiler& profiler = test.system.getRealizeProfiler();
+
+    const SubsystemIndex matterIx = test.matter.getMySubsystemIndex();
+    const SubsystemIndex forcesIx = test.forces.getMySubsystemIndex();
+
+    State state = test.system.getDefaultState();
+    for (int i=0; i < 3; ++i) {
+        state.updQ()[0] += .01;
+        test.system.realize(state, Stage::Acceleration);
+    }
+
+    // Realizing Acceleration stage three times required realizing Position
+    // three times, once per Subsystem; Instance was only needed once.
+    SimTK_TEST(profiler.getSystemTiming(Stage::Position).numCalls == 3);
+    SimTK_TEST(profiler.getSystemTiming(Stage::Instance).numCalls == 1);
+    SimTK_TEST(profiler.getSystemTiming(Stage::Report).numCalls == 0);
+    SimTK_TEST(profiler.getSubsystemTiming(matterIx, Stage::Position)
+               .numCalls == 3);
+    SimTK_TEST(profiler.getSubsystemTiming(forcesIx, Stage::Dynamics)
+               .numCalls == 3);
+
+    const RealizeProfiler::Timing sys =
+        profiler.getSystemTiming(Stage::Dynamics);
+    const RealizeProfiler::Timing sub =
+        profiler.getSubsystemTiming(forcesIx, Stage::Dynamics);
+    SimTK_TEST(sys.wallTime >= sub.wallTime && sub.wallTime >= 0);
+    SimTK_TEST(sub.cpuTime >= 0);
+
+    // Each force element and the constraint were timed.
+    for (int i=0; i < 2; ++i) {
+        const int e = profiler.findElement(forcesIx, Stage::Dynamics,
+                                           "Force", i);
+        SimTK_TEST(e >= 0);
+        SimTK_TEST(profiler.getElementSubsystem(e) == forcesIx);
+        SimTK_TEST(profiler.getElementStage(e) == Stage::Dynamics);
+        SimTK_TEST(String(profiler.getElementKind(e)) == "Force");
+        SimTK_TEST(profiler.getElementIndex(e) == i);
+        SimTK_TEST(profiler.getElementTiming(e).numCalls == 3);
+    }
+    SimTK_TEST(profiler.findElement(forcesIx, Stage::Dynamics, "Force", 2)
+               == -1);
+    const int c = profiler.findElement(matterIx, Stage::Position,
+                                       "Constraint", 0);
+    SimTK_TEST(c >= 0 && profiler.getElementTiming(c).numCalls == 3);
+    SimTK_TEST(profiler.findElement(matterIx, Stage::Velocity,
+                                    "Constraint", 0) >= 0);
+
+    // Disabling keeps the results but stops adding to them.
+    test.system.setRealizeProfilingEnabled(false);
+    state.updQ()[0] += .01;
+    test.system.realize(state, Stage::Acceleration);
+    SimTK_TEST(profiler.getSystemTiming(Stage::Position).numCalls == 3);
+
+    test.system.resetAllCountersToZero();
+    SimTK_TEST(profiler.getSystemTiming(Stage::Position).numCalls == 0);
+    SimTK_TEST(profiler.getNumElements() == 0);
+}
+
+void testOutput() {
+    TestSystem test;
+    test.system.setRealizeProfilingEnabled(true);
+    RealizeProfiler& profiler = test.system.updRealizeProfiler();
+
+    State state = test.system.getDefaultState();
+    test.system.realize(state, Stage::Acceleration);
+
+    std::ostringstream json;
+    profiler.writeJSON(json);
+    cout << json.str();
+    SimTK_TEST(json.str().find("\"subsystems\"") != std::string::npos);
+    SimTK_TEST(json.str().find("\"kind\": \"Force\"") != std::string::npos);
+    SimTK_TEST(json.str().find("\"stage\": \"Dynamics\"")
+               != std::string::npos);
+
+    // No trace is kept unless asked for.
+    std::ostringstream empty;
+    profiler.writeChromeTrace(empty);
+    SimTK_TEST(empty.str().find("\"ph\"") == std::string::npos);
+
+    // Keep only the last few calls.
+    profiler.setTraceCapacity(5);
+    SimTK_TEST(profiler.getTraceCapacity() == 5);
+    for (int i=0; i < 3; ++i) {
+        state.updU()[0] += .01;
+        test.system.realize(state, Stage::Acceleration);
+    }
+    std::ostringstream trace;
+    profiler.writeChromeTrace(trace);
+    cout << trace.str();
+    int nEvents = 0;
+    for (size_t p = trace.str().find("\"ph\": \"X\""); p != std::string::npos;
+         p = trace.str().find("\"ph\": \"X\"", p+1))
+        ++nEvents;
+    SimTK_TEST(nEvents == 5);
+    SimTK_TEST(trace.str().find("\"name\": \"System Acceleration\"")
+               != std::string::npos);
+
+    SimTK_TEST_MUST_THROW(profiler.setTraceCapacity(-1));
+}
+
+int main() {
+    SimTK_START_TEST("TestRealizeProfiler");
+        SimTK_SUBTEST(testDisabled);
+        SimTK_SUBTEST(testTimings);
+        SimTK_SUBTEST(testOutput);
+    SimTK_END_TEST();
+}
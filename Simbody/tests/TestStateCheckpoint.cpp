@@ -0,0 +1,262 @@
+/* -------------------------------------------------------------------------- *
+ *                       Simbody(tm): SimTKsimbody                            *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+// Check that a State saved with StateCheckpoint is restored exactly.
+
+#include "SimTKsimbody.h"
+#include "SimTKcommon/Testing.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+using namespace SimTK;
+using std::cout; using std::endl;
+
+static const char* CheckpointFile = "TestStateCheckpoint.chk";
+
+// A two-link pendulum and a free box tied to it by a rod that needs
+// assembly, a spring that we'll disable, and some discrete forces. The
+// States we save also use Euler angles, lock the first link, and disable
+// the rod, all of which are kept in the matter subsystem's variables.
+class TestSystem {
+public:
+    TestSystem() : matter(system), forces(system) {
+        const Body::Rigid link(MassProperties(1, Vec3(0,-.5,0),
+            UnitInertia::cylinderAlongY(.05,.5).shiftFromCentroid(Vec3(0,-.5,0))));
+        const Body::Rigid box(MassProperties(3, Vec3(0),
+                              UnitInertia::brick(.2,.1,.3)));
+        b1 = MobilizedBody::Pin(matter.updGround(), Vec3(0), link, Vec3(0));
+        MobilizedBody::Ball b2(b1, Vec3(0,-1,0), link, Vec3(0));
+        b3 = MobilizedBody::Free(matter.updGround(), Vec3(1,0,0), box, Vec3(0));
+        rod = Constraint::Rod(b2, Vec3(0,-1,0), b3, Vec3(0,.1,0), 1.5);
+        Force::Gravity(forces, matter, -YAxis, 9.8);
+        spring = Force::TwoPointLinearSpring(forces, b1, Vec3(0),
+                                             b3, Vec3(0), 10, 1);
+        discrete = Force::DiscreteForces(forces, matter);
+        system.realizeTopology();
+    }
+
+    // A State that has been assembled and given non-default discrete
+    // variables and time.
+    State makeState() const {
+        State state = system.getDefaultState();
+        matter.setUseEulerAngles(state, true);
+        system.realizeModel(state);
+        for (int i=0; i < state.getNQ(); ++i)
+            state.updQ()[i] = .1*(i+1);
+        Assembler(system).assemble(state);
+        for (int i=0; i < state.getNU(); ++i)
+            state.updU()[i] = .2*(i+1);
+        state.setTime(1.25);
+        rod.disable(state);
+        b1.lockAt(state, .3);
+        spring.disable(state);
+        discrete.setAllMobilityForces(state,
+                                      Vector(state.getNU(), Real(.5)));
+        discrete.setOneBodyForce(state, b3, SpatialVec(Vec3(1,2,3),
+                                                       Vec3(4,5,6)));
+        return state;
+    }
+
+    MultibodySystem                 system;
+    SimbodyMatterSubsystem          matter;
+    GeneralForceSubsystem           forces;
+    MobilizedBody::Pin              b1;
+    MobilizedBody::Free             b3;
+    Constraint::Rod                 rod;
+    Force::TwoPointLinearSpring     spring;
+    Force::DiscreteForces           discrete;
+};
+
+template <class T>
+static bool isSame(const Vector_<T>& v1, const Vector_<T>& v2) {
+    if (v1.size() != v2.size()) return false;
+    for (int i=0; i < v1.size(); ++i)
+        if (!(v1[i] == v2[i])) return false;
+    return true;
+}
+
+// The restored State must be bitwise identical, and realized to the
+// same stage.
+static void compareStates(const TestSystem& test, const State& s1,
+                          const State& s2) {
+    SimTK_TEST(s1.getSystemStage() == s2.getSystemStage());
+    SimTK_TEST(s1.getTime() == s2.getTime());
+    SimTK_TEST(isSame(s1.getY(), s2.getY()));
+    SimTK_TEST(test.matter.getUseEulerAngles(s2)
+               == test.matter.getUseEulerAngles(s1));
+    SimTK_TEST(test.rod.isDisabled(s2) == test.rod.isDisabled(s1));
+    SimTK_TEST(test.b1.getLockLevel(s2) == test.b1.getLockLevel(s1));
+    SimTK_TEST(isSame(test.b1.getLockValueAsVector(s2),
+                      test.b1.getLockValueAsVector(s1)));
+    SimTK_TEST(test.spring.isDisabled(s2) == test.spring.isDisabled(s1));
+    SimTK_TEST(isSame(test.discrete.getAllMobilityForces(s1),
+                      test.discrete.getAllMobilityForces(s2)));
+    SimTK_TEST(isSame(test.discrete.getAllBodyForces(s1),
+                      test.discrete.getAllBodyForces(s2)));
+    if (s1.getSystemStage() >= Stage::Acceleration)
+        SimTK_TEST(isSame(s1.getYDot(), s2.getYDot()));
+}
+
+void testRoundTrip() {
+    TestSystem test;
+    State state = test.makeState();
+    test.system.realize(state, Stage::Acceleration);
+    StateCheckpoint::writeFile(state, CheckpointFile);
+
+    StateCheckpoint checkpoint(CheckpointFile);
+    SimTK_TEST(checkpoint.getTime() == 1.25);
+    SimTK_TEST(checkpoint.getStage() == Stage::Acceleration);
+    SimTK_TEST(checkpoint.getNumSubsystems() == state.getNumSubsystems());
+    SimTK_TEST(checkpoint.getSubsystemName(SubsystemIndex(1))
+               == state.getSubsystemName(SubsystemIndex(1)));
+
+    State restored = test.system.getDefaultState();
+    SimTK_TEST(!test.spring.isDisabled(restored));
+    SimTK_TEST(!test.rod.isDisabled(restored));
+    SimTK_TEST(!test.b1.isLocked(restored));
+    checkpoint.restore(test.system, restored);
+    compareStates(test, state, restored);
+    SimTK_TEST(test.rod.isDisabled(restored));
+    SimTK_TEST(test.b1.getLockValueAsVector(restored)[0] == .3);
+
+    // A State realized only through Topology stage is fine too.
+    State topology = test.system.getDefaultState();
+    topology.invalidateAll(Stage::Model);
+    checkpoint.restore(test.system, topology);
+    compareStates(test, state, topology);
+
+    // The same checkpoint can be used again, even with a State that has
+    // been changed.
+    State another = test.makeState();
+    another.updQ() = 0; another.updU() = 1; another.setTime(7);
+    test.spring.enable(another);
+    checkpoint.restore(test.system, another);
+    compareStates(test, state, another);
+
+    // A checkpoint of a State realized only through Model stage.
+    State model = test.makeState();
+    test.system.realizeModel(model);
+    std::ofstream out(CheckpointFile, std::ios::out | std::ios::binary);
+    StateCheckpoint::write(model, out);
+    out.close();
+    StateCheckpoint modelCheckpoint(CheckpointFile);
+    SimTK_TEST(modelCheckpoint.getStage() == Stage::Model);
+    checkpoint.restore(test.system, another);
+    modelCheckpoint.restore(test.system, another);
+    compareStates(test, model, another);
+}
+
+// Types that aren't built in can be registered. Unregistered ones are
+// skipped only if they don't affect the model.
+struct Pair {Vec3 a, b;};
+struct Unregistered {int i;};
+void testRegisteredType() {
+    MultibodySystem system;
+    SimbodyMatterSubsystem matter(system);
+    system.realizeTopology();
+    State state = system.getDefaultState();
+    state.invalidateAll(Stage::Model); // so we can allocate
+    const DiscreteVariableIndex dx = matter.allocateDiscreteVariable
+       (state, Stage::Position, new Value<Pair>());
+    const Pair p = {Vec3(1,2,3), Vec3(4,5,6)}, zero = {Vec3(0), Vec3(0)};
+    Value<Pair>::updDowncast(matter.updDiscreteVariable(state, dx)) = p;
+    system.realizeModel(state);
+
+    // Not registered yet so it isn't saved.
+    StateCheckpoint::writeFile(state, CheckpointFile);
+    State restored = state;
+    Value<Pair>::updDowncast(matter.updDiscreteVariable(restored, dx)) = zero;
+    StateCheckpoint(CheckpointFile).restore(system, restored);
+    SimTK_TEST(Value<Pair>::downcast(matter.getDiscreteVariable(restored, dx))
+               .get().b == Vec3(0));
+
+    State instance = system.getDefaultState();
+    instance.invalidateAll(Stage::Model);
+    matter.allocateDiscreteVariable(instance, Stage::Instance,
+                                    new Value<Unregistered>());
+    system.realizeModel(instance);
+    SimTK_TEST_MUST_THROW(StateCheckpoint::writeFile(instance,
+                                                     CheckpointFile));
+
+    StateCheckpoint::registerPlainType<Pair>("Pair");
+    StateCheckpoint::writeFile(state, CheckpointFile);
+    StateCheckpoint(CheckpointFile).restore(system, restored);
+    SimTK_TEST(Value<Pair>::downcast(matter.getDiscreteVariable(restored, dx))
+               .get().b == Vec3(4,5,6));
+}
+
+void testErrors() {
+    TestSystem test;
+    State state = test.makeState();
+
+    // Not realized far enough to write.
+    State topology = test.system.getDefaultState();
+    topology.invalidateAll(Stage::Model);
+    SimTK_TEST_MUST_THROW(StateCheckpoint::writeFile(topology,
+                                                     CheckpointFile));
+
+    SimTK_TEST_MUST_THROW(StateCheckpoint("NoSuchFile.chk"));
+
+    // Truncated.
+    test.system.realize(state, Stage::Position);
+    StateCheckpoint::writeFile(state, CheckpointFile);
+    std::ifstream in(CheckpointFile, std::ios::in | std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(in)),
+                          std::istreambuf_iterator<char>());
+    in.close();
+    std::ofstream out(CheckpointFile, std::ios::out | std::ios::binary);
+    out.write(contents.data(), contents.size()-10);
+    out.close();
+    SimTK_TEST_MUST_THROW(StateCheckpoint chk(CheckpointFile));
+
+    // Not a checkpoint.
+    out.open(CheckpointFile, std::ios::out | std::ios::binary);
+    out << "This is not a State checkpoint.";
+    out.close();
+    SimTK_TEST_MUST_THROW(StateCheckpoint chk(CheckpointFile));
+
+    // A different System.
+    StateCheckpoint::writeFile(state, CheckpointFile);
+    StateCheckpoint checkpoint(CheckpointFile);
+    MultibodySystem other;
+    SimbodyMatterSubsystem otherMatter(other);
+    GeneralForceSubsystem otherForces(other);
+    MobilizedBody::Pin(otherMatter.updGround(), Vec3(0),
+                       Body::Rigid(MassProperties(1,Vec3(0),UnitInertia(1))),
+                       Vec3(0,1,0));
+    other.realizeTopology();
+    State otherState = other.getDefaultState();
+    SimTK_TEST_MUST_THROW(checkpoint.restore(other, otherState));
+
+    std::remove(CheckpointFile);
+}
+
+int main() {
+    SimTK_START_TEST("TestStateCheckpoint");
+        SimTK_SUBTEST(testRoundTrip);
+        SimTK_SUBTEST(testRegisteredType);
+        SimTK_SUBTEST(testErrors);
+    SimTK_END_TEST();
+}
@@ -0,0 +1,177 @@
+/* -------------------------------------------------------------------------- *
+ *                       Simbody(tm): SimTKsimbody                            *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Michael Sherman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+// Check that a Force::TwoPointSpringBundle produces the same forces and
+// energy as the equivalent individual TwoPointLinearSpring and
+// TwoPointLinearDamper elements, and that its per-spring enabled flags work.
+
+#include "SimTKsimbody.h"
+#include "SimTKcommon/Testing.h"
+
+#include <iostream>
+
+using namespace SimTK;
+using std::cout; using std::endl;
+
+// A grid of free bodies connected to their neighbors (and a few to Ground)
+// by springs. The same springs are created either as a bundle or as
+// individual force elements, in separate but identical systems.
+class TestSystem {
+public:
+    TestSystem(int nSide, bool damped, bool useBundle)
+    :   matter(system), forces(system) {
+        const Body::Rigid body(MassProperties(.8, Vec3(0),
+                                              UnitInertia::brick(.1,.1,.2)));
+        for (int i=0; i < nSide*nSide; ++i)
+            bodies.push_back(MobilizedBody::Free(matter.updGround(),
+                Vec3(i % nSide, 0, i / nSide), body, Vec3(0)));
+        if (useBundle)
+            bundle = Force::TwoPointSpringBundle(forces, matter);
+
+        Random::Uniform random(.5, 1.5);
+        random.setSeed(11);
+        for (int i=0; i < nSide*nSide; ++i) {
+            const int right = (i % nSide) + 1 < nSide ? i+1     : -1;
+            const int below = i + nSide < nSide*nSide ? i+nSide : -1;
+            if (right >= 0) addSpring(bodies[i], bodies[right], random, damped);
+            if (below >= 0) addSpring(bodies[i], bodies[below], random, damped);
+            if (i % 3 == 0)
+                addSpring(matter.Ground(), bodies[i], random, damped);
+        }
+        system.realizeTopology();
+
+        state = system.getDefaultState();
+        Random::Uniform perturb(-.2, .2);
+        perturb.setSeed(3);
+        for (int i=0; i < state.getNQ(); ++i)
+            state.updQ()[i] += perturb.getValue();
+        for (int i=0; i < state.getNU(); ++i)
+            state.updU()[i] = perturb.getValue();
+        system.realize(state, Stage::Position);
+        matter.normalizeQuaternions(state);
+    }
+
+    void addSpring(const MobilizedBody& b1, const MobilizedBody& b2,
+                   Random::Uniform& random, bool damped) {
+        const Vec3 s1(.1*random.getValue(), -.1, .05);
+        const Vec3 s2(0, .1*random.getValue(), -.05);
+        const Real k = 10*random.getValue(), x0 = random.getValue();
+        const Real c = damped ? random.getValue() : 0;
+        if (bundle.isEmptyHandle()) {
+            Force::TwoPointLinearSpring(forces, b1, s1, b2, s2, k, x0);
+            if (damped) Force::TwoPointLinearDamper(forces, b1, s1, b2, s2, c);
+        } else
+            bundle.addSpring(b1, s1, b2, s2, k, x0, c);
+        ++numSprings;
+    }
+
+    const Vector_<SpatialVec>& calcBodyForces() {
+        system.realize(state, Stage::Dynamics);
+        return system.getRigidBodyForces(state, Stage::Dynamics);
+    }
+
+    MultibodySystem             system;
+    SimbodyMatterSubsystem      matter;
+    GeneralForceSubsystem       forces;
+    Force::TwoPointSpringBundle bundle;
+    Array_<MobilizedBody>       bodies;
+    int                         numSprings = 0;
+    State                       state;
+};
+
+void testMatchesIndividualSprings() {
+    for (int damped=0; damped <= 1; ++damped) {
+        TestSystem individual(7, damped != 0, false);
+        TestSystem bundled(7, damped != 0, true);
+        SimTK_TEST(bundled.bundle.getNumSprings() == bundled.numSprings);
+        SimTK_TEST(bundled.forces.getNumForces() == 1);
+
+        SimTK_TEST_EQ(bundled.calcBodyForces(), individual.calcBodyForces());
+        SimTK_TEST_EQ(bundled.system.calcPotentialEnergy(bundled.state),
+                      individual.system.calcPotentialEnergy(individual.state));
+
+        // Without damping the bundle depends only on positions, so its
+        // forces are cached and reused until q changes.
+        bundled.state.updU()[2] += .5; individual.state.updU()[2] += .5;
+        SimTK_TEST_EQ(bundled.calcBodyForces(), individual.calcBodyForces());
+        bundled.state.updQ()[4] += .1; individual.state.updQ()[4] += .1;
+        SimTK_TEST_EQ(bundled.calcBodyForces(), individual.calcBodyForces());
+    }
+}
+
+// Tension reported for a single spring matches what it applies to a body.
+void testTension() {
+    TestSystem test(2, true, true);
+    test.system.realize(test.state, Stage::Velocity);
+    for (int i=0; i < test.bundle.getNumSprings(); ++i)
+        test.bundle.setSpringIsEnabled(test.state, i, i == 0);
+    SimTK_TEST(test.bundle.getNumEnabledSprings(test.state) == 1);
+
+    // Spring 0 goes from body 1 to body 2 (bodies[0] to bodies[1]).
+    const SpatialVec F = test.calcBodyForces()[test.bodies[1]
+                                                   .getMobilizedBodyIndex()];
+    SimTK_TEST_EQ(F[1].norm(), std::abs(test.bundle.calcTension(test.state,0)));
+    SimTK_TEST_MUST_THROW(test.bundle.calcTension(test.state, 1000));
+    SimTK_TEST_MUST_THROW(test.bundle.addSpring(test.bodies[0], Vec3(0),
+                                        test.bodies[1], Vec3(0), -1, 1));
+}
+
+// Disabled springs contribute nothing; the result matches a bundle built
+// with only the enabled springs.
+void testEnabledMask() {
+    TestSystem test(5, true, true);
+    const Vector_<SpatialVec> all = test.calcBodyForces();
+    const Real allPE = test.system.calcPotentialEnergy(test.state);
+    SimTK_TEST(test.bundle.getNumEnabledSprings(test.state)
+               == test.bundle.getNumSprings());
+
+    for (int i=0; i < test.bundle.getNumSprings(); i += 2)
+        test.bundle.setSpringIsEnabled(test.state, i, false);
+    SimTK_TEST(!test.bundle.isSpringEnabled(test.state, 0));
+    SimTK_TEST(test.bundle.isSpringEnabled(test.state, 1));
+    const Vector_<SpatialVec> odd = test.calcBodyForces();
+    const Real oddPE = test.system.calcPotentialEnergy(test.state);
+
+    test.bundle.setAllSpringsAreEnabled(test.state, true);
+    for (int i=1; i < test.bundle.getNumSprings(); i += 2)
+        test.bundle.setSpringIsEnabled(test.state, i, false);
+    const Vector_<SpatialVec> even = test.calcBodyForces();
+    const Real evenPE = test.system.calcPotentialEnergy(test.state);
+
+    SimTK_TEST_EQ(odd + even, all);
+    SimTK_TEST_EQ(oddPE + evenPE, allPE);
+
+    test.bundle.setAllSpringsAreEnabled(test.state, false);
+    SimTK_TEST(test.bundle.getNumEnabledSprings(test.state) == 0);
+    SimTK_TEST_EQ(test.calcBodyForces(),
+                  Vector_<SpatialVec>(all.size(), SpatialVec(Vec3(0),Vec3(0))));
+    SimTK_TEST(test.system.calcPotentialEnergy(test.state) == 0);
+}
+
+int main() {
+    SimTK_START_TEST("TestTwoPointSpringBundle");
+        SimTK_SUBTEST(testMatchesIndividualSprings);
+        SimTK_SUBTEST(testTension);
+        SimTK_SUBTEST(testEnabledMask);
+    SimTK_END_TEST();
+}
@@ -195,6 +195,74 @@ void runAllTests(MultibodySystem& system, bool useEulerAngles=false) {
     timeComputation(system, doCalcCompositeBodyInertias, "calcCompositeBodyInertias", 5000, useEulerAngles);
 }
 
+/**
+ * Measure the wall-clock time per iteration of an operation. Unlike the CPU
+ * time measured above, this shows the benefit of multithreading.
+ */
+double timeWallClock(MultibodySystem& system, void function(MultibodySystem& system, State& state),
+                     int iterations) {
+    State state = system.getDefaultState();
+    system.realize(state, Stage::Acceleration);
+    function(system, state); // warm up
+    double startClock = realTime();
+    for (int j = 0; j < iterations; j++)
+        function(system, state);
+    return (realTime()-startClock)*1000000/iterations; // us
+}
+
+/**
+ * Compare the wall-clock times for the tree sweeps with and without parallel
+ * tree sweeps enabled.
+ */
+void compareParallelTreeSweeps(MultibodySystem& system) {
+    SimbodyMatterSubsystem& matter = system.updMatterSubsystem();
+    const int nThreads = ParallelExecutor::getNumProcessors();
+    std::printf("%40s  serial  %d threads  speedup\n", "parallel tree sweeps:", nThreads);
+
+    const int nOps = 4;
+    void (*ops[nOps])(MultibodySystem&, State&) = 
+        {doRealizePosition, doRealizeArticulatedBodyInertias, 
+         doRealizeDynamics2Acceleration, doRealizeTime2Acceleration};
+    const char* names[nOps] = 
+        {"realizePosition", "doRealizeArticulatedBodyInertias", 
+         "doRealizeDynamics2Acceleration", "realizeTime2Acceleration"};
+    for (int i = 0; i < nOps; i++) {
+        const double serialUs = timeWallClock(system, ops[i], 2000);
+        matter.setUseParallelTreeSweeps(true, nThreads);
+        const double parallelUs = timeWallClock(system, ops[i], 2000);
+        matter.setUseParallelTreeSweeps(false);
+        std::printf("%40s:%6.4gus %8.4gus %7.2fx\n", names[i], serialUs, 
+                    parallelUs, serialUs/parallelUs);
+    }
+}
+
+/**
+ * Compare the wall-clock times for serial tree sweeps with and without
+ * type-batched sweeps (see SimbodyMatterSubsystem::setUseTypeBatchedTreeSweeps()).
+ */
+void compareTypeBatchedTreeSweeps(MultibodySystem& system) {
+    SimbodyMatterSubsystem& matter = system.updMatterSubsystem();
+    const bool wasBatched = matter.getUseTypeBatchedTreeSweeps();
+    std::printf("%40s  unbatched  batched  speedup\n", "type-batched tree sweeps:");
+
+    const int nOps = 5;
+    void (*ops[nOps])(MultibodySystem&, State&) = 
+        {doRealizePosition, doRealizeVelocity, doRealizeArticulatedBodyInertias, 
+         doRealizeDynamics2Acceleration, doMultiplyByMInv};
+    const char* names[nOps] = 
+        {"realizePosition", "realizeVelocity", "doRealizeArticulatedBodyInertias", 
+         "doRealizeDynamics2Acceleration", "multiplyByMInv"};
+    for (int i = 0; i < nOps; i++) {
+        matter.setUseTypeBatchedTreeSweeps(false);
+        const double unbatchedUs = timeWallClock(system, ops[i], 5000);
+        matter.setUseTypeBatchedTreeSweeps(true);
+        const double batchedUs = timeWallClock(system, ops[i], 5000);
+        std::printf("%40s:%8.4gus %8.4gus %7.2fx\n", names[i], unbatchedUs, 
+                    batchedUs, unbatchedUs/batchedUs);
+    }
+    matter.setUseTypeBatchedTreeSweeps(wasBatched);
+}
+
 // The following routines create the systems to be profiled.
 
 void createParticles(MultibodySystem& system) {
@@ -532,6 +600,7 @@ int main() {
         MultibodySystem system;
         createFreeBodies(system);
         runAllTests(system, false);
+        compareTypeBatchedTreeSweeps(system);
     }
     {
         std::cout << "\nFree Bodies (Euler angles):\n" << std::endl;
@@ -545,6 +614,7 @@ int main() {
         MultibodySystem system;
         createPinChain(system);
         runAllTests(system);
+        compareParallelTreeSweeps(system);
     }
     {
         std::cout << "\nSlider Chain:\n" << std::endl;
@@ -557,6 +627,7 @@ int main() {
         MultibodySystem system;
         createBallChain(system);
         runAllTests(system, false);
+        compareParallelTreeSweeps(system);
     }
     {
         std::cout << "\nBall Chain (Euler angles):\n" << std::endl;
@@ -576,12 +647,16 @@ int main() {
         MultibodySystem system;
         createPinTree(system);
         runAllTests(system);
+        compareParallelTreeSweeps(system);
+        compareTypeBatchedTreeSweeps(system);
     }
     {
         std::cout << "\nBall Tree:\n" << std::endl;
         MultibodySystem system;
         createBallTree(system);
         runAllTests(system);
+        compareParallelTreeSweeps(system);
+        compareTypeBatchedTreeSweeps(system);
     }
     
 
@@ -171,63 +171,10 @@ Vector TaskSpace::Inertia::operator*(const Vec3& a) const
 //==============================================================================
 void TaskSpace::InertiaInverse::updateCache(Matrix& cache) const
 {
-    const SimbodyMatterSubsystem& matter = m_tspace->getMatterSubsystem();
-
-    const JacobianTranspose& JT = m_tspace->JT(getState());
-    // TODO const Matrix& JT = m_tspace.JT().value();
-    const Matrix& J = m_tspace->J(getState()).value();
-    /* TODO 
-    // TODO cache the result.
-
-    unsigned int nst = m_tspace.getNumScalarTasks();
-    unsigned int nu = m_tspace.getState().getNU();
-
-    Matrix J = m_tspace.getJacobian().value();
-
-    Matrix MInvJt(nu, nst);
-
-    for (unsigned int j = 0; j < nst; ++j)
-    {
-        matter.multiplyByMInv(m_tspace.getState(), J.transpose()(j), MInvJt(j));
-    }
-
-    updCacheValue() = J * MInvJt;
-    */
-
-    unsigned int nt = m_tspace->getNumTasks();
-    unsigned int nst = m_tspace->getNumScalarTasks();
-    unsigned int nu = getState().getNU();
-
-    Matrix& inertiaInverse = cache;
-    inertiaInverse.resize(nst, nst);
-
-    // Create temporary variables.
-    Vector Jtcol(nu);
-    Vector MInvJtcol(nu);
-    Vector_<Vec3> JMInvJt_j(nt);
-
-    // f_GP is used to pluck out one column at a time of Jt. Exactly one
-    // element at a time of f_GP will be 1, the rest are 0.
-    Vector f_GP(nst, Real(0));
-
-    for (unsigned int j = 0; j < nst; ++j)
-    {
-        f_GP[j] = 1;
-        Jtcol = JT * f_GP;
-        f_GP[j] = 0;
-
-        matter.multiplyByMInv(getState(), Jtcol, MInvJtcol);
-
-        // TODO replace with operator.
-        inertiaInverse(j) = J * MInvJtcol;
-        /* TODO
-        matter.multiplyByStationJacobian(m_tspace.getState(),
-                m_tspace.getMobilizedBodyIndices(), m_tspace.getStations(),
-                MInvJtcol, JMInvJt_j);
-
-        inertiaInverse(j) = JMInvJt_j;
-        */
-    }
+    // Simbody computes J M^-1 ~J directly without forming J.
+    m_tspace->getMatterSubsystem().calcStationOperationalSpaceInertiaInverse(
+            getState(), m_tspace->getMobilizedBodyIndices(),
+            m_tspace->getStations(), cache);
 }
 
 const TaskSpace::Inertia& TaskSpace::InertiaInverse::inverse() const
@@ -248,17 +195,9 @@ void TaskSpace::DynamicallyConsistentJacobianInverse::updateCache(Matrix& cache)
     // TODO inefficient?
     Matrix JtLambda = JT * Lambda;
 
-    unsigned int nst = m_tspace->getNumScalarTasks();
-    unsigned int nu = getState().getNU();
-
     Matrix& Jbar = cache;
-    Jbar.resize(nu, nst);
-
-    for (unsigned int j = 0; j < nst; ++j)
-    {
-        m_tspace->getMatterSubsystem().multiplyByMInv(getState(),
-                JtLambda(j), Jbar(j));
-    }
+    m_tspace->getMatterSubsystem().solveUsingMassMatrixFactorization(
+            getState(), JtLambda, Jbar);
 }
 
 const TaskSpace::DynamicallyConsistentJacobianInverseTranspose&
@@ -284,15 +223,12 @@ Vector TaskSpace::DynamicallyConsistentJacobianInverse::operator*(
 Matrix TaskSpace::DynamicallyConsistentJacobianInverse::operator*(
         const Matrix& mat) const
 {
-    unsigned int nrow = getState().getNU();
-    unsigned int ncol = mat.ncol();
-
-    Matrix out(nrow, ncol);
-    for (unsigned int j = 0; j < ncol; ++j)
-    {
-        out(j) = operator*(mat(j).getAsVector());
-    }
+    const JacobianTranspose& JT = m_tspace->getJacobianTranspose(getState());
+    const Inertia& Lambda = m_tspace->getInertia(getState());
 
+    Matrix out;
+    m_tspace->getMatterSubsystem().solveUsingMassMatrixFactorization(
+            getState(), JT * (Lambda.value() * mat), out);
     return out;
 }
 